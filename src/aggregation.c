@@ -0,0 +1,535 @@
+/**
+ * @file    aggregation.c
+ *
+ * @brief  Parallel hash group-by (AGG) over the payloads of relation S.
+ *
+ * Computes COUNT, SUM, MIN and MAX of the payload grouped by key. The
+ * pre-aggregation phase has a scalar and an AVX-512 kernel, where the latter
+ * uses conflict detection to update all lanes that address distinct slots
+ * at once. The merge phase into the partitioned global table has a scalar
+ * and an AMAC kernel, the global table is as cache-unfriendly as the NPO
+ * hashtable and benefits from the same interleaving.
+ */
+#include "aggregation.h"
+
+#include <inttypes.h>
+
+static volatile char agg_lock;
+static volatile int64_t agg_groups = 0, agg_count = 0, agg_sum = 0;
+
+static void init_agg_bucket_buffer(agg_bucket_buffer_t **ppbuf) {
+  agg_bucket_buffer_t *overflowbuf;
+  overflowbuf = (agg_bucket_buffer_t *)malloc(sizeof(agg_bucket_buffer_t));
+  if (posix_memalign((void **)&(overflowbuf->buf), PAGE_SIZE,
+                     sizeof(agg_bucket_t) * AGG_OVERFLOW_BUF_SIZE)) {
+    perror("agg overflow buffer : Aligned allocation failed!\n");
+    exit(EXIT_FAILURE);
+  }
+  overflowbuf->count = 0;
+  overflowbuf->next = NULL;
+
+  *ppbuf = overflowbuf;
+}
+
+static inline agg_bucket_t *get_new_agg_bucket(agg_bucket_buffer_t **buf) {
+  if ((*buf)->count < AGG_OVERFLOW_BUF_SIZE) {
+    return (*buf)->buf + (*buf)->count++;
+  }
+  agg_bucket_buffer_t *new_buf;
+  init_agg_bucket_buffer(&new_buf);
+  new_buf->count = 1;
+  new_buf->next = *buf;
+  *buf = new_buf;
+  return new_buf->buf;
+}
+
+static void free_agg_bucket_buffer(agg_bucket_buffer_t *buf) {
+  do {
+    agg_bucket_buffer_t *tmp = buf->next;
+    free(buf->buf);
+    free(buf);
+    buf = tmp;
+  } while (buf);
+}
+
+/**
+ * Allocates the global table of one partition. Since every spilled entry is
+ * at most one new group, nentries bounds the number of groups.
+ */
+static void allocate_agg_table(agg_table_t *t, uint32_t nentries) {
+  t->num_buckets = nentries ? nentries : 1;
+  NEXT_POW_2((t->num_buckets));
+  t->buckets = (agg_bucket_t *)alloc_aligned(t->num_buckets *
+                                             sizeof(agg_bucket_t));
+  memset(t->buckets, 0, t->num_buckets * sizeof(agg_bucket_t));
+  /* the low bits of the key already select the partition */
+  t->skip_bits = AGG_PART_BITS;
+  t->hash_mask = (t->num_buckets - 1) << t->skip_bits;
+}
+
+static inline void agg_combine(agg_entry_t *dst, const agg_entry_t *src) {
+  dst->count += src->count;
+  dst->sum += src->sum;
+  if (src->min < dst->min) dst->min = src->min;
+  if (src->max > dst->max) dst->max = src->max;
+}
+
+static inline void agg_local_install(agg_local_t *lt, uint32_t slot,
+                                     int64_t key, int64_t val) {
+  lt->key[slot] = key;
+  lt->count[slot] = 1;
+  lt->sum[slot] = val;
+  lt->min[slot] = val;
+  lt->max[slot] = val;
+}
+
+/** appends the group in the given local slot to its partition's spill list */
+static inline void agg_spill(agg_local_t *lt, uint32_t slot,
+                             agg_chunk_t **spill) {
+  agg_chunk_t **head = spill + (lt->key[slot] & (AGG_NUM_PARTS - 1));
+  agg_chunk_t *chunk = *head;
+  if (chunk == NULL || chunk->count == AGG_CHUNK_SIZE) {
+    chunk = (agg_chunk_t *)malloc(sizeof(agg_chunk_t));
+    if (chunk == NULL) {
+      perror("spill chunk : allocation failed!\n");
+      exit(EXIT_FAILURE);
+    }
+    chunk->count = 0;
+    chunk->next = *head;
+    *head = chunk;
+  }
+  agg_entry_t *e = chunk->entries + chunk->count++;
+  e->key = lt->key[slot];
+  e->count = lt->count[slot];
+  e->sum = lt->sum[slot];
+  e->min = lt->min[slot];
+  e->max = lt->max[slot];
+}
+
+/** folds one tuple into the local table, evicting a colliding group */
+static inline void agg_local_update(agg_local_t *lt, int64_t key, int64_t val,
+                                    agg_chunk_t **spill) {
+  uint32_t slot = key & (AGG_LOCAL_SIZE - 1);
+  if (lt->count[slot] == 0) {
+    agg_local_install(lt, slot, key, val);
+  } else if (lt->key[slot] == key) {
+    lt->count[slot]++;
+    lt->sum[slot] += val;
+    if (val < lt->min[slot]) lt->min[slot] = val;
+    if (val > lt->max[slot]) lt->max[slot] = val;
+  } else {
+    agg_spill(lt, slot, spill);
+    agg_local_install(lt, slot, key, val);
+  }
+}
+
+/** spills all remaining groups and empties the local table */
+static void agg_local_flush(agg_local_t *lt, agg_chunk_t **spill) {
+  for (uint32_t i = 0; i < AGG_LOCAL_SIZE; ++i) {
+    if (lt->count[i]) {
+      agg_spill(lt, i, spill);
+    }
+  }
+  memset(lt->count, 0, sizeof(lt->count));
+}
+
+void agg_preagg_scalar(agg_local_t *lt, relation_t *rel, agg_chunk_t **spill) {
+  for (uint64_t i = 0; i < rel->num_tuples; ++i) {
+#if SEQPREFETCH
+    _mm_prefetch(((char *)(rel->tuples + i) + PDIS), _MM_HINT_T0);
+#endif
+    agg_local_update(lt, rel->tuples[i].key, rel->tuples[i].payload, spill);
+  }
+}
+
+/**
+ * AVX-512 pre-aggregation. VECTOR_SCALE tuples are hashed at once, and
+ * _mm512_conflict_epi64 finds the lanes whose slot is also used by a lower
+ * lane. All conflict-free lanes that find their group (or an empty slot) are
+ * updated with one gather/scatter per field, the remaining lanes (conflicts
+ * and evictions) are folded in by the scalar path afterwards.
+ */
+void agg_preagg_simd(agg_local_t *lt, relation_t *rel, agg_chunk_t **spill) {
+  __mmask8 m_free, m_empty, m_hit, m_rest;
+  __m512i v_key, v_payload, v_slot, v_conflict, v_cnt, v_tkey, v_field,
+      v_zero512 = _mm512_set1_epi64(0), v_one512 = _mm512_set1_epi64(1),
+      v_slot_mask = _mm512_set1_epi64(AGG_LOCAL_SIZE - 1);
+  int64_t keys[VECTOR_SCALE], payloads[VECTOR_SCALE];
+  uint64_t i = 0;
+#ifdef KEY_8B
+  uint64_t base_off[VECTOR_SCALE];
+  for (int j = 0; j < VECTOR_SCALE; ++j) {
+    base_off[j] = j * sizeof(tuple_t);
+  }
+  __m512i v_base_offset = _mm512_loadu_si512(base_off);
+#endif
+
+  for (; i + VECTOR_SCALE <= rel->num_tuples; i += VECTOR_SCALE) {
+#if SEQPREFETCH
+    _mm_prefetch(((char *)(rel->tuples + i) + PDIS), _MM_HINT_T0);
+#endif
+#ifdef KEY_8B
+    v_key = _mm512_i64gather_epi64(v_base_offset, (void *)(rel->tuples + i), 1);
+    v_payload = _mm512_i64gather_epi64(
+        v_base_offset, ((char *)(rel->tuples + i)) + sizeof(intkey_t), 1);
+#else
+    /* 8 tuples of 4B key and 4B payload fill exactly one vector */
+    v_field = _mm512_loadu_si512(rel->tuples + i);
+    v_key = _mm512_srai_epi64(_mm512_slli_epi64(v_field, 32), 32);
+    v_payload = _mm512_srai_epi64(v_field, 32);
+#endif
+    v_slot = _mm512_and_epi64(v_key, v_slot_mask);
+    v_conflict = _mm512_conflict_epi64(v_slot);
+    m_free = _mm512_cmpeq_epi64_mask(v_conflict, v_zero512);
+
+    v_cnt = _mm512_mask_i64gather_epi64(v_zero512, m_free, v_slot, lt->count, 8);
+    v_tkey = _mm512_mask_i64gather_epi64(v_zero512, m_free, v_slot, lt->key, 8);
+    m_empty = _mm512_mask_cmpeq_epi64_mask(m_free, v_cnt, v_zero512);
+    m_hit = _mm512_mask_cmpeq_epi64_mask(m_free & (~m_empty), v_tkey, v_key);
+
+    ///////// new groups in empty slots
+    _mm512_mask_i64scatter_epi64(lt->key, m_empty, v_slot, v_key, 8);
+    _mm512_mask_i64scatter_epi64(lt->count, m_empty, v_slot, v_one512, 8);
+    _mm512_mask_i64scatter_epi64(lt->sum, m_empty, v_slot, v_payload, 8);
+    _mm512_mask_i64scatter_epi64(lt->min, m_empty, v_slot, v_payload, 8);
+    _mm512_mask_i64scatter_epi64(lt->max, m_empty, v_slot, v_payload, 8);
+
+    ///////// existing groups
+    v_cnt = _mm512_add_epi64(v_cnt, v_one512);
+    _mm512_mask_i64scatter_epi64(lt->count, m_hit, v_slot, v_cnt, 8);
+    v_field = _mm512_mask_i64gather_epi64(v_zero512, m_hit, v_slot, lt->sum, 8);
+    v_field = _mm512_add_epi64(v_field, v_payload);
+    _mm512_mask_i64scatter_epi64(lt->sum, m_hit, v_slot, v_field, 8);
+    v_field = _mm512_mask_i64gather_epi64(v_zero512, m_hit, v_slot, lt->min, 8);
+    v_field = _mm512_min_epi64(v_field, v_payload);
+    _mm512_mask_i64scatter_epi64(lt->min, m_hit, v_slot, v_field, 8);
+    v_field = _mm512_mask_i64gather_epi64(v_zero512, m_hit, v_slot, lt->max, 8);
+    v_field = _mm512_max_epi64(v_field, v_payload);
+    _mm512_mask_i64scatter_epi64(lt->max, m_hit, v_slot, v_field, 8);
+
+    ///////// conflicting lanes and evictions
+    m_rest = (~(m_empty | m_hit)) & 0xff;
+    if (m_rest) {
+      _mm512_storeu_si512(keys, v_key);
+      _mm512_storeu_si512(payloads, v_payload);
+      for (int j = 0; j < VECTOR_SCALE; ++j) {
+        if (m_rest & (1 << j)) {
+          agg_local_update(lt, keys[j], payloads[j], spill);
+        }
+      }
+    }
+  }
+  for (; i < rel->num_tuples; ++i) {
+    agg_local_update(lt, rel->tuples[i].key, rel->tuples[i].payload, spill);
+  }
+}
+
+/**
+ * Merges partial aggregates into a partition of the global table.
+ *
+ * @return number of new groups
+ */
+int64_t agg_merge(agg_table_t *t, agg_entry_t *entries, uint64_t num,
+                  agg_bucket_buffer_t **overflowbuf) {
+  int64_t groups = 0;
+  const uint32_t hashmask = t->hash_mask;
+  const uint32_t skipbits = t->skip_bits;
+
+  for (uint64_t i = 0; i < num; ++i) {
+    agg_bucket_t *b =
+        t->buckets + HASH(entries[i].key, hashmask, skipbits);
+    while (1) {
+      if (b->entry.count == 0) {
+        b->entry = entries[i];
+        ++groups;
+        break;
+      }
+      if (b->entry.key == entries[i].key) {
+        agg_combine(&b->entry, entries + i);
+        break;
+      }
+      if (b->next == NULL) {
+        agg_bucket_t *nb = get_new_agg_bucket(overflowbuf);
+        nb->entry = entries[i];
+        nb->next = NULL;
+        b->next = nb;
+        ++groups;
+        break;
+      }
+      b = b->next;
+    }
+  }
+  return groups;
+}
+
+/**
+ * AMAC version of agg_merge(): ScalarStateSize entries walk their bucket
+ * chains interleaved, each step touches one (prefetched) bucket.
+ *
+ * @return number of new groups
+ */
+int64_t agg_merge_AMAC(agg_table_t *t, agg_entry_t *entries, uint64_t num,
+                       agg_bucket_buffer_t **overflowbuf) {
+  int64_t groups = 0;
+  int16_t k = 0, done = 0;
+  agg_state_t state[ScalarStateSize];
+  const uint32_t hashmask = t->hash_mask;
+  const uint32_t skipbits = t->skip_bits;
+
+  // init # of the state
+  for (int i = 0; i < ScalarStateSize; ++i) {
+    state[i].stage = 1;
+  }
+  for (uint64_t cur = 0; (done < ScalarStateSize);) {
+    k = (k >= ScalarStateSize) ? 0 : k;
+
+    switch (state[k].stage) {
+      case 1: {
+        if (cur >= num) {
+          ++done;
+          state[k].stage = 3;
+          break;
+        }
+#if SEQPREFETCH
+        _mm_prefetch(((char *)(entries + cur) + PDIS), _MM_HINT_T0);
+#endif
+        state[k].b = t->buckets + HASH(entries[cur].key, hashmask, skipbits);
+        _mm_prefetch((char *)(state[k].b), _MM_HINT_T0);
+        state[k].entry_id = cur;
+        state[k].stage = 0;
+        ++cur;
+      } break;
+      case 0: {
+        agg_bucket_t *b = state[k].b;
+        agg_entry_t *e = entries + state[k].entry_id;
+        if (b->entry.count == 0) {
+          b->entry = *e;
+          ++groups;
+        } else if (b->entry.key == e->key) {
+          agg_combine(&b->entry, e);
+        } else if (b->next) {
+          state[k].b = b->next; /* follow overflow pointer */
+          _mm_prefetch((char *)(state[k].b), _MM_HINT_T0);
+          break;
+        } else {
+          agg_bucket_t *nb = get_new_agg_bucket(overflowbuf);
+          nb->entry = *e;
+          nb->next = NULL;
+          b->next = nb;
+          ++groups;
+        }
+        state[k].stage = 1;
+        --k;
+      } break;
+    }
+    ++k;
+  }
+
+  return groups;
+}
+
+typedef void (*agg_preagg_fun_t)(agg_local_t *, relation_t *, agg_chunk_t **);
+typedef int64_t (*agg_merge_fun_t)(agg_table_t *, agg_entry_t *, uint64_t,
+                                   agg_bucket_buffer_t **);
+
+/**
+ * One complete aggregation: pre-aggregate the own slice, then merge the owned
+ * partitions. Prints the time of both phases on thread 0.
+ */
+static void agg_run(agg_arg_t *args, agg_local_t *lt, agg_preagg_fun_t preagg,
+                    agg_merge_fun_t merge, const char *name) {
+  int rv;
+  struct timeval t1, t2, t3;
+  result_timer_t rt, rt_merge;
+  char preagg_name[32], merge_name[32];
+  agg_chunk_t **myspill = args->spill + args->tid * AGG_NUM_PARTS;
+  agg_bucket_buffer_t *overflowbuf;
+  agg_table_t tables[AGG_NUM_PARTS];
+  int64_t groups = 0, count = 0, sum = 0;
+  uint64_t merged = 0;
+
+  init_agg_bucket_buffer(&overflowbuf);
+  BARRIER_ARRIVE(args->barrier, rv);
+  gettimeofday(&t1, NULL);
+  results_start(&rt);
+  snprintf(preagg_name, sizeof(preagg_name), "%s pre-agg", name);
+  snprintf(merge_name, sizeof(merge_name), "%s merge", name);
+
+  preagg(lt, &args->relS, myspill);
+  agg_local_flush(lt, myspill);
+  results_thread("aggregate", preagg_name, args->tid, &rt,
+                 args->relS.num_tuples, 0);
+
+  BARRIER_ARRIVE(args->barrier, rv);
+  gettimeofday(&t2, NULL);
+  results_start(&rt_merge);
+
+  for (int p = args->tid; p < AGG_NUM_PARTS; p += args->nthreads) {
+    uint32_t nentries = 0;
+    for (int t = 0; t < args->nthreads; ++t) {
+      for (agg_chunk_t *c = args->spill[t * AGG_NUM_PARTS + p]; c; c = c->next)
+        nentries += c->count;
+    }
+    allocate_agg_table(&tables[p], nentries);
+    merged += nentries;
+    for (int t = 0; t < args->nthreads; ++t) {
+      for (agg_chunk_t *c = args->spill[t * AGG_NUM_PARTS + p]; c;
+           c = c->next) {
+        groups += merge(&tables[p], c->entries, c->count, &overflowbuf);
+        for (uint32_t j = 0; j < c->count; ++j) {
+          count += c->entries[j].count;
+          sum += c->entries[j].sum;
+        }
+      }
+    }
+  }
+  args->num_groups = groups;
+  results_thread("aggregate", merge_name, args->tid, &rt_merge, merged,
+                 groups);
+  lock(&agg_lock);
+  agg_groups += groups;
+  agg_count += count;
+  agg_sum += sum;
+  unlock(&agg_lock);
+
+  BARRIER_ARRIVE(args->barrier, rv);
+  if (args->tid == 0) {
+    gettimeofday(&t3, NULL);
+    results_add("aggregate", preagg_name, RESULTS_ALL_THREADS,
+                (t2.tv_sec - t1.tv_sec) * 1000000.0 + t2.tv_usec - t1.tv_usec,
+                rt_merge.tick - rt.tick, 0, agg_groups);
+    results_total("aggregate", merge_name, &rt_merge, agg_groups);
+    printf("total groups = %" PRId64 "\tcount = %" PRId64
+           "\tsum = %" PRId64 "\t",
+           agg_groups, agg_count, agg_sum);
+    printf("---- %s aggregation costs time (ms) = %lf (pre-agg %lf, merge %lf)\n",
+           name,
+           ((t3.tv_sec - t1.tv_sec) * 1000000 + t3.tv_usec - t1.tv_usec) *
+               1.0 / 1000,
+           ((t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec) *
+               1.0 / 1000,
+           ((t3.tv_sec - t2.tv_sec) * 1000000 + t3.tv_usec - t2.tv_usec) *
+               1.0 / 1000);
+    agg_groups = agg_count = agg_sum = 0;
+  }
+
+  /* every other thread is done reading the own spills after the barrier */
+  for (int p = 0; p < AGG_NUM_PARTS; ++p) {
+    agg_chunk_t *c = myspill[p];
+    while (c) {
+      agg_chunk_t *tmp = c->next;
+      free(c);
+      c = tmp;
+    }
+    myspill[p] = NULL;
+  }
+  for (int p = args->tid; p < AGG_NUM_PARTS; p += args->nthreads) {
+    free(tables[p].buckets);
+  }
+  free_agg_bucket_buffer(overflowbuf);
+}
+
+void *agg_thread(void *param) {
+  agg_arg_t *args = (agg_arg_t *)param;
+  agg_local_t *lt = (agg_local_t *)alloc_aligned(sizeof(agg_local_t));
+  memset(lt->count, 0, sizeof(lt->count));
+
+#ifdef PERF_COUNTERS
+  if (args->tid == 0) {
+    PCM_initPerformanceMonitor(NULL, NULL);
+    PCM_start();
+  }
+#endif
+  for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
+    agg_run(args, lt, agg_preagg_scalar, agg_merge, "RAW");
+  }
+  for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
+    agg_run(args, lt, agg_preagg_scalar, agg_merge_AMAC, "AMAC");
+  }
+  for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
+    agg_run(args, lt, agg_preagg_simd, agg_merge_AMAC, "SIMD");
+  }
+#ifdef PERF_COUNTERS
+  if (args->tid == 0) {
+    PCM_stop();
+    PCM_accumulatePhase(PCM_PHASE_AGGREGATE);
+    PCM_log("========== Aggregation profiling results ==========\n");
+    PCM_printResults();
+    PCM_log("===================================================\n");
+    PCM_cleanup();
+  }
+#endif
+  free(lt);
+  return 0;
+}
+
+result_t *AGG(relation_t *relR, relation_t *relS, int nthreads) {
+  int64_t result = 0;
+  int32_t numS, numSthr; /* total and per thread num */
+  int i, rv;
+  cpu_set_t set;
+  agg_arg_t args[nthreads];
+  pthread_t tid[nthreads];
+  pthread_attr_t attr;
+  pthread_barrier_t barrier;
+
+  result_t *joinresult = 0;
+  joinresult = (result_t *)malloc(sizeof(result_t));
+
+#ifdef JOIN_RESULT_MATERIALIZE
+  joinresult->resultlist =
+      (threadresult_t *)alloc_aligned(sizeof(threadresult_t) * nthreads);
+#endif
+
+  agg_chunk_t **spill = (agg_chunk_t **)calloc(nthreads * AGG_NUM_PARTS,
+                                               sizeof(agg_chunk_t *));
+  numS = relS->num_tuples;
+  numSthr = numS / nthreads;
+
+  rv = pthread_barrier_init(&barrier, NULL, nthreads);
+  if (rv != 0) {
+    printf("Couldn't create the barrier\n");
+    exit(EXIT_FAILURE);
+  }
+
+  pthread_attr_init(&attr);
+  for (i = 0; i < nthreads; i++) {
+    int cpu_idx = get_cpu_id(i);
+
+    DEBUGMSG(1, "Assigning thread-%d to CPU-%d\n", i, cpu_idx);
+
+#if AFFINITY
+    CPU_ZERO(&set);
+    CPU_SET(cpu_idx, &set);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+#endif
+    args[i].tid = i;
+    args[i].nthreads = nthreads;
+    args[i].spill = spill;
+    args[i].barrier = &barrier;
+
+    /* groups must not be counted twice, so S is always divided */
+    args[i].relS.num_tuples = (i == (nthreads - 1)) ? numS : numSthr;
+    args[i].relS.tuples = relS->tuples + numSthr * i;
+    numS -= numSthr;
+    args[i].threadresult = &(joinresult->resultlist[i]);
+
+    rv = pthread_create(&tid[i], &attr, agg_thread, (void *)&args[i]);
+    if (rv) {
+      printf("ERROR; return code from pthread_create() is %d\n", rv);
+      exit(-1);
+    }
+  }
+
+  for (i = 0; i < nthreads; i++) {
+    pthread_join(tid[i], NULL);
+    /* sum up results */
+    result += args[i].num_groups;
+  }
+  joinresult->totalresults = result;
+  joinresult->nthreads = nthreads;
+
+  free(spill);
+
+  return joinresult;
+}
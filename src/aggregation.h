@@ -0,0 +1,124 @@
+/**
+ * @file    aggregation.h
+ *
+ * @brief  Types and parameters of the parallel hash group-by (AGG).
+ *
+ * Every thread first folds its slice of the input into a small, cache
+ * resident pre-aggregation table. Groups that get evicted from it, and all
+ * groups left in it at the end, are spilled as partial aggregates into
+ * per-partition chunk lists. After a barrier each thread merges the spills of
+ * the partitions it owns into a chained global table, so the merge phase
+ * needs no latches.
+ */
+#ifndef AGGREGATION_H
+#define AGGREGATION_H
+#include "no_partitioning_join.h" /* BARRIER_ARRIVE, HASH, NEXT_POW_2 */
+
+#ifndef AGG_LOCAL_BITS
+/** log2 of the slots in the thread-local pre-aggregation table (L2 sized) */
+#define AGG_LOCAL_BITS 11
+#endif
+#define AGG_LOCAL_SIZE (1 << AGG_LOCAL_BITS)
+
+#ifndef AGG_PART_BITS
+/** log2 of the number of partitions of the global aggregation table */
+#define AGG_PART_BITS 6
+#endif
+#define AGG_NUM_PARTS (1 << AGG_PART_BITS)
+
+#ifndef AGG_CHUNK_SIZE
+/** number of partial aggregates in one spill chunk */
+#define AGG_CHUNK_SIZE 4096
+#endif
+
+#ifndef AGG_OVERFLOW_BUF_SIZE
+/** number of overflow buckets in one agg_bucket_buffer_t */
+#define AGG_OVERFLOW_BUF_SIZE (PAGE_SIZE >> 6)
+#endif
+
+typedef struct agg_entry_t agg_entry_t;
+typedef struct agg_bucket_t agg_bucket_t;
+typedef struct agg_bucket_buffer_t agg_bucket_buffer_t;
+typedef struct agg_table_t agg_table_t;
+typedef struct agg_chunk_t agg_chunk_t;
+typedef struct agg_local_t agg_local_t;
+typedef struct agg_state_t agg_state_t;
+typedef struct agg_arg_t agg_arg_t;
+
+/** A (partial) aggregate of one group: COUNT, SUM, MIN and MAX of payloads */
+struct agg_entry_t {
+  intkey_t key;
+  value_t min;
+  value_t max;
+  int64_t count;
+  int64_t sum;
+};
+
+/** Bucket of the global table, count == 0 marks an empty head bucket */
+struct agg_bucket_t {
+  agg_entry_t entry;
+  agg_bucket_t *next;
+};
+
+/** Pre-allocated overflow buckets of the global table */
+struct agg_bucket_buffer_t {
+  agg_bucket_buffer_t *next;
+  uint32_t count;
+  agg_bucket_t *buf;
+};
+
+/** One partition of the global table, hashed with HASH() like hashtable_t */
+struct agg_table_t {
+  agg_bucket_t *buckets;
+  uint32_t num_buckets;
+  uint32_t hash_mask;
+  uint32_t skip_bits;
+};
+
+/** Spilled partial aggregates of one (thread, partition) pair */
+struct agg_chunk_t {
+  agg_chunk_t *next;
+  uint32_t count;
+  agg_entry_t entries[AGG_CHUNK_SIZE];
+};
+
+/**
+ * Thread-local pre-aggregation table. It is direct mapped and kept as 64-bit
+ * columns so that the SIMD kernel can gather/scatter every field.
+ */
+struct agg_local_t {
+  int64_t key[AGG_LOCAL_SIZE];
+  int64_t count[AGG_LOCAL_SIZE];
+  int64_t sum[AGG_LOCAL_SIZE];
+  int64_t min[AGG_LOCAL_SIZE];
+  int64_t max[AGG_LOCAL_SIZE];
+};
+
+/** AMAC state of the merge kernel */
+struct agg_state_t {
+  int64_t entry_id;
+  agg_bucket_t *b;
+  int16_t stage;
+};
+
+/** AGG arguments to the threads */
+struct agg_arg_t {
+  int32_t tid;
+  int32_t nthreads;
+  relation_t relS;
+  /* [nthreads][AGG_NUM_PARTS] spill lists, shared among threads */
+  agg_chunk_t **spill;
+  pthread_barrier_t *barrier;
+  int64_t num_groups;
+
+  /* results of the thread */
+  threadresult_t *threadresult;
+
+#ifndef NO_TIMING
+  /* stats about the thread */
+  uint64_t timer1, timer2, timer3;
+  struct timeval start, end;
+#endif
+};
+
+#endif /* AGGREGATION_H */
@@ -0,0 +1,160 @@
+/**
+ * @file    compressed_relation.c
+ *
+ * @brief  Encoding of the bit-packed, frame-of-reference relation.
+ */
+#include "no_partitioning_join.h" /* alloc_aligned, get_cpu_id, BARRIER */
+#include "compressed_relation.h"
+
+typedef struct compress_arg_t {
+  int32_t tid;
+  int32_t nthreads;
+  relation_t *rel;
+  crelation_t *crel;
+  uint64_t nrows; /* rows of the thread's blocks after pass 1 */
+  uint64_t *rows; /* [nthreads], shared */
+  pthread_barrier_t *barrier;
+} compress_arg_t;
+
+static inline uint8_t bit_width(uint64_t range) {
+  return range ? 64 - __builtin_clzll(range) : 0;
+}
+
+/** ORs the b-bit value d into lane `lane` at position `row` of a section */
+static inline void cr_pack(uint64_t *data, uint64_t base, uint32_t lane,
+                           uint32_t row, uint32_t bits, uint64_t d) {
+  uint32_t bit = row * bits, w = bit >> 6, sh = bit & 63;
+  uint64_t *p = data + (base + w) * CR_LANES + lane;
+  *p |= d << sh;
+  if (sh + bits > 64) {
+    p[CR_LANES] |= d >> (64 - sh);
+  }
+}
+
+void *compress_thread(void *param) {
+  compress_arg_t *arg = (compress_arg_t *)param;
+  crelation_t *crel = arg->crel;
+  tuple_t *tuples = arg->rel->tuples;
+  uint64_t n = arg->rel->num_tuples;
+  uint64_t per_thr = (crel->num_blocks + arg->nthreads - 1) / arg->nthreads;
+  uint64_t first = per_thr * arg->tid, last = first + per_thr;
+  uint64_t blk, i, offset = 0;
+  int rv;
+  if (last > crel->num_blocks) last = crel->num_blocks;
+  if (first > last) first = last;
+
+  /* pass 1: frame of reference and bit widths of the own blocks */
+  for (blk = first; blk < last; blk++) {
+    uint64_t beg = blk * CR_BLOCK_SIZE;
+    uint64_t end = (beg + CR_BLOCK_SIZE < n) ? beg + CR_BLOCK_SIZE : n;
+    int64_t kmin = tuples[beg].key, kmax = kmin;
+    int64_t pmin = tuples[beg].payload, pmax = pmin;
+    for (i = beg + 1; i < end; i++) {
+      if (tuples[i].key < kmin) kmin = tuples[i].key;
+      if (tuples[i].key > kmax) kmax = tuples[i].key;
+      if (tuples[i].payload < pmin) pmin = tuples[i].payload;
+      if (tuples[i].payload > pmax) pmax = tuples[i].payload;
+    }
+    cr_block_t *b = crel->blocks + blk;
+    b->key_base = kmin;
+    b->payload_base = pmin;
+    b->key_bits = bit_width((uint64_t)(kmax - kmin));
+    b->payload_bits = bit_width((uint64_t)(pmax - pmin));
+    b->offset = arg->nrows;
+    arg->nrows += b->key_bits + b->payload_bits;
+  }
+  arg->rows[arg->tid] = arg->nrows;
+  BARRIER_ARRIVE(arg->barrier, rv);
+
+  if (arg->tid == 0) {
+    uint64_t total = 0;
+    for (int t = 0; t < arg->nthreads; t++) total += arg->rows[t];
+    /* one spare row, the decoder may load the row after a section */
+    crel->data =
+        (uint64_t *)alloc_aligned((total + 1) * CR_LANES * sizeof(uint64_t));
+    memset(crel->data, 0, (total + 1) * CR_LANES * sizeof(uint64_t));
+  }
+  BARRIER_ARRIVE(arg->barrier, rv);
+
+  /* pass 2: pack the deltas */
+  for (int t = 0; t < arg->tid; t++) offset += arg->rows[t];
+  for (blk = first; blk < last; blk++) {
+    cr_block_t *b = crel->blocks + blk;
+    uint64_t beg = blk * CR_BLOCK_SIZE;
+    uint64_t end = (beg + CR_BLOCK_SIZE < n) ? beg + CR_BLOCK_SIZE : n;
+    b->offset += offset;
+    for (i = beg; i < end; i++) {
+      uint32_t j = i - beg;
+      if (b->key_bits) {
+        cr_pack(crel->data, b->offset, j % CR_LANES, j / CR_LANES, b->key_bits,
+                (uint64_t)(tuples[i].key - b->key_base));
+      }
+      if (b->payload_bits) {
+        cr_pack(crel->data, b->offset + b->key_bits, j % CR_LANES,
+                j / CR_LANES, b->payload_bits,
+                (uint64_t)(tuples[i].payload - b->payload_base));
+      }
+    }
+  }
+  return 0;
+}
+
+crelation_t *compress_relation(relation_t *rel, int nthreads) {
+  crelation_t *crel = (crelation_t *)malloc(sizeof(crelation_t));
+  compress_arg_t args[nthreads];
+  uint64_t rows[nthreads];
+  pthread_t tid[nthreads];
+  pthread_barrier_t barrier;
+  int i, rv;
+
+  crel->num_tuples = rel->num_tuples;
+  crel->num_blocks = (rel->num_tuples + CR_BLOCK_SIZE - 1) / CR_BLOCK_SIZE;
+  crel->blocks = (cr_block_t *)alloc_aligned(
+      (crel->num_blocks + 1) * sizeof(cr_block_t));
+
+  rv = pthread_barrier_init(&barrier, NULL, nthreads);
+  if (rv != 0) {
+    printf("Couldn't create the barrier\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_attr_t attr;
+  cpu_set_t set;
+  pthread_attr_init(&attr);
+  for (i = 0; i < nthreads; i++) {
+    /* a single thread stays on the CPU of the caller */
+    if (nthreads > 1) {
+      CPU_ZERO(&set);
+      CPU_SET(get_cpu_id(i), &set);
+      pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+    }
+    args[i].tid = i;
+    args[i].nthreads = nthreads;
+    args[i].rel = rel;
+    args[i].crel = crel;
+    args[i].nrows = 0;
+    args[i].rows = rows;
+    args[i].barrier = &barrier;
+    rv = pthread_create(&tid[i], &attr, compress_thread, (void *)&args[i]);
+    if (rv) {
+      printf("ERROR; return code from pthread_create() is %d\n", rv);
+      exit(-1);
+    }
+  }
+  uint64_t total = 0;
+  for (i = 0; i < nthreads; i++) {
+    pthread_join(tid[i], NULL);
+    total += rows[i];
+  }
+  pthread_barrier_destroy(&barrier);
+
+  printf("compressed relation: %.2lf bits/tuple, raw %d bits/tuple\n",
+         rel->num_tuples ? total * CR_LANES * 64.0 / rel->num_tuples : 0.0,
+         (int)(sizeof(tuple_t) * 8));
+  return crel;
+}
+
+void free_crelation(crelation_t *crel) {
+  free(crel->data);
+  free(crel->blocks);
+  free(crel);
+}
@@ -0,0 +1,80 @@
+/**
+ * @file    compressed_relation.h
+ *
+ * @brief  Bit-packed, frame-of-reference encoded relation for the probe side.
+ *
+ * The tuples are cut into blocks of CR_BLOCK_SIZE. Every block stores the
+ * minimum key and payload as base and the differences to it with the
+ * smallest bit width that fits the block. The deltas are packed vertically:
+ * tuple i of a block goes to lane i % CR_LANES, so every lane is a stream of
+ * CR_BLOCK_ROWS packed values and one 64B row holds the next word of all
+ * lanes. A block with b-bit keys thus has exactly b rows of keys, followed by
+ * the rows of the payloads, and VECTOR_SCALE consecutive tuples are decoded
+ * with one or two aligned loads, a variable shift and an add.
+ */
+#ifndef COMPRESSED_RELATION_H
+#define COMPRESSED_RELATION_H
+#include <immintrin.h>
+#include "types.h" /* relation_t */
+
+#define CR_LANES 8        /* = VECTOR_SCALE */
+#define CR_BLOCK_ROWS 64  /* packed values per lane and block */
+#define CR_BLOCK_SIZE (CR_LANES * CR_BLOCK_ROWS)
+
+typedef struct cr_block_t cr_block_t;
+typedef struct crelation_t crelation_t;
+
+struct cr_block_t {
+  int64_t key_base;
+  int64_t payload_base;
+  uint64_t offset; /* first row of the block in crelation_t.data */
+  uint8_t key_bits;
+  uint8_t payload_bits;
+};
+
+struct crelation_t {
+  uint64_t num_tuples;
+  uint64_t num_blocks;
+  cr_block_t *blocks;
+  uint64_t *data; /* rows of CR_LANES words, cache line aligned */
+};
+
+/**
+ * Encodes rel, the blocks are packed in parallel by nthreads threads.
+ *
+ * @return the compressed relation, to be released with free_crelation()
+ */
+crelation_t *compress_relation(relation_t *rel, int nthreads);
+
+void free_crelation(crelation_t *crel);
+
+/** unpacks row `row` of a b-bit section starting at row `base` */
+static inline __m512i cr_unpack8(const uint64_t *data, uint64_t base,
+                                 uint32_t row, uint32_t bits) {
+  if (bits == 0) {
+    return _mm512_set1_epi64(0);
+  }
+  uint32_t bit = row * bits, w = bit >> 6, sh = bit & 63;
+  const uint64_t *p = data + (base + w) * CR_LANES;
+  __m512i v = _mm512_srli_epi64(_mm512_load_epi64(p), sh);
+  if (sh + bits > 64) {
+    v = _mm512_or_epi64(
+        v, _mm512_slli_epi64(_mm512_load_epi64(p + CR_LANES), 64 - sh));
+  }
+  if (bits < 64) {
+    v = _mm512_and_epi64(v, _mm512_set1_epi64((1ULL << bits) - 1));
+  }
+  return v;
+}
+
+/** decodes the CR_LANES tuples of row `row` of block b */
+static inline void cr_decode8(const crelation_t *crel, const cr_block_t *b,
+                              uint32_t row, __m512i *key, __m512i *payload) {
+  *key = _mm512_add_epi64(cr_unpack8(crel->data, b->offset, row, b->key_bits),
+                          _mm512_set1_epi64(b->key_base));
+  *payload = _mm512_add_epi64(
+      cr_unpack8(crel->data, b->offset + b->key_bits, row, b->payload_bits),
+      _mm512_set1_epi64(b->payload_base));
+}
+
+#endif /* COMPRESSED_RELATION_H */
@@ -1,7 +1,13 @@
 /* @version $Id: cpu_mapping.c 4548 2013-12-07 16:05:16Z bcagri $ */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>  /* sched_getaffinity, CPU_ISSET */
 #include <stdio.h>  /* FILE, fopen */
-#include <stdlib.h> /* exit, perror */
+#include <stdlib.h> /* exit, perror, qsort */
+#include <string.h> /* strcmp */
+#include <dirent.h> /* opendir, readdir */
 #include <unistd.h> /* sysconf */
 #include <numaif.h> /* get_mempolicy() */
 
@@ -13,13 +19,232 @@
 
 #define MAX_NODES 512
 
+#define SYS_CPU "/sys/devices/system/cpu"
+#define SYS_NODE "/sys/devices/system/node"
+
+typedef struct cpu_info_t cpu_info_t;
+
+/** Position of a logical CPU in the machine, as reported by sysfs */
+struct cpu_info_t {
+  int cpu;
+  int node;   /* NUMA node */
+  int socket; /* physical package */
+  int core;   /* core id within the package */
+  int smt;    /* index among the hardware threads of the core */
+  int l3;     /* lowest CPU sharing the last level cache, names the domain */
+};
+
 static int inited = 0;
 static int max_cpus;
 static int node_mapping[MAX_NODES];
 
+static int placement = -1; /* set_cpu_placement(), -1: file or default */
+static int num_cpus;       /* CPUs we are allowed to run on */
+static int num_nodes = 1;  /* highest NUMA node id + 1 */
+static cpu_info_t topology[MAX_NODES];
+static int node_of_cpu[MAX_NODES];
+
+/** Reads a single integer from a sysfs file, def if it does not exist */
+static int read_sys_int(const char *path, int def) {
+  FILE *f = fopen(path, "r");
+  int v = def;
+
+  if (f != NULL) {
+    if (fscanf(f, "%d", &v) != 1) v = def;
+    fclose(f);
+  }
+  return v;
+}
+
+/**
+ * Parses a sysfs cpu list such as "0-3,8,10-11" into cpus[], at most max
+ * entries.
+ *
+ * @return number of CPUs in the list, -1 if the file does not exist
+ */
+static int read_sys_cpulist(const char *path, int *cpus, int max) {
+  FILE *f = fopen(path, "r");
+  int n = 0, begin, end, j;
+  char sep;
+
+  if (f == NULL) return -1;
+  while (fscanf(f, "%d", &begin) == 1) {
+    end = begin;
+    sep = fgetc(f);
+    if (sep == '-') {
+      if (fscanf(f, "%d", &end) != 1) break;
+      sep = fgetc(f);
+    }
+    for (j = begin; j <= end && n < max; j++) cpus[n++] = j;
+    if (sep != ',') break;
+  }
+  fclose(f);
+  return n;
+}
+
+/** Finds the NUMA node of every CPU from the cpulists of the nodes */
+static void discover_nodes() {
+  DIR *dir = opendir(SYS_NODE);
+  struct dirent *ent;
+  char path[256];
+  int cpus[MAX_NODES];
+  int i, n, node;
+
+  for (i = 0; i < MAX_NODES; i++) node_of_cpu[i] = 0;
+  num_nodes = 1;
+  if (dir == NULL) return; /* no NUMA support, a single node */
+
+  while ((ent = readdir(dir)) != NULL) {
+    if (strncmp(ent->d_name, "node", 4) != 0 ||
+        sscanf(ent->d_name + 4, "%d", &node) != 1)
+      continue;
+    if (node + 1 > num_nodes) num_nodes = node + 1;
+    snprintf(path, sizeof(path), SYS_NODE "/node%d/cpulist", node);
+    n = read_sys_cpulist(path, cpus, MAX_NODES);
+    for (i = 0; i < n; i++)
+      if (cpus[i] < MAX_NODES) node_of_cpu[cpus[i]] = node;
+  }
+  closedir(dir);
+}
+
+/** Fills in the topology of one CPU */
+static void discover_cpu(int cpu, cpu_info_t *info) {
+  char path[256];
+  int siblings[MAX_NODES];
+  int i, n;
+
+  info->cpu = cpu;
+  info->node = node_of_cpu[cpu];
+
+  snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/physical_package_id",
+           cpu);
+  info->socket = read_sys_int(path, 0);
+  snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/core_id", cpu);
+  info->core = read_sys_int(path, cpu);
+
+  info->smt = 0;
+  snprintf(path, sizeof(path), SYS_CPU "/cpu%d/topology/thread_siblings_list",
+           cpu);
+  n = read_sys_cpulist(path, siblings, MAX_NODES);
+  for (i = 0; i < n; i++)
+    if (siblings[i] == cpu) info->smt = i;
+
+  /* the last level cache is the highest cache index of level 3 */
+  info->l3 = info->socket;
+  for (i = 0; i < 8; i++) {
+    snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/level", cpu, i);
+    if (read_sys_int(path, -1) != 3) continue;
+    snprintf(path, sizeof(path), SYS_CPU "/cpu%d/cache/index%d/shared_cpu_list",
+             cpu, i);
+    if (read_sys_cpulist(path, siblings, 1) == 1) info->l3 = siblings[0];
+  }
+}
+
+/** Discovers all CPUs of the affinity mask of the process */
+static void discover_topology() {
+  cpu_set_t set;
+  int cpu;
+
+  discover_nodes();
+  num_cpus = 0;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+    perror("sched_getaffinity");
+    for (cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN); cpu++) CPU_SET(cpu, &set);
+  }
+  for (cpu = 0; cpu < MAX_NODES && cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &set)) discover_cpu(cpu, &topology[num_cpus++]);
+  }
+}
+
+#define CMP_FIELD(a, b, f) \
+  if ((a)->f != (b)->f) return (a)->f < (b)->f ? -1 : 1;
+
+/** node, socket, L3, core, SMT: fills all hardware threads of a node first */
+static int cmp_compact(const void *x, const void *y) {
+  const cpu_info_t *a = (const cpu_info_t *)x, *b = (const cpu_info_t *)y;
+  CMP_FIELD(a, b, node);
+  CMP_FIELD(a, b, socket);
+  CMP_FIELD(a, b, l3);
+  CMP_FIELD(a, b, core);
+  CMP_FIELD(a, b, smt);
+  CMP_FIELD(a, b, cpu);
+  return 0;
+}
+
+/** SMT first: every physical core gets one thread before siblings are used */
+static int cmp_core_first(const void *x, const void *y) {
+  const cpu_info_t *a = (const cpu_info_t *)x, *b = (const cpu_info_t *)y;
+  CMP_FIELD(a, b, smt);
+  return cmp_compact(x, y);
+}
+
+/**
+ * Orders the discovered CPUs according to the placement policy and stores
+ * the result as the logical to physical mapping.
+ */
+static void init_mappings_from_topology() {
+  cpu_info_t sorted[MAX_NODES];
+  int i, n, node, pos[MAX_NODES];
+
+  if (placement == PLACEMENT_COMPACT) {
+    qsort(topology, num_cpus, sizeof(cpu_info_t), cmp_compact);
+    for (i = 0; i < num_cpus; i++) node_mapping[i] = topology[i].cpu;
+  } else {
+    qsort(topology, num_cpus, sizeof(cpu_info_t), cmp_core_first);
+    if (placement == PLACEMENT_SCATTER) {
+      /* round-robin over the nodes, physical cores first within a node */
+      for (node = 0; node < num_nodes; node++) pos[node] = 0;
+      for (n = 0; n < num_cpus;) {
+        for (node = 0; node < num_nodes; node++) {
+          while (pos[node] < num_cpus && topology[pos[node]].node != node)
+            pos[node]++;
+          if (pos[node] < num_cpus) sorted[n++] = topology[pos[node]++];
+        }
+      }
+      memcpy(topology, sorted, num_cpus * sizeof(cpu_info_t));
+    }
+    for (i = 0; i < num_cpus; i++) node_mapping[i] = topology[i].cpu;
+  }
+  max_cpus = num_cpus;
+}
+
+/** Number of different values of field f among the discovered CPUs */
+static int count_distinct(int (*field)(const cpu_info_t *)) {
+  int i, j, n = 0;
+
+  for (i = 0; i < num_cpus; i++) {
+    for (j = 0; j < i; j++)
+      if (field(&topology[j]) == field(&topology[i])) break;
+    if (j == i) n++;
+  }
+  return n;
+}
+
+static int field_socket(const cpu_info_t *c) { return c->socket; }
+static int field_node(const cpu_info_t *c) { return c->node; }
+static int field_l3(const cpu_info_t *c) { return c->l3; }
+static int field_core(const cpu_info_t *c) {
+  return c->socket * MAX_NODES + c->core;
+}
+
+static const char *placement_names[] = {"compact", "scatter", "core"};
+
+/** Whether cpu is among the discovered CPUs of the affinity mask */
+static int cpu_allowed(int cpu) {
+  int i;
+
+  for (i = 0; i < num_cpus; i++)
+    if (topology[i].cpu == cpu) return 1;
+  return 0;
+}
+
 /**
  * Initializes the cpu mapping from the file defined by CUSTOM_CPU_MAPPING.
  * The mapping used for our machine Intel L5520 is = "8 0 1 2 3 8 9 10 11".
+ * The file is ignored if it names a CPU we are not allowed to run on.
+ *
+ * @return 1 if the mapping was taken from the file, 0 otherwise
  */
 static int init_mappings_from_file() {
   FILE* cfg;
@@ -30,6 +255,7 @@ static int init_mappings_from_file() {
     if (fscanf(cfg, "%d", &max_cpus) <= 0) {
       perror("Could not parse input!\n");
     }
+    if (max_cpus > MAX_NODES || max_cpus < -MAX_NODES) max_cpus = 0;
 
     if (max_cpus >= 0) {  // 4 0,1,2,3,
       for (i = 0; i < max_cpus; i++) {
@@ -42,8 +268,9 @@ static int init_mappings_from_file() {
       for (i = 0; i < max_cpus;) {
         if (fscanf(cfg, "%d-%d,", &begin, &end) <= 0) {
           perror("Could not parse input!\n");
+          break;
         } else {
-          for (j = begin; j <= end; ++j) {
+          for (j = begin; j <= end && i < max_cpus; ++j) {
             node_mapping[i] = j;
             i++;
           }
@@ -51,38 +278,74 @@ static int init_mappings_from_file() {
       }
     }
 
+    fclose(cfg);
+    for (i = 0; i < max_cpus && cpu_allowed(node_mapping[i]); ++i)
+      ;
+    if (i < max_cpus) {
+      fprintf(stderr,
+              "[WARN ] %s: cpu %d is not available, using the topology\n",
+              CUSTOM_CPU_MAPPING, node_mapping[i]);
+      return 0;
+    }
+    if (max_cpus == 0) return 0;
+
     printf("all cpus,  %d, there are, ", max_cpus);
     for (i = 0; i < max_cpus; ++i) {
       printf("%d\t", node_mapping[i]);
     }
     puts("end");
-
-    fclose(cfg);
     return 1;
   }
-  perror("Could not open input!\n");
-  fclose(cfg);
   /* perror("Custom cpu mapping file not found!\n"); */
   return 0;
 }
 
 /**
- * Try custom cpu mapping file first, if does not exist then round-robin
- * initialization among available CPUs reported by the system.
+ * Discovers the machine topology. An explicit placement policy orders the
+ * CPUs, otherwise the custom cpu mapping file is tried first and physical
+ * cores first is the default.
  */
 static void init_mappings() {
-  if (init_mappings_from_file() == 0) {
+  discover_topology();
+
+  if (num_cpus == 0) { /* sysfs is not available */
     int i;
 
-    max_cpus = sysconf(_SC_NPROCESSORS_ONLN);
-    for (i = 0; i < max_cpus; i++) {
-      node_mapping[i] = i;
+    num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (i = 0; i < num_cpus && i < MAX_NODES; i++) {
+      topology[i].cpu = i;
+      topology[i].node = topology[i].socket = topology[i].smt = 0;
+      topology[i].core = topology[i].l3 = i;
     }
   }
+
+  if (placement >= 0 || init_mappings_from_file() == 0) {
+    if (placement < 0) placement = PLACEMENT_CORE_FIRST;
+    init_mappings_from_topology();
+    printf("topology: %d cpus, %d sockets, %d cores, %d L3 domains, "
+           "%d numa nodes, placement %s\n",
+           num_cpus, count_distinct(field_socket), count_distinct(field_core),
+           count_distinct(field_l3), count_distinct(field_node),
+           placement_names[placement]);
+  }
 }
 
 /** @} */
 
+void set_cpu_placement(int policy) {
+  placement = policy;
+  inited = 0;
+}
+
+int parse_cpu_placement(const char *name) {
+  int i;
+
+  for (i = 0; i < (int)(sizeof(placement_names) / sizeof(char *)); i++)
+    if (strcmp(name, placement_names[i]) == 0) return i;
+  if (strcmp(name, "physical-core-first") == 0) return PLACEMENT_CORE_FIRST;
+  return -1;
+}
+
 /**
  * Returns SMT aware logical to physical CPU mapping for a given thread id.
  */
@@ -95,46 +358,18 @@ int get_cpu_id(int thread_id) {
   return node_mapping[thread_id % max_cpus];
 }
 
-/* TODO: These are just place-holder implementations. */
-/**
- * Topology of Intel E5-4640
- node 0 cpus: 0 4 8 12 16 20 24 28 32 36 40 44 48 52 56 60
- node 1 cpus: 1 5 9 13 17 21 25 29 33 37 41 45 49 53 57 61
- node 2 cpus: 2 6 10 14 18 22 26 30 34 38 42 46 50 54 58 62
- node 3 cpus: 3 7 11 15 19 23 27 31 35 39 43 47 51 55 59 63
-*/
-#define INTEL_E5 1
-
-static int numa[][16] = {
-    {0, 4, 8, 12, 16, 20, 24, 28, 32, 36, 40, 44, 48, 52, 56, 60},
-    {1, 5, 9, 13, 17, 21, 25, 29, 33, 37, 41, 45, 49, 53, 57, 61},
-    {2, 6, 10, 14, 18, 22, 26, 30, 34, 38, 42, 46, 50, 54, 58, 62},
-    {3, 7, 11, 15, 19, 23, 27, 31, 35, 39, 43, 47, 51, 55, 59, 63}};
-
 int get_numa_id(int mytid) {
-#if INTEL_E5
-  int ret = 0;
-
-  for (int i = 0; i < 4; i++)
-    for (int j = 0; j < 16; j++)
-      if (numa[i][j] == mytid) {
-        ret = i;
-        break;
-      }
+  int cpu = get_cpu_id(mytid);
 
-  return ret;
-#else
-  return 0;
-#endif
+  return cpu < MAX_NODES ? node_of_cpu[cpu] : 0;
 }
 
 int get_num_numa_regions(void) {
-/* TODO: FIXME automate it from the system config. */
-#if INTEL_E5
-  return 4;
-#else
-  return 1;
-#endif
+  if (!inited) {
+    init_mappings();
+    inited = 1;
+  }
+  return num_nodes;
 }
 
 int get_numa_node_of_address(void* ptr) {
@@ -142,5 +377,7 @@ int get_numa_node_of_address(void* ptr) {
 #if !KNL
   get_mempolicy(&numa_node, NULL, 0, ptr, MPOL_F_NODE | MPOL_F_ADDR);
 #endif
+  /* unmapped pages or no NUMA support, keep indexing per-node data valid */
+  if (numa_node < 0 || numa_node >= get_num_numa_regions()) numa_node = 0;
   return numa_node;
 }
@@ -24,13 +24,37 @@
 #define CUSTOM_CPU_MAPPING "cpu-mapping.txt"
 #endif
 
+/**
+ * Placement policies, the order in which threads are pinned to the CPUs
+ * discovered from /sys/devices/system/{cpu,node}:
+ *  - compact:    fill all hardware threads of a NUMA node, L3 domain and core
+ *                before moving on to the next one
+ *  - scatter:    round-robin over the NUMA nodes, physical cores first
+ *  - core:       one thread per physical core on all nodes, SMT siblings last
+ */
+#define PLACEMENT_COMPACT 0
+#define PLACEMENT_SCATTER 1
+#define PLACEMENT_CORE_FIRST 2
+
+/**
+ * Selects the placement policy, overriding CUSTOM_CPU_MAPPING. Without it the
+ * mapping file is used if present, PLACEMENT_CORE_FIRST otherwise.
+ */
+void set_cpu_placement(int policy);
+
+/**
+ * Returns the policy named "compact", "scatter" or "core", -1 if unknown.
+ */
+int parse_cpu_placement(const char *name);
+
 /**
  * Returns SMT aware logical to physical CPU mapping for a given thread id.
  */
 int get_cpu_id(int thread_id);
 
 /** 
- * Returns the NUMA id of the given thread id returned from get_cpu_id(int)
+ * Returns the NUMA id of the CPU the given thread id is mapped to by
+ * get_cpu_id(int)
  * 
  * @param mytid 
  * 
@@ -40,7 +64,7 @@ int
 get_numa_id(int mytid);
 
 /** 
- * Returns number of NUMA regions.
+ * Returns number of NUMA regions, i.e. the highest NUMA node id + 1.
  * 
  * @return 
  */
@@ -48,7 +72,7 @@ int
 get_num_numa_regions(void);
 
 /**
- * Returns the NUMA-node id of a given memory address
+ * Returns the NUMA-node id of a given memory address, 0 if it is unknown
  */
 int 
 get_numa_node_of_address(void * ptr);
@@ -11,13 +11,20 @@
 #include <time.h>    /* time() */
 #include <unistd.h>  /* getpagesize() */
 #include <string.h>  /* memcpy() */
+#include <fcntl.h>   /* open() */
+#include <sys/mman.h> /* mmap() */
+#include <sys/stat.h> /* fstat() */
+#ifdef __SSE4_1__
+#include <smmintrin.h> /* _mm_packus_epi32 */
+#endif
 
 #include "cpu_mapping.h" /* get_cpu_id() */
 #include "generator.h"   /* create_relation_*() */
 #include "affinity.h"    /* pthread_attr_setaffinity_np */
-#include "genzipf.h"     /* gen_zipf() */
+#include "genzipf.h"     /* gen_zipf(), zipf_sampler_t */
 #include "lock.h"
 #include "prj_params.h" /* RELATION_PADDING for Parallel Radix */
+#include "hash_functions.h" /* hash_murmur */
 
 /* return a random number in range [0,N] */
 #define RAND_RANGE(N) ((double)rand() / ((double)RAND_MAX + 1) * (N))
@@ -136,6 +143,30 @@ struct create_arg_t {
 
 typedef struct create_arg_t create_arg_t;
 
+/**
+ * Knuth-shuffles the keys of rel, a slice of fullrel, with the keys of the
+ * whole relation. All threads shuffle their slices at the same time, every
+ * swap latches both tuples in locks.
+ */
+static void parallel_shuffle(relation_t *rel, relation_t *fullrel,
+                             volatile char *locks, unsigned short *state) {
+  uint64_t i;
+  uint64_t rel_offset_in_full = rel->tuples - fullrel->tuples;
+  uint64_t k = rel_offset_in_full + rel->num_tuples - 1;
+  for (i = rel->num_tuples - 1; i > 0; i--, k--) {
+    int64_t j = RAND_RANGE48(k, state);
+    lock(locks + k); /* lock this rel-idx=i, fullrel-idx=k */
+    lock(locks + j); /* lock full rel-idx=j */
+
+    intkey_t tmp = fullrel->tuples[k].key;
+    fullrel->tuples[k].key = fullrel->tuples[j].key;
+    fullrel->tuples[j].key = tmp;
+
+    unlock(locks + j);
+    unlock(locks + k);
+  }
+}
+
 /**
  * Create random unique keys starting from firstkey
  */
@@ -168,23 +199,7 @@ void *random_unique_gen_thread(void *args) {
   BARRIER_ARRIVE(arg->barrier, i);
 
   /* parallel synchronized knuth-shuffle */
-  volatile char *locks = (volatile char *)(arg->locks);
-  relation_t *fullrel = arg->fullrel;
-
-  uint64_t rel_offset_in_full = rel->tuples - fullrel->tuples;
-  uint64_t k = rel_offset_in_full + rel->num_tuples - 1;
-  for (i = rel->num_tuples - 1; i > 0; i--, k--) {
-    int64_t j = RAND_RANGE48(k, state);
-    lock(locks + k); /* lock this rel-idx=i, fullrel-idx=k */
-    lock(locks + j); /* lock full rel-idx=j */
-
-    intkey_t tmp = fullrel->tuples[k].key;
-    fullrel->tuples[k].key = fullrel->tuples[j].key;
-    fullrel->tuples[j].key = tmp;
-
-    unlock(locks + j);
-    unlock(locks + k);
-  }
+  parallel_shuffle(rel, arg->fullrel, (volatile char *)(arg->locks), state);
 
   return 0;
 }
@@ -205,18 +220,96 @@ void *numa_localize_thread(void *args) {
 }
 
 /**
- * Read a 2-column relation from a file, rel is already allocated (preferably
- * NUMA-aware).
+ * Touch one word of every page by reading and writing it back, so that a
+ * private file mapping gets a local copy of the page on the NUMA node of the
+ * thread, without changing the data.
+ */
+void *numa_touch_thread(void *args) {
+  create_arg_t *arg = (create_arg_t *)args;
+  relation_t *rel = &arg->rel;
+  volatile char *p = (volatile char *)rel->tuples;
+  volatile char *end = (volatile char *)(rel->tuples + rel->num_tuples);
+  unsigned int pagesize = getpagesize();
+
+  for (; p < end; p += pagesize) {
+    *p = *p;
+  }
+
+  return 0;
+}
+
+/**
+ * Read a 2-column text relation from a file in parallel, allocates rel.
  */
 void read_relation(relation_t *rel, char *filename);
-void read_relation_binary(relation_t *rel, char *filename);
 #define BINARY 1
+
+/**
+ * Fill in the header of a binary relation file: min/max keys, whether the
+ * keys are sorted, and whether they are unique. Uniqueness is checked with a
+ * bitmap over [min, max] for unsorted keys if the range is small enough,
+ * otherwise the flag is left unset.
+ */
+static void relation_stats(relation_t *rel, relation_header_t *hdr) {
+  uint64_t i;
+  int sorted = 1, unique = 1;
+
+  memset(hdr, 0, sizeof(relation_header_t));
+  hdr->magic = RELATION_FILE_MAGIC;
+  hdr->version = RELATION_FILE_VERSION;
+  hdr->header_size = RELATION_FILE_HEADER_SIZE;
+  hdr->num_tuples = rel->num_tuples;
+  hdr->key_width = sizeof(intkey_t);
+  hdr->payload_width = sizeof(value_t);
+  if (rel->num_tuples == 0) {
+    hdr->flags = RELATION_SORTED | RELATION_UNIQUE;
+    return;
+  }
+
+  hdr->min_key = hdr->max_key = rel->tuples[0].key;
+  for (i = 1; i < rel->num_tuples; i++) {
+    intkey_t key = rel->tuples[i].key;
+    if (key < hdr->min_key) hdr->min_key = key;
+    if (key > hdr->max_key) hdr->max_key = key;
+    if (key < rel->tuples[i - 1].key) sorted = 0;
+    if (key == rel->tuples[i - 1].key) unique = 0;
+  }
+
+  if (!sorted && unique) {
+    uint64_t range = (uint64_t)(hdr->max_key - hdr->min_key) + 1;
+    uint64_t *bitmap = NULL;
+    if (range <= (1ULL << 34)) {
+      bitmap = (uint64_t *)calloc(range / 64 + 1, sizeof(uint64_t));
+    }
+    if (bitmap) {
+      for (i = 0; i < rel->num_tuples && unique; i++) {
+        uint64_t k = rel->tuples[i].key - hdr->min_key;
+        if (bitmap[k >> 6] & (1ULL << (k & 63))) unique = 0;
+        bitmap[k >> 6] |= 1ULL << (k & 63);
+      }
+      free(bitmap);
+    } else {
+      unique = 0; /* unknown */
+    }
+  }
+
+  hdr->flags = (sorted ? RELATION_SORTED : 0) | (unique ? RELATION_UNIQUE : 0);
+}
+
 /**
  * Write relation to a file.
  */
 void write_relation(relation_t *rel, char *filename) {
   FILE *fp = fopen(filename, "w");
+  if (!fp) {
+    perror("[ERROR] write_relation() can not open the file");
+    exit(EXIT_FAILURE);
+  }
 #if BINARY
+  char header[RELATION_FILE_HEADER_SIZE];
+  memset(header, 0, RELATION_FILE_HEADER_SIZE);
+  relation_stats(rel, (relation_header_t *)header);
+  fwrite(header, RELATION_FILE_HEADER_SIZE, 1, fp);
   fwrite(rel->tuples, sizeof(tuple_t), rel->num_tuples, fp);
 #else
   uint64_t i;
@@ -360,26 +453,385 @@ int parallel_create_relation(relation_t *relation, uint64_t num_tuples,
   return 0;
 }
 
-int load_relation(relation_t *relation, char *filename, uint64_t num_tuples) {
-  relation->num_tuples = num_tuples;
+/* ------------- build and probe relations of gen_params_t ------------- */
 
-#if BINARY
-  read_relation_binary(relation, filename);
-#else
-  /* load from the given input file */
-  /* we need aligned allocation of items */
+/** salt of the key hash, the same for every relation so that the keys match */
+#define GEN_KEY_SALT 0x2545F4914F6CDD1DULL
+
+struct gen_arg_t {
+  int32_t tid;
+  int32_t nthreads;
+  relation_t rel;     /* the slice of the thread */
+  relation_t *fullrel;
+  uint64_t ridstart;
+  uint64_t maxid;
+  const gen_params_t *params;
+  uint64_t *totals; /* build: tuples of the ids of every thread */
+  volatile char *locks;
+  pthread_barrier_t *barrier;
+};
+
+typedef struct gen_arg_t gen_arg_t;
+
+void gen_params_init(gen_params_t *p) {
+  p->order = GEN_SHUFFLED;
+  p->run_length = 1024;
+  p->key_gap = 1;
+  p->dup = 1;
+  p->dup_dist = GEN_DUP_CONST;
+  p->hot_keys = 0;
+  p->hot_fraction = 0.0;
+  p->selectivity = 1.0;
+  p->skew = 0.0;
+}
+
+uint64_t gen_build_keys(uint64_t ntuples, const gen_params_t *p) {
+  uint64_t maxid = ntuples / (p->dup ? p->dup : 1);
+  return maxid ? maxid : 1;
+}
+
+/** the key of id, strictly increasing in id */
+static inline intkey_t gen_key(uint64_t id, uint64_t gap) {
+  if (gap <= 1) return id;
+  return (id - 1) * gap + 1 + hash_murmur(id ^ GEN_KEY_SALT) % gap;
+}
+
+/** number of build tuples of id */
+static inline uint64_t gen_dup(uint64_t id, const gen_params_t *p) {
+  uint64_t h = hash_murmur(id);
+  if (p->dup <= 1) return 1;
+  switch (p->dup_dist) {
+    case GEN_DUP_UNIFORM:
+      return 1 + h % (2 * p->dup - 1);
+    case GEN_DUP_GEOMETRIC: {
+      /* inversion with u in (0, 1] from the upper 53 bits of the hash */
+      double u = ((h >> 11) + 1) * (1.0 / 9007199254740992.0);
+      return 1 + (uint64_t)(log(u) / log(1.0 - 1.0 / p->dup));
+    }
+    default:
+      return p->dup;
+  }
+}
+
+/** random number k of tuple n, a counter-based generator */
+static inline uint64_t gen_rand(uint64_t seed, uint64_t n, uint64_t k) {
+  return hash_murmur(hash_murmur(seed * HASH_MULT_A + n) + k * GEN_KEY_SALT);
+}
+
+/** gen_rand() as a uniform number in [0, 1) */
+static inline double gen_uniform(uint64_t seed, uint64_t n, uint64_t k) {
+  return (gen_rand(seed, n, k) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * A random permutation of [0, n) chosen by seed: a 4-round Feistel network
+ * over the next even power of two, cycle-walking until the value is below n.
+ */
+static uint64_t gen_permute(uint64_t x, uint64_t n, uint64_t seed) {
+  int half = 1;
+  while ((1ULL << (2 * half)) < n) half++;
+  uint64_t mask = (1ULL << half) - 1;
+  do {
+    uint64_t l = x >> half, r = x & mask;
+    for (uint64_t round = 0; round < 4; round++) {
+      uint64_t t = l ^ (hash_murmur(r ^ (seed + round) * GEN_KEY_SALT) & mask);
+      l = r;
+      r = t;
+    }
+    x = (l << half) | r;
+  } while (x >= n);
+  return x;
+}
+
+/** a uniform random number in [0, n), nrand48() has only 31 bits */
+static inline uint64_t rand_range64(uint64_t n, unsigned short *state) {
+  uint64_t r = ((uint64_t)nrand48(state) << 31) ^ nrand48(state);
+  r = (r << 31) ^ nrand48(state);
+  return r % n;
+}
+
+static int tuple_key_cmp(const void *a, const void *b) {
+  intkey_t ka = ((const tuple_t *)a)->key, kb = ((const tuple_t *)b)->key;
+  return (ka > kb) - (ka < kb);
+}
+
+/** sorts the slice, and for GEN_CLUSTERED swaps its runs around */
+static void gen_order_slice(gen_arg_t *arg, unsigned short *state) {
+  relation_t *rel = &arg->rel;
+  uint64_t len = arg->params->run_length, nruns, i;
+
+  qsort(rel->tuples, rel->num_tuples, sizeof(tuple_t), tuple_key_cmp);
+  if (arg->params->order == GEN_CLUSTERED && len > 0) {
+    /* only whole runs move, a shorter last run stays in place */
+    nruns = rel->num_tuples / len;
+    for (i = nruns - 1; nruns > 1 && i > 0; i--) {
+      uint64_t j = rand_range64(i + 1, state);
+      tuple_t *a = rel->tuples + i * len, *b = rel->tuples + j * len;
+      for (uint64_t t = 0; t < len && i != j; t++) {
+        intkey_t tmp = a[t].key;
+        a[t].key = b[t].key;
+        b[t].key = tmp;
+      }
+    }
+  }
+  for (i = 0; i < rel->num_tuples; i++) {
+    rel->tuples[i].payload = arg->ridstart + i;
+  }
+}
+
+/**
+ * Writes the tuples of the ids of the thread at their prefix-sum position,
+ * which is about its own slice when the multiplicities are balanced, then
+ * orders its slice.
+ */
+void *gen_build_thread(void *param) {
+  gen_arg_t *arg = (gen_arg_t *)param;
+  const gen_params_t *p = arg->params;
+  relation_t *full = arg->fullrel;
+  uint64_t first = 1 + arg->maxid * arg->tid / arg->nthreads;
+  uint64_t last = 1 + arg->maxid * (arg->tid + 1) / arg->nthreads;
+  uint64_t id, pos = 0, total = 0, n = full->num_tuples;
+  unsigned short state[3] = {(unsigned short)(seedValue & 0xffff),
+                             (unsigned short)(seedValue >> 16),
+                             (unsigned short)arg->tid};
+  int rv;
+
+  for (id = first; id < last; id++) total += gen_dup(id, p);
+  arg->totals[arg->tid] = total;
+  BARRIER_ARRIVE(arg->barrier, rv);
+
+  for (int t = 0; t < arg->tid; t++) pos += arg->totals[t];
+  for (id = first; id < last && pos < n; id++) {
+    intkey_t key = gen_key(id, p->key_gap);
+    for (uint64_t d = gen_dup(id, p); d > 0 && pos < n; d--, pos++) {
+      full->tuples[pos].key = key;
+      full->tuples[pos].payload = pos;
+    }
+  }
+  if (arg->tid == arg->nthreads - 1) {
+    /* fill up to ntuples with extra duplicates of uniform ids */
+    for (; pos < n; pos++) {
+      full->tuples[pos].key =
+          gen_key(1 + gen_rand(seedValue, pos, 1) % arg->maxid, p->key_gap);
+      full->tuples[pos].payload = pos;
+    }
+  }
+  BARRIER_ARRIVE(arg->barrier, rv);
+
+  if (p->order == GEN_SHUFFLED) {
+    parallel_shuffle(&arg->rel, full, arg->locks, state);
+  } else {
+    gen_order_slice(arg, state);
+  }
+  return 0;
+}
+
+/**
+ * Draws the ids of the own slice, then orders it. Random number k of tuple n
+ * is gen_rand(seed, n, k), so the relation only depends on the seed and not
+ * on the number of threads. The ids are independent draws and already in
+ * random order, GEN_SHUFFLED needs no shuffle.
+ */
+void *gen_probe_thread(void *param) {
+  gen_arg_t *arg = (gen_arg_t *)param;
+  const gen_params_t *p = arg->params;
+  relation_t *rel = &arg->rel;
+  uint64_t i, n, id, rank;
+  unsigned short state[3] = {(unsigned short)(seedValue & 0xffff),
+                             (unsigned short)(seedValue >> 16),
+                             (unsigned short)arg->tid};
+  uint64_t hot = p->hot_keys < arg->maxid ? p->hot_keys : arg->maxid;
+  zipf_sampler_t zipf;
+
+  if (p->skew > 0) zipf_sampler_init(&zipf, arg->maxid, p->skew);
+
+  for (i = 0; i < rel->num_tuples; i++) {
+    n = arg->ridstart + i;
+    if (hot > 0 && gen_uniform(seedValue, n, 0) < p->hot_fraction) {
+      /* heavy hitters are spread over the domain */
+      id = 1 + gen_rand(seedValue, n, 1) % hot * (arg->maxid / hot);
+    } else if (p->skew > 0) {
+      for (int k = 3; !zipf_try(&zipf, gen_uniform(seedValue, n, k), &rank);)
+        k++;
+      /* rank 1 is the most frequent, the ranks get a random id */
+      id = 1 + gen_permute(rank - 1, arg->maxid, seedValue);
+    } else {
+      id = 1 + gen_rand(seedValue, n, 1) % arg->maxid;
+    }
+    if (p->selectivity < 1.0 &&
+        gen_uniform(seedValue, n, 2) >= p->selectivity) {
+      id += arg->maxid; /* no build tuple has this id */
+    }
+    rel->tuples[i].key = gen_key(id, p->key_gap);
+    rel->tuples[i].payload = n;
+  }
+
+  if (p->order != GEN_SHUFFLED) gen_order_slice(arg, state);
+  return 0;
+}
+
+/**
+ * Runs fn on nthreads pinned threads over page-aligned slices of relation,
+ * with the latches of parallel_shuffle() if shuffle is set.
+ */
+static int gen_run(relation_t *relation, uint64_t num_tuples, uint32_t nthreads,
+                   uint64_t maxid, const gen_params_t *p, int shuffle,
+                   void *(*fn)(void *)) {
+  int rv;
+  uint32_t i;
+  uint64_t offset = 0;
+
+  check_seed();
+
+  /* the largest key is that of a non-matching id, at most 2 maxid */
+  if (sizeof(intkey_t) < 8 &&
+      2 * maxid * (p->key_gap ? p->key_gap : 1) > (uint64_t)INT32_MAX) {
+    printf("[ERROR] Keys up to %llu do not fit 4B keys, use --enable-key8B\n",
+           (unsigned long long)(2 * maxid * (p->key_gap ? p->key_gap : 1)));
+    exit(EXIT_FAILURE);
+  }
+
+  relation->num_tuples = num_tuples;
   relation->tuples = (tuple_t *)MALLOC(num_tuples * sizeof(tuple_t));
 
   if (!relation->tuples) {
     perror("out of memory");
     return -1;
   }
-  read_relation(relation, filename);
-#endif
+
+  gen_arg_t args[nthreads];
+  pthread_t tid[nthreads];
+  uint64_t totals[nthreads];
+  cpu_set_t set;
+  pthread_attr_t attr;
+  pthread_barrier_t barrier;
+
+  unsigned int pagesize;
+  unsigned int npages;
+  unsigned int npages_perthr;
+  uint64_t ntuples_perthr;
+  uint64_t ntuples_lastthr;
+
+  pagesize = getpagesize();
+  npages = (num_tuples * sizeof(tuple_t)) / pagesize + 1;
+  npages_perthr = npages / nthreads;
+  ntuples_perthr = npages_perthr * (pagesize / sizeof(tuple_t));
+
+  if (npages_perthr == 0) ntuples_perthr = num_tuples / nthreads;
+
+  ntuples_lastthr = num_tuples - ntuples_perthr * (nthreads - 1);
+
+  pthread_attr_init(&attr);
+
+  rv = pthread_barrier_init(&barrier, NULL, nthreads);
+  if (rv != 0) {
+    printf("[ERROR] Couldn't create the barrier\n");
+    exit(EXIT_FAILURE);
+  }
+
+  volatile char *locks = NULL;
+  if (shuffle) {
+    locks = (volatile char *)calloc(num_tuples, sizeof(char));
+  }
+
+  for (i = 0; i < nthreads; i++) {
+    int cpu_idx = get_cpu_id(i);
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu_idx, &set);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+
+    args[i].tid = i;
+    args[i].nthreads = nthreads;
+    args[i].ridstart = offset;
+    args[i].rel.tuples = relation->tuples + offset;
+    args[i].rel.num_tuples =
+        (i == nthreads - 1) ? ntuples_lastthr : ntuples_perthr;
+    args[i].fullrel = relation;
+    args[i].maxid = maxid;
+    args[i].params = p;
+    args[i].totals = totals;
+    args[i].locks = locks;
+    args[i].barrier = &barrier;
+
+    offset += ntuples_perthr;
+
+    rv = pthread_create(&tid[i], &attr, fn, (void *)&args[i]);
+    if (rv) {
+      fprintf(stderr, "[ERROR] pthread_create() return code is %d\n", rv);
+      exit(-1);
+    }
+  }
+
+  for (i = 0; i < nthreads; i++) {
+    pthread_join(tid[i], NULL);
+  }
+
+  /* clean up */
+  free((char *)locks);
+  pthread_barrier_destroy(&barrier);
+
   return 0;
 }
 
-int numa_localize(tuple_t *relation, int64_t num_tuples, uint32_t nthreads) {
+int parallel_create_build_relation(relation_t *reln, uint64_t ntuples,
+                                   uint32_t nthreads, const gen_params_t *p) {
+  return gen_run(reln, ntuples, nthreads, gen_build_keys(ntuples, p), p,
+                 p->order == GEN_SHUFFLED, gen_build_thread);
+}
+
+int parallel_create_probe_relation(relation_t *reln, uint64_t ntuples,
+                                   uint32_t nthreads, uint64_t maxid,
+                                   const gen_params_t *p) {
+  return gen_run(reln, ntuples, nthreads, maxid, p, 0, gen_probe_thread);
+}
+
+int parallel_create_relation_zipf(relation_t *reln, uint64_t ntuples,
+                                  uint32_t nthreads, uint64_t maxid,
+                                  double zipfparam) {
+  gen_params_t p;
+  gen_params_init(&p);
+  p.skew = zipfparam;
+  return parallel_create_probe_relation(reln, ntuples, nthreads, maxid, &p);
+}
+
+/** does the file start like a text relation (header or number lines)? */
+static int is_text_relation(char *filename) {
+  unsigned char buf[64];
+  FILE *fp = fopen(filename, "r");
+  if (!fp) {
+    perror("[ERROR] load_relation() can not open the file");
+    exit(EXIT_FAILURE);
+  }
+  size_t n = fread(buf, 1, sizeof(buf), fp);
+  fclose(fp);
+  for (size_t i = 0; i < n; i++) {
+    if (buf[i] != '\n' && buf[i] != '\r' && buf[i] != '\t' &&
+        (buf[i] < ' ' || buf[i] > '~')) {
+      return 0;
+    }
+  }
+  return n > 0;
+}
+
+int load_relation(relation_t *relation, char *filename, uint64_t num_tuples) {
+  relation->num_tuples = num_tuples;
+
+  /* written by write_relation() with or without BINARY, or by hand */
+  if (is_text_relation(filename)) {
+    read_relation(relation, filename);
+  } else {
+    read_relation_binary(relation, filename);
+  }
+  return 0;
+}
+
+/**
+ * Runs fn on nthreads pinned threads, each given a page-aligned slice of the
+ * relation.
+ */
+static int numa_run(tuple_t *relation, int64_t num_tuples, uint32_t nthreads,
+                    void *(*fn)(void *)) {
   uint32_t i, rv;
   uint64_t offset = 0;
 
@@ -416,7 +868,7 @@ int numa_localize(tuple_t *relation, int64_t num_tuples, uint32_t nthreads) {
         (i == nthreads - 1) ? ntuples_lastthr : ntuples_perthr;
     offset += ntuples_perthr;
 
-    rv = pthread_create(&tid[i], &attr, numa_localize_thread, (void *)&args[i]);
+    rv = pthread_create(&tid[i], &attr, fn, (void *)&args[i]);
     if (rv) {
       fprintf(stderr, "[ERROR] pthread_create() return code is %d\n", rv);
       exit(-1);
@@ -430,6 +882,10 @@ int numa_localize(tuple_t *relation, int64_t num_tuples, uint32_t nthreads) {
   return 0;
 }
 
+int numa_localize(tuple_t *relation, int64_t num_tuples, uint32_t nthreads) {
+  return numa_run(relation, num_tuples, nthreads, numa_localize_thread);
+}
+
 int create_relation_fk(relation_t *relation, int64_t num_tuples,
                        const int64_t maxid) {
   int32_t i, iters;
@@ -556,17 +1012,125 @@ int create_relation_zipf(relation_t *relation, int64_t num_tuples,
   return 0;
 }
 
+/** relations mapped by read_relation_binary(), unmapped by delete_relation */
+#define MAX_MAPPED_RELATIONS 8
+static struct {
+  tuple_t *tuples;
+  void *base;
+  size_t len;
+} mapped[MAX_MAPPED_RELATIONS];
+
 void delete_relation(relation_t *rel) {
   /* clean up */
+  for (int i = 0; i < MAX_MAPPED_RELATIONS; i++) {
+    if (mapped[i].tuples && mapped[i].tuples == rel->tuples) {
+      munmap(mapped[i].base, mapped[i].len);
+      mapped[i].tuples = NULL;
+      return;
+    }
+  }
   FREE(rel->tuples, rel->num_tuples * sizeof(tuple_t));
 }
+
+/**
+ * Maps a file with a relation_header_t. The mapping is private, so the
+ * relation may be modified in memory. RELATION_PADDING bytes of anonymous
+ * memory follow the tuples, like with MALLOC().
+ *
+ * @return 0 on success, -1 if the file has no header
+ */
+static int mmap_relation(relation_t *rel, char *filename) {
+  relation_header_t hdr;
+  struct stat st;
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    perror("[ERROR] read_relation_binary() can not open the file");
+    exit(EXIT_FAILURE);
+  }
+  if (fstat(fd, &st) || st.st_size < RELATION_FILE_HEADER_SIZE ||
+      pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+      hdr.magic != RELATION_FILE_MAGIC) {
+    close(fd);
+    return -1;
+  }
+  if (hdr.version != RELATION_FILE_VERSION ||
+      hdr.key_width != sizeof(intkey_t) ||
+      hdr.payload_width != sizeof(value_t)) {
+    fprintf(stderr,
+            "[ERROR] %s: version %u with %u/%u-byte key/payload does not match "
+            "version %u with %u/%u-byte key/payload (see --enable-key8B)\n",
+            filename, hdr.version, hdr.key_width, hdr.payload_width,
+            RELATION_FILE_VERSION, (uint32_t)sizeof(intkey_t),
+            (uint32_t)sizeof(value_t));
+    exit(EXIT_FAILURE);
+  }
+  /* the tuples must be aligned and fit in the file */
+  if (hdr.header_size < sizeof(relation_header_t) ||
+      hdr.header_size % sizeof(tuple_t) != 0 ||
+      hdr.header_size > (uint64_t)st.st_size ||
+      hdr.num_tuples >
+          ((uint64_t)st.st_size - hdr.header_size) / sizeof(tuple_t)) {
+    fprintf(stderr,
+            "[ERROR] %s: corrupt header, %llu tuples at offset %u of a "
+            "%lld-byte file\n",
+            filename, (unsigned long long)hdr.num_tuples, hdr.header_size,
+            (long long)st.st_size);
+    exit(EXIT_FAILURE);
+  }
+  int slot = 0;
+  while (slot < MAX_MAPPED_RELATIONS && mapped[slot].tuples != NULL) {
+    slot++;
+  }
+  if (slot == MAX_MAPPED_RELATIONS) {
+    fprintf(stderr,
+            "[ERROR] %s: more than %d relations are mapped, raise "
+            "MAX_MAPPED_RELATIONS\n",
+            filename, MAX_MAPPED_RELATIONS);
+    exit(EXIT_FAILURE);
+  }
+
+  size_t filelen = hdr.header_size + hdr.num_tuples * sizeof(tuple_t);
+  size_t len = filelen + RELATION_PADDING;
+  /* reserve room for the padding, then map the file over its beginning */
+  char *base = (char *)mmap(NULL, len, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  int flags = MAP_PRIVATE | MAP_FIXED | (numalocalize ? 0 : MAP_POPULATE);
+  if (base == MAP_FAILED ||
+      mmap(base, filelen, PROT_READ | PROT_WRITE, flags, fd, 0) == MAP_FAILED) {
+    perror("[ERROR] read_relation_binary() mmap failed");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+
+  rel->tuples = (tuple_t *)(base + hdr.header_size);
+  rel->num_tuples = hdr.num_tuples;
+  if (numalocalize) {
+    numa_run(rel->tuples, rel->num_tuples, nthreads, numa_touch_thread);
+  }
+
+  mapped[slot].tuples = rel->tuples;
+  mapped[slot].base = base;
+  mapped[slot].len = len;
+  printf("mapped relation file num = %llu, min = %lld, max = %lld, %s, %s\n",
+         (unsigned long long)hdr.num_tuples, (long long)hdr.min_key,
+         (long long)hdr.max_key,
+         (hdr.flags & RELATION_SORTED) ? "sorted" : "unsorted",
+         (hdr.flags & RELATION_UNIQUE) ? "unique" : "non-unique");
+  return 0;
+}
+
 void read_relation_binary(relation_t *rel, char *filename) {
+  if (mmap_relation(rel, filename) == 0) {
+    return;
+  }
+  /* raw tuples without a header */
   FILE *fp = fopen(filename, "r");
   fseek(fp, 0, SEEK_END);
   uint64_t size = ftell(fp);
   rewind(fp);
   size = size / sizeof(tuple_t);
-  printf("read relation file num = %lld, num = %lld\n", size, rel->num_tuples);
+  printf("read relation file num = %llu, num = %llu\n",
+         (unsigned long long)size, (unsigned long long)rel->num_tuples);
   rel->num_tuples = size;
   /* load from the given input file */
   /* we need aligned allocation of items */
@@ -579,57 +1143,219 @@ void read_relation_binary(relation_t *rel, char *filename) {
   fread(rel->tuples, sizeof(tuple_t), size, fp);
   fclose(fp);
 }
-void read_relation(relation_t *rel, char *filename) {
-  FILE *fp = fopen(filename, "r");
+/** arguments of the text loader threads */
+typedef struct text_load_arg_t {
+  int32_t tid;
+  const char *begin; /* first byte of the first whole line of the thread */
+  const char *end;   /* lines starting before end belong to the thread */
+  const char *fend;  /* end of the file */
+  uint64_t count;
+  uint64_t *counts; /* [nthreads], shared */
+  relation_t *rel;
+  int nthreads;
+  pthread_barrier_t *barrier;
+} text_load_arg_t;
 
-  /* skip the header line */
-  char c;
-  do {
-    c = fgetc(fp);
-  } while (c != '\n');
+/** is the line starting at p blank (nothing but spaces, tabs or "\r")? */
+static inline int empty_line(const char *p, const char *fend) {
+  while (p < fend && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+  return p >= fend || *p == '\n';
+}
 
-  /* search for a whitespace for "key payload" format */
-  int fmtspace = 0;
-  int fmtcomma = 0;
-  do {
-    c = fgetc(fp);
-    if (c == ' ') {
-      fmtspace = 1;
-      break;
-    }
-    if (c == ',') {
-      fmtcomma = 1;
-      break;
+/**
+ * Parses the unsigned decimal at p. With SSE4.1 up to 16 digits are
+ * converted at once: the digits are right-aligned with a shuffle and then
+ * multiplied pairwise by 10, 100 and 10000 with horizontal adds.
+ *
+ * @return pointer to the first byte after the number
+ */
+static inline const char *parse_uint(const char *p, const char *fend,
+                                     uint64_t *val) {
+#ifdef __SSE4_1__
+  if (p + 16 <= fend) {
+    __m128i v_digits =
+        _mm_sub_epi8(_mm_loadu_si128((const __m128i *)p), _mm_set1_epi8('0'));
+    int nondigit = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmplt_epi8(v_digits, _mm_setzero_si128()),
+                     _mm_cmpgt_epi8(v_digits, _mm_set1_epi8(9))));
+    int len = __builtin_ctz(nondigit | 0x10000);
+    if (len < 16) {
+      /* lanes below 16 - len get a negative index and are zeroed */
+      __m128i v_shuffle =
+          _mm_add_epi8(_mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                                     13, 14, 15),
+                       _mm_set1_epi8(len - 16));
+      v_digits = _mm_shuffle_epi8(v_digits, v_shuffle);
+      v_digits = _mm_maddubs_epi16(
+          v_digits,
+          _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+      v_digits = _mm_madd_epi16(
+          v_digits, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+      v_digits = _mm_packus_epi32(v_digits, v_digits);
+      v_digits = _mm_madd_epi16(
+          v_digits, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+      *val = (uint64_t)(uint32_t)_mm_cvtsi128_si32(v_digits) * 100000000ULL +
+             (uint32_t)_mm_extract_epi32(v_digits, 1);
+      return p + len;
     }
-  } while (c != '\n');
+  }
+#endif
+  uint64_t v = 0;
+  while (p < fend && (unsigned)(*p - '0') <= 9) {
+    v = v * 10 + (*p++ - '0');
+  }
+  *val = v;
+  return p;
+}
 
-  /* rewind back to the beginning and start parsing again */
-  rewind(fp);
-  /* skip the header line */
-  do {
-    c = fgetc(fp);
-  } while (c != '\n');
-
-  uint64_t ntuples = rel->num_tuples;
-  intkey_t key;
-  value_t payload = 0;
-  int warn = 1;
-  for (uint64_t i = 0; i < ntuples; i++) {
-    if (fmtspace) {
-      fscanf(fp, "%lld %lld", &key, &payload);
-    } else if (fmtcomma) {
-      fscanf(fp, "%lld,%lld", &key, &payload);
+/**
+ * Parses one "key payload", "key,payload" or "key" line into t, leading
+ * blanks are skipped.
+ *
+ * @return pointer to the beginning of the next line
+ */
+static inline const char *parse_line(const char *p, const char *fend,
+                                     tuple_t *t) {
+  uint64_t v;
+  while (*p == ' ' || *p == '\t') ++p;
+  int neg = (*p == '-');
+  p = parse_uint(p + neg, fend, &v);
+  t->key = neg ? -(int64_t)v : (int64_t)v;
+  t->payload = 0;
+  while (p < fend && (*p == ' ' || *p == ',' || *p == '\t')) ++p;
+  if (p < fend && *p != '\n' && *p != '\r') {
+    neg = (*p == '-');
+    p = parse_uint(p + neg, fend, &v);
+    t->payload = neg ? -(int64_t)v : (int64_t)v;
+  }
+  p = (const char *)memchr(p, '\n', fend - p);
+  return p ? p + 1 : fend;
+}
+
+void *text_load_thread(void *param) {
+  text_load_arg_t *arg = (text_load_arg_t *)param;
+  const char *p;
+  uint64_t count = 0;
+  int rv;
+
+  /* pass 1: count the non-empty lines */
+  for (p = arg->begin; p < arg->end;) {
+    count += !empty_line(p, arg->fend);
+    p = (const char *)memchr(p, '\n', arg->fend - p);
+    p = p ? p + 1 : arg->fend;
+  }
+  arg->counts[arg->tid] = count;
+  BARRIER_ARRIVE(arg->barrier, rv);
+
+  if (arg->tid == 0) {
+    uint64_t total = 0;
+    for (int i = 0; i < arg->nthreads; i++) total += arg->counts[i];
+    arg->rel->num_tuples = total;
+    /* not touched here, each thread faults in its own slice below */
+    if (posix_memalign((void **)&arg->rel->tuples, CACHE_LINE_SIZE,
+                       total * sizeof(tuple_t) + RELATION_PADDING)) {
+      perror("[ERROR] read_relation() failed: out of memory");
+      exit(EXIT_FAILURE);
+    }
+  }
+  BARRIER_ARRIVE(arg->barrier, rv);
+
+  /* pass 2: parse into the own slice of the relation */
+  tuple_t *out = arg->rel->tuples;
+  for (int i = 0; i < arg->tid; i++) out += arg->counts[i];
+  for (p = arg->begin; p < arg->end;) {
+    if (empty_line(p, arg->fend)) {
+      p = (const char *)memchr(p, '\n', arg->fend - p);
+      p = p ? p + 1 : arg->fend;
     } else {
-      fscanf(fp, "%lld", &key);
+      p = parse_line(p, arg->fend, out++);
     }
+  }
 
-    if (warn && key < 0) {
-      warn = 0;
-      printf("[WARN ] key=%d, payload=%d\n", key, payload);
+  return 0;
+}
+
+/**
+ * Reads a text relation in parallel. The file is mapped and cut into
+ * nthreads byte ranges that are moved forward to the next line start. Every
+ * thread counts its lines, then parses them into its own slice of the
+ * tuples, which it touches first. A first line that does not start with a
+ * number is skipped as header. The number of tuples is taken from the file.
+ */
+void read_relation(relation_t *rel, char *filename) {
+  struct stat st;
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st)) {
+    perror("[ERROR] read_relation() can not open the file");
+    exit(EXIT_FAILURE);
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    rel->num_tuples = 0;
+    rel->tuples = (tuple_t *)MALLOC(0);
+    return;
+  }
+  const char *data =
+      (const char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    perror("[ERROR] read_relation() mmap failed");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+
+  const char *fend = data + st.st_size, *begin = data;
+  /* skip the header line */
+  if (begin < fend && *begin != '-' && (unsigned)(*begin - '0') > 9) {
+    begin = (const char *)memchr(begin, '\n', fend - begin);
+    begin = begin ? begin + 1 : fend;
+  }
+
+  int nthr = nthreads > 0 ? nthreads : 1;
+  text_load_arg_t args[nthr];
+  uint64_t counts[nthr];
+  pthread_t tid[nthr];
+  pthread_attr_t attr;
+  pthread_barrier_t barrier;
+  cpu_set_t set;
+  uint64_t chunk = (fend - begin) / nthr;
+  int rv;
+
+  pthread_barrier_init(&barrier, NULL, nthr);
+  pthread_attr_init(&attr);
+  for (int i = 0; i < nthr; i++) {
+    const char *b = begin + chunk * i;
+    /* a range starts at the first line beginning at or after its offset */
+    if (b > begin && b[-1] != '\n') {
+      b = (const char *)memchr(b, '\n', fend - b);
+      b = b ? b + 1 : fend;
+    }
+    args[i].tid = i;
+    args[i].begin = b;
+    args[i].fend = fend;
+    args[i].counts = counts;
+    args[i].rel = rel;
+    args[i].nthreads = nthr;
+    args[i].barrier = &barrier;
+    if (i > 0) {
+      args[i - 1].end = b;
     }
-    rel->tuples[i].key = key;
-    rel->tuples[i].payload = payload;
   }
+  args[nthr - 1].end = fend;
 
-  fclose(fp);
+  for (int i = 0; i < nthr; i++) {
+    int cpu_idx = get_cpu_id(i);
+    CPU_ZERO(&set);
+    CPU_SET(cpu_idx, &set);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+    rv = pthread_create(&tid[i], &attr, text_load_thread, (void *)&args[i]);
+    if (rv) {
+      fprintf(stderr, "[ERROR] pthread_create() return code is %d\n", rv);
+      exit(-1);
+    }
+  }
+  for (int i = 0; i < nthr; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  pthread_barrier_destroy(&barrier);
+  munmap((void *)data, st.st_size);
 }
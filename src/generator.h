@@ -60,6 +60,16 @@ int create_relation_fk_from_pk(relation_t *fkrel, relation_t *pkrel,
 int create_relation_zipf(relation_t *reln, int64_t ntuples, const int64_t maxid,
                          const double zipfparam);
 
+/**
+ * Parallel version of create_relation_zipf(): keys are distributed with zipf
+ * between [1, maxid], sampled by rejection-inversion without a lookup table.
+ * Each of the nthreads threads fills its own slice, the keys only depend on
+ * the seed and not on nthreads. See parallel_create_probe_relation().
+ */
+int parallel_create_relation_zipf(relation_t *reln, uint64_t ntuples,
+                                  uint32_t nthreads, uint64_t maxid,
+                                  double zipfparam);
+
 /**
  * Create relation with only primary keys (i.e. keys are unique from 1 to
  * maxid). Creation procedure is executed by
@@ -77,6 +87,66 @@ int parallel_create_relation(relation_t *reln, uint64_t ntuples,
 int parallel_create_relation_fk(relation_t *reln, int64_t ntuples,
                                 const int64_t maxid, uint32_t nthreads);
 
+/** key orders of the parallel_create_*_relation() generators */
+#define GEN_SHUFFLED 0  /* random permutation of all tuples */
+#define GEN_SORTED 1    /* ascending keys within the slice of every thread */
+#define GEN_CLUSTERED 2 /* sorted runs of run_length tuples in random order */
+
+/** distributions of the number of build tuples per key, all with mean dup */
+#define GEN_DUP_CONST 0     /* every key dup times */
+#define GEN_DUP_UNIFORM 1   /* uniform in [1, 2 dup - 1] */
+#define GEN_DUP_GEOMETRIC 2 /* geometric with p = 1 / dup */
+
+/**
+ * Parameters of the generators parallel_create_build_relation() and
+ * parallel_create_probe_relation(). Keys are made from ids: id i becomes
+ * key i if key_gap is 1, otherwise a key in ((i - 1) key_gap, i key_gap]
+ * chosen by a hash of i, so that the keys are sparse and their low bits
+ * irregular. The mapping only depends on the id, build and probe keys with the
+ * same id match.
+ */
+typedef struct gen_params_t {
+  int order;           /* GEN_SHUFFLED, GEN_SORTED or GEN_CLUSTERED */
+  uint64_t run_length; /* tuples per run of GEN_CLUSTERED */
+  uint64_t key_gap;    /* distance of the keys of neighbouring ids */
+  uint32_t dup;        /* mean build tuples per key */
+  int dup_dist;        /* GEN_DUP_* */
+  uint64_t hot_keys;   /* probe: number of heavy hitters */
+  double hot_fraction; /* probe: fraction of tuples on the heavy hitters */
+  double selectivity;  /* probe: fraction of tuples that have a match */
+  double skew;         /* probe: zipf exponent of the ids, 0 for uniform */
+} gen_params_t;
+
+/** the defaults: shuffled dense unique keys, all probe tuples match */
+void gen_params_init(gen_params_t *p);
+
+/** number of distinct keys of a build relation of ntuples tuples */
+uint64_t gen_build_keys(uint64_t ntuples, const gen_params_t *p);
+
+/**
+ * Create a build relation of ntuples tuples over the gen_build_keys() ids
+ * 1..maxid. Every id has a number of tuples drawn from p->dup_dist, the
+ * relation is cut, or filled up with uniformly chosen ids, to exactly ntuples
+ * tuples. Executed by nthreads pinned threads, each initializing its own
+ * slice of the relation.
+ */
+int parallel_create_build_relation(relation_t *reln, uint64_t ntuples,
+                                   uint32_t nthreads, const gen_params_t *p);
+
+/**
+ * Create a probe relation of ntuples tuples for a build relation over ids
+ * 1..maxid. A tuple takes one of p->hot_keys evenly spaced heavy hitters with
+ * probability p->hot_fraction, and otherwise a uniform id, or a zipf
+ * distributed one if p->skew > 0. Only a fraction p->selectivity of the tuples
+ * keeps its id, the others are moved to an id above maxid that has no match.
+ * Executed by nthreads pinned threads, each initializing its own slice of the
+ * relation. The random numbers are drawn per tuple from the seed, the
+ * relation is the same for any nthreads unless its order is GEN_CLUSTERED.
+ */
+int parallel_create_probe_relation(relation_t *reln, uint64_t ntuples,
+                                   uint32_t nthreads, uint64_t maxid,
+                                   const gen_params_t *p);
+
 /**
  * Free memory allocated for only tuples.
  */
@@ -96,6 +166,42 @@ void write_relation(relation_t *rel, char *filename);
 /** Load a relation from given file name */
 int load_relation(relation_t *relation, char *filename, uint64_t num_tuples);
 
+/** "RELATION" in little-endian, first word of a binary relation file */
+#define RELATION_FILE_MAGIC 0x4E4F4954414C4552ULL
+#define RELATION_FILE_VERSION 1
+/** tuples start at this offset, so that they are page aligned when mapped */
+#define RELATION_FILE_HEADER_SIZE 4096
+
+/** flags of relation_header_t */
+#define RELATION_SORTED 0x1 /* keys are non-decreasing */
+#define RELATION_UNIQUE 0x2 /* keys are proven to be unique */
+
+/**
+ * Header of the binary relation file written by write_relation(). It is
+ * followed by num_tuples tuple_t's at RELATION_FILE_HEADER_SIZE, laid out
+ * exactly as in memory so that the loader can map them without a copy.
+ */
+typedef struct relation_header_t {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t num_tuples;
+  uint32_t key_width;     /* sizeof(intkey_t) of the writer */
+  uint32_t payload_width; /* sizeof(value_t) of the writer */
+  uint32_t flags;
+  uint32_t reserved;
+  int64_t min_key;
+  int64_t max_key;
+} relation_header_t;
+
+/**
+ * Maps a binary relation file into memory. With numalocalize set, the pages
+ * are touched in parallel by the threads that will use them, otherwise they
+ * are read in with MAP_POPULATE. Files without a header (written by earlier
+ * versions) are read with fread() instead.
+ */
+void read_relation_binary(relation_t *rel, char *filename);
+
 /** @} */
 
 #endif /* GENERATOR_H */
@@ -156,3 +156,74 @@ gen_zipf (unsigned int stream_size,
 
     return ret;
 }
+
+/** log1p(x) / x, also near 0 */
+static double
+zipf_helper1 (double x)
+{
+    if (fabs (x) > 1e-8)
+        return log1p (x) / x;
+    return 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+/** expm1(x) / x, also near 0 */
+static double
+zipf_helper2 (double x)
+{
+    if (fabs (x) > 1e-8)
+        return expm1 (x) / x;
+    return 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+}
+
+/** H(x) = (x^(1-s) - 1) / (1 - s), the integral of the hat function */
+static double
+zipf_h_integral (const zipf_sampler_t *z, double x)
+{
+    double log_x = log (x);
+    return zipf_helper2 ((1.0 - z->s) * log_x) * log_x;
+}
+
+/** h(x) = x^-s, the hat function */
+static double
+zipf_h (const zipf_sampler_t *z, double x)
+{
+    return exp (-z->s * log (x));
+}
+
+static double
+zipf_h_integral_inverse (const zipf_sampler_t *z, double x)
+{
+    double t = x * (1.0 - z->s);
+    if (t < -1.0)
+        t = -1.0;   /* rounding errors */
+    return exp (zipf_helper1 (t) * x);
+}
+
+void
+zipf_sampler_init (zipf_sampler_t *z, uint64_t n, double s)
+{
+    z->n = n;
+    z->s = s;
+    z->h_integral_x1 = zipf_h_integral (z, 1.5) - 1.0;
+    z->h_integral_n  = zipf_h_integral (z, n + 0.5);
+    z->sc = 2.0 - zipf_h_integral_inverse (z, zipf_h_integral (z, 2.5)
+                                              - zipf_h (z, 2.0));
+}
+
+int
+zipf_try (const zipf_sampler_t *z, double u, uint64_t *rank)
+{
+    double hu = z->h_integral_n + u * (z->h_integral_x1 - z->h_integral_n);
+    double x  = zipf_h_integral_inverse (z, hu);
+    uint64_t k;
+
+    if (x < 1.5)
+        k = 1;
+    else if (x + 0.5 >= (double) z->n)
+        k = z->n;
+    else
+        k = (uint64_t) (x + 0.5);
+
+    *rank = k;
+    return k - x <= z->sc || hu >= zipf_h_integral (z, k + 0.5) - zipf_h (z, k);
+}
@@ -23,4 +23,27 @@ item_t * gen_zipf (unsigned int stream_size,
                    double zipf_factor,
                    item_t ** output);
 
+/**
+ * Sampler of Zipf-distributed ranks 1..n with exponent s > 0 by
+ * rejection-inversion (Hoermann and Derflinger, ACM TOMACS 1996). It needs
+ * no lookup table and O(1) time per rank, so every thread can sample its
+ * part of a relation on its own.
+ */
+typedef struct zipf_sampler_t {
+    uint64_t n;
+    double   s;
+    double   h_integral_x1;
+    double   h_integral_n;
+    double   sc;
+} zipf_sampler_t;
+
+void zipf_sampler_init (zipf_sampler_t *z, uint64_t n, double s);
+
+/**
+ * One rejection-inversion step with the uniform number u in [0, 1).
+ * Returns 1 and the rank in @a rank if u is accepted, 0 if another
+ * u has to be tried. Less than 1.1 steps are needed on average.
+ */
+int zipf_try (const zipf_sampler_t *z, double u, uint64_t *rank);
+
 #endif  /* GENZIPF_H */
@@ -0,0 +1,177 @@
+/**
+ * @file    hash_functions.c
+ *
+ * @brief  Selection of the join hash function and the HASH benchmark, which
+ *         measures the cost of every hash function on the keys of S.
+ */
+#include "no_partitioning_join.h" /* BARRIER_ARRIVE, result_t, alloc_aligned */
+#include "hash_functions.h"
+
+#include <inttypes.h>
+
+int hash_fn = HASH_FN_MODULO;
+
+const char *hash_fn_names[HASH_FN_NUM] = {"modulo", "mult", "crc32c",
+                                          "murmur"};
+
+int parse_hash_fn(const char *name) {
+  for (int i = 0; i < HASH_FN_NUM; i++) {
+    if (strcmp(name, hash_fn_names[i]) == 0) return i;
+  }
+  return -1;
+}
+
+typedef struct hashbench_arg_t hashbench_arg_t;
+
+/** arguments of the HASH benchmark threads */
+struct hashbench_arg_t {
+  int32_t tid;
+  relation_t relS;
+  pthread_barrier_t *barrier;
+  /* sum of the checksums, keeps the compiler from dropping the loops */
+  uint64_t sink;
+};
+
+static uint64_t hash_rel_scalar(relation_t *rel, int fn) {
+  uint64_t sink = 0;
+  for (uint64_t i = 0; i < rel->num_tuples; ++i) {
+    sink += hash_key(rel->tuples[i].key, fn);
+  }
+  return sink;
+}
+
+/** the keys are loaded the same way as in the SIMD probes */
+static uint64_t hash_rel_simd(relation_t *rel, int fn) {
+  __m512i v_key, v_sink = _mm512_set1_epi64(0);
+  uint64_t sink = 0, lanes[VECTOR_SCALE];
+  uint64_t i = 0;
+#ifdef KEY_8B
+  uint64_t base_off[VECTOR_SCALE];
+  for (int j = 0; j < VECTOR_SCALE; ++j) {
+    base_off[j] = j * sizeof(tuple_t);
+  }
+  __m512i v_base_offset = _mm512_loadu_si512(base_off);
+#endif
+
+  for (; i + VECTOR_SCALE <= rel->num_tuples; i += VECTOR_SCALE) {
+#ifdef KEY_8B
+    v_key = _mm512_i64gather_epi64(v_base_offset, (void *)(rel->tuples + i), 1);
+#else
+    v_key = _mm512_loadu_si512(rel->tuples + i);
+    v_key = _mm512_srai_epi64(_mm512_slli_epi64(v_key, 32), 32);
+#endif
+    v_sink = _mm512_add_epi64(v_sink, hash_key_simd(v_key, fn));
+  }
+  _mm512_storeu_si512(lanes, v_sink);
+  for (int j = 0; j < VECTOR_SCALE; ++j) sink += lanes[j];
+  for (; i < rel->num_tuples; ++i) {
+    sink += hash_key(rel->tuples[i].key, fn);
+  }
+  return sink;
+}
+
+void *hashbench_thread(void *param) {
+  hashbench_arg_t *args = (hashbench_arg_t *)param;
+  struct timeval t1, t2;
+  result_timer_t rt;
+  char name[32];
+  uint64_t checksum, expected = 0;
+  int rv;
+
+  for (int fn = 0; fn < HASH_FN_NUM; ++fn) {
+    for (int simd = 0; simd < 2; ++simd) {
+      snprintf(name, sizeof(name), "%s%s", simd ? "SIMD " : "",
+               hash_fn_names[fn]);
+      for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
+        BARRIER_ARRIVE(args->barrier, rv);
+        gettimeofday(&t1, NULL);
+        results_start(&rt);
+        checksum = simd ? hash_rel_simd(&args->relS, fn)
+                        : hash_rel_scalar(&args->relS, fn);
+        results_thread("hash", name, args->tid, &rt, args->relS.num_tuples,
+                       0);
+        /* the sum of all hashes, the same for the scalar and SIMD kernels */
+        if (!simd) {
+          expected = checksum;
+        } else if (checksum != expected) {
+          printf("[ERROR] %s hash differs from the scalar one on thread %d\n",
+                 name, args->tid);
+        }
+        args->sink += checksum;
+        BARRIER_ARRIVE(args->barrier, rv);
+        if (args->tid == 0) {
+          gettimeofday(&t2, NULL);
+          results_total("hash", name, &rt, 0);
+          printf("---- %s hash costs time (ms) = %lf\n", name,
+                 ((t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec -
+                  t1.tv_usec) * 1.0 / 1000);
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+result_t *HASHBENCH(relation_t *relR, relation_t *relS, int nthreads) {
+  int32_t numS, numSthr; /* total and per thread num */
+  int i, rv;
+  cpu_set_t set;
+  hashbench_arg_t args[nthreads];
+  pthread_t tid[nthreads];
+  pthread_attr_t attr;
+  pthread_barrier_t barrier;
+  uint64_t sink = 0;
+
+  result_t *joinresult = 0;
+  joinresult = (result_t *)malloc(sizeof(result_t));
+
+#ifdef JOIN_RESULT_MATERIALIZE
+  joinresult->resultlist =
+      (threadresult_t *)alloc_aligned(sizeof(threadresult_t) * nthreads);
+#endif
+
+  numS = relS->num_tuples;
+  numSthr = numS / nthreads;
+
+  rv = pthread_barrier_init(&barrier, NULL, nthreads);
+  if (rv != 0) {
+    printf("Couldn't create the barrier\n");
+    exit(EXIT_FAILURE);
+  }
+
+  pthread_attr_init(&attr);
+  for (i = 0; i < nthreads; i++) {
+    int cpu_idx = get_cpu_id(i);
+
+    DEBUGMSG(1, "Assigning thread-%d to CPU-%d\n", i, cpu_idx);
+
+#if AFFINITY
+    CPU_ZERO(&set);
+    CPU_SET(cpu_idx, &set);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+#endif
+    args[i].tid = i;
+    args[i].barrier = &barrier;
+    args[i].sink = 0;
+    args[i].relS.num_tuples = (i == (nthreads - 1)) ? numS : numSthr;
+    args[i].relS.tuples = relS->tuples + numSthr * i;
+    numS -= numSthr;
+
+    rv = pthread_create(&tid[i], &attr, hashbench_thread, (void *)&args[i]);
+    if (rv) {
+      printf("ERROR; return code from pthread_create() is %d\n", rv);
+      exit(-1);
+    }
+  }
+
+  for (i = 0; i < nthreads; i++) {
+    pthread_join(tid[i], NULL);
+    sink += args[i].sink;
+  }
+  printf("hash checksum = %" PRIx64 "\n", sink);
+  /* no results, the benchmark only hashes */
+  joinresult->totalresults = 0;
+  joinresult->nthreads = nthreads;
+
+  return joinresult;
+}
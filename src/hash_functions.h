@@ -0,0 +1,137 @@
+/**
+ * @file    hash_functions.h
+ *
+ * @brief  Hash functions applied to the join keys before the bucket and
+ *         partition bits are taken, with matching scalar and AVX-512 versions.
+ *
+ * The bucket of a key used to be its low bits, HASH(X, MASK, SKIP) =
+ * (X & MASK) >> SKIP. That spreads the dense generated keys perfectly but
+ * piles up real keys whose low bits follow a pattern. The key can now be
+ * hashed first, the function is chosen at runtime with --hash:
+ *  - modulo   HASH_FN_MODULO, the key itself, the former behaviour [default]
+ *  - mult     HASH_FN_MULT, multiply-shift, the upper half of x * HASH_MULT_A
+ *  - crc32c   HASH_FN_CRC32C, CRC32C of the 8 bytes of the key. AVX-512 has no
+ *             CRC instruction, the vector version runs crc32 lane by lane
+ *  - murmur   HASH_FN_MURMUR, the 64-bit finalizer (fmix64) of MurmurHash3
+ * A key hashes to the same value through hash_key() and hash_key_simd(), so
+ * scalar builds and vectorized probes (or the other way round) agree.
+ *
+ * The header is C++-compatible and is also used by the HashFunction classes
+ * of wisconsin-src. Without AVX-512 only the scalar functions are defined,
+ * without SSE4.2 CRC32C is computed bitwise.
+ */
+#ifndef HASH_FUNCTIONS_H
+#define HASH_FUNCTIONS_H
+
+#include <stdint.h> /* uint64_t */
+#if defined(__SSE4_2__) || defined(__AVX512F__)
+#include <immintrin.h> /* _mm_crc32_u64, __m512i */
+#endif
+
+#define HASH_FN_MODULO 0
+#define HASH_FN_MULT 1
+#define HASH_FN_CRC32C 2
+#define HASH_FN_MURMUR 3
+#define HASH_FN_NUM 4
+
+/** odd multiplier of multiply-shift, 2^64 / golden ratio */
+#define HASH_MULT_A 0x9E3779B97F4A7C15ULL
+/** initial value of the CRC32C */
+#define HASH_CRC32C_SEED 0xFFFFFFFFU
+
+static inline uint64_t hash_mult(uint64_t x) { return (x * HASH_MULT_A) >> 32; }
+
+static inline uint64_t hash_crc32c(uint64_t x) {
+#ifdef __SSE4_2__
+  return _mm_crc32_u64(HASH_CRC32C_SEED, x);
+#else
+  /* bitwise CRC32C (Castagnoli, reflected polynomial 0x82F63B78) */
+  uint32_t crc = HASH_CRC32C_SEED;
+  for (int i = 0; i < 64; i++, x >>= 1) {
+    crc = (crc >> 1) ^ (0x82F63B78U & (0U - ((crc ^ (uint32_t)x) & 1)));
+  }
+  return crc;
+#endif
+}
+
+static inline uint64_t hash_murmur(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+/** hashes key x with function fn, one of HASH_FN_* */
+static inline uint64_t hash_key(uint64_t x, int fn) {
+  switch (fn) {
+    case HASH_FN_MULT:
+      return hash_mult(x);
+    case HASH_FN_CRC32C:
+      return hash_crc32c(x);
+    case HASH_FN_MURMUR:
+      return hash_murmur(x);
+    default:
+      return x;
+  }
+}
+
+#ifdef __AVX512F__
+/** 64-bit lane multiply, lane by lane without AVX512DQ (KNL) */
+static inline __m512i hash_mullo_simd(__m512i x, uint64_t c) {
+#ifdef __AVX512DQ__
+  return _mm512_mullo_epi64(x, _mm512_set1_epi64(c));
+#else
+  __attribute__((aligned(64))) uint64_t lanes[8];
+  _mm512_store_epi64(lanes, x);
+  for (int i = 0; i < 8; i++) lanes[i] *= c;
+  return _mm512_load_epi64(lanes);
+#endif
+}
+
+static inline __m512i hash_mult_simd(__m512i x) {
+  return _mm512_srli_epi64(hash_mullo_simd(x, HASH_MULT_A), 32);
+}
+
+static inline __m512i hash_crc32c_simd(__m512i x) {
+  __attribute__((aligned(64))) uint64_t lanes[8];
+  _mm512_store_epi64(lanes, x);
+  for (int i = 0; i < 8; i++) lanes[i] = hash_crc32c(lanes[i]);
+  return _mm512_load_epi64(lanes);
+}
+
+static inline __m512i hash_murmur_simd(__m512i x) {
+  x = _mm512_xor_epi64(x, _mm512_srli_epi64(x, 33));
+  x = hash_mullo_simd(x, 0xff51afd7ed558ccdULL);
+  x = _mm512_xor_epi64(x, _mm512_srli_epi64(x, 33));
+  x = hash_mullo_simd(x, 0xc4ceb9fe1a85ec53ULL);
+  x = _mm512_xor_epi64(x, _mm512_srli_epi64(x, 33));
+  return x;
+}
+
+/** hashes the 8 keys of x with function fn, lane i equals hash_key(x[i]) */
+static inline __m512i hash_key_simd(__m512i x, int fn) {
+  switch (fn) {
+    case HASH_FN_MULT:
+      return hash_mult_simd(x);
+    case HASH_FN_CRC32C:
+      return hash_crc32c_simd(x);
+    case HASH_FN_MURMUR:
+      return hash_murmur_simd(x);
+    default:
+      return x;
+  }
+}
+#endif /* __AVX512F__ */
+
+/** the hash function of the joins, HASH_FN_MODULO unless --hash is given */
+extern int hash_fn;
+
+/** names of the HASH_FN_* for --hash and the reports */
+extern const char *hash_fn_names[HASH_FN_NUM];
+
+/** returns the HASH_FN_* called name, -1 if there is none */
+int parse_hash_fn(const char *name);
+
+#endif /* HASH_FUNCTIONS_H */
@@ -24,6 +24,8 @@ Hardware
  *  - PRHO:   Parallel Radix Join Histogram-based Optimized
  *  - RJ:     Radix Join (single-threaded)
  *  - NPO_st: No Partitioning Join Optimized (single-threaded)
+ *  - AGG:    Parallel hash group-by (COUNT, SUM, MIN, MAX) of S on key
+ *  - HASH:   Cost of each hash function of --hash on the keys of S
  *
  * @section compilation Compilation
  *
@@ -44,6 +46,11 @@ Hardware
    --enable-debug         enable debug messages on commandline  [default=no]
    --enable-key8B         use 8B keys and values making tuples 16B  [default=no]
    --enable-perfcounters  enable performance monitoring with Intel PCM  [no]
+   --enable-perfevent     enable per-thread performance monitoring with Linux
+                          perf_event_open, no MSR access needed  [no]
+   --enable-probestats    enable rdtscp latency histograms, chain lengths, lane
+                          utilization and in-flight lookups of the GP, AMAC
+                          and SIMD probe kernels, see probe_stats.h  [no]
    --enable-paddedbucket  enable padding of buckets to cache line size in NPO
 [no]
    --enable-timing        enable execution timing  [default=yes]
@@ -79,6 +86,13 @@ handling in radix [default=no]
  * --enable-perfcounters the code is compiled with g++ since Intel
  * code is written in C++.
  *
+ * Alternatively, <tt>--enable-perfevent</tt> uses the Linux perf_event_open
+ * interface, which needs neither the library nor MSR access, only a
+ * sufficiently low <tt>/proc/sys/kernel/perf_event_paranoid</tt>. Every
+ * thread is then counted separately and the counters are attributed to the
+ * build, partitioning, probe and materialization phases, summarized at the
+ * end of the run.
+ *
  * We have successfully compiled and run our code on different Linux
  * variants; the experiments in the paper were performed on Debian and Ubuntu
  * Linux systems.
@@ -88,7 +102,8 @@ handling in radix [default=no]
  * The <tt>mchashjoins</tt> binary understands the following command line
  * options:
  * @verbatim
-      Join algorithm selection, algorithms : RJ, PRO, PRH, PRHO, NPO, NPO_st
+      Join algorithm selection, algorithms : RJ, PRO, PRH, PRHO, NPO, NPO_st, AGG,
+                                             HASH
          -a --algo=<name>    Run the hash join algorithm named <name> [PRO]
 
       Other join configuration options, with default values in [] :
@@ -102,9 +117,40 @@ handling in radix [default=no]
          --non-unique       Use non-unique (duplicated) keys in input relations
          --full-range       Spread keys in relns. in full 32-bit integer range
          --basic-numa       Numa-localize relations to threads (Experimental)
-
-      Performance profiling options, when compiled with --enable-perfcounters.
-         -p --perfconf=<P>  Intel PCM config file with upto 4 counters [none]
+         --placement=<P>    Pin threads compact, scatter or core (physical cores
+                            first) over the discovered topology [core]
+         --results=<F>      Write the configuration, per-phase and per-thread
+                            timings and counters to <F>, as CSV if it ends in
+                            .csv and as JSON otherwise [none]
+         --sweep=<C>        Run the parameter sweep over the NPO probe kernels
+                            described by the JSON file <C>, see sweep.h [none]
+         --bucket-size=<B>  Tuples per bucket of the NPO hashtable, 1, 2, 4 or
+                            8. Larger buckets shorten the chains of duplicate
+                            keys and run the multi-slot probe kernels [1]
+         --hash=<H>         Hash applied to the keys before the hashtable and
+                            radix bits are taken: modulo (the key itself),
+                            mult (multiply-shift), crc32c or murmur [modulo]
+
+      Key distribution options of generated relations (not with --non-unique
+      or --full-range), see generator.h. Skewed relations are generated in
+      parallel as well, and only depend on their seed.
+         --r-order=<O>      Order of R: shuffled, sorted or clustered (sorted
+                            runs in random order) [shuffled]
+         --s-order=<O>      Order of S, as --r-order [shuffled]
+         --run-length=<L>   Tuples per run of the clustered order [1024]
+         --key-gap=<G>      Spread the keys of R and S over a G times larger
+                            domain, with irregular gaps [1]
+         --r-dup=<M>        Mean number of R tuples per key [1]
+         --dup-dist=<D>     Distribution of the R tuples per key: const,
+                            uniform or geometric [const]
+         --heavy-hitters=<H> Number of heavy hitter keys in S [0]
+         --heavy-fraction=<F> Fraction of S on the heavy hitters [0.0]
+         --selectivity=<F>  Fraction of S that has a match in R [1.0]
+
+      Performance profiling options, when compiled with --enable-perfcounters
+      or --enable-perfevent.
+         -p --perfconf=<P>  Counter config file, lines of <name> <event> <umask>
+                            [none]
          -o --perfout=<O>   Output file to print performance counters [stdout]
 
       Basic user options
@@ -161,7 +207,11 @@ cpu-mapping.txt
  * degree. For instance #CACHE_LINE_SIZE is required by both of the
  * implementations. In case of no partitioning join, other implementation
  * parameters such as bucket size or whether to pre-allocate for overflowing
- * buckets are parametrized and can be modified in `npj_params.h'.
+ * buckets are parametrized and can be modified in `npj_params.h'. NPO sizes
+ * its hashtable from the distinct keys of R, estimated from a sample of
+ * #DISTINCT_SAMPLE_SIZE tuples, and the bucket size can also be chosen at
+ * runtime with --bucket-size. The hash function of both the hashtable and the
+ * radix partitioning is chosen with --hash, see hash_functions.h.
  *
  * On the other hand, radix joins are more sensitive to system parameters and
  * the optimal setting of parameters should be found from machine to machine to
@@ -218,6 +268,16 @@ cpu-mapping.txt
  *
  * @verbatim
      $ ./mchashjoins [other options] --skew=1.05
+@endverbatim
+ *
+ * Skewed relations are generated by all threads in parallel, with the same
+ * keys for any number of threads. The key distribution options generate
+ * relations that look less like a dense primary/foreign key join, e.g. sparse 64-bit keys, 4 build
+ * tuples per key, 10% of S on 100 heavy hitters and half of S unmatched:
+ *
+ * @verbatim
+     $ ./mchashjoins [other options] --key-gap=1000 --r-dup=4 \
+         --heavy-hitters=100 --heavy-fraction=0.1 --selectivity=0.5
 @endverbatim
  *
  * @section wisconsin Wisconsin Implementation
@@ -253,6 +313,9 @@ cpu-mapping.txt
 #include "parallel_radix_join.h"  /* parallel radix joins: RJ, PRO, PRH, PRHO \
                                      */
 #include "generator.h"            /* create_relation_xk */
+#include "cpu_mapping.h"          /* set_cpu_placement */
+#include "results.h"              /* results_write */
+#include "sweep.h"                /* sweep_run */
 
 #include "perf_counters.h" /* PCM_x */
 #include "affinity.h"      /* pthread_attr_setaffinity_np & sched_setaffinity */
@@ -292,6 +355,17 @@ struct param_t {
   /** if the relations are load from file */
   char *loadfileR;
   char *loadfileS;
+  /** thread placement policy, NULL if not given */
+  char *placement;
+  /** file for the machine-readable results, NULL if not requested */
+  char *results;
+  /** sweep config, NULL if no sweep is run */
+  char *sweep;
+  /** key distribution of generated relations, used if gen is set */
+  gen_params_t gen;
+  int r_order;
+  int s_order;
+  int use_gen;
 };
 
 extern char *optarg;
@@ -309,6 +383,8 @@ static struct algo_t algos[] = {{"PRO", PRO},
                                 {"NPO", NPO},
                                 {"PIPELINE", PIPELINE},
                                 {"BTS", BTS},
+                                {"AGG", AGG}, /* group-by on S, not a join */
+                                {"HASH", HASHBENCH}, /* hash cost on S */
                                 {"NPO_st", NPO_st}, /* NPO single threaded */
                                 {"GEN", NPO},
                                 {{0}, 0}};
@@ -319,6 +395,7 @@ void print_help();
 void print_version();
 
 void parse_args(int argc, char **argv, param_t *cmd_params);
+void write_results(param_t *cmd_params);
 
 int main(int argc, char **argv) {
   relation_t relR;
@@ -354,6 +431,13 @@ int main(int argc, char **argv) {
   cmd_params.basic_numa = 0;
   cmd_params.loadfileR = NULL;
   cmd_params.loadfileS = NULL;
+  cmd_params.placement = NULL;
+  cmd_params.results = NULL;
+  cmd_params.sweep = NULL;
+  gen_params_init(&cmd_params.gen);
+  cmd_params.r_order = GEN_SHUFFLED;
+  cmd_params.s_order = GEN_SHUFFLED;
+  cmd_params.use_gen = 0;
 
   parse_args(argc, argv, &cmd_params);
 
@@ -362,6 +446,13 @@ int main(int argc, char **argv) {
   PCM_OUT = cmd_params.perfout;
 #endif
 
+  if (cmd_params.sweep != NULL) {
+    /* generates its own relations */
+    numalocalize = cmd_params.basic_numa;
+    sweep_run(cmd_params.sweep, cmd_params.results);
+    return 0;
+  }
+
   /* create relation R */
   fprintf(stdout,
           "[INFO ] %s relation R with size = %.3lf MiB, #tuples = %llu, skew = "
@@ -386,9 +477,18 @@ int main(int argc, char **argv) {
     create_relation_nonunique(&relR, cmd_params.r_size, cmd_params.r_size);
   } else {
     if (cmd_params.r_skew > 0) {
-      /* S is skewed */
-      create_relation_zipf(&relR, cmd_params.r_size, cmd_params.r_size,
-                           cmd_params.r_skew);
+      /* R is skewed, drawn like a probe relation without misses */
+      gen_params_t p = cmd_params.gen;
+      p.order = cmd_params.r_order;
+      p.hot_keys = 0;
+      p.selectivity = 1.0;
+      p.skew = cmd_params.r_skew;
+      parallel_create_probe_relation(&relR, cmd_params.r_size, nthreads,
+                                     cmd_params.r_size, &p);
+    } else if (cmd_params.use_gen) {
+      cmd_params.gen.order = cmd_params.r_order;
+      parallel_create_build_relation(&relR, cmd_params.r_size, nthreads,
+                                     &cmd_params.gen);
     } else {
       // create_relation_pk(&relR, cmd_params.r_size);
       parallel_create_relation(&relR, cmd_params.r_size, nthreads,
@@ -419,10 +519,16 @@ int main(int argc, char **argv) {
   } else {
     /* if r_size == s_size then equal-dataset, else non-equal dataset */
 
-    if (cmd_params.s_skew > 0) {
-      /* S is skewed */
-      create_relation_zipf(&relS, cmd_params.s_size, cmd_params.r_size,
-                           cmd_params.s_skew);
+    if (cmd_params.s_skew > 0 || cmd_params.use_gen) {
+      /* S is skewed or follows the key distribution options */
+      cmd_params.gen.order = cmd_params.s_order;
+      cmd_params.gen.skew = cmd_params.s_skew;
+      parallel_create_probe_relation(
+          &relS, cmd_params.s_size, nthreads,
+          cmd_params.r_skew > 0
+              ? cmd_params.r_size
+              : gen_build_keys(cmd_params.r_size, &cmd_params.gen),
+          &cmd_params.gen);
     } else {
       /* S is uniform foreign key */
       // create_relation_fk(&relS, cmd_params.s_size, cmd_params.r_size);
@@ -487,8 +593,26 @@ int main(int argc, char **argv) {
 
 #if (defined(PERSIST_RELATIONS) && defined(JOIN_RESULT_MATERIALIZE))
     printf("[INFO ] Persisting the join result to \"Out.tbl\" ...\n");
+#ifdef PERF_COUNTERS
+    PCM_initPerformanceMonitor(NULL, NULL);
+    PCM_start();
+#endif
     write_result_relation(results, "Out.tbl");
+#ifdef PERF_COUNTERS
+    PCM_stop();
+    PCM_accumulatePhase(PCM_PHASE_MATERIALIZE);
+    PCM_cleanup();
+#endif
+#endif
+#ifdef PERF_COUNTERS
+    PCM_printPhases();
 #endif
+#ifdef PROBE_STATS
+    probe_stats_print();
+#endif
+    if (cmd_params.results != NULL) {
+      write_results(&cmd_params);
+    }
     free(results);
 #ifdef JOIN_RESULT_MATERIALIZE
     free(results->resultlist);
@@ -506,7 +630,8 @@ void print_help(char *progname) {
 
   printf(
       "\
-    Join algorithm selection, algorithms : RJ, PRO, PRH, PRHO, NPO, NPO_st    \n\
+    Join algorithm selection, algorithms : RJ, PRO, PRH, PRHO, NPO, NPO_st, AGG,  \n\
+                                             HASH                             \n\
        -a --algo=<name>    Run the hash join algorithm named <name> [PRO]     \n\
                                                                               \n\
     Other join configuration options, with default values in [] :             \n\
@@ -522,9 +647,25 @@ void print_help(char *progname) {
        --non-unique       Use non-unique (duplicated) keys in input relations \n\
        --full-range       Spread keys in relns. in full 32-bit integer range  \n\
        --basic-numa       Numa-localize relations to threads (Experimental)   \n\
+       --placement=<P>    Thread pinning: compact, scatter or core [core]     \n\
+       --results=<F>      Write results as JSON, or CSV if <F> is *.csv       \n\
+       --sweep=<C>        Run the probe kernel sweep of JSON config <C>       \n\
+       --bucket-size=<B>  Tuples per NPO hashtable bucket: 1, 2, 4 or 8 [1]   \n\
+       --hash=<H>         Key hash: modulo, mult, crc32c or murmur [modulo]   \n\
                                                                               \n\
-    Performance profiling options, when compiled with --enable-perfcounters.  \n\
-       -p --perfconf=<P>  Intel PCM config file with upto 4 counters [none]   \n\
+    Key distribution options of generated relations, see generator.h.        \n\
+       --r-order=<O>      R order: shuffled, sorted or clustered [shuffled]   \n\
+       --s-order=<O>      S order: shuffled, sorted or clustered [shuffled]   \n\
+       --run-length=<L>   Tuples per sorted run of clustered order [1024]     \n\
+       --key-gap=<G>      Spread keys over a G times larger domain [1]        \n\
+       --r-dup=<M>        Mean number of R tuples per key [1]                 \n\
+       --dup-dist=<D>     R tuples per key: const, uniform, geometric [const] \n\
+       --heavy-hitters=<H> Number of heavy hitter keys in S [0]               \n\
+       --heavy-fraction=<F> Fraction of S on the heavy hitters [0.0]          \n\
+       --selectivity=<F>  Fraction of S that has a match in R [1.0]           \n\
+                                                                              \n\
+    Performance profiling options, with --enable-perfcounters/perfevent.      \n\
+       -p --perfconf=<P>  Counter config file (name event umask) [none]       \n\
        -o --perfout=<O>   Output file to print performance counters [stdout]  \n\
                                                                               \n\
     Basic user options                                                        \n\
@@ -534,6 +675,61 @@ void print_help(char *progname) {
     \n");
 }
 
+/** names of the GEN_* key orders and multiplicity distributions */
+static const char *gen_order_names[] = {"shuffled", "sorted", "clustered"};
+static const char *gen_dup_names[] = {"const", "uniform", "geometric"};
+
+/** Writes the configuration and all recorded results to cmd_params->results */
+void write_results(param_t *cmd_params) {
+  results_config_str("algo", cmd_params->algo->name);
+  results_config_int("nthreads", cmd_params->nthreads);
+  results_config_int("r_size", cmd_params->r_size);
+  results_config_int("s_size", cmd_params->s_size);
+  results_config_int("r_seed", cmd_params->r_seed);
+  results_config_int("s_seed", cmd_params->s_seed);
+  results_config_double("r_skew", cmd_params->r_skew);
+  results_config_double("s_skew", cmd_params->s_skew);
+  results_config_str("r_file", cmd_params->loadfileR);
+  results_config_str("s_file", cmd_params->loadfileS);
+  results_config_int("non_unique", cmd_params->nonunique_keys);
+  results_config_int("full_range", cmd_params->fullrange_keys);
+  results_config_int("basic_numa", cmd_params->basic_numa);
+  results_config_str("placement", cmd_params->placement ? cmd_params->placement
+                                                        : "default");
+  results_config_int("tuple_size", sizeof(tuple_t));
+  results_config_int("repeat_probe", REPEAT_PROBE);
+  results_config_int("divide", DIVIDE);
+  results_config_int("scalar_state_size", ScalarStateSize);
+  results_config_int("simd_state_size", SIMDStateSize);
+  results_config_int("pdis", PDIS);
+  results_config_int("bucket_size", bucket_size);
+  results_config_str("hash", hash_fn_names[hash_fn]);
+  if (cmd_params->use_gen) {
+    results_config_str("r_order", gen_order_names[cmd_params->r_order]);
+    results_config_str("s_order", gen_order_names[cmd_params->s_order]);
+    results_config_int("run_length", cmd_params->gen.run_length);
+    results_config_int("key_gap", cmd_params->gen.key_gap);
+    results_config_int("r_dup", cmd_params->gen.dup);
+    results_config_str("dup_dist", gen_dup_names[cmd_params->gen.dup_dist]);
+    results_config_int("heavy_hitters", cmd_params->gen.hot_keys);
+    results_config_double("heavy_fraction", cmd_params->gen.hot_fraction);
+    results_config_double("selectivity", cmd_params->gen.selectivity);
+  }
+
+#ifdef PERF_COUNTERS
+  for (int p = 0; p < PCM_NUM_PHASES; p++) {
+    const char *names[16];
+    double values[16];
+    int n = PCM_getPhase(p, names, values, 16);
+    for (int i = 0; i < n; i++) {
+      results_counter(PCM_phaseName(p), names[i], values[i]);
+    }
+  }
+#endif
+  results_write(cmd_params->results);
+  printf("[INFO ] Results written to %s\n", cmd_params->results);
+}
+
 void print_version() {
   printf("\n%s\n", PACKAGE_STRING);
   printf("Copyright (c) 2012, 2013, ETH Zurich, Systems Group.\n");
@@ -548,6 +744,14 @@ static char *mystrdup(const char *s) {
   return ss;
 }
 
+/** index of name in names[0..n), -1 if it is not there */
+static int parse_name(const char *name, const char **names, int n) {
+  for (int i = 0; i < n; i++) {
+    if (strcmp(name, names[i]) == 0) return i;
+  }
+  return -1;
+}
+
 void parse_args(int argc, char **argv, param_t *cmd_params) {
   int c, i, found;
   /* Flag set by ‘--verbose’. */
@@ -580,11 +784,25 @@ void parse_args(int argc, char **argv, param_t *cmd_params) {
         {"s-skew", required_argument, 0, 'z'},
         {"r-file", required_argument, 0, 'R'},
         {"s-file", required_argument, 0, 'S'},
+        {"placement", required_argument, 0, 'P'},
+        {"results", required_argument, 0, 'J'},
+        {"sweep", required_argument, 0, 'W'},
+        {"bucket-size", required_argument, 0, 'B'},
+        {"hash", required_argument, 0, 'H'},
+        {"r-order", required_argument, 0, 'O'},
+        {"s-order", required_argument, 0, 'Q'},
+        {"run-length", required_argument, 0, 'L'},
+        {"key-gap", required_argument, 0, 'G'},
+        {"r-dup", required_argument, 0, 'D'},
+        {"dup-dist", required_argument, 0, 'M'},
+        {"heavy-hitters", required_argument, 0, 'K'},
+        {"heavy-fraction", required_argument, 0, 'F'},
+        {"selectivity", required_argument, 0, 'E'},
         {0, 0, 0, 0}};
     /* getopt_long stores the option index here. */
     int option_index = 0;
 
-    c = getopt_long(argc, argv, "a:n:p:r:s:o:x:y:t:z:R:S:hv", long_options,
+    c = getopt_long(argc, argv, "a:n:p:r:s:o:x:y:t:z:R:S:P:hv", long_options,
                     &option_index);
 
     /* Detect the end of the options. */
@@ -673,6 +891,96 @@ void parse_args(int argc, char **argv, param_t *cmd_params) {
         cmd_params->loadfileS = mystrdup(optarg);
         break;
 
+      case 'P':
+        i = parse_cpu_placement(optarg);
+        if (i < 0) {
+          printf("[ERROR] Placement policy `%s' does not exist!\n", optarg);
+          print_help(argv[0]);
+          exit(EXIT_SUCCESS);
+        }
+        set_cpu_placement(i);
+        cmd_params->placement = mystrdup(optarg);
+        break;
+
+      case 'J':
+        cmd_params->results = mystrdup(optarg);
+        break;
+
+      case 'W':
+        cmd_params->sweep = mystrdup(optarg);
+        break;
+
+      case 'B':
+        bucket_size = atoi(optarg);
+        if (bucket_size != 1 && bucket_size != 2 && bucket_size != 4 &&
+            bucket_size != MAX_BUCKET_SLOTS) {
+          printf("[ERROR] Bucket size must be 1, 2, 4 or 8, not `%s'!\n",
+                 optarg);
+          print_help(argv[0]);
+          exit(EXIT_SUCCESS);
+        }
+        break;
+
+      case 'H':
+        hash_fn = parse_hash_fn(optarg);
+        if (hash_fn < 0) {
+          printf("[ERROR] Unknown hash function `%s'!\n", optarg);
+          print_help(argv[0]);
+          exit(EXIT_SUCCESS);
+        }
+        break;
+
+      case 'O':
+      case 'Q':
+        i = parse_name(optarg, gen_order_names, 3);
+        if (i < 0) {
+          printf("[ERROR] Unknown key order `%s'!\n", optarg);
+          print_help(argv[0]);
+          exit(EXIT_SUCCESS);
+        }
+        *(c == 'O' ? &cmd_params->r_order : &cmd_params->s_order) = i;
+        if (i != GEN_SHUFFLED) cmd_params->use_gen = 1;
+        break;
+
+      case 'L':
+        cmd_params->gen.run_length = atoll(optarg);
+        break;
+
+      case 'G':
+        cmd_params->gen.key_gap = atoll(optarg);
+        if (cmd_params->gen.key_gap < 1) cmd_params->gen.key_gap = 1;
+        if (cmd_params->gen.key_gap > 1) cmd_params->use_gen = 1;
+        break;
+
+      case 'D':
+        cmd_params->gen.dup = atoi(optarg);
+        if (cmd_params->gen.dup < 1) cmd_params->gen.dup = 1;
+        if (cmd_params->gen.dup > 1) cmd_params->use_gen = 1;
+        break;
+
+      case 'M':
+        cmd_params->gen.dup_dist = parse_name(optarg, gen_dup_names, 3);
+        if (cmd_params->gen.dup_dist < 0) {
+          printf("[ERROR] Unknown multiplicity distribution `%s'!\n", optarg);
+          print_help(argv[0]);
+          exit(EXIT_SUCCESS);
+        }
+        break;
+
+      case 'K':
+        cmd_params->gen.hot_keys = atoll(optarg);
+        if (cmd_params->gen.hot_keys > 0) cmd_params->use_gen = 1;
+        break;
+
+      case 'F':
+        cmd_params->gen.hot_fraction = atof(optarg);
+        break;
+
+      case 'E':
+        cmd_params->gen.selectivity = atof(optarg);
+        if (cmd_params->gen.selectivity < 1.0) cmd_params->use_gen = 1;
+        break;
+
       default:
         break;
     }
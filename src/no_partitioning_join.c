@@ -11,6 +11,10 @@
  */
 
 #include "no_partitioning_join.h"
+#include "compressed_relation.h" /* crelation_t, cr_decode8 */
+
+int scalar_state_size = SCALAR_STATE_SIZE;
+int simd_state_size = SIMD_STATE_SIZE;
 
 /**
  * @defgroup OverflowBuckets Buffer management for overflowing buckets.
@@ -91,16 +95,48 @@ void free_bucket_buffer(bucket_buffer_t *buf) {
  * @param ht pointer to a hashtable_t pointer
  */
 void allocate_hashtable(hashtable_t **ppht, uint32_t nbuckets) {
+  allocate_hashtable_slots(ppht, nbuckets, 1);
+}
+
+/**
+ * Size of a bucket of slots tuples: bucket_t for a single one, otherwise an
+ * sbucket_t padded to a power of two up to a cache line and to whole cache
+ * lines beyond, so that no bucket straddles more lines than it needs.
+ */
+static uint32_t bucket_bytes(uint32_t slots) {
+  uint32_t bytes;
+
+  if (slots <= 1) return sizeof(bucket_t);
+  bytes = sizeof(sbucket_t) + slots * (sizeof(intkey_t) + sizeof(value_t));
+  if (bytes > CACHE_LINE_SIZE) {
+    return (bytes + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+  }
+  NEXT_POW_2(bytes);
+  return bytes;
+}
+
+/**
+ * Allocates a hashtable of NUM_BUCKETS buckets of slots tuples each and
+ * inits everything to 0.
+ *
+ * @param ht pointer to a hashtable_t pointer
+ * @param slots tuples per bucket, 1 for bucket_t, up to 8 for sbucket_t
+ */
+void allocate_hashtable_slots(hashtable_t **ppht, uint32_t nbuckets,
+                              uint32_t slots) {
   hashtable_t *ht;
+  size_t bytes;
 
   ht = (hashtable_t *)malloc(sizeof(hashtable_t));
   ht->num_buckets = nbuckets;
   NEXT_POW_2((ht->num_buckets));
   ht->num_buckets = ht->num_buckets / LOAD_FACTOR;
+  ht->bucket_size = slots;
+  ht->bucket_bytes = bucket_bytes(slots);
+  bytes = (size_t)ht->num_buckets * ht->bucket_bytes;
 
   /* allocate hashtable buckets cache line aligned */
-  if (posix_memalign((void **)&ht->buckets, CACHE_LINE_SIZE,
-                     ht->num_buckets * sizeof(bucket_t))) {
+  if (posix_memalign((void **)&ht->buckets, CACHE_LINE_SIZE, bytes)) {
     perror("Aligned allocation failed!\n");
     exit(EXIT_FAILURE);
   }
@@ -109,16 +145,60 @@ void allocate_hashtable(hashtable_t **ppht, uint32_t nbuckets) {
       feature is experimental anyway. */
   if (numalocalize) {
     tuple_t *mem = (tuple_t *)ht->buckets;
-    uint32_t ntuples = (ht->num_buckets * sizeof(bucket_t)) / sizeof(tuple_t);
+    uint32_t ntuples = bytes / sizeof(tuple_t);
     numa_localize(mem, ntuples, nthreads);
   }
 
-  memset(ht->buckets, 0, ht->num_buckets * sizeof(bucket_t));
+  memset(ht->buckets, 0, bytes);
   ht->skip_bits = 0; /* the default for modulo hash */
   ht->hash_mask = (ht->num_buckets - 1) << ht->skip_bits;
   *ppht = ht;
 }
 
+static int intkey_cmp(const void *a, const void *b) {
+  intkey_t x = *(const intkey_t *)a, y = *(const intkey_t *)b;
+  return (x > y) - (x < y);
+}
+
+/** \copydoc estimate_distinct */
+uint64_t estimate_distinct(relation_t *rel, uint32_t nsample) {
+  uint64_t N = rel->num_tuples, n, d = 0, f1 = 0;
+  intkey_t *sample;
+
+  if (N == 0) return 0;
+  n = N < nsample ? N : nsample;
+  sample = (intkey_t *)malloc(n * sizeof(intkey_t));
+  /* systematic sample without replacement, as Duj1 assumes, every N/n-th */
+  for (uint64_t i = 0; i < n; i++) {
+    sample[i] = rel->tuples[i * N / n].key;
+  }
+  qsort(sample, n, sizeof(intkey_t), intkey_cmp);
+  for (uint64_t i = 0, j; i < n; i = j) {
+    for (j = i + 1; j < n && sample[j] == sample[i]; j++)
+      ;
+    ++d;
+    f1 += (j - i == 1);
+  }
+  free(sample);
+
+  if (n == N) return d;
+  /* Duj1: n d / (n - f1 + f1 n / N), between d and N */
+  double D = (double)n * d / ((double)n - f1 + (double)f1 * n / N);
+  if (D < d) D = d;
+  if (D > N) D = N;
+  return (uint64_t)D;
+}
+
+/** \copydoc hashtable_num_buckets */
+uint32_t hashtable_num_buckets(relation_t *rel, uint32_t slots) {
+  uint64_t distinct = estimate_distinct(rel, DISTINCT_SAMPLE_SIZE);
+  uint64_t nbuckets = (distinct + slots - 1) / slots;
+
+  printf("[INFO ] ~%llu distinct keys in %u tuples of R\n", distinct,
+         rel->num_tuples);
+  return nbuckets > 0 ? nbuckets : 1;
+}
+
 /**
  * Releases memory allocated for the hashtable.
  *
@@ -129,35 +209,160 @@ void destroy_hashtable(hashtable_t *ht) {
   free(ht);
 }
 
+typedef struct htstats_arg_t htstats_arg_t;
+
+struct htstats_arg_t {
+  hashtable_t *ht;
+  uint32_t first; /* buckets [first, last) of the thread */
+  uint32_t last;
+  hashtable_stats_t stats;
+};
+
+/** cache lines spanned by the bucket of bytes bytes at b */
+static inline uint64_t bucket_lines(const void *b, uint32_t bytes) {
+  uintptr_t addr = (uintptr_t)b;
+  return (addr + bytes - 1) / CACHE_LINE_SIZE - addr / CACHE_LINE_SIZE + 1;
+}
+
+void *htstats_thread(void *param) {
+  htstats_arg_t *arg = (htstats_arg_t *)param;
+  hashtable_stats_t *s = &arg->stats;
+
+  for (uint32_t i = arg->first; i < arg->last; ++i) {
+    uint64_t nbuckets = 0, ntuples = 0, lines = 0;
+    /* a probe reads the head even if it is empty, then the whole chain */
+    if (arg->ht->bucket_size > 1) {
+      sbucket_t *b = SBUCKET_AT(arg->ht, i);
+      do {
+        lines += bucket_lines(b, arg->ht->bucket_bytes);
+        ntuples += b->count;
+        ++nbuckets;
+        b = b->next;
+      } while (b);
+    } else {
+      bucket_t *b = arg->ht->buckets + i;
+      do {
+        lines += bucket_lines(b, sizeof(bucket_t));
+        ntuples += b->count;
+        ++nbuckets;
+        b = b->next;
+      } while (b);
+    }
+
+    if (ntuples == 0) {
+      ++s->empty;
+      nbuckets = 0;
+    }
+    s->overflow += nbuckets > 1 ? nbuckets - 1 : 0;
+    s->tuples += ntuples;
+    if (nbuckets > s->max_chain) s->max_chain = nbuckets;
+    ++s->chain[nbuckets < HT_STATS_CHAIN_BINS ? nbuckets
+                                              : HT_STATS_CHAIN_BINS - 1];
+    s->lines += lines;
+    s->tuple_lines += ntuples * lines;
+  }
+  s->buckets = arg->last - arg->first;
+  return 0;
+}
+
+void hashtable_stats(hashtable_t *ht, int nthreads, hashtable_stats_t *stats) {
+  uint32_t per_thr;
+  htstats_arg_t args[nthreads];
+  pthread_t tid[nthreads];
+  pthread_attr_t attr;
+  cpu_set_t set;
+  int i, rv;
+
+  if (nthreads < 1) nthreads = 1;
+  per_thr = (ht->num_buckets + nthreads - 1) / nthreads;
+  memset(args, 0, sizeof(htstats_arg_t) * nthreads);
+  pthread_attr_init(&attr);
+  for (i = 0; i < nthreads; i++) {
+    args[i].ht = ht;
+    args[i].first = per_thr * i < ht->num_buckets ? per_thr * i
+                                                  : ht->num_buckets;
+    args[i].last = args[i].first + per_thr < ht->num_buckets
+                       ? args[i].first + per_thr
+                       : ht->num_buckets;
+    if (nthreads == 1) {
+      htstats_thread(&args[0]);
+      break;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(get_cpu_id(i), &set);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+    rv = pthread_create(&tid[i], &attr, htstats_thread, (void *)&args[i]);
+    if (rv) {
+      printf("ERROR; return code from pthread_create() is %d\n", rv);
+      exit(-1);
+    }
+  }
+
+  memset(stats, 0, sizeof(hashtable_stats_t));
+  for (i = 0; i < nthreads; i++) {
+    hashtable_stats_t *s = &args[i].stats;
+    if (nthreads > 1) pthread_join(tid[i], NULL);
+    stats->buckets += s->buckets;
+    stats->empty += s->empty;
+    stats->overflow += s->overflow;
+    stats->tuples += s->tuples;
+    if (s->max_chain > stats->max_chain) stats->max_chain = s->max_chain;
+    for (int j = 0; j < HT_STATS_CHAIN_BINS; j++) stats->chain[j] += s->chain[j];
+    stats->lines += s->lines;
+    stats->tuple_lines += s->tuple_lines;
+  }
+}
+
 /**
- * print the distribution of the hash table
+ * print the distribution of the hash table: chain lengths, fill factor,
+ * memory and the cache lines a probe touches, assuming none is cached. A
+ * probe with a key drawn uniformly from the key domain hits every head with
+ * the same probability, a probe with a build key hits a chain in proportion
+ * to its tuples.
  *
  * @param ht pointer to hashtable
  */
-#define LENGTH 100
 void print_hashtable(hashtable_t *const ht) {
-  uint32_t num[LENGTH], max = 0, len;
-  uint64_t total = 0;
-  bucket_t *curr = NULL;
-  memset(num, 0, sizeof(num));
-  for (uint32_t i = 0; i < ht->num_buckets; ++i) {
-    curr = ht->buckets + i;
-    len = (curr->lenth + 9) / 10;
-    ++num[(len > LENGTH ? LENGTH - 1 : len)];
-    if (curr->lenth > max) {
-      max = curr->lenth;
-    }
-    total += curr->lenth;
-  }
-  // assert(max < LENGTH);
-  printf("max = %d\t total = %lld\n", max, total);
+  hashtable_stats_t s;
+  hashtable_stats(ht, nthreads, &s);
+
+  double head_bytes = (double)s.buckets * ht->bucket_bytes;
+  double overflow_bytes = (double)s.overflow * ht->bucket_bytes;
+  double empty_ratio = s.buckets ? (double)s.empty / s.buckets : 0;
+  double bytes_per_tuple =
+      s.tuples ? (head_bytes + overflow_bytes) / s.tuples : 0;
+  double misses_per_probe = s.buckets ? (double)s.lines / s.buckets : 0;
+  double misses_per_match = s.tuples ? (double)s.tuple_lines / s.tuples : 0;
+
   puts("======the statics of a hash table ====");
-  for (uint32_t i = 0; i < LENGTH; ++i) {
-    if (num[i] > 0) {
-      printf("len= %5d, num= %10d\n", i * 10, num[i]);
+  printf("buckets = %llu of %u B and %u tuples, tuples = %llu, empty = %llu "
+         "(%.2lf%%)\n",
+         s.buckets, ht->bucket_bytes, ht->bucket_size, s.tuples, s.empty,
+         100.0 * empty_ratio);
+  printf("overflow buckets = %llu (%.3lf MiB), max chain = %llu\n", s.overflow,
+         overflow_bytes / 1024.0 / 1024.0, s.max_chain);
+  printf("memory = %.3lf MiB, bytes per tuple = %.2lf\n",
+         (head_bytes + overflow_bytes) / 1024.0 / 1024.0, bytes_per_tuple);
+  printf("projected cache misses per probe = %.3lf, per matching probe = "
+         "%.3lf\n",
+         misses_per_probe, misses_per_match);
+  for (uint32_t i = 0; i < HT_STATS_CHAIN_BINS; ++i) {
+    if (s.chain[i] > 0) {
+      printf("len= %s%3d, num= %10llu (%.2lf%%)\n",
+             i == HT_STATS_CHAIN_BINS - 1 ? ">=" : "  ", i, s.chain[i],
+             100.0 * s.chain[i] / s.buckets);
     }
   }
   puts("==END=the statics of a hash table ====");
+
+  results_counter("hashtable", "buckets", s.buckets);
+  results_counter("hashtable", "empty_ratio", empty_ratio);
+  results_counter("hashtable", "overflow_buckets", s.overflow);
+  results_counter("hashtable", "overflow_bytes", overflow_bytes);
+  results_counter("hashtable", "max_chain", s.max_chain);
+  results_counter("hashtable", "bytes_per_tuple", bytes_per_tuple);
+  results_counter("hashtable", "misses_per_probe", misses_per_probe);
+  results_counter("hashtable", "misses_per_match", misses_per_match);
 }
 /**
  * Single-thread hashtable build method, ht is pre-allocated.
@@ -338,6 +543,7 @@ int64_t probe_gp(hashtable_t *ht, relation_t *rel, void *output) {
   const uint32_t hashmask = ht->hash_mask;
   const uint32_t skipbits = ht->skip_bits;
   chainedtuplebuffer_t *chainedbuf = (chainedtuplebuffer_t *)output;
+  PS_BEGIN();
 
   // init # of the state
   for (int i = 0; i < ScalarStateSize; ++i) {
@@ -345,6 +551,7 @@ int64_t probe_gp(hashtable_t *ht, relation_t *rel, void *output) {
   }
   for (uint64_t cur = 0; cur < rel->num_tuples;) {
     // step 1: load tuples from probing table
+    PS_STAGE(PS_STAGE_ISSUE);
     for (k = 0; (k < ScalarStateSize) && (cur < rel->num_tuples); ++k) {
       _mm_prefetch((char *)(rel->tuples + cur) + PDIS, _MM_HINT_T0);
 
@@ -355,6 +562,8 @@ int64_t probe_gp(hashtable_t *ht, relation_t *rel, void *output) {
 
       state[k].tuple_id = cur;
       state[k].stage = 0;
+      PS_ISSUE(state[k]);
+      PS_INFLIGHT(1);
       ++cur;
     }
     // step 2: repeating step 2
@@ -366,10 +575,15 @@ int64_t probe_gp(hashtable_t *ht, relation_t *rel, void *output) {
         if (state[k].stage == 1) {
           continue;
         }
+        PS_STAGE(PS_STAGE_VISIT);
+        PS_SAMPLE_INFLIGHT();
+        PS_VISIT(state[k]);
         if (b->count == 0) {
           if (state[k].stage == 0) {
             ++done;
           }
+          PS_DONE(state[k]);
+          PS_INFLIGHT(-1);
           state[k].stage = 1;
           continue;
         }
@@ -389,11 +603,14 @@ int64_t probe_gp(hashtable_t *ht, relation_t *rel, void *output) {
 
         } else {
           ++done;
+          PS_DONE(state[k]);
+          PS_INFLIGHT(-1);
           state[k].stage = 1;
         }
       }
     }
   }
+  PS_END("GP");
   return matches;
 }
 int64_t probe_AMAC(hashtable_t *ht, relation_t *rel, void *output) {
@@ -403,6 +620,7 @@ int64_t probe_AMAC(hashtable_t *ht, relation_t *rel, void *output) {
   const uint32_t hashmask = ht->hash_mask;
   const uint32_t skipbits = ht->skip_bits;
   chainedtuplebuffer_t *chainedbuf = (chainedtuplebuffer_t *)output;
+  PS_BEGIN();
 
   // init # of the state
   for (int i = 0; i < ScalarStateSize; ++i) {
@@ -413,6 +631,7 @@ int64_t probe_AMAC(hashtable_t *ht, relation_t *rel, void *output) {
 
     switch (state[k].stage) {
       case 1: {
+        PS_STAGE(PS_STAGE_ISSUE);
         if (cur >= rel->num_tuples) {
           ++done;
           state[k].stage = 3;
@@ -428,13 +647,20 @@ int64_t probe_AMAC(hashtable_t *ht, relation_t *rel, void *output) {
 
         state[k].tuple_id = cur;
         state[k].stage = 0;
+        PS_ISSUE(state[k]);
+        PS_INFLIGHT(1);
         ++cur;
       } break;
       case 0: {
         bucket_t *b = state[k].b;
+        PS_STAGE(PS_STAGE_VISIT);
+        PS_SAMPLE_INFLIGHT();
+        PS_VISIT(state[k]);
         //  _mm_lfence();
         //#pragma unroll(2)
         if (b->count == 0) {
+          PS_DONE(state[k]);
+          PS_INFLIGHT(-1);
           state[k].stage = 1;
           --k;
           break;
@@ -457,6 +683,229 @@ int64_t probe_AMAC(hashtable_t *ht, relation_t *rel, void *output) {
           state[k].b = b;
           // __builtin_prefetch(state[k].b, 0, 1);
           _mm_prefetch((char *)(state[k].b), _MM_HINT_T0);
+        } else {
+          PS_DONE(state[k]);
+          PS_INFLIGHT(-1);
+          state[k].stage = 1;
+          --k;
+        }
+      } break;
+    }
+    ++k;
+  }
+
+  PS_END("AMAC");
+  return matches;
+}
+
+/**
+ * Semi-, anti- and left-outer probe of the hashtable, selected by mode
+ * (PROBE_SEMI, PROBE_ANTI or PROBE_OUTER). Semi and anti probes stop walking
+ * the chain at the first match. Emits (S-key, S-rid) for semi and anti,
+ * (R-rid, S-rid) pairs plus (NULL_RID, S-rid) for unmatched S in outer mode.
+ *
+ * @return number of emitted tuples
+ */
+int64_t probe_hashtable_semi(hashtable_t *ht, relation_t *rel, void *output,
+                             int mode) {
+  int64_t matches = 0;
+  const uint32_t hashmask = ht->hash_mask;
+  const uint32_t skipbits = ht->skip_bits;
+  chainedtuplebuffer_t *chainedbuf = (chainedtuplebuffer_t *)output;
+  tuple_t *joinres;
+
+  for (uint64_t i = 0; i < rel->num_tuples; i++) {
+    intkey_t idx = HASH(rel->tuples[i].key, hashmask, skipbits);
+    bucket_t *b = ht->buckets + idx;
+    int16_t matched = 0;
+
+    do {
+      if (b->count == 0) {
+        break;
+      }
+      if (rel->tuples[i].key == b->tuples[0].key) {
+        matched = 1;
+        if (mode != PROBE_OUTER) {
+          break;
+        }
+        ++matches;
+        joinres = cb_next_writepos(chainedbuf);
+        joinres->key = b->tuples[0].payload;       /* R-rid */
+        joinres->payload = rel->tuples[i].payload; /* S-rid */
+      }
+      b = b->next; /* follow overflow pointer */
+    } while (b);
+
+    if ((mode == PROBE_SEMI) == matched) {
+      ++matches;
+      joinres = cb_next_writepos(chainedbuf);
+      joinres->key =
+          (mode == PROBE_OUTER) ? NULL_RID : rel->tuples[i].key; /* S-key */
+      joinres->payload = rel->tuples[i].payload;                 /* S-rid */
+    }
+  }
+
+  return matches;
+}
+
+/**
+ * AMAC version of probe_hashtable_semi().
+ *
+ * @return number of emitted tuples
+ */
+int64_t probe_AMAC_semi(hashtable_t *ht, relation_t *rel, void *output,
+                        int mode) {
+  int64_t matches = 0;
+  int16_t k = 0, done = 0, end;
+  scalar_state_t state[ScalarStateSize];
+  const uint32_t hashmask = ht->hash_mask;
+  const uint32_t skipbits = ht->skip_bits;
+  chainedtuplebuffer_t *chainedbuf = (chainedtuplebuffer_t *)output;
+  tuple_t *joinres, *s;
+
+  // init # of the state
+  for (int i = 0; i < ScalarStateSize; ++i) {
+    state[i].stage = 1;
+  }
+  for (uint64_t cur = 0; (done < ScalarStateSize);) {
+    k = (k >= ScalarStateSize) ? 0 : k;
+
+    switch (state[k].stage) {
+      case 1: {
+        if (cur >= rel->num_tuples) {
+          ++done;
+          state[k].stage = 3;
+          break;
+        }
+#if SEQPREFETCH
+        _mm_prefetch(((char *)(rel->tuples + cur) + PDIS), _MM_HINT_T0);
+#endif
+        intkey_t idx = HASH(rel->tuples[cur].key, hashmask, skipbits);
+        state[k].b = ht->buckets + idx;
+        _mm_prefetch((char *)(state[k].b), _MM_HINT_T0);
+
+        state[k].tuple_id = cur;
+        state[k].matched = 0;
+        state[k].stage = 0;
+        ++cur;
+      } break;
+      case 0: {
+        bucket_t *b = state[k].b;
+        s = rel->tuples + state[k].tuple_id;
+        end = (b->count == 0);
+        if (!end && s->key == b->tuples[0].key) {
+          state[k].matched = 1;
+          if (mode == PROBE_OUTER) {
+            ++matches;
+            joinres = cb_next_writepos(chainedbuf);
+            joinres->key = b->tuples[0].payload; /* R-rid */
+            joinres->payload = s->payload;       /* S-rid */
+          } else {
+            end = 1; /* the first match decides EXISTS / NOT EXISTS */
+          }
+        }
+        if (!end && b->next) {
+          state[k].b = b->next; /* follow overflow pointer */
+          _mm_prefetch((char *)(state[k].b), _MM_HINT_T0);
+          break;
+        }
+        if ((mode == PROBE_SEMI) == state[k].matched) {
+          ++matches;
+          joinres = cb_next_writepos(chainedbuf);
+          joinres->key = (mode == PROBE_OUTER) ? NULL_RID : s->key; /* S-key */
+          joinres->payload = s->payload;                            /* S-rid */
+        }
+        state[k].stage = 1;
+        --k;
+      } break;
+    }
+    ++k;
+  }
+
+  return matches;
+}
+
+/**
+ * probe_AMAC() over a compressed relation. A block of CR_BLOCK_SIZE tuples
+ * is decoded into a small, cache resident buffer whenever the previous one
+ * is consumed, and the states keep a copy of their key and payload, so the
+ * states in flight survive the next decode.
+ *
+ * @return number of matching tuples
+ */
+int64_t probe_AMAC_compressed(hashtable_t *ht, crelation_t *crel,
+                              void *output) {
+  int64_t matches = 0;
+  int16_t k = 0, done = 0;
+  struct {
+    intkey_t key;
+    value_t payload;
+    bucket_t *b;
+    int16_t stage;
+  } state[ScalarStateSize];
+  __attribute__((aligned(64))) int64_t keys[CR_BLOCK_SIZE],
+      payloads[CR_BLOCK_SIZE];
+  __m512i v_key, v_payload;
+  uint32_t pos = 0, avail = 0;
+  uint64_t blk = 0;
+  const uint32_t hashmask = ht->hash_mask;
+  const uint32_t skipbits = ht->skip_bits;
+  chainedtuplebuffer_t *chainedbuf = (chainedtuplebuffer_t *)output;
+
+  // init # of the state
+  for (int i = 0; i < ScalarStateSize; ++i) {
+    state[i].stage = 1;
+  }
+  for (uint64_t cur = 0; (done < ScalarStateSize);) {
+    k = (k >= ScalarStateSize) ? 0 : k;
+
+    switch (state[k].stage) {
+      case 1: {
+        if (cur >= crel->num_tuples) {
+          ++done;
+          state[k].stage = 3;
+          break;
+        }
+        if (pos == avail) {
+          for (uint32_t row = 0; row < CR_BLOCK_ROWS; ++row) {
+            cr_decode8(crel, crel->blocks + blk, row, &v_key, &v_payload);
+            _mm512_store_epi64(keys + row * CR_LANES, v_key);
+            _mm512_store_epi64(payloads + row * CR_LANES, v_payload);
+          }
+          ++blk;
+          pos = 0;
+          avail = (crel->num_tuples - cur < CR_BLOCK_SIZE)
+                      ? crel->num_tuples - cur
+                      : CR_BLOCK_SIZE;
+        }
+        state[k].key = keys[pos];
+        state[k].payload = payloads[pos];
+        ++pos;
+        intkey_t idx = HASH(state[k].key, hashmask, skipbits);
+        state[k].b = ht->buckets + idx;
+        _mm_prefetch((char *)(state[k].b), _MM_HINT_T0);
+
+        state[k].stage = 0;
+        ++cur;
+      } break;
+      case 0: {
+        bucket_t *b = state[k].b;
+        if (b->count == 0) {
+          state[k].stage = 1;
+          --k;
+          break;
+        }
+        if (state[k].key == b->tuples[0].key) {
+          ++matches;
+          /* copy to the result buffer */
+          tuple_t *joinres = cb_next_writepos(chainedbuf);
+          joinres->key = b->tuples[0].payload; /* R-rid */
+          joinres->payload = state[k].payload; /* S-rid */
+        }
+        b = b->next; /* follow overflow pointer */
+        if (b) {
+          state[k].b = b;
+          _mm_prefetch((char *)(state[k].b), _MM_HINT_T0);
         } else {
           state[k].stage = 1;
           --k;
@@ -486,6 +935,18 @@ static void print_timing(uint64_t total, uint64_t build, uint64_t part,
   fprintf(stderr, "%.4lf ", cyclestuple);
   fflush(stderr);
   fprintf(stdout, "\n");
+
+  /* thread 0 times the phases in cycles only, the wall time is apportioned */
+  results_add("total", "join", RESULTS_ALL_THREADS, diff_usec, total,
+              numtuples, result);
+  if (build > 0) {
+    results_add("build", "join", RESULTS_ALL_THREADS,
+                diff_usec * build / total, build, numtuples, result);
+  }
+  if (part > 0) {
+    results_add("partition", "join", RESULTS_ALL_THREADS,
+                diff_usec * part / total, part, numtuples, result);
+  }
 }
 
 /** \copydoc NPO_st */
@@ -622,11 +1083,16 @@ void build_hashtable_mt(hashtable_t *ht, relation_t *rel,
  */
 volatile char g_lock;
 volatile static uint64_t total_num = 0;
+#if COMPRESSED_PROBE
+/* relS compressed once by thread 0 and probed by all threads */
+static crelation_t *g_crelS;
+#endif
 
 void *npo_thread(void *param) {
   int rv;
   arg_t *args = (arg_t *)param;
   struct timeval t1, t2;
+  result_timer_t rt;
   int deltaT = 0;
   /* allocate overflow buffer for each thread */
   bucket_buffer_t *overflowbuf;
@@ -652,12 +1118,19 @@ void *npo_thread(void *param) {
   }
 #endif
   gettimeofday(&t1, NULL);
+  results_start(&rt);
   /* insert tuples from the assigned part of relR to the ht */
-  build_hashtable_mt(args->ht, &args->relR, &overflowbuf);
+  if (args->ht->bucket_size > 1) {
+    build_hashtable_slots_mt(args->ht, &args->relR, &overflowbuf);
+  } else {
+    build_hashtable_mt(args->ht, &args->relR, &overflowbuf);
+  }
+  results_thread("build", "build", args->tid, &rt, args->relR.num_tuples, 0);
 
   /* wait at a barrier until each thread completes build phase */
   BARRIER_ARRIVE(args->barrier, rv);
   if (args->tid == 0) {
+    results_total("build", "build", &rt, 0);
     gettimeofday(&t2, NULL);
     deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
     printf("--------build costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -667,6 +1140,7 @@ void *npo_thread(void *param) {
 #ifdef PERF_COUNTERS
   if (args->tid == 0) {
     PCM_stop();
+    PCM_accumulatePhase(PCM_PHASE_BUILD);
     PCM_log("========== Build phase profiling results ==========\n");
     PCM_printResults();
     PCM_start();
@@ -688,7 +1162,58 @@ void *npo_thread(void *param) {
   if (args->tid == 0) {
     puts("+++++sleep end  +++++");
   }
- 
+
+  //////// multi-slot buckets: the kernels below assume one tuple per bucket
+  if (args->ht->bucket_size > 1) {
+    static const struct {
+      const char *name;
+      int64_t (*probe)(hashtable_t *, relation_t *, void *);
+    } slot_probes[] = {{"SLOTS RAW probe", probe_slots},
+                       {"SLOTS AMAC probe", probe_slots_amac},
+#ifdef KEY_8B /* like the other SIMD kernels */
+                       {"SLOTS SIMD AMAC probe", probe_simd_amac_slots}
+#endif
+    };
+    chainedtuplebuffer_t *chainedbuf_slots = chainedtuplebuffer_init();
+    for (int p = 0; p < sizeof(slot_probes) / sizeof(slot_probes[0]); ++p) {
+      for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
+        BARRIER_ARRIVE(args->barrier, rv);
+        gettimeofday(&t1, NULL);
+        results_start(&rt);
+        args->num_results =
+            slot_probes[p].probe(args->ht, &args->relS, chainedbuf_slots);
+        results_thread("probe", slot_probes[p].name, args->tid, &rt,
+                       args->relS.num_tuples, args->num_results);
+        lock(&g_lock);
+#if DIVIDE
+        total_num += args->num_results;
+#else
+        total_num = args->num_results;
+#endif
+        unlock(&g_lock);
+        BARRIER_ARRIVE(args->barrier, rv);
+        if (args->tid == 0) {
+          printf("total result num = %lld\t", total_num);
+          results_total("probe", slot_probes[p].name, &rt, total_num);
+          gettimeofday(&t2, NULL);
+          deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
+          printf("---- %s costs time (ms) = %lf\n", slot_probes[p].name,
+                 deltaT * 1.0 / 1000);
+          total_num = 0;
+        }
+      }
+      if (args->tid == 0) {
+        puts("+++++sleep begin+++++");
+      }
+      sleep(SLEEP_TIME);
+      if (args->tid == 0) {
+        puts("+++++sleep end  +++++");
+      }
+    }
+    chainedtuplebuffer_free(chainedbuf_slots);
+    goto probes_done;
+  }
+
  ////////// compact, do two branches in the integration
 
   /*chainedtuplebuffer_t *chainedbuf_compact = chainedtuplebuffer_init();
@@ -728,7 +1253,10 @@ void *npo_thread(void *param) {
     BARRIER_ARRIVE(args->barrier, rv);
     /* probe for matching tuples from the assigned part of relS */
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results = smv_probe(args->ht, &args->relS, chainedbuf_compact1);
+    results_thread("probe", "SMV probe", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
 #if DIVIDE
     total_num += args->num_results;
@@ -739,6 +1267,7 @@ void *npo_thread(void *param) {
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "SMV probe", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("---- SMV probe costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -822,7 +1351,10 @@ void *npo_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results = probe_AMAC(args->ht, &args->relS, chainedbuf_amac);
+    results_thread("probe", "AMAC probe", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
 #if DIVIDE
     total_num += args->num_results;
@@ -833,6 +1365,7 @@ void *npo_thread(void *param) {
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "AMAC probe", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("--------AMAC probe costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -888,8 +1421,11 @@ void *npo_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results =
         probe_simd_amac(args->ht, &args->relS, chainedbuf_simd_amac);
+    results_thread("probe", "SIMD AMAC probe", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
 #if DIVIDE
     total_num += args->num_results;
@@ -900,6 +1436,7 @@ void *npo_thread(void *param) {
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "SIMD AMAC probe", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("---SIMD AMAC probe costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -920,8 +1457,11 @@ void *npo_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results =
         probe_simd_amac_raw(args->ht, &args->relS, chainedbuf_simd_amac_raw);
+    results_thread("probe", "SIMD AMAC RAW", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
 #if DIVIDE
     total_num += args->num_results;
@@ -932,6 +1472,7 @@ void *npo_thread(void *param) {
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "SIMD AMAC RAW", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("---  SIMD AMAC RAW costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -951,7 +1492,10 @@ void *npo_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results = probe_simd(args->ht, &args->relS, chainedbuf_simd);
+    results_thread("probe", "SIMD probe", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
 #if DIVIDE
     total_num += args->num_results;
@@ -962,6 +1506,7 @@ void *npo_thread(void *param) {
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "SIMD probe", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("--------SIMD probe costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -983,7 +1528,10 @@ void *npo_thread(void *param) {
     BARRIER_ARRIVE(args->barrier, rv);
     /* probe for matching tuples from the assigned part of relS */
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results = probe_hashtable(args->ht, &args->relS, chainedbuf);
+    results_thread("probe", "RAW probe", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
 #if DIVIDE
     total_num += args->num_results;
@@ -994,6 +1542,7 @@ void *npo_thread(void *param) {
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "RAW probe", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("-------- RAW probe costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -1001,8 +1550,144 @@ void *npo_thread(void *param) {
     }
   }
   chainedtuplebuffer_free(chainedbuf);
+#if SEMI_PROBE
+  //////// semi-, anti- and outer-join probes
+  const char *mode_name[] = {"", "SEMI", "ANTI", "OUTER"};
+  for (int mode = PROBE_SEMI; mode <= PROBE_OUTER; ++mode) {
+    chainedtuplebuffer_t *chainedbuf_semi = chainedtuplebuffer_init();
+    char amac_name[32], smv_name[32];
+    snprintf(amac_name, sizeof(amac_name), "AMAC %s probe", mode_name[mode]);
+    snprintf(smv_name, sizeof(smv_name), "SMV %s probe", mode_name[mode]);
+    for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
+      BARRIER_ARRIVE(args->barrier, rv);
+      gettimeofday(&t1, NULL);
+      results_start(&rt);
+      args->num_results =
+          probe_AMAC_semi(args->ht, &args->relS, chainedbuf_semi, mode);
+      results_thread("probe", amac_name, args->tid, &rt, args->relS.num_tuples,
+                     args->num_results);
+      lock(&g_lock);
+#if DIVIDE
+      total_num += args->num_results;
+#else
+      total_num = args->num_results;
+#endif
+      unlock(&g_lock);
+      BARRIER_ARRIVE(args->barrier, rv);
+      if (args->tid == 0) {
+        printf("total result num = %lld\t", total_num);
+        results_total("probe", amac_name, &rt, total_num);
+        gettimeofday(&t2, NULL);
+        deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
+        printf("---- AMAC %5s probe costs time (ms) = %lf\n", mode_name[mode],
+               deltaT * 1.0 / 1000);
+        total_num = 0;
+      }
+    }
+    for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
+      BARRIER_ARRIVE(args->barrier, rv);
+      gettimeofday(&t1, NULL);
+      results_start(&rt);
+      args->num_results =
+          smv_probe_semi(args->ht, &args->relS, chainedbuf_semi, mode);
+      results_thread("probe", smv_name, args->tid, &rt, args->relS.num_tuples,
+                     args->num_results);
+      lock(&g_lock);
+#if DIVIDE
+      total_num += args->num_results;
+#else
+      total_num = args->num_results;
+#endif
+      unlock(&g_lock);
+      BARRIER_ARRIVE(args->barrier, rv);
+      if (args->tid == 0) {
+        printf("total result num = %lld\t", total_num);
+        results_total("probe", smv_name, &rt, total_num);
+        gettimeofday(&t2, NULL);
+        deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
+        printf("----  SMV %5s probe costs time (ms) = %lf\n", mode_name[mode],
+               deltaT * 1.0 / 1000);
+        total_num = 0;
+      }
+    }
+    chainedtuplebuffer_free(chainedbuf_semi);
+  }
+#endif
+#if COMPRESSED_PROBE
+  //////// probes decoding the compressed relS on the fly
+  crelation_t *crelS;
+#if DIVIDE
+  crelS = compress_relation(&args->relS, 1);
+#else
+  if (args->tid == 0) {
+    g_crelS = compress_relation(&args->relS, nthreads);
+  }
+  BARRIER_ARRIVE(args->barrier, rv);
+  crelS = g_crelS;
+#endif
+  chainedtuplebuffer_t *chainedbuf_cr = chainedtuplebuffer_init();
+  for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
+    BARRIER_ARRIVE(args->barrier, rv);
+    gettimeofday(&t1, NULL);
+    results_start(&rt);
+    args->num_results = probe_AMAC_compressed(args->ht, crelS, chainedbuf_cr);
+    results_thread("probe", "AMAC compressed probe", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
+    lock(&g_lock);
+#if DIVIDE
+    total_num += args->num_results;
+#else
+    total_num = args->num_results;
+#endif
+    unlock(&g_lock);
+    BARRIER_ARRIVE(args->barrier, rv);
+    if (args->tid == 0) {
+      printf("total result num = %lld\t", total_num);
+      results_total("probe", "AMAC compressed probe", &rt, total_num);
+      gettimeofday(&t2, NULL);
+      deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
+      printf("---- AMAC compressed probe costs time (ms) = %lf\n",
+             deltaT * 1.0 / 1000);
+      total_num = 0;
+    }
+  }
+  for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
+    BARRIER_ARRIVE(args->barrier, rv);
+    gettimeofday(&t1, NULL);
+    results_start(&rt);
+    args->num_results = smv_probe_compressed(args->ht, crelS, chainedbuf_cr);
+    results_thread("probe", "SMV compressed probe", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
+    lock(&g_lock);
+#if DIVIDE
+    total_num += args->num_results;
+#else
+    total_num = args->num_results;
+#endif
+    unlock(&g_lock);
+    BARRIER_ARRIVE(args->barrier, rv);
+    if (args->tid == 0) {
+      printf("total result num = %lld\t", total_num);
+      results_total("probe", "SMV compressed probe", &rt, total_num);
+      gettimeofday(&t2, NULL);
+      deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
+      printf("----  SMV compressed probe costs time (ms) = %lf\n",
+             deltaT * 1.0 / 1000);
+      total_num = 0;
+    }
+  }
+  chainedtuplebuffer_free(chainedbuf_cr);
+#if DIVIDE
+  free_crelation(crelS);
+#else
+  if (args->tid == 0) {
+    free_crelation(g_crelS);
+  }
+#endif
+#endif
 
 //------------------------------------
+probes_done:
 #ifdef JOIN_RESULT_MATERIALIZE
   args->threadresult->nresults = args->num_results;
   args->threadresult->threadid = args->tid;
@@ -1024,6 +1709,7 @@ void *npo_thread(void *param) {
 #ifdef PERF_COUNTERS
   if (args->tid == 0) {
     PCM_stop();
+    PCM_accumulatePhase(PCM_PHASE_PROBE);
     PCM_log("========== Probe phase profiling results ==========\n");
     PCM_printResults();
     PCM_log("===================================================\n");
@@ -1059,8 +1745,10 @@ result_t *NPO(relation_t *relR, relation_t *relS, int nthreads) {
       (threadresult_t *)alloc_aligned(sizeof(threadresult_t) * nthreads);
 #endif
 
-  uint32_t nbuckets = (relR->num_tuples / BUCKET_SIZE);
-  allocate_hashtable(&ht, nbuckets);
+  uint32_t nbuckets = hashtable_num_buckets(relR, bucket_size);
+  allocate_hashtable_slots(&ht, nbuckets, bucket_size);
+  printf("[INFO ] Hashtable of %d buckets of %u tuples (%u B)\n",
+         ht->num_buckets, ht->bucket_size, ht->bucket_bytes);
 
   numR = relR->num_tuples;
   numS = relS->num_tuples;
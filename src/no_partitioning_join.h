@@ -38,6 +38,8 @@
 #include "barrier.h"   /* pthread_barrier_* */
 #include "affinity.h"  /* pthread_attr_setaffinity_np */
 #include "generator.h" /* numa_localize() */
+#include "results.h"   /* results_thread, results_total */
+#include "compressed_relation.h" /* crelation_t */
 
 #ifdef JOIN_RESULT_MATERIALIZE
 #include "tuple_buffer.h" /* for materialization */
@@ -72,7 +74,8 @@
 #endif
 
 #ifndef HASH
-#define HASH(X, MASK, SKIP) (((X)&MASK) >> SKIP)
+/** bucket of key X, the bits MASK of its hash_fn hash (hash_functions.h) */
+#define HASH(X, MASK, SKIP) ((hash_key((X), hash_fn) & (MASK)) >> (SKIP))
 #endif
 
 /** Debug msg logging method */
@@ -88,6 +91,8 @@
 /** An experimental feature to allocate input relations numa-local */
 extern int numalocalize; /* defined in generator.c */
 extern int nthreads;     /* defined in generator.c */
+/** tuples per bucket of the NPO hashtable, 1, 2, 4 or 8 (--bucket-size) */
+extern int bucket_size;
 
 /**
  * \ingroup NPO arguments to the threads
@@ -112,6 +117,74 @@ struct arg_t {
 #endif
 };
 
+/** defined in generator.c, returns NUMA-local memory if numalocalize is set */
+void *alloc_aligned(size_t size);
+
+/** hashtable and overflow buffers shared by NPO, PIPELINE and the sweep */
+void allocate_hashtable(hashtable_t **ppht, uint32_t nbuckets);
+void allocate_hashtable_slots(hashtable_t **ppht, uint32_t nbuckets,
+                              uint32_t slots);
+void destroy_hashtable(hashtable_t *ht);
+void init_bucket_buffer(bucket_buffer_t **ppbuf);
+void free_bucket_buffer(bucket_buffer_t *buf);
+void build_hashtable_mt(hashtable_t *ht, relation_t *rel,
+                        bucket_buffer_t **overflowbuf);
+
+/**
+ * Estimates the number of distinct keys of rel from nsample evenly spaced
+ * tuples with the Duj1 estimator of Haas et al. (VLDB 1995),
+ * D = n d / (n - f1 + f1 n / N), where d is the number of distinct keys in the
+ * sample of n tuples and f1 the number of those seen exactly once. Exact if
+ * rel has at most nsample tuples.
+ */
+uint64_t estimate_distinct(relation_t *rel, uint32_t nsample);
+
+/**
+ * Number of buckets of slots tuples for a hashtable over rel, from its
+ * estimated distinct keys. Duplicates of a key share a chain whatever the
+ * number of buckets, so they do not count.
+ */
+uint32_t hashtable_num_buckets(relation_t *rel, uint32_t slots);
+
+/**
+ * Build and probes of the multi-slot hashtable (bucket_size > 1). The SIMD
+ * variants compare the probe keys with all slots of a bucket at once.
+ */
+void build_hashtable_slots_mt(hashtable_t *ht, relation_t *rel,
+                              bucket_buffer_t **overflowbuf);
+int64_t probe_slots(hashtable_t *ht, relation_t *rel, void *output);
+int64_t probe_slots_amac(hashtable_t *ht, relation_t *rel, void *output);
+int64_t probe_simd_amac_slots(hashtable_t *ht, relation_t *rel, void *output);
+
+/**
+ * Walks all chains of ht with nthreads threads and collects the chain
+ * lengths, empty and overflow buckets and the cache lines a probe touches.
+ */
+void hashtable_stats(hashtable_t *ht, int nthreads, hashtable_stats_t *stats);
+
+/** prints the hashtable_stats() of ht, computed with `nthreads` threads */
+void print_hashtable(hashtable_t *ht);
+
+/**
+ * The probe kernels over the NPO hashtable. Each probes all tuples of rel,
+ * appends the matches to the chainedtuplebuffer_t output and returns their
+ * number.
+ */
+int64_t probe_hashtable(hashtable_t *ht, relation_t *rel, void *output);
+int64_t probe_gp(hashtable_t *ht, relation_t *rel, void *output);
+int64_t probe_AMAC(hashtable_t *ht, relation_t *rel, void *output);
+int64_t probe_simd(hashtable_t *ht, relation_t *rel, void *output);
+int64_t probe_simd_gp(hashtable_t *ht, relation_t *rel, void *output);
+int64_t probe_simd_amac(hashtable_t *ht, relation_t *rel, void *output);
+int64_t probe_simd_amac_raw(hashtable_t *ht, relation_t *rel, void *output);
+int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
+                                 void *output);
+int64_t smv_probe(hashtable_t *ht, relation_t *rel, void *output);
+int64_t smv_probe_semi(hashtable_t *ht, relation_t *rel, void *output,
+                       int mode);
+int64_t smv_probe_compressed(hashtable_t *ht, crelation_t *crel,
+                             void *output);
+
 /**
  * NPO: No Partitioning Join Optimized.
  *
@@ -141,4 +214,26 @@ result_t *NPO_st(relation_t *relR, relation_t *relS, int nthreads);
 result_t *PIPELINE(relation_t *relR, relation_t *relS, int nthreads);
 result_t *BTS(relation_t *relR, relation_t *relS, int nthreads);
 
+/**
+ * AGG: parallel hash group-by computing COUNT, SUM, MIN and MAX of the
+ * payloads of S grouped by key. R is not used.
+ *
+ * @param relR unused
+ * @param relS input relation to be aggregated
+ *
+ * @return number of groups
+ */
+result_t *AGG(relation_t *relR, relation_t *relS, int nthreads);
+
+/**
+ * HASH: hashes the keys of S with every hash function of hash_functions.h,
+ * scalar and AVX-512, and reports the time of each. R is not used.
+ *
+ * @param relR unused
+ * @param relS input relation whose keys are hashed
+ *
+ * @return no results
+ */
+result_t *HASHBENCH(relation_t *relR, relation_t *relS, int nthreads);
+
 #endif /* NO_PARTITIONING_JOIN_H */
@@ -3,6 +3,7 @@
 
 #include "prefetch.h"
 #include "tuple_buffer.h"
+#include "compressed_relation.h"
 #define WORDSIZE 8
 // target for 8B keys and 8B payload
 int64_t probe_simd(hashtable_t *ht, relation_t *rel, void *output) {
@@ -68,7 +69,7 @@ int64_t probe_simd(hashtable_t *ht, relation_t *rel, void *output) {
         v_tuple_cell, m_new_cells, v_addr_offset, ((void *)rel->tuples), 1);
     ///// step 3: load new values from hash tables;
     // hash the cell values
-    v_cell_hash = _mm512_and_epi64(v_tuple_cell, v_factor);
+    v_cell_hash = _mm512_and_epi64(HASH_SIMD(v_tuple_cell), v_factor);
     v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
     v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
     v_ht_pos =
@@ -148,6 +149,7 @@ int64_t probe_simd_amac(hashtable_t *ht, relation_t *rel, void *output) {
     state[i].payload = _mm512_set1_epi64(0);
     state[i].key = _mm512_set1_epi64(0);
   }
+  PS_BEGIN();
   for (uint64_t cur = 0; (cur < rel->num_tuples) || (done < SIMDStateSize);) {
     k = (k >= SIMDStateSize) ? 0 : k;
     if (cur >= rel->num_tuples) {
@@ -160,6 +162,7 @@ int64_t probe_simd_amac(hashtable_t *ht, relation_t *rel, void *output) {
     }
     switch (state[k].stage) {
       case 1: {
+        PS_STAGE(PS_STAGE_ISSUE);
 ///////// step 1: load new tuples' address offsets
 // the offset should be within MAX_32INT_
 // the tail depends on the number of joins and tuples in each bucket
@@ -187,6 +190,8 @@ int64_t probe_simd_amac(hashtable_t *ht, relation_t *rel, void *output) {
             _mm512_cmpgt_epi64_mask(v_base_offset_upper, state[k].tb_off);
         ///// step 2: load new cells from right tuples;
         m_new_cells = _mm512_kand(m_new_cells, state[k].m_have_tuple);
+        PS_SIMD_ISSUE(state[k], m_new_cells);
+        PS_INFLIGHT(_mm_popcnt_u32(m_new_cells));
         // maybe need offset within a tuple
         state[k].key = _mm512_mask_i64gather_epi64(state[k].key, m_new_cells,
                                                    state[k].tb_off,
@@ -197,7 +202,7 @@ int64_t probe_simd_amac(hashtable_t *ht, relation_t *rel, void *output) {
             ((void *)rel->tuples), 1);
         ///// step 3: load new values from hash tables;
         // hash the cell values
-        v_cell_hash = _mm512_and_epi64(state[k].key, v_factor);
+        v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
         v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
         v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
         state[k].ht_off = _mm512_mask_add_epi64(state[k].ht_off, m_new_cells,
@@ -223,6 +228,9 @@ int64_t probe_simd_amac(hashtable_t *ht, relation_t *rel, void *output) {
 #endif
       } break;
       case 0: {
+        PS_STAGE(PS_STAGE_VISIT);
+        PS_SAMPLE_INFLIGHT();
+        PS_SIMD_VISIT(state[k]);
         /////////////////// random access
         // check valid bucket
         v_ht_cell = _mm512_mask_i64gather_epi64(
@@ -254,6 +262,7 @@ int64_t probe_simd_amac(hashtable_t *ht, relation_t *rel, void *output) {
         state[k].m_have_tuple =
             _mm512_kand(_mm512_cmpneq_epi64_mask(state[k].ht_off, v_zero512),
                         state[k].m_have_tuple);
+        PS_SIMD_DONE(state[k]);
 
         // to scatter join results
         join_res = cb_next_n_writepos(chainedbuf, new_add);
@@ -275,6 +284,7 @@ int64_t probe_simd_amac(hashtable_t *ht, relation_t *rel, void *output) {
     }
     ++k;
   }
+  PS_END("SIMD_AMAC");
   return matches;
 }
 int64_t probe_simd_amac_raw(hashtable_t *ht, relation_t *rel, void *output) {
@@ -361,7 +371,7 @@ int64_t probe_simd_amac_raw(hashtable_t *ht, relation_t *rel, void *output) {
             _mm512_add_epi64(v_offset, v_word_size), ((void *)rel->tuples), 1);
         ///// step 3: load new values from hash tables;
         // hash the cell values
-        v_cell_hash = _mm512_and_epi64(state[k].key, v_factor);
+        v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
         v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
         v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
         state[k].ht_off = _mm512_mask_add_epi64(
@@ -557,7 +567,7 @@ int64_t probe_simd_amac_compact(hashtable_t *ht, relation_t *rel,
             _mm512_add_epi64(v_offset, v_word_size), ((void *)rel->tuples), 1);
         ///// step 3: load new values from hash tables;
         // hash the cell values
-        v_cell_hash = _mm512_and_epi64(state[k].key, v_factor);
+        v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
         v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
         v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
         state[k].ht_off = _mm512_mask_add_epi64(
@@ -771,6 +781,7 @@ int64_t smv_probe(hashtable_t *ht, relation_t *rel, void *output) {
     state[i].payload = _mm512_set1_epi64(0);
     state[i].key = _mm512_set1_epi64(0);
   }
+  PS_BEGIN();
   for (uint64_t cur = 0; 1;) {
     k = (k >= SIMDStateSize) ? 0 : k;
     if (UNLIKELY(cur >= rel->num_tuples)) {
@@ -791,6 +802,7 @@ int64_t smv_probe(hashtable_t *ht, relation_t *rel, void *output) {
     }
     switch (state[k].stage) {
       case 1: {
+        PS_STAGE(PS_STAGE_ISSUE);
 ///////// step 1: load new tuples' address offsets
 // the offset should be within MAX_32INT_
 // the tail depends on the number of joins and tuples in each bucket
@@ -812,6 +824,8 @@ int64_t smv_probe(hashtable_t *ht, relation_t *rel, void *output) {
         cur = cur + VECTOR_SCALE;
         state[k].m_have_tuple =
             _mm512_cmpgt_epi64_mask(v_base_offset_upper, v_offset);
+        PS_SIMD_ISSUE(state[k], state[k].m_have_tuple);
+        PS_INFLIGHT(_mm_popcnt_u32(state[k].m_have_tuple));
         ///// step 2: load new cells from right tuples;
         // maybe need offset within a tuple
         state[k].key =
@@ -822,7 +836,7 @@ int64_t smv_probe(hashtable_t *ht, relation_t *rel, void *output) {
             _mm512_add_epi64(v_offset, v_word_size), ((void *)rel->tuples), 1);
         ///// step 3: load new values from hash tables;
         // hash the cell values
-        v_cell_hash = _mm512_and_epi64(state[k].key, v_factor);
+        v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
         v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
         v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
         state[k].ht_off = _mm512_mask_add_epi64(
@@ -848,6 +862,9 @@ int64_t smv_probe(hashtable_t *ht, relation_t *rel, void *output) {
 #endif
       } break;
       case 0: {
+        PS_STAGE(PS_STAGE_VISIT);
+        PS_SAMPLE_INFLIGHT();
+        PS_SIMD_VISIT(state[k]);
         /////////////////// random access
         // check valid bucket
         v_ht_cell = _mm512_mask_i64gather_epi64(
@@ -879,6 +896,7 @@ int64_t smv_probe(hashtable_t *ht, relation_t *rel, void *output) {
         state[k].m_have_tuple =
             _mm512_kand(_mm512_cmpneq_epi64_mask(state[k].ht_off, v_zero512),
                         state[k].m_have_tuple);
+        PS_SIMD_DONE(state[k]);
 #if 1
         // to scatter join results
         join_res = cb_next_n_writepos(chainedbuf, new_add);
@@ -911,6 +929,7 @@ int64_t smv_probe(hashtable_t *ht, relation_t *rel, void *output) {
 #endif
         {
           if (LIKELY(done < SIMDStateSize)) {
+            PS_STAGE(PS_STAGE_COMPACT);
             num_temp = _mm_popcnt_u32(state[SIMDStateSize].m_have_tuple);
             if (num + num_temp < VECTOR_SCALE) {
               // compress v
@@ -920,6 +939,7 @@ int64_t smv_probe(hashtable_t *ht, relation_t *rel, void *output) {
                                                          state[k].key);
               state[k].payload = _mm512_maskz_compress_epi64(
                   state[k].m_have_tuple, state[k].payload);
+              PS_SIMD_COMPRESS(state[k], state[k].m_have_tuple, state[k]);
               // expand v -> temp
               state[SIMDStateSize].ht_off = _mm512_mask_expand_epi64(
                   state[SIMDStateSize].ht_off,
@@ -932,6 +952,9 @@ int64_t smv_probe(hashtable_t *ht, relation_t *rel, void *output) {
                   state[SIMDStateSize].payload,
                   _mm512_knot(state[SIMDStateSize].m_have_tuple),
                   state[k].payload);
+              PS_SIMD_EXPAND(state[SIMDStateSize], state[SIMDStateSize],
+                             _mm512_knot(state[SIMDStateSize].m_have_tuple),
+                             state[k]);
               state[SIMDStateSize].m_have_tuple = mask[num + num_temp];
               state[k].m_have_tuple = 0;
               state[k].stage = 1;
@@ -947,6 +970,9 @@ int64_t smv_probe(hashtable_t *ht, relation_t *rel, void *output) {
               state[k].payload = _mm512_mask_expand_epi64(
                   state[k].payload, _mm512_knot(state[k].m_have_tuple),
                   state[SIMDStateSize].payload);
+              PS_SIMD_EXPAND(state[k], state[k],
+                             _mm512_knot(state[k].m_have_tuple),
+                             state[SIMDStateSize]);
               // compress temp
               state[SIMDStateSize].m_have_tuple =
                   _mm512_kand(state[SIMDStateSize].m_have_tuple,
@@ -959,6 +985,9 @@ int64_t smv_probe(hashtable_t *ht, relation_t *rel, void *output) {
               state[SIMDStateSize].payload =
                   _mm512_maskz_compress_epi64(state[SIMDStateSize].m_have_tuple,
                                               state[SIMDStateSize].payload);
+              PS_SIMD_COMPRESS(state[SIMDStateSize],
+                               state[SIMDStateSize].m_have_tuple,
+                               state[SIMDStateSize]);
               state[k].m_have_tuple = mask[VECTOR_SCALE];
               state[SIMDStateSize].m_have_tuple =
                   (state[SIMDStateSize].m_have_tuple >> (VECTOR_SCALE - num));
@@ -988,6 +1017,496 @@ int64_t smv_probe(hashtable_t *ht, relation_t *rel, void *output) {
     }
     ++k;
   }
+  PS_END("SMV");
+  return matches;
+}
+/**
+ * smv_probe() over a compressed relation: every new vector of keys and
+ * payloads is decoded straight from the packed rows, the decompressed
+ * relation is never materialized.
+ */
+int64_t smv_probe_compressed(hashtable_t *ht, crelation_t *crel,
+                             void *output) {
+  int64_t matches = 0;
+  int32_t new_add = 0, k = 0, done = 0, num, num_temp;
+  __attribute__((aligned(64))) __mmask8 m_match = 0, m_new_cells = -1,
+                                        m_valid_bucket = 0,
+                                        mask[VECTOR_SCALE + 1];
+  uint32_t row = 0;
+  uint64_t blk = 0;
+  __m512i v_base_offset, v_ht_cell, v_factor = _mm512_set1_epi64(ht->hash_mask),
+          v_shift = _mm512_set1_epi64(ht->skip_bits), v_cell_hash,
+          v_neg_one512 = _mm512_set1_epi64(-1),
+          v_zero512 = _mm512_set1_epi64(0),
+          v_write_index = _mm512_set1_epi64(0),
+          v_ht_addr = _mm512_set1_epi64(ht->buckets),
+          v_word_size = _mm512_set1_epi64(WORDSIZE),
+          v_tuple_size = _mm512_set1_epi64(sizeof(tuple_t)),
+          v_bucket_size = _mm512_set1_epi64(sizeof(bucket_t)),
+          v_next_off = _mm512_set1_epi64(8), v_right_payload,
+          v_payload_off = _mm512_set1_epi64(24);
+  chainedtuplebuffer_t *chainedbuf = (chainedtuplebuffer_t *)output;
+  tuple_t *join_res = NULL;
+  __attribute__((aligned(64))) uint64_t base_off[16], *ht_pos;
+  for (int i = 0; i <= VECTOR_SCALE; ++i) {
+    base_off[i] = i * sizeof(tuple_t);
+    mask[i] = (1 << i) - 1;
+  }
+  v_base_offset = _mm512_load_epi64(base_off);
+  __attribute__((aligned(64))) StateSIMD state[SIMDStateSize + 1];
+  // init # of the state
+  for (int i = 0; i <= SIMDStateSize; ++i) {
+    state[i].stage = 1;
+    state[i].m_have_tuple = 0;
+    state[i].ht_off = _mm512_set1_epi64(0);
+    state[i].payload = _mm512_set1_epi64(0);
+    state[i].key = _mm512_set1_epi64(0);
+  }
+  for (uint64_t cur = 0; 1;) {
+    k = (k >= SIMDStateSize) ? 0 : k;
+    if (UNLIKELY(cur >= crel->num_tuples)) {
+      if (state[k].m_have_tuple == 0 && state[k].stage != 3) {
+        ++done;
+        state[k].stage = 3;
+        ++k;
+        continue;
+      }
+      if ((done >= SIMDStateSize)) {
+        if (state[SIMDStateSize].m_have_tuple > 0) {
+          k = SIMDStateSize;
+          state[SIMDStateSize].stage = 0;
+        } else {
+          break;
+        }
+      }
+    }
+    switch (state[k].stage) {
+      case 1: {
+        ///////// step 1: decode the next row of the current block
+        cr_decode8(crel, crel->blocks + blk, row, &state[k].key,
+                   &state[k].payload);
+        if (++row == CR_BLOCK_ROWS) {
+          row = 0;
+          ++blk;
+        }
+        state[k].m_have_tuple = (crel->num_tuples - cur >= VECTOR_SCALE)
+                                    ? mask[VECTOR_SCALE]
+                                    : mask[crel->num_tuples - cur];
+        cur = cur + VECTOR_SCALE;
+        ///// step 3: load new values from hash tables;
+        // hash the cell values
+        v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
+        v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
+        v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
+        state[k].ht_off = _mm512_mask_add_epi64(
+            state[k].ht_off, state[k].m_have_tuple, v_cell_hash, v_ht_addr);
+        state[k].stage = 0;
+#if KNL
+        _mm512_mask_prefetch_i64gather_pd(
+            state[k].ht_off, state[k].m_have_tuple, 0, 1, _MM_HINT_T0);
+#elif DIR_PREFETCH
+        ht_pos = (uint64_t *)&state[k].ht_off;
+        for (int i = 0; i < VECTOR_SCALE; ++i) {
+          _mm_prefetch((char *)(ht_pos[i]), _MM_HINT_T0);
+        }
+#else
+        m_have_tuple = state[k].m_have_tuple;
+        ht_pos = (uint64_t *)&state[k].ht_off;
+        for (int i = 0; (i < VECTOR_SCALE) & (m_have_tuple);
+             ++i, (m_have_tuple >> 1)) {
+          if (m_have_tuple & 1) {
+            _mm_prefetch((char *)(ht_pos[i]), _MM_HINT_T0);
+          }
+        }
+#endif
+      } break;
+      case 0: {
+        /////////////////// random access
+        // check valid bucket
+        v_ht_cell = _mm512_mask_i64gather_epi64(
+            v_neg_one512, state[k].m_have_tuple, state[k].ht_off, 0, 1);
+        m_valid_bucket = _mm512_cmpneq_epi64_mask(v_ht_cell, v_zero512);
+        state[k].m_have_tuple =
+            _mm512_kand(m_valid_bucket, state[k].m_have_tuple);
+
+        v_ht_cell = _mm512_mask_i64gather_epi64(
+            v_neg_one512, state[k].m_have_tuple,
+            _mm512_add_epi64(state[k].ht_off, v_tuple_size), 0,
+            1);  // note the offset of the tuple in %bucket_t%
+
+        ///// step 4: compare;
+        m_match = _mm512_cmpeq_epi64_mask(state[k].key, v_ht_cell);
+        m_match = _mm512_kand(m_match, state[k].m_have_tuple);
+        new_add = _mm_popcnt_u32(m_match);
+        matches += new_add;
+
+        // gather payloads
+        v_right_payload = _mm512_mask_i64gather_epi64(
+            v_neg_one512, m_match,
+            _mm512_add_epi64(state[k].ht_off, v_payload_off), 0, 1);
+
+        // update next
+        state[k].ht_off = _mm512_mask_i64gather_epi64(
+            v_zero512, state[k].m_have_tuple,
+            _mm512_add_epi64(state[k].ht_off, v_next_off), 0, 1);
+        state[k].m_have_tuple =
+            _mm512_kand(_mm512_cmpneq_epi64_mask(state[k].ht_off, v_zero512),
+                        state[k].m_have_tuple);
+#if 1
+        // to scatter join results
+        join_res = cb_next_n_writepos(chainedbuf, new_add);
+#if SEQPREFETCH
+        _mm_prefetch((char *)(((void *)join_res) + PDIS), _MM_HINT_T0);
+        _mm_prefetch((char *)(((void *)join_res) + PDIS + 64), _MM_HINT_T0);
+        _mm_prefetch((char *)(((void *)join_res) + PDIS + 128), _MM_HINT_T0);
+#endif
+        v_write_index =
+            _mm512_mask_expand_epi64(v_zero512, m_match, v_base_offset);
+        _mm512_mask_i64scatter_epi64((void *)join_res, m_match, v_write_index,
+                                     state[k].payload, 1);
+        v_write_index = _mm512_add_epi64(v_write_index, v_word_size);
+        _mm512_mask_i64scatter_epi64(((void *)join_res), m_match, v_write_index,
+                                     v_right_payload, 1);
+#endif
+        num = _mm_popcnt_u32(state[k].m_have_tuple);
+#if 1
+        if (num == VECTOR_SCALE) {
+#if KNL
+          _mm512_mask_prefetch_i64gather_pd(
+              state[k].ht_off, state[k].m_have_tuple, 0, 1, _MM_HINT_T0);
+#else
+          ht_pos = (uint64_t *)&state[k].ht_off;
+          for (int i = 0; i < VECTOR_SCALE; ++i) {
+            _mm_prefetch((char *)(ht_pos[i]), _MM_HINT_T0);
+          }
+#endif
+        } else
+#endif
+        {
+          if (LIKELY(done < SIMDStateSize)) {
+            num_temp = _mm_popcnt_u32(state[SIMDStateSize].m_have_tuple);
+            if (num + num_temp < VECTOR_SCALE) {
+              // compress v
+              state[k].ht_off = _mm512_maskz_compress_epi64(
+                  state[k].m_have_tuple, state[k].ht_off);
+              state[k].key = _mm512_maskz_compress_epi64(state[k].m_have_tuple,
+                                                         state[k].key);
+              state[k].payload = _mm512_maskz_compress_epi64(
+                  state[k].m_have_tuple, state[k].payload);
+              // expand v -> temp
+              state[SIMDStateSize].ht_off = _mm512_mask_expand_epi64(
+                  state[SIMDStateSize].ht_off,
+                  _mm512_knot(state[SIMDStateSize].m_have_tuple),
+                  state[k].ht_off);
+              state[SIMDStateSize].key = _mm512_mask_expand_epi64(
+                  state[SIMDStateSize].key,
+                  _mm512_knot(state[SIMDStateSize].m_have_tuple), state[k].key);
+              state[SIMDStateSize].payload = _mm512_mask_expand_epi64(
+                  state[SIMDStateSize].payload,
+                  _mm512_knot(state[SIMDStateSize].m_have_tuple),
+                  state[k].payload);
+              state[SIMDStateSize].m_have_tuple = mask[num + num_temp];
+              state[k].m_have_tuple = 0;
+              state[k].stage = 1;
+            } else {
+              // expand temp -> v
+              state[k].ht_off = _mm512_mask_expand_epi64(
+                  state[k].ht_off, _mm512_knot(state[k].m_have_tuple),
+                  state[SIMDStateSize].ht_off);
+              state[k].key = _mm512_mask_expand_epi64(
+                  state[k].key, _mm512_knot(state[k].m_have_tuple),
+                  state[SIMDStateSize].key);
+
+              state[k].payload = _mm512_mask_expand_epi64(
+                  state[k].payload, _mm512_knot(state[k].m_have_tuple),
+                  state[SIMDStateSize].payload);
+              // compress temp
+              state[SIMDStateSize].m_have_tuple =
+                  _mm512_kand(state[SIMDStateSize].m_have_tuple,
+                              _mm512_knot(mask[VECTOR_SCALE - num]));
+              state[SIMDStateSize].ht_off =
+                  _mm512_maskz_compress_epi64(state[SIMDStateSize].m_have_tuple,
+                                              state[SIMDStateSize].ht_off);
+              state[SIMDStateSize].key = _mm512_maskz_compress_epi64(
+                  state[SIMDStateSize].m_have_tuple, state[SIMDStateSize].key);
+              state[SIMDStateSize].payload =
+                  _mm512_maskz_compress_epi64(state[SIMDStateSize].m_have_tuple,
+                                              state[SIMDStateSize].payload);
+              state[k].m_have_tuple = mask[VECTOR_SCALE];
+              state[SIMDStateSize].m_have_tuple =
+                  (state[SIMDStateSize].m_have_tuple >> (VECTOR_SCALE - num));
+              state[k].stage = 0;
+#if KNL
+              _mm512_mask_prefetch_i64gather_pd(
+                  state[k].ht_off, state[k].m_have_tuple, 0, 1, _MM_HINT_T0);
+#elif DIR_PREFETCH
+              ht_pos = (uint64_t *)&state[k].ht_off;
+              for (int i = 0; i < VECTOR_SCALE; ++i) {
+                _mm_prefetch((char *)(ht_pos[i]), _MM_HINT_T0);
+              }
+#else
+              m_have_tuple = state[k].m_have_tuple;
+              ht_pos = (uint64_t *)&state[k].ht_off;
+              for (int i = 0; (i < VECTOR_SCALE) & (m_have_tuple);
+                   ++i, (m_have_tuple >> 1)) {
+                if (m_have_tuple & 1) {
+                  _mm_prefetch((char *)(ht_pos[i]), _MM_HINT_T0);
+                }
+              }
+#endif
+            }
+          }
+        }
+      } break;
+    }
+    ++k;
+  }
+  return matches;
+}
+/** scatters the lanes in m_out as (left, right) tuples to the result */
+static inline int64_t simd_emit(chainedtuplebuffer_t *chainedbuf, __mmask8 m_out,
+                                __m512i v_left, __m512i v_right,
+                                __m512i v_base_offset) {
+  int32_t new_add = _mm_popcnt_u32(m_out);
+  tuple_t *join_res = cb_next_n_writepos(chainedbuf, new_add);
+  __m512i v_write_index =
+      _mm512_mask_expand_epi64(_mm512_set1_epi64(0), m_out, v_base_offset);
+  _mm512_mask_i64scatter_epi64((void *)join_res, m_out, v_write_index, v_left,
+                               1);
+  v_write_index = _mm512_add_epi64(v_write_index, _mm512_set1_epi64(WORDSIZE));
+  _mm512_mask_i64scatter_epi64((void *)join_res, m_out, v_write_index, v_right,
+                               1);
+  return new_add;
+}
+/**
+ * smv_probe() for the PROBE_SEMI, PROBE_ANTI and PROBE_OUTER modes, with the
+ * same output as probe_AMAC_semi(). Lanes of semi and anti probes retire at
+ * their first match, and lanes that reach the end of their chain retire in
+ * all modes. Freed lanes are refilled by lane compaction, so the vectors keep
+ * running at full width.
+ */
+int64_t smv_probe_semi(hashtable_t *ht, relation_t *rel, void *output,
+                       int mode) {
+  int64_t matches = 0;
+  int32_t k = 0, done = 0, num, num_temp;
+  __attribute__((aligned(64))) __mmask8 m_match = 0, m_valid_bucket = 0,
+                                        m_end, m_out, m_have_tuple,
+                                        mask[VECTOR_SCALE + 1];
+  __m512i v_offset = _mm512_set1_epi64(0),
+          v_base_offset_upper =
+              _mm512_set1_epi64(rel->num_tuples * sizeof(tuple_t)),
+          v_base_offset, v_ht_cell, v_factor = _mm512_set1_epi64(ht->hash_mask),
+          v_shift = _mm512_set1_epi64(ht->skip_bits), v_cell_hash,
+          v_neg_one512 = _mm512_set1_epi64(-1),
+          v_zero512 = _mm512_set1_epi64(0),
+          v_ht_addr = _mm512_set1_epi64(ht->buckets),
+          v_word_size = _mm512_set1_epi64(WORDSIZE),
+          v_tuple_size = _mm512_set1_epi64(sizeof(tuple_t)),
+          v_bucket_size = _mm512_set1_epi64(sizeof(bucket_t)),
+          v_next_off = _mm512_set1_epi64(8), v_right_payload,
+          v_payload_off = _mm512_set1_epi64(24);
+  chainedtuplebuffer_t *chainedbuf = (chainedtuplebuffer_t *)output;
+  __attribute__((aligned(64))) uint64_t cur_offset = 0, base_off[16], *ht_pos;
+  for (int i = 0; i <= VECTOR_SCALE; ++i) {
+    base_off[i] = i * sizeof(tuple_t);
+    mask[i] = (1 << i) - 1;
+  }
+  v_base_offset = _mm512_load_epi64(base_off);
+  __attribute__((aligned(64))) StateSIMD state[SIMDStateSize + 1];
+  // init # of the state
+  for (int i = 0; i <= SIMDStateSize; ++i) {
+    state[i].stage = 1;
+    state[i].m_have_tuple = 0;
+    state[i].ht_off = _mm512_set1_epi64(0);
+    state[i].payload = _mm512_set1_epi64(0);
+    state[i].key = _mm512_set1_epi64(0);
+    state[i].matched = _mm512_set1_epi64(0);
+  }
+  for (uint64_t cur = 0; 1;) {
+    k = (k >= SIMDStateSize) ? 0 : k;
+    if (UNLIKELY(cur >= rel->num_tuples)) {
+      if (state[k].m_have_tuple == 0 && state[k].stage != 3) {
+        ++done;
+        state[k].stage = 3;
+        ++k;
+        continue;
+      }
+      if ((done >= SIMDStateSize)) {
+        if (state[SIMDStateSize].m_have_tuple > 0) {
+          k = SIMDStateSize;
+          state[SIMDStateSize].stage = 0;
+        } else {
+          break;
+        }
+      }
+    }
+    switch (state[k].stage) {
+      case 1: {
+#if SEQPREFETCH
+        _mm_prefetch((char *)(((void *)rel->tuples) + cur_offset + PDIS),
+                     _MM_HINT_T0);
+        _mm_prefetch((char *)(((void *)rel->tuples) + cur_offset + PDIS + 64),
+                     _MM_HINT_T0);
+        _mm_prefetch((char *)(((void *)rel->tuples) + cur_offset + PDIS + 128),
+                     _MM_HINT_T0);
+#endif
+        v_offset =
+            _mm512_add_epi64(_mm512_set1_epi64(cur_offset), v_base_offset);
+        cur_offset = cur_offset + base_off[VECTOR_SCALE];
+        cur = cur + VECTOR_SCALE;
+        state[k].m_have_tuple =
+            _mm512_cmpgt_epi64_mask(v_base_offset_upper, v_offset);
+        state[k].key =
+            _mm512_mask_i64gather_epi64(state[k].key, state[k].m_have_tuple,
+                                        v_offset, ((void *)rel->tuples), 1);
+        state[k].payload = _mm512_mask_i64gather_epi64(
+            state[k].payload, state[k].m_have_tuple,
+            _mm512_add_epi64(v_offset, v_word_size), ((void *)rel->tuples), 1);
+        state[k].matched = v_zero512;
+        v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
+        v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
+        v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
+        state[k].ht_off = _mm512_mask_add_epi64(
+            state[k].ht_off, state[k].m_have_tuple, v_cell_hash, v_ht_addr);
+        state[k].stage = 0;
+#if KNL
+        _mm512_mask_prefetch_i64gather_pd(
+            state[k].ht_off, state[k].m_have_tuple, 0, 1, _MM_HINT_T0);
+#else
+        ht_pos = (uint64_t *)&state[k].ht_off;
+        for (int i = 0; i < VECTOR_SCALE; ++i) {
+          _mm_prefetch((char *)(ht_pos[i]), _MM_HINT_T0);
+        }
+#endif
+      } break;
+      case 0: {
+        /////////////////// random access
+        // an empty head bucket ends the chain without a match
+        v_ht_cell = _mm512_mask_i64gather_epi64(
+            v_neg_one512, state[k].m_have_tuple, state[k].ht_off, 0, 1);
+        m_valid_bucket = _mm512_mask_cmpneq_epi64_mask(state[k].m_have_tuple,
+                                                       v_ht_cell, v_zero512);
+        m_end = _mm512_kandn(m_valid_bucket, state[k].m_have_tuple);
+        state[k].m_have_tuple = m_valid_bucket;
+
+        v_ht_cell = _mm512_mask_i64gather_epi64(
+            v_neg_one512, state[k].m_have_tuple,
+            _mm512_add_epi64(state[k].ht_off, v_tuple_size), 0,
+            1);  // note the offset of the tuple in %bucket_t%
+        m_match = _mm512_mask_cmpeq_epi64_mask(state[k].m_have_tuple,
+                                               state[k].key, v_ht_cell);
+        if (mode == PROBE_OUTER) {
+          v_right_payload = _mm512_mask_i64gather_epi64(
+              v_neg_one512, m_match,
+              _mm512_add_epi64(state[k].ht_off, v_payload_off), 0, 1);
+          matches += simd_emit(chainedbuf, m_match, v_right_payload,
+                               state[k].payload, v_base_offset);
+          state[k].matched =
+              _mm512_mask_mov_epi64(state[k].matched, m_match, v_neg_one512);
+        }
+
+        // update next, lanes at the end of their chain retire
+        state[k].ht_off = _mm512_mask_i64gather_epi64(
+            v_zero512, state[k].m_have_tuple,
+            _mm512_add_epi64(state[k].ht_off, v_next_off), 0, 1);
+        m_end = _mm512_kor(m_end, _mm512_mask_cmpeq_epi64_mask(
+                                      state[k].m_have_tuple, state[k].ht_off,
+                                      v_zero512));
+        if (mode == PROBE_OUTER) {
+          m_out = _mm512_kandn(
+              _mm512_cmpneq_epi64_mask(state[k].matched, v_zero512), m_end);
+          matches += simd_emit(chainedbuf, m_out, v_neg_one512,
+                               state[k].payload, v_base_offset);
+        } else {
+          // semi and anti: the first match decides
+          m_out = (mode == PROBE_SEMI) ? m_match : _mm512_kandn(m_match, m_end);
+          matches += simd_emit(chainedbuf, m_out, state[k].key,
+                               state[k].payload, v_base_offset);
+          m_end = _mm512_kor(m_end, m_match);
+        }
+        state[k].m_have_tuple = _mm512_kandn(m_end, state[k].m_have_tuple);
+
+        num = _mm_popcnt_u32(state[k].m_have_tuple);
+        if (num == VECTOR_SCALE) {
+#if KNL
+          _mm512_mask_prefetch_i64gather_pd(
+              state[k].ht_off, state[k].m_have_tuple, 0, 1, _MM_HINT_T0);
+#else
+          ht_pos = (uint64_t *)&state[k].ht_off;
+          for (int i = 0; i < VECTOR_SCALE; ++i) {
+            _mm_prefetch((char *)(ht_pos[i]), _MM_HINT_T0);
+          }
+#endif
+        } else if (LIKELY(done < SIMDStateSize)) {
+          num_temp = _mm_popcnt_u32(state[SIMDStateSize].m_have_tuple);
+          if (num + num_temp < VECTOR_SCALE) {
+            // compress v
+            state[k].ht_off = _mm512_maskz_compress_epi64(state[k].m_have_tuple,
+                                                          state[k].ht_off);
+            state[k].key = _mm512_maskz_compress_epi64(state[k].m_have_tuple,
+                                                       state[k].key);
+            state[k].payload = _mm512_maskz_compress_epi64(
+                state[k].m_have_tuple, state[k].payload);
+            state[k].matched = _mm512_maskz_compress_epi64(
+                state[k].m_have_tuple, state[k].matched);
+            // expand v -> temp
+            m_have_tuple = _mm512_knot(state[SIMDStateSize].m_have_tuple);
+            state[SIMDStateSize].ht_off = _mm512_mask_expand_epi64(
+                state[SIMDStateSize].ht_off, m_have_tuple, state[k].ht_off);
+            state[SIMDStateSize].key = _mm512_mask_expand_epi64(
+                state[SIMDStateSize].key, m_have_tuple, state[k].key);
+            state[SIMDStateSize].payload = _mm512_mask_expand_epi64(
+                state[SIMDStateSize].payload, m_have_tuple, state[k].payload);
+            state[SIMDStateSize].matched = _mm512_mask_expand_epi64(
+                state[SIMDStateSize].matched, m_have_tuple, state[k].matched);
+            state[SIMDStateSize].m_have_tuple = mask[num + num_temp];
+            state[k].m_have_tuple = 0;
+            state[k].stage = 1;
+          } else {
+            // expand temp -> v
+            m_have_tuple = _mm512_knot(state[k].m_have_tuple);
+            state[k].ht_off = _mm512_mask_expand_epi64(
+                state[k].ht_off, m_have_tuple, state[SIMDStateSize].ht_off);
+            state[k].key = _mm512_mask_expand_epi64(
+                state[k].key, m_have_tuple, state[SIMDStateSize].key);
+            state[k].payload = _mm512_mask_expand_epi64(
+                state[k].payload, m_have_tuple, state[SIMDStateSize].payload);
+            state[k].matched = _mm512_mask_expand_epi64(
+                state[k].matched, m_have_tuple, state[SIMDStateSize].matched);
+            // compress temp
+            state[SIMDStateSize].m_have_tuple =
+                _mm512_kand(state[SIMDStateSize].m_have_tuple,
+                            _mm512_knot(mask[VECTOR_SCALE - num]));
+            state[SIMDStateSize].ht_off =
+                _mm512_maskz_compress_epi64(state[SIMDStateSize].m_have_tuple,
+                                            state[SIMDStateSize].ht_off);
+            state[SIMDStateSize].key = _mm512_maskz_compress_epi64(
+                state[SIMDStateSize].m_have_tuple, state[SIMDStateSize].key);
+            state[SIMDStateSize].payload =
+                _mm512_maskz_compress_epi64(state[SIMDStateSize].m_have_tuple,
+                                            state[SIMDStateSize].payload);
+            state[SIMDStateSize].matched =
+                _mm512_maskz_compress_epi64(state[SIMDStateSize].m_have_tuple,
+                                            state[SIMDStateSize].matched);
+            state[k].m_have_tuple = mask[VECTOR_SCALE];
+            state[SIMDStateSize].m_have_tuple =
+                (state[SIMDStateSize].m_have_tuple >> (VECTOR_SCALE - num));
+            state[k].stage = 0;
+#if KNL
+            _mm512_mask_prefetch_i64gather_pd(
+                state[k].ht_off, state[k].m_have_tuple, 0, 1, _MM_HINT_T0);
+#else
+            ht_pos = (uint64_t *)&state[k].ht_off;
+            for (int i = 0; i < VECTOR_SCALE; ++i) {
+              _mm_prefetch((char *)(ht_pos[i]), _MM_HINT_T0);
+            }
+#endif
+          }
+        }
+      } break;
+    }
+    ++k;
+  }
   return matches;
 }
 int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
@@ -1033,6 +1552,7 @@ int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
     state[i].tb_off = _mm512_set1_epi64(0);
     state[i].key = _mm512_set1_epi64(0);
   }
+  PS_BEGIN();
   for (uint64_t cur = 0; 1;) {
     k = (k >= SIMDStateSize) ? 0 : k;
     if (cur >= rel->num_tuples) {
@@ -1053,6 +1573,7 @@ int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
     }
     switch (state[k].stage) {
       case 1: {
+        PS_STAGE(PS_STAGE_ISSUE);
 ///////// step 1: load new tuples' address offsets
 // the offset should be within MAX_32INT_
 // the tail depends on the number of joins and tuples in each bucket
@@ -1075,6 +1596,8 @@ int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
         cur = cur + VECTOR_SCALE;
         state[k].m_have_tuple =
             _mm512_cmpgt_epi64_mask(v_base_offset_upper, v_offset);
+        PS_SIMD_ISSUE(state[k], state[k].m_have_tuple);
+        PS_INFLIGHT(_mm_popcnt_u32(state[k].m_have_tuple));
         ///// step 2: load new cells from right tuples;
         // maybe need offset within a tuple
         state[k].key =
@@ -1085,7 +1608,7 @@ int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
             _mm512_add_epi64(v_offset, v_word_size), ((void *)rel->tuples), 1);
         ///// step 3: load new values from hash tables;
         // hash the cell values
-        v_cell_hash = _mm512_and_epi64(state[k].key, v_factor);
+        v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
         v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
         v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
         state[k].ht_off = _mm512_mask_add_epi64(
@@ -1111,6 +1634,9 @@ int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
 #endif
       } break;
       case 0: {
+        PS_STAGE(PS_STAGE_VISIT);
+        PS_SAMPLE_INFLIGHT();
+        PS_SIMD_VISIT(state[k]);
         /////////////////// random access
         // check valid bucket
         v_ht_cell = _mm512_mask_i64gather_epi64(
@@ -1141,6 +1667,7 @@ int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
         state[k].m_have_tuple =
             _mm512_kand(_mm512_cmpneq_epi64_mask(state[k].ht_off, v_zero512),
                         state[k].m_have_tuple);
+        PS_SIMD_DONE(state[k]);
 
         // to scatter join results
         join_res = cb_next_n_writepos(chainedbuf, new_add);
@@ -1173,6 +1700,7 @@ int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
         if (done < SIMDStateSize)
 #endif
         {
+          PS_STAGE(PS_STAGE_COMPACT);
           num = _mm_popcnt_u32(state[k].m_have_tuple);
           num_temp = _mm_popcnt_u32(state[SIMDStateSize].m_have_tuple);
           flag = (num + num_temp >= VECTOR_SCALE);
@@ -1186,6 +1714,7 @@ int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
               _mm512_maskz_compress_epi64(state[k].m_have_tuple, state[k].key);
           state_temp[0].payload = _mm512_maskz_compress_epi64(
               state[k].m_have_tuple, state[k].payload);
+          PS_SIMD_COMPRESS(state_temp[0], state[k].m_have_tuple, state[k]);
           // expand v -> temp
           state_temp[1].ht_off = _mm512_mask_expand_epi64(
               state[SIMDStateSize].ht_off,
@@ -1199,6 +1728,9 @@ int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
               state[SIMDStateSize].payload,
               _mm512_knot(state[SIMDStateSize].m_have_tuple),
               state_temp[0].payload);
+          PS_SIMD_EXPAND(state_temp[1], state[SIMDStateSize],
+                         _mm512_knot(state[SIMDStateSize].m_have_tuple),
+                         state_temp[0]);
 
           {
             // case: num + num_temp >= VECTOR_SCALE
@@ -1212,6 +1744,9 @@ int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
             state[k].payload = _mm512_mask_expand_epi64(
                 state[k].payload, _mm512_knot(state[k].m_have_tuple),
                 state[SIMDStateSize].payload);
+            PS_SIMD_EXPAND(state[k], state[k],
+                           _mm512_knot(state[k].m_have_tuple),
+                           state[SIMDStateSize]);
             // compress temp
             state[SIMDStateSize].m_have_tuple =
                 _mm512_kand(state[SIMDStateSize].m_have_tuple,
@@ -1223,6 +1758,9 @@ int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
             state[SIMDStateSize].payload =
                 _mm512_maskz_compress_epi64(state[SIMDStateSize].m_have_tuple,
                                             state[SIMDStateSize].payload);
+            PS_SIMD_COMPRESS(state[SIMDStateSize],
+                             state[SIMDStateSize].m_have_tuple,
+                             state[SIMDStateSize]);
           }
 
           {  // merge the results of the two cases
@@ -1239,6 +1777,8 @@ int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
                 state[SIMDStateSize].key, flag, state_temp[1].key);
             state[SIMDStateSize].payload = _mm512_mask_mov_epi64(
                 state[SIMDStateSize].payload, flag, state_temp[1].payload);
+            PS_SIMD_MOV(state[k], flag, state_temp[0]);
+            PS_SIMD_MOV(state[SIMDStateSize], flag, state_temp[1]);
             state[k].m_have_tuple = _mm512_kor(
                 0, _mm512_kand(mask[VECTOR_SCALE], _mm512_knot(flag)));
 
@@ -1272,6 +1812,7 @@ int64_t probe_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
     }
     ++k;
   }
+  PS_END("SIMD_AMAC_COMPACT2");
   return matches;
 }
 
@@ -1350,7 +1891,7 @@ int64_t probe_simd_gp(hashtable_t *ht, relation_t *rel, void *output) {
           _mm512_add_epi64(v_offset, v_word_size), ((void *)rel->tuples), 1);
       ///// step 3: load new values from hash tables;
       // hash the cell values
-      v_cell_hash = _mm512_and_epi64(state[k].key, v_factor);
+      v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
       v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
       v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
       state[k].ht_off =
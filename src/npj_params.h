@@ -19,6 +19,14 @@
 #define BUCKET_SIZE 1
 #endif
 
+/** Tuples of R sampled to estimate its distinct keys, see estimate_distinct */
+#ifndef DISTINCT_SAMPLE_SIZE
+#define DISTINCT_SAMPLE_SIZE (1 << 16)
+#endif
+
+/** Largest runtime bucket size (--bucket-size) of the sbucket_t hashtable */
+#define MAX_BUCKET_SLOTS 8
+
 #ifndef PAGE_SIZE
 #define PAGE_SIZE (1 << 21)
 #endif
@@ -19,8 +19,10 @@
  */
 
 typedef struct bucket_t bucket_t;
+typedef struct sbucket_t sbucket_t;
 typedef struct hashtable_t hashtable_t;
 typedef struct bucket_buffer_t bucket_buffer_t;
+typedef struct hashtable_stats_t hashtable_stats_t;
 
 #if PADDED_BUCKET == 0
 /**
@@ -51,12 +53,55 @@ struct bucket_t {
 } __attribute__((aligned(CACHE_LINE_SIZE)));
 #endif /* PADDED_BUCKET */
 
+/**
+ * Multi-slot bucket, used when the hashtable holds more than one tuple per
+ * bucket (hashtable_t.bucket_size > 1). The keys of all slots are contiguous
+ * so that a single vector compares them, the payloads follow the keys:
+ *
+ *   | latch | count | next | key[0..size) | payload[0..size) | padding |
+ *
+ * Buckets are hashtable_t.bucket_bytes apart, see SBUCKET_AT().
+ */
+struct sbucket_t {
+  volatile char latch;
+  uint8_t count;
+  /* 6B hole */
+  struct sbucket_t* next;
+  intkey_t keys[];
+};
+
+/** the payloads of the S slots of bucket B */
+#define SBUCKET_PAYLOADS(B, S) ((value_t*)((B)->keys + (S)))
+
 /** Hashtable structure for NPO. */
 struct hashtable_t {
   bucket_t* buckets;
   int32_t num_buckets;
   uint32_t hash_mask;
   uint32_t skip_bits;
+  uint32_t bucket_size;  /* tuples per bucket, > 1: buckets are sbucket_t */
+  uint32_t bucket_bytes; /* distance of two buckets */
+};
+
+/** the bucket at index IDX of a hashtable of sbucket_t */
+#define SBUCKET_AT(HT, IDX) \
+  ((sbucket_t*)((char*)(HT)->buckets + (size_t)(IDX) * (HT)->bucket_bytes))
+
+/** chain lengths of more buckets go to the last bin */
+#define HT_STATS_CHAIN_BINS 32
+
+/** Quality of a built hashtable, see hashtable_stats(). */
+struct hashtable_stats_t {
+  uint64_t buckets;  /* head buckets */
+  uint64_t empty;    /* head buckets without tuples */
+  uint64_t overflow; /* overflow buckets */
+  uint64_t tuples;
+  uint64_t max_chain;
+  /* number of chains with i buckets, empty heads count as 0 */
+  uint64_t chain[HT_STATS_CHAIN_BINS];
+  /* cache lines of all chains, and weighted by the tuples of the chain */
+  uint64_t lines;
+  uint64_t tuple_lines;
 };
 
 /** Pre-allocated bucket buffers are used for overflow-buckets. */
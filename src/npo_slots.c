@@ -0,0 +1,393 @@
+/**
+ * @file    npo_slots.c
+ *
+ * @brief  NPO hashtable with several tuples per bucket (--bucket-size).
+ *
+ * The buckets of the default hashtable hold a single tuple, non-unique and
+ * zipf-skewed build relations turn into long chains of 32B buckets and a
+ * probe pays one cache miss per tuple of the chain. Here a bucket holds up to
+ * 8 tuples (sbucket_t) with the keys of all slots side by side, a probe
+ * compares them with one AVX-512 instruction and misses once per bucket. The
+ * number of buckets comes from the estimated distinct keys of R, see
+ * hashtable_num_buckets().
+ */
+#include <stddef.h> /* offsetof */
+
+#include "no_partitioning_join.h"
+
+int bucket_size = 1;
+
+/**
+ * Returns a new sbucket_t of bytes bytes from the given bucket_buffer_t,
+ * which then holds sbucket_t instead of bucket_t. If the bucket_buffer_t is
+ * full, allocates a new one and adds it to the list.
+ */
+static inline sbucket_t *get_new_sbucket(bucket_buffer_t **buf,
+                                         uint32_t bytes) {
+  if ((*buf)->count == sizeof(bucket_t) * OVERFLOW_BUF_SIZE / bytes) {
+    bucket_buffer_t *new_buf =
+        (bucket_buffer_t *)malloc(sizeof(bucket_buffer_t));
+    if (posix_memalign((void **)&(new_buf->buf), PAGE_SIZE,
+                       sizeof(bucket_t) * OVERFLOW_BUF_SIZE)) {
+      perror("overflow buffer : Aligned allocation failed!\n");
+      exit(EXIT_FAILURE);
+    }
+    new_buf->count = 0;
+    new_buf->next = *buf;
+    *buf = new_buf;
+  }
+  return (sbucket_t *)((char *)(*buf)->buf + (size_t)bytes * (*buf)->count++);
+}
+
+/** prefetches all cache lines of the bucket b */
+static inline void sbucket_prefetch(const sbucket_t *b, uint32_t bytes) {
+  for (uint32_t off = 0; off < bytes; off += CACHE_LINE_SIZE) {
+    _mm_prefetch((const char *)b + off, _MM_HINT_T0);
+  }
+}
+
+/** the slots of b holding key, one vector compare for all of them */
+static inline uint32_t sbucket_match(const sbucket_t *b, intkey_t key) {
+  const __mmask16 valid = (1U << b->count) - 1;
+#ifdef KEY_8B
+  return _mm512_mask_cmpeq_epi64_mask(
+      valid, _mm512_maskz_loadu_epi64(valid, b->keys), _mm512_set1_epi64(key));
+#else
+  return _mm512_mask_cmpeq_epi32_mask(
+      valid, _mm512_maskz_loadu_epi32(valid, b->keys), _mm512_set1_epi32(key));
+#endif
+}
+
+/**
+ * Multi-thread build of the multi-slot hashtable, ht is pre-allocated. A
+ * full head gets its overflow bucket right after it, like
+ * build_hashtable_mt(). Writes to a chain are synchronized via the latch of
+ * its head.
+ *
+ * @param ht hastable to be built
+ * @param rel the build relation
+ * @param overflowbuf pre-allocated chunk of buckets for overflow use.
+ */
+void build_hashtable_slots_mt(hashtable_t *ht, relation_t *rel,
+                              bucket_buffer_t **overflowbuf) {
+  const uint32_t hashmask = ht->hash_mask;
+  const uint32_t skipbits = ht->skip_bits;
+  const uint32_t slots = ht->bucket_size;
+
+#ifdef PREFETCH_NPJ
+  size_t prefetch_index = PREFETCH_DISTANCE;
+#endif
+
+  for (uint64_t i = 0; i < rel->num_tuples; i++) {
+    sbucket_t *curr, *nxt, *dest;
+
+#ifdef PREFETCH_NPJ
+    if (prefetch_index < rel->num_tuples) {
+      intkey_t idx_prefetch =
+          HASH(rel->tuples[prefetch_index++].key, hashmask, skipbits);
+      __builtin_prefetch(SBUCKET_AT(ht, idx_prefetch), 1, 1);
+    }
+#endif
+
+    int32_t idx = HASH(rel->tuples[i].key, hashmask, skipbits);
+    curr = SBUCKET_AT(ht, idx);
+    lock(&curr->latch);
+    nxt = curr->next;
+
+    if (curr->count < slots) {
+      dest = curr;
+    } else if (nxt && nxt->count < slots) {
+      dest = nxt;
+    } else {
+      dest = get_new_sbucket(overflowbuf, ht->bucket_bytes);
+      dest->count = 0;
+      dest->next = nxt;
+      curr->next = dest;
+    }
+    dest->keys[dest->count] = rel->tuples[i].key;
+    SBUCKET_PAYLOADS(dest, slots)[dest->count] = rel->tuples[i].payload;
+    dest->count++;
+    unlock(&curr->latch);
+  }
+}
+
+/**
+ * Probes the multi-slot hashtable one tuple after the other, the
+ * counterpart of probe_hashtable().
+ *
+ * @return number of matching tuples
+ */
+int64_t probe_slots(hashtable_t *ht, relation_t *rel, void *output) {
+  int64_t matches = 0;
+  const uint32_t hashmask = ht->hash_mask;
+  const uint32_t skipbits = ht->skip_bits;
+  const uint32_t slots = ht->bucket_size;
+  chainedtuplebuffer_t *chainedbuf = (chainedtuplebuffer_t *)output;
+
+  for (uint64_t i = 0; i < rel->num_tuples; i++) {
+    intkey_t idx = HASH(rel->tuples[i].key, hashmask, skipbits);
+    sbucket_t *b = SBUCKET_AT(ht, idx);
+
+    do {
+      for (uint32_t j = 0; j < b->count; j++) {
+        if (rel->tuples[i].key == b->keys[j]) {
+          ++matches;
+          tuple_t *joinres = cb_next_writepos(chainedbuf);
+          joinres->key = SBUCKET_PAYLOADS(b, slots)[j]; /* R-rid */
+          joinres->payload = rel->tuples[i].payload;    /* S-rid */
+        }
+      }
+      b = b->next; /* follow overflow pointer */
+    } while (b);
+  }
+
+  return matches;
+}
+
+typedef struct slots_state_t slots_state_t;
+
+/** state of a lookup of probe_slots_amac() */
+struct slots_state_t {
+  int64_t tuple_id;
+  sbucket_t *b;
+  int16_t stage;
+#ifdef PROBE_STATS
+  uint64_t ps_start; /* issue tick of the lookup */
+  uint64_t ps_chain; /* buckets visited */
+#endif
+};
+
+/**
+ * AMAC probe of the multi-slot hashtable, ScalarStateSize lookups in flight
+ * like probe_AMAC(). A bucket visit compares the key with all slots at once.
+ *
+ * @return number of matching tuples
+ */
+int64_t probe_slots_amac(hashtable_t *ht, relation_t *rel, void *output) {
+  int64_t matches = 0;
+  int16_t k = 0, done = 0;
+  slots_state_t state[ScalarStateSize];
+  const uint32_t hashmask = ht->hash_mask;
+  const uint32_t skipbits = ht->skip_bits;
+  const uint32_t slots = ht->bucket_size;
+  const uint32_t bytes = ht->bucket_bytes;
+  chainedtuplebuffer_t *chainedbuf = (chainedtuplebuffer_t *)output;
+  PS_BEGIN();
+
+  for (int i = 0; i < ScalarStateSize; ++i) {
+    state[i].stage = 1;
+  }
+  for (uint64_t cur = 0; (done < ScalarStateSize);) {
+    k = (k >= ScalarStateSize) ? 0 : k;
+
+    switch (state[k].stage) {
+      case 1: {
+        PS_STAGE(PS_STAGE_ISSUE);
+        if (cur >= rel->num_tuples) {
+          ++done;
+          state[k].stage = 3;
+          break;
+        }
+#if SEQPREFETCH
+        _mm_prefetch(((char *)(rel->tuples + cur) + PDIS), _MM_HINT_T0);
+#endif
+        intkey_t idx = HASH(rel->tuples[cur].key, hashmask, skipbits);
+        state[k].b = SBUCKET_AT(ht, idx);
+        sbucket_prefetch(state[k].b, bytes);
+        state[k].tuple_id = cur;
+        state[k].stage = 0;
+        PS_ISSUE(state[k]);
+        PS_INFLIGHT(1);
+        ++cur;
+      } break;
+      case 0: {
+        sbucket_t *b = state[k].b;
+        tuple_t *t = rel->tuples + state[k].tuple_id;
+        PS_STAGE(PS_STAGE_VISIT);
+        PS_SAMPLE_INFLIGHT();
+        PS_VISIT(state[k]);
+        for (uint32_t m = sbucket_match(b, t->key); m; m &= m - 1) {
+          ++matches;
+          tuple_t *joinres = cb_next_writepos(chainedbuf);
+          joinres->key = SBUCKET_PAYLOADS(b, slots)[__builtin_ctz(m)];
+          joinres->payload = t->payload;
+        }
+        b = b->next; /* follow overflow pointer */
+        if (b) {
+          state[k].b = b;
+          sbucket_prefetch(b, bytes);
+        } else {
+          PS_DONE(state[k]);
+          PS_INFLIGHT(-1);
+          state[k].stage = 1;
+          --k;
+        }
+      } break;
+    }
+    ++k;
+  }
+
+  PS_END("SLOTS_AMAC");
+  return matches;
+}
+
+/**
+ * SIMD AMAC probe of the multi-slot hashtable for 8B keys, structured like
+ * probe_simd_amac(): each of the SIMDStateSize states probes VECTOR_SCALE
+ * keys, one bucket per lane and visit, and refills the lanes whose chain
+ * ended. A visit compares every slot of the buckets of all lanes, slot by
+ * slot, up to the largest count among the lanes.
+ *
+ * @return number of matching tuples
+ */
+int64_t probe_simd_amac_slots(hashtable_t *ht, relation_t *rel, void *output) {
+  int64_t matches = 0;
+  int32_t new_add = 0, k = 0, done = 0;
+  const uint32_t slots = ht->bucket_size;
+  const uint32_t bytes = ht->bucket_bytes;
+  __mmask8 m_match = 0, m_new_cells = -1, m_slot = 0;
+  __m512i v_offset, v_cell_hash, v_ht_cell, v_count, v_right_payload,
+      v_write_index,
+      v_base_offset_upper =
+          _mm512_set1_epi64(rel->num_tuples * sizeof(tuple_t)),
+      v_factor = _mm512_set1_epi64(ht->hash_mask),
+      v_shift = _mm512_set1_epi64(ht->skip_bits),
+      v_zero512 = _mm512_set1_epi64(0), v_neg_one512 = _mm512_set1_epi64(-1),
+      v_ht_addr = _mm512_set1_epi64((uint64_t)ht->buckets),
+      v_bucket_size = _mm512_set1_epi64(bytes),
+      v_word_size = _mm512_set1_epi64(sizeof(intkey_t)),
+      v_next_off = _mm512_set1_epi64(offsetof(sbucket_t, next)),
+      v_base_offset;
+  /* the gathers of slot j add these offsets to the bucket addresses */
+  const size_t keys_off = offsetof(sbucket_t, keys);
+  const size_t payloads_off = keys_off + slots * sizeof(intkey_t);
+  chainedtuplebuffer_t *chainedbuf = (chainedtuplebuffer_t *)output;
+  tuple_t *join_res = NULL;
+  __attribute__((aligned(64))) uint64_t cur_offset = 0, base_off[16], *ht_pos;
+
+  for (int i = 0; i <= VECTOR_SCALE; ++i) {
+    base_off[i] = i * sizeof(tuple_t);
+  }
+  v_base_offset = _mm512_load_epi64(base_off);
+  StateSIMD state[SIMDStateSize];
+  for (int i = 0; i < SIMDStateSize; ++i) {
+    state[i].stage = 1;
+    state[i].m_have_tuple = 0;
+    state[i].ht_off = _mm512_set1_epi64(0);
+    state[i].tb_off = _mm512_set1_epi64(0);
+    state[i].payload = _mm512_set1_epi64(0);
+    state[i].key = _mm512_set1_epi64(0);
+  }
+  PS_BEGIN();
+  for (uint64_t cur = 0; (cur < rel->num_tuples) || (done < SIMDStateSize);) {
+    k = (k >= SIMDStateSize) ? 0 : k;
+    if (cur >= rel->num_tuples) {
+      if (state[k].m_have_tuple == 0 && state[k].stage != 3) {
+        ++done;
+        state[k].stage = 3;
+        ++k;
+        continue;
+      }
+    }
+    switch (state[k].stage) {
+      case 1: {
+        PS_STAGE(PS_STAGE_ISSUE);
+#if SEQPREFETCH
+        _mm_prefetch((char *)(((void *)rel->tuples) + cur_offset + PDIS),
+                     _MM_HINT_T0);
+        _mm_prefetch((char *)(((void *)rel->tuples) + cur_offset + PDIS + 64),
+                     _MM_HINT_T0);
+#endif
+        ///// refill the lanes whose chain ended with the next tuples
+        v_offset =
+            _mm512_add_epi64(_mm512_set1_epi64(cur_offset), v_base_offset);
+        state[k].tb_off = _mm512_mask_expand_epi64(
+            state[k].tb_off, _mm512_knot(state[k].m_have_tuple), v_offset);
+        m_new_cells = _mm512_knot(state[k].m_have_tuple);
+        new_add = _mm_popcnt_u32(m_new_cells);
+        cur_offset = cur_offset + base_off[new_add];
+        cur = cur + new_add;
+        state[k].m_have_tuple =
+            _mm512_cmpgt_epi64_mask(v_base_offset_upper, state[k].tb_off);
+        m_new_cells = _mm512_kand(m_new_cells, state[k].m_have_tuple);
+        PS_SIMD_ISSUE(state[k], m_new_cells);
+        PS_INFLIGHT(_mm_popcnt_u32(m_new_cells));
+        state[k].key = _mm512_mask_i64gather_epi64(state[k].key, m_new_cells,
+                                                   state[k].tb_off,
+                                                   ((void *)rel->tuples), 1);
+        state[k].payload = _mm512_mask_i64gather_epi64(
+            state[k].payload, m_new_cells,
+            _mm512_add_epi64(state[k].tb_off, v_word_size),
+            ((void *)rel->tuples), 1);
+        ///// hash the new keys to their head buckets
+        v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
+        v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
+        v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
+        state[k].ht_off = _mm512_mask_add_epi64(state[k].ht_off, m_new_cells,
+                                                v_cell_hash, v_ht_addr);
+        state[k].stage = 0;
+        ht_pos = (uint64_t *)&state[k].ht_off;
+        for (int i = 0; i < VECTOR_SCALE; ++i) {
+          if (state[k].m_have_tuple & (1 << i)) {
+            sbucket_prefetch((sbucket_t *)ht_pos[i], bytes);
+          }
+        }
+      } break;
+      case 0: {
+        PS_STAGE(PS_STAGE_VISIT);
+        PS_SAMPLE_INFLIGHT();
+        PS_SIMD_VISIT(state[k]);
+        ///// count is the 2nd byte of the bucket, after the latch
+        v_count = _mm512_mask_i64gather_epi64(v_zero512, state[k].m_have_tuple,
+                                              state[k].ht_off, 0, 1);
+        v_count = _mm512_and_epi64(_mm512_srli_epi64(v_count, 8),
+                                   _mm512_set1_epi64(0xff));
+        ///// compare every slot holding a tuple in some lane
+        for (uint32_t j = 0; j < slots; ++j) {
+          m_slot = _mm512_mask_cmpgt_epi64_mask(state[k].m_have_tuple, v_count,
+                                                _mm512_set1_epi64(j));
+          if (m_slot == 0) break;
+          v_ht_cell = _mm512_mask_i64gather_epi64(
+              v_neg_one512, m_slot, state[k].ht_off,
+              (void *)(keys_off + j * sizeof(intkey_t)), 1);
+          m_match =
+              _mm512_mask_cmpeq_epi64_mask(m_slot, state[k].key, v_ht_cell);
+          if (m_match) {
+            v_right_payload = _mm512_mask_i64gather_epi64(
+                v_neg_one512, m_match, state[k].ht_off,
+                (void *)(payloads_off + j * sizeof(value_t)), 1);
+            new_add = _mm_popcnt_u32(m_match);
+            matches += new_add;
+            join_res = cb_next_n_writepos(chainedbuf, new_add);
+            v_write_index =
+                _mm512_mask_expand_epi64(v_zero512, m_match, v_base_offset);
+            _mm512_mask_i64scatter_epi64((void *)join_res, m_match,
+                                         v_write_index, v_right_payload, 1);
+            v_write_index = _mm512_add_epi64(v_write_index, v_word_size);
+            _mm512_mask_i64scatter_epi64((void *)join_res, m_match,
+                                         v_write_index, state[k].payload, 1);
+          }
+        }
+        ///// follow the overflow pointers
+        state[k].ht_off = _mm512_mask_i64gather_epi64(
+            v_zero512, state[k].m_have_tuple,
+            _mm512_add_epi64(state[k].ht_off, v_next_off), 0, 1);
+        state[k].m_have_tuple =
+            _mm512_kand(_mm512_cmpneq_epi64_mask(state[k].ht_off, v_zero512),
+                        state[k].m_have_tuple);
+        PS_SIMD_DONE(state[k]);
+        ht_pos = (uint64_t *)&state[k].ht_off;
+        for (int i = 0; i < VECTOR_SCALE; ++i) {
+          if (state[k].m_have_tuple & (1 << i)) {
+            sbucket_prefetch((sbucket_t *)ht_pos[i], bytes);
+          }
+        }
+        // return back every time
+        state[k].stage = 1;
+      } break;
+    }
+    ++k;
+  }
+  PS_END("SIMD_AMAC_SLOTS");
+  return matches;
+}
@@ -32,6 +32,8 @@
 #include "barrier.h"   /* pthread_barrier_* */
 #include "affinity.h"  /* pthread_attr_setaffinity_np */
 #include "generator.h" /* numa_localize() */
+#include "results.h"   /* results_add */
+#include "hash_functions.h" /* hash_key, hash_fn */
 
 #ifdef JOIN_RESULT_MATERIALIZE
 #include "tuple_buffer.h" /* for materialization */
@@ -62,7 +64,9 @@
 #endif
 
 /* #define RADIX_HASH(V)  ((V>>7)^(V>>13)^(V>>21)^V) */
-#define HASH_BIT_MODULO(K, MASK, NBITS) (((K)&MASK) >> NBITS)
+/* the radix bits are taken from the hash_fn hash of the key, see --hash */
+#define HASH_BIT_MODULO(K, MASK, NBITS) \
+  ((hash_key((K), hash_fn) & (MASK)) >> (NBITS))
 
 #ifndef NEXT_POW_2
 /**
@@ -1260,6 +1264,7 @@ void *prj_thread(void *param) {
 #ifdef PERF_COUNTERS
   if (my_tid == 0) {
     PCM_stop();
+    PCM_accumulatePhase(PCM_PHASE_PARTITION);
     PCM_log("======= Partitioning phase profiling results ======\n");
     PCM_printResults();
     PCM_start();
@@ -1312,6 +1317,8 @@ void *prj_thread(void *param) {
 #ifdef PERF_COUNTERS
   if (my_tid == 0) {
     PCM_stop();
+    /* build and probe are interleaved per partition, counted as probe */
+    PCM_accumulatePhase(PCM_PHASE_PROBE);
     PCM_log("=========== Build+Probe profiling results =========\n");
     PCM_printResults();
     PCM_log("===================================================\n");
@@ -1341,6 +1348,18 @@ static void print_timing(uint64_t total, uint64_t build, uint64_t part,
   fprintf(stderr, "%.4lf ", cyclestuple);
   fflush(stderr);
   fprintf(stdout, "\n");
+
+  /* thread 0 times the phases in cycles only, the wall time is apportioned */
+  results_add("total", "join", RESULTS_ALL_THREADS, diff_usec, total,
+              numtuples, result);
+  if (build > 0) {
+    results_add("build", "join", RESULTS_ALL_THREADS,
+                diff_usec * build / total, build, numtuples, result);
+  }
+  if (part > 0) {
+    results_add("partition", "join", RESULTS_ALL_THREADS,
+                diff_usec * part / total, part, numtuples, result);
+  }
 }
 
 /**
@@ -1634,11 +1653,13 @@ result_t *RJ(relation_t *relR, relation_t *relS, int nthreads) {
 
   /* compute number of tuples per cluster */
   for (i = 0; i < relR->num_tuples; i++) {
-    uint32_t idx = (relR->tuples[i].key) & ((1 << NUM_RADIX_BITS) - 1);
+    uint32_t idx =
+        HASH_BIT_MODULO(relR->tuples[i].key, (1 << NUM_RADIX_BITS) - 1, 0);
     R_count_per_cluster[idx]++;
   }
   for (i = 0; i < relS->num_tuples; i++) {
-    uint32_t idx = (relS->tuples[i].key) & ((1 << NUM_RADIX_BITS) - 1);
+    uint32_t idx =
+        HASH_BIT_MODULO(relS->tuples[i].key, (1 << NUM_RADIX_BITS) - 1, 0);
     S_count_per_cluster[idx]++;
   }
 
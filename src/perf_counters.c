@@ -2,8 +2,418 @@
 
 #include "perf_counters.h"
 
+#if defined(PERF_COUNTERS) && defined(PERF_EVENT)
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <linux/perf_event.h> /* perf_event_attr */
+#include <sys/syscall.h>      /* SYS_perf_event_open, SYS_gettid */
+#include <sys/ioctl.h>        /* ioctl */
+#include <dirent.h>           /* opendir, readdir */
+#include <errno.h>            /* errno */
+#include <stdint.h>           /* uint64_t */
+#include <stdio.h>            /* FILE, fprintf */
+#include <stdlib.h>           /* malloc, free */
+#include <string.h>           /* strcmp, strerror */
+#include <unistd.h>           /* close, read, getpid */
+
+/** \ingroup PerformanceMonitoring maximum number of counters per thread */
+#define PCM_MAX_EVENTS 8
+/** maximum number of threads that can be monitored */
+#define PCM_MAX_THREADS 256
+
+/** A counter opened for every thread, in one group per thread */
+typedef struct pcm_event_t {
+  char name[64];
+  uint32_t type;
+  uint64_t config;
+} pcm_event_t;
+
+/** Counter group of one thread of the process */
+typedef struct pcm_thread_t {
+  pid_t tid;
+  int leader;
+  int fd[PCM_MAX_EVENTS];   /* -1 if the event is not supported */
+  int slot[PCM_MAX_EVENTS]; /* position of the event in the group read */
+  int nslots;
+  uint64_t before[PCM_MAX_EVENTS];
+  uint64_t after[PCM_MAX_EVENTS];
+} pcm_thread_t;
+
+#define HW_CACHE(cache, op, result)                         \
+  ((PERF_COUNT_HW_CACHE_##cache) | (PERF_COUNT_HW_CACHE_OP_##op << 8) | \
+   (PERF_COUNT_HW_CACHE_RESULT_##result << 16))
+
+/**
+ * The default counters. Memory-bound stalls are taken from the generic
+ * backend stall event; where the PMU does not map it, a raw event such as
+ * CYCLE_ACTIVITY.STALLS_MEM_ANY can be given in the config file.
+ */
+static const pcm_event_t defaultEvents[] = {
+    {"Active-cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"Instructions-retired", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"L1DMisses", PERF_TYPE_HW_CACHE, HW_CACHE(L1D, READ, MISS)},
+    {"LLCMisses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"DTLBMisses", PERF_TYPE_HW_CACHE, HW_CACHE(DTLB, READ, MISS)},
+    {"StalledCyclesBackend", PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_STALLED_CYCLES_BACKEND},
+    {"Task-clock-ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK}};
+
+static const char *phaseNames[PCM_NUM_PHASES] = {
+    "Build", "Partitioning", "Probe", "Materialize", "Aggregation"};
+
+static pcm_event_t events[PCM_MAX_EVENTS];
+static int numEvents;
+static pcm_thread_t threads[PCM_MAX_THREADS];
+static int numThreads;
+static int reportedError;
+static int supported[PCM_MAX_EVENTS]; /* opened for at least one thread */
+
+/** internal state variables */
+static double eventAcc[PCM_MAX_EVENTS];
+static double phaseAcc[PCM_NUM_PHASES][PCM_MAX_THREADS][PCM_MAX_EVENTS];
+static int phaseThreads[PCM_NUM_PHASES];
+static int phaseIntervals[PCM_NUM_PHASES];
+
+/** custom performance counters config file, if NULL no custom config. */
+char * PCM_CONFIG;
+
+/** the output file for performance counter results, if NULL output to stdout */
+char * PCM_OUT;
+
+static char *
+mystrdup (const char *s)
+{
+    char *ss = (char*) malloc (strlen (s) + 1);
+
+    if (ss != NULL)
+        memcpy (ss, s, strlen(s) + 1);
+
+    return ss;
+}
+
+static FILE *
+pcm_open_out()
+{
+    FILE * out = PCM_OUT ? fopen(PCM_OUT, "a") : NULL;
+    return out ? out : stdout;
+}
+
+static void
+pcm_close_out(FILE * out)
+{
+    if (out != stdout)
+        fclose(out);
+}
+
+static int
+perf_event_open(struct perf_event_attr * attr, pid_t tid, int group_fd)
+{
+    return (int) syscall(SYS_perf_event_open, attr, tid, -1, group_fd, 0);
+}
+
+/**
+ * Opens the counter group of one thread. Events the PMU (or the VM) does
+ * not support are skipped, the first event that opens leads the group.
+ */
+static void
+pcm_open_thread(pcm_thread_t * t, pid_t tid)
+{
+    struct perf_event_attr attr;
+
+    t->tid = tid;
+    t->leader = -1;
+    t->nslots = 0;
+    for (int i = 0; i < numEvents; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                           | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        t->fd[i] = perf_event_open(&attr, tid, t->leader);
+        if (t->fd[i] < 0) {
+            if (!reportedError) {
+                fprintf(stderr, "[WARN ] perf_event_open(%s): %s, see "
+                        "/proc/sys/kernel/perf_event_paranoid\n",
+                        events[i].name, strerror(errno));
+                reportedError = 1;
+            }
+            continue;
+        }
+        if (t->leader < 0)
+            t->leader = t->fd[i];
+        supported[i] = 1;
+        t->slot[i] = t->nslots++;
+    }
+}
+
+static int
+cmp_thread(const void * a, const void * b)
+{
+    return ((const pcm_thread_t *) a)->tid - ((const pcm_thread_t *) b)->tid;
+}
+
+/**
+ * Opens counters for the threads of the process that are not monitored yet.
+ * The main thread only waits for the workers, so it is left out unless it
+ * is the one doing the measurement.
+ */
+static void
+pcm_attach_threads()
+{
+    DIR * dir = opendir("/proc/self/task");
+    struct dirent * ent;
+    pid_t self = (pid_t) syscall(SYS_gettid);
+
+    if (dir == NULL)
+        return;
+    while ((ent = readdir(dir)) != NULL && numThreads < PCM_MAX_THREADS) {
+        pid_t tid = (pid_t) atoi(ent->d_name);
+        int i;
+        if (tid <= 0 || (tid == getpid() && tid != self))
+            continue;
+        for (i = 0; i < numThreads; i++)
+            if (threads[i].tid == tid)
+                break;
+        if (i == numThreads)
+            pcm_open_thread(&threads[numThreads++], tid);
+    }
+    closedir(dir);
+    /* in creation order, so that thread i is mostly worker i */
+    qsort(threads, numThreads, sizeof(pcm_thread_t), cmp_thread);
+}
+
+/** Reads the group of a thread, scaled up if the group was multiplexed */
+static void
+pcm_read_thread(pcm_thread_t * t, uint64_t * values)
+{
+    uint64_t buf[3 + PCM_MAX_EVENTS];
+
+    memset(values, 0, numEvents * sizeof(uint64_t));
+    if (t->leader < 0
+        || read(t->leader, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t)))
+        return;
+
+    /* buf = { nr, time_enabled, time_running, values[nr] } */
+    double scale = (buf[2] > 0 && buf[2] < buf[1])
+                   ? (double) buf[1] / buf[2] : 1.0;
+    for (int i = 0; i < numEvents; i++)
+        if (t->fd[i] >= 0 && (uint64_t) t->slot[i] < buf[0])
+            values[i] = (uint64_t) (buf[3 + t->slot[i]] * scale);
+}
+
+static double
+pcm_delta(const pcm_thread_t * t, int i)
+{
+    return (double) (t->after[i] - t->before[i]);
+}
+
+static void
+pcm_print_counters(FILE * out, const double * v)
+{
+    for (int i = 0; i < numEvents; i++)
+        if (supported[i])
+            fprintf(out, "%s %.0lf\n", events[i].name, v[i]);
+    if (v[0] > 0)
+        fprintf(out, "IPC %lf\n", v[1] / v[0]);
+}
+
+static void
+pcm_print_thread_line(FILE * out, int tid, const double * v)
+{
+    fprintf(out, "thread %d:", tid);
+    for (int i = 0; i < numEvents; i++)
+        if (supported[i])
+            fprintf(out, " %s=%.0lf", events[i].name, v[i]);
+    fprintf(out, "\n");
+}
+
+void
+PCM_initPerformanceMonitor(const char * pcmcfg, const char * pcmout)
+{
+    numEvents = 0;
+    numThreads = 0;
+    reportedError = 0;
+
+    if(pcmcfg)
+        PCM_CONFIG = mystrdup(pcmcfg);
+
+    if(pcmout)
+        PCM_OUT = mystrdup(pcmout);
+
+    if(PCM_CONFIG) {
+        /**
+         * Same format as for Intel PCM: every line names a raw event with
+         * its event number and umask in hex, e.g.
+         * "DTLB_LOAD_MISSES.ANY 0x08 0x01". Cycles and instructions are
+         * always counted in addition.
+         */
+        FILE * cfg = fopen(PCM_CONFIG, "r");
+        unsigned int event, umask;
+
+        memcpy(events, defaultEvents, 2 * sizeof(pcm_event_t));
+        numEvents = 2;
+        if (cfg == NULL) {
+            perror("Could not open the performance counter config");
+        } else {
+            while (numEvents < PCM_MAX_EVENTS
+                   && fscanf(cfg, "%63s %x %x", events[numEvents].name,
+                             &event, &umask) == 3) {
+                events[numEvents].type = PERF_TYPE_RAW;
+                events[numEvents].config = event | (umask << 8);
+                numEvents++;
+            }
+            fclose(cfg);
+        }
+    }
+    else {
+        numEvents = sizeof(defaultEvents) / sizeof(pcm_event_t);
+        memcpy(events, defaultEvents, sizeof(defaultEvents));
+    }
+
+    pcm_attach_threads();
+}
+
+void
+PCM_start()
+{
+    /* threads created after the initialization are picked up here */
+    pcm_attach_threads();
+    for (int t = 0; t < numThreads; t++)
+        pcm_read_thread(&threads[t], threads[t].before);
+}
+
+void
+PCM_stop()
+{
+    for (int t = 0; t < numThreads; t++)
+        pcm_read_thread(&threads[t], threads[t].after);
+}
+
+void
+PCM_printResults()
+{
+    FILE * out = pcm_open_out();
+    double total[PCM_MAX_EVENTS] = {0.0}, v[PCM_MAX_EVENTS];
+
+    for (int t = 0; t < numThreads; t++)
+        for (int i = 0; i < numEvents; i++)
+            total[i] += pcm_delta(&threads[t], i);
+    pcm_print_counters(out, total);
+
+    if (numThreads > 1) {
+        for (int t = 0; t < numThreads; t++) {
+            for (int i = 0; i < numEvents; i++)
+                v[i] = pcm_delta(&threads[t], i);
+            pcm_print_thread_line(out, t, v);
+        }
+    }
+    pcm_close_out(out);
+}
+
+void
+PCM_accumulate()
+{
+    for (int t = 0; t < numThreads; t++)
+        for (int i = 0; i < numEvents; i++)
+            eventAcc[i] += pcm_delta(&threads[t], i);
+}
+
+void
+PCM_printAccumulators()
+{
+    FILE * out = pcm_open_out();
+
+    pcm_print_counters(out, eventAcc);
+    pcm_close_out(out);
+}
+
+void
+PCM_accumulatePhase(int phase)
+{
+    for (int t = 0; t < numThreads; t++)
+        for (int i = 0; i < numEvents; i++)
+            phaseAcc[phase][t][i] += pcm_delta(&threads[t], i);
+    if (numThreads > phaseThreads[phase])
+        phaseThreads[phase] = numThreads;
+    phaseIntervals[phase]++;
+}
+
+void
+PCM_printPhases()
+{
+    FILE * out = pcm_open_out();
+
+    for (int p = 0; p < PCM_NUM_PHASES; p++) {
+        double total[PCM_MAX_EVENTS] = {0.0};
+
+        if (phaseIntervals[p] == 0)
+            continue;
+        for (int t = 0; t < phaseThreads[p]; t++)
+            for (int i = 0; i < numEvents; i++)
+                total[i] += phaseAcc[p][t][i];
+
+        fprintf(out, "========== %s phase, %d threads ==========\n",
+                phaseNames[p], phaseThreads[p]);
+        pcm_print_counters(out, total);
+        if (phaseThreads[p] > 1)
+            for (int t = 0; t < phaseThreads[p]; t++)
+                pcm_print_thread_line(out, t, phaseAcc[p][t]);
+    }
+    pcm_close_out(out);
+}
+
+int
+PCM_getPhase(int phase, const char ** names, double * values, int max)
+{
+    int n = 0;
+
+    if (phaseIntervals[phase] == 0)
+        return 0;
+    for (int i = 0; i < numEvents && n < max; i++) {
+        if (!supported[i])
+            continue;
+        names[n] = events[i].name;
+        values[n] = 0.0;
+        for (int t = 0; t < phaseThreads[phase]; t++)
+            values[n] += phaseAcc[phase][t][i];
+        n++;
+    }
+    return n;
+}
+
+const char *
+PCM_phaseName(int phase)
+{
+    return phaseNames[phase];
+}
+
+void
+PCM_cleanup()
+{
+    /* PCM_CONFIG and PCM_OUT are kept, later phases are monitored again */
+    for (int t = 0; t < numThreads; t++)
+        for (int i = 0; i < numEvents; i++)
+            if (threads[t].fd[i] >= 0)
+                close(threads[t].fd[i]);
+    numThreads = 0;
+}
+
+void
+PCM_log(char * msg)
+{
+    FILE * out = pcm_open_out();
+
+    fprintf(out, "%s\n", msg);
+    pcm_close_out(out);
+}
+
 /** Intel PCM is only available from C++ */
-#if defined(__cplusplus) && defined(PERF_COUNTERS)
+#elif defined(__cplusplus) && defined(PERF_COUNTERS)
 
 #include <iostream>
 #include <fstream>
@@ -118,16 +528,9 @@ PCM_initPerformanceMonitor(const char * pcmcfg, const char * pcmout)
         cout << "Access to Intel(r) Performance Counter Monitor has denied "
              << "(Performance Monitoring Unit is occupied by other application)."
              << "Try to stop the application that uses PMU." << endl;
-        cout << "Alternatively you can try to reset PMU configuration at your"
-             << " own risk. Try to reset? (y/n)" << endl;
-        char yn;
-        std::cin >> yn;
-        if ('y' == yn)
-        {
-            m->resetPMU();
-            cout << "PMU configuration has been reset. Try to rerun the "
-                 << "program again." << endl;
-        }
+        cout << "Alternatively reset the PMU configuration at your own "
+             << "risk, e.g. with `pcm.x -r', or build with --enable-perfevent."
+             << endl;
         break;
     default:
         cout << "Access to Intel(r) Performance Counter Monitor has denied "
@@ -292,6 +695,31 @@ PCM_printAccumulators()
     outf.close();
 }
 
+/** per phase, the Intel PCM counters are only kept for the whole process */
+void
+PCM_accumulatePhase(int phase)
+{
+    PCM_accumulate();
+}
+
+void
+PCM_printPhases()
+{
+    PCM_printAccumulators();
+}
+
+int
+PCM_getPhase(int phase, const char ** names, double * values, int max)
+{
+    return 0;
+}
+
+const char *
+PCM_phaseName(int phase)
+{
+    return "";
+}
+
 void
 PCM_cleanup()
 {
@@ -334,6 +762,12 @@ void PCM_printResults(){}
 void PCM_cleanup(){}
 void PCM_accumulate(){}
 void PCM_printAccumulators(){}
+void PCM_accumulatePhase(int phase){}
+void PCM_printPhases(){}
+int PCM_getPhase(int phase, const char ** names, double * values, int max){
+    return 0;
+}
+const char * PCM_phaseName(int phase){ return ""; }
 void PCM_log(char * msg){}
 
 #endif /*PERF_COUNTERS*/
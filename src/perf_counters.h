@@ -14,8 +14,11 @@
 
 
 /** @defgroup PerformanceMonitoring Performance Monitoring Tools.
- * A set of methods to use Intel Performance Counter Monitor library.
- * @warning This tool is only available when compiled with C++ (g++).
+ * A set of methods to use Intel Performance Counter Monitor library, or with
+ * PERF_EVENT the Linux perf_event_open() interface.
+ * @warning The Intel PCM backend is only available when compiled with C++
+ * (g++). The perf_event backend needs no MSR access and counts every thread
+ * of the process separately.
  *
  * @{
  */
@@ -35,6 +38,14 @@
 #define PER_SYSTEM 0
 #endif
 
+/** Phases the counters of an interval can be attributed to */
+#define PCM_PHASE_BUILD 0
+#define PCM_PHASE_PARTITION 1
+#define PCM_PHASE_PROBE 2
+#define PCM_PHASE_MATERIALIZE 3
+#define PCM_PHASE_AGGREGATE 4
+#define PCM_NUM_PHASES 5
+
 /** custom performance counters config file, if NULL no custom config. */
 extern char * PCM_CONFIG;
 
@@ -96,6 +107,39 @@ PCM_accumulate();
 void
 PCM_printAccumulators();
 
+/**
+ * Adds the counters between the last start and stop calls, per thread, to
+ * the accumulators of the given phase (one of PCM_PHASE_x). The phase
+ * accumulators survive PCM_cleanup().
+ *
+ */
+void
+PCM_accumulatePhase(int phase);
+
+/**
+ * Prints the counters of every phase so far, aggregated over all threads and
+ * per thread.
+ *
+ */
+void
+PCM_printPhases();
+
+/**
+ * Returns the accumulated counters of a phase, summed over all threads.
+ *
+ * @param phase one of PCM_PHASE_x
+ * @param names receives the event names, max entries
+ * @param values receives the event values, max entries
+ *
+ * @return number of events, 0 if the phase was not monitored
+ */
+int
+PCM_getPhase(int phase, const char ** names, double * values, int max);
+
+/** Returns the name of a phase, e.g. "Probe" */
+const char *
+PCM_phaseName(int phase);
+
 /**
  * Logs a message to the performance counters output file (default is stdout)
  *
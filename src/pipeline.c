@@ -145,6 +145,7 @@ void *pipeline_thread(void *param) {
   total_num = 0;
   arg_t *args = (arg_t *)param;
   struct timeval t1, t2;
+  result_timer_t rt;
   int deltaT = 0;
   /* allocate overflow buffer for each thread */
   bucket_buffer_t *overflowbuf;
@@ -170,12 +171,15 @@ void *pipeline_thread(void *param) {
   }
 #endif
   gettimeofday(&t1, NULL);
+  results_start(&rt);
   /* insert tuples from the assigned part of relR to the ht */
   build_hashtable_mt(args->ht, &args->relR, &overflowbuf);
+  results_thread("build", "build", args->tid, &rt, args->relR.num_tuples, 0);
 
   /* wait at a barrier until each thread completes build phase */
   BARRIER_ARRIVE(args->barrier, rv);
   if (args->tid == 0) {
+    results_total("build", "build", &rt, 0);
     gettimeofday(&t2, NULL);
     deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
     printf("--------build costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -185,6 +189,7 @@ void *pipeline_thread(void *param) {
 #ifdef PERF_COUNTERS
   if (args->tid == 0) {
     PCM_stop();
+    PCM_accumulatePhase(PCM_PHASE_BUILD);
     PCM_log("========== Build phase profiling results ==========\n");
     PCM_printResults();
     PCM_start();
@@ -234,14 +239,18 @@ void *pipeline_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results =
         pipeline_smv(args->ht, &args->relS, chainedbuf_compact1);
+    results_thread("probe", "SMV pipeline", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
     total_num += args->num_results;
     unlock(&g_lock);
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "SMV pipeline", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("---- SMV pipeline costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -319,13 +328,17 @@ void *pipeline_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results = pipeline_AMAC(args->ht, &args->relS, chainedbuf_amac);
+    results_thread("probe", "AMAC pipeline", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
     total_num += args->num_results;
     unlock(&g_lock);
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "AMAC pipeline", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("--------AMAC pipeline costs time (ms) = %lf\n",
@@ -379,14 +392,18 @@ void *pipeline_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results =
         pipeline_simd_amac(args->ht, &args->relS, chainedbuf_simd_amac);
+    results_thread("probe", "SIMD AMAC pipeline", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
     total_num += args->num_results;
     unlock(&g_lock);
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "SIMD AMAC pipeline", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("---SIMD AMAC pipeline costs time (ms) = %lf\n",
@@ -409,14 +426,18 @@ void *pipeline_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results =
         pipeline_simd_amac_raw(args->ht, &args->relS, chainedbuf_simd_amac_raw);
+    results_thread("probe", "SIMD AMAC RAW", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
     total_num += args->num_results;
     unlock(&g_lock);
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "SIMD AMAC RAW", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("---  SIMD AMAC RAW costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -436,13 +457,17 @@ void *pipeline_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results = pipeline_simd(args->ht, &args->relS, chainedbuf_simd);
+    results_thread("probe", "SIMD pipeline", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
     total_num += args->num_results;
     unlock(&g_lock);
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "SIMD pipeline", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("--------SIMD pipeline costs time (ms) = %lf\n",
@@ -465,13 +490,17 @@ void *pipeline_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results = pipeline_raw(args->ht, &args->relS, chainedbuf);
+    results_thread("probe", "RAW pipeline", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
     total_num += args->num_results;
     unlock(&g_lock);
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "RAW pipeline", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("-------- RAW pipeline costs time (ms) = %lf\n",
@@ -503,6 +532,7 @@ void *pipeline_thread(void *param) {
 #ifdef PERF_COUNTERS
   if (args->tid == 0) {
     PCM_stop();
+    PCM_accumulatePhase(PCM_PHASE_PROBE);
     PCM_log("========== Probe phase profiling results ==========\n");
     PCM_printResults();
     PCM_log("===================================================\n");
@@ -79,7 +79,7 @@ int64_t pipeline_simd(hashtable_t *ht, relation_t *rel, void *output) {
 
     ///// step 3: load new values from hash tables;
     // hash the cell values
-    v_cell_hash = _mm512_and_epi64(v_tuple_cell, v_factor);
+    v_cell_hash = _mm512_and_epi64(HASH_SIMD(v_tuple_cell), v_factor);
     v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
     v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
     v_ht_pos =
@@ -222,7 +222,7 @@ int64_t pipeline_simd_amac(hashtable_t *ht, relation_t *rel, void *output) {
       case 2: {
         ///// step 3: load new values from hash tables;
         // hash the cell values
-        v_cell_hash = _mm512_and_epi64(state[k].key, v_factor);
+        v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
         v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
         v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
         state[k].ht_off = _mm512_mask_add_epi64(state[k].ht_off, m_new,
@@ -393,7 +393,7 @@ int64_t pipeline_simd_amac_raw(hashtable_t *ht, relation_t *rel, void *output) {
 
         ///// step 3: load new values from hash tables;
         // hash the cell values
-        v_cell_hash = _mm512_and_epi64(state[k].key, v_factor);
+        v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
         v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
         v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
         state[k].ht_off = _mm512_mask_add_epi64(
@@ -590,7 +590,7 @@ int64_t pipeline_simd_amac_compact(hashtable_t *ht, relation_t *rel,
             _mm512_add_epi64(v_offset, v_word_size), ((void *)rel->tuples), 1);
         ///// step 3: load new values from hash tables;
         // hash the cell values
-        v_cell_hash = _mm512_and_epi64(state[k].key, v_factor);
+        v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
         v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
         v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
         state[k].ht_off = _mm512_mask_add_epi64(
@@ -928,7 +928,7 @@ int64_t pipeline_smv(hashtable_t *ht, relation_t *rel, void *output) {
       case 2: {
         ///// step 3: load new values from hash tables;
         // hash the cell values
-        v_cell_hash = _mm512_and_epi64(state[k].key, v_factor);
+        v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
         v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
         v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
         state[k].ht_off = _mm512_mask_add_epi64(
@@ -1191,7 +1191,7 @@ int64_t pipeline_simd_amac_compact2(hashtable_t *ht, relation_t *rel,
             _mm512_add_epi64(v_offset, v_word_size), ((void *)rel->tuples), 1);
         ///// step 3: load new values from hash tables;
         // hash the cell values
-        v_cell_hash = _mm512_and_epi64(state[k].key, v_factor);
+        v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
         v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
         v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
         state[k].ht_off = _mm512_mask_add_epi64(
@@ -1456,7 +1456,7 @@ int64_t pipeline_simd_gp(hashtable_t *ht, relation_t *rel, void *output) {
           _mm512_add_epi64(v_offset, v_word_size), ((void *)rel->tuples), 1);
       ///// step 3: load new values from hash tables;
       // hash the cell values
-      v_cell_hash = _mm512_and_epi64(state[k].key, v_factor);
+      v_cell_hash = _mm512_and_epi64(HASH_SIMD(state[k].key), v_factor);
       v_cell_hash = _mm512_srlv_epi64(v_cell_hash, v_shift);
       v_cell_hash = _mm512_mullo_epi64(v_cell_hash, v_bucket_size);
       state[k].ht_off =
@@ -4,20 +4,30 @@
 #include <immintrin.h>
 #include "types.h"
 #include "npj_types.h"
+#include "probe_stats.h" /* PS_*, compiled out without PROBE_STATS */
+#include "hash_functions.h" /* hash_key_simd, hash_fn */
 typedef struct amac_state_t scalar_state_t;
 typedef struct StateSIMD StateSIMD;
 #define UNLIKELY(expr) __builtin_expect(!!(expr), 0)
 #define LIKELY(expr) __builtin_expect(!!(expr), 1)
 
-#define ScalarStateSize 20
+/* default group sizes (in-flight lookups) of the scalar and SIMD kernels */
+#define SCALAR_STATE_SIZE 20
 #define PDIS 192
-#define SIMDStateSize 5
+#define SIMD_STATE_SIZE 5
+/* the group sizes in use, --sweep changes them without recompiling */
+extern int scalar_state_size;
+extern int simd_state_size;
+#define ScalarStateSize scalar_state_size
+#define SIMDStateSize simd_state_size
 
 #define LOAD_FACTOR 1
 #define MULTI_TUPLE (BUCKET_SIZE - 1)
 #define REPEAT_PROBE 3
 #define SLEEP_TIME 0
 #define VECTOR_SCALE 8
+/* hashes the keys of a vector before the bucket bits are taken, see HASH */
+#define HASH_SIMD(V) hash_key_simd((V), hash_fn)
 #define DIR_PREFETCH 1
 #define SEQPREFETCH PDIS
 #define DIVIDE 0
@@ -26,6 +36,15 @@ typedef struct StateSIMD StateSIMD;
 #define SIMD_A _mm512_set1_epi64(A)
 #define SIMD_B _mm512_set1_epi64(B)
 #define AFFINITY 1
+/* probe modes of the *_semi kernels, the other kernels are inner joins */
+#define PROBE_SEMI 1  /* EXISTS: emit the S tuple at its first match */
+#define PROBE_ANTI 2  /* NOT EXISTS: emit the S tuples without any match */
+#define PROBE_OUTER 3 /* left outer: all matches + unmatched S with NULL_RID */
+#define NULL_RID -1
+/* also run the PROBE_SEMI, PROBE_ANTI and PROBE_OUTER probes */
+#define SEMI_PROBE 0
+/* also probe a bit-packed copy of relS, see compressed_relation.h */
+#define COMPRESSED_PROBE 0
 #if KNL
 #define _mm512_mullo_epi64(a, b) _mm512_mullo_epi32(a, b)
 #endif
@@ -36,14 +55,24 @@ struct amac_state_t {
   int64_t tuple_id;
   bucket_t *b;
   int16_t stage;
+  int16_t matched;
+#ifdef PROBE_STATS
+  uint64_t ps_start; /* issue tick of the lookup */
+  uint64_t ps_chain; /* buckets visited */
+#endif
 };
 struct StateSIMD {
   __m512i key;
   __m512i payload;
   __m512i tb_off;
   __m512i ht_off;
+  __m512i matched;
   __mmask8 m_have_tuple;
   char stage;
+#ifdef PROBE_STATS
+  __m512i ps_start; /* issue ticks of the lanes */
+  __m512i ps_chain; /* buckets visited by the lanes */
+#endif
 };
 
 #endif /* SRC_PREFETCH_H_ */
@@ -0,0 +1,152 @@
+/**
+ * @file    probe_stats.c
+ *
+ * @brief  Aggregation and report of the probe kernel instrumentation.
+ */
+#ifdef PROBE_STATS
+#include <pthread.h> /* pthread_mutex_t */
+#include <stdio.h>   /* printf */
+#include <string.h>  /* strcmp, memset */
+
+#include "probe_stats.h"
+#include "results.h" /* results_counter */
+
+#define PS_MAX_KERNELS 32
+
+typedef struct ps_kernel_t ps_kernel_t;
+
+struct ps_kernel_t {
+  const char *name;
+  probe_stats_t stats;
+};
+
+__thread probe_stats_t probe_stats_tls;
+
+static ps_kernel_t ps_kernels[PS_MAX_KERNELS];
+static int ps_num_kernels;
+static pthread_mutex_t ps_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void ps_add(uint64_t *dst, const uint64_t *src, int n) {
+  for (int i = 0; i < n; i++) dst[i] += src[i];
+}
+
+void probe_stats_merge(const char *kernel) {
+  probe_stats_t *t = &probe_stats_tls;
+  int i;
+
+  pthread_mutex_lock(&ps_lock);
+  for (i = 0; i < ps_num_kernels; i++) {
+    if (strcmp(ps_kernels[i].name, kernel) == 0) break;
+  }
+  if (i == ps_num_kernels && i < PS_MAX_KERNELS) {
+    ps_kernels[ps_num_kernels++].name = kernel;
+  }
+  if (i < PS_MAX_KERNELS) {
+    probe_stats_t *s = &ps_kernels[i].stats;
+    s->lookups += t->lookups;
+    ps_add(s->latency, t->latency, PS_LATENCY_BINS);
+    ps_add(s->chain, t->chain, PS_CHAIN_BINS);
+    ps_add(s->lanes, t->lanes, PS_LANE_BINS);
+    ps_add(s->inflight, t->inflight, PS_INFLIGHT_BINS);
+    ps_add(s->stage_cycles, t->stage_cycles, PS_NUM_STAGES);
+    ps_add(s->stage_visits, t->stage_visits, PS_NUM_STAGES);
+  }
+  pthread_mutex_unlock(&ps_lock);
+  memset(t, 0, sizeof(probe_stats_t));
+}
+
+static uint64_t ps_total(const uint64_t *h, int n) {
+  uint64_t total = 0;
+  for (int i = 0; i < n; i++) total += h[i];
+  return total;
+}
+
+static double ps_mean(const uint64_t *h, int n) {
+  uint64_t total = ps_total(h, n);
+  double sum = 0;
+  for (int i = 0; i < n; i++) sum += (double)i * h[i];
+  return total ? sum / total : 0;
+}
+
+/** smallest bin holding at least fraction q of the histogram */
+static int ps_quantile(const uint64_t *h, int n, double q) {
+  uint64_t total = ps_total(h, n), sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum += h[i];
+    if (sum > 0 && sum >= q * total) return i;
+  }
+  return n - 1;
+}
+
+/** log2: bins are powers of two, open: the last bin holds the larger values */
+static void ps_print_hist(const char *what, const uint64_t *h, int n,
+                          int log2, int open) {
+  uint64_t total = ps_total(h, n);
+  if (total == 0) return;
+  printf("  %s:\n", what);
+  for (int i = 0; i < n; i++) {
+    if (h[i] == 0) continue;
+    if (log2)
+      printf("    [%llu, %llu) %llu (%.2lf%%)\n", 1ULL << i, 2ULL << i, h[i],
+             100.0 * h[i] / total);
+    else
+      printf("    %s%d %llu (%.2lf%%)\n", open && i == n - 1 ? ">=" : "", i,
+             h[i], 100.0 * h[i] / total);
+  }
+}
+
+void probe_stats_print() {
+  static const char *stages[PS_NUM_STAGES] = {"issue", "visit", "compact"};
+
+  pthread_mutex_lock(&ps_lock);
+  for (int k = 0; k < ps_num_kernels; k++) {
+    const char *name = ps_kernels[k].name;
+    probe_stats_t *s = &ps_kernels[k].stats;
+    uint64_t cycles = ps_total(s->stage_cycles, PS_NUM_STAGES);
+    int p50 = ps_quantile(s->latency, PS_LATENCY_BINS, 0.5);
+    int p90 = ps_quantile(s->latency, PS_LATENCY_BINS, 0.9);
+    int p99 = ps_quantile(s->latency, PS_LATENCY_BINS, 0.99);
+
+    printf("==== %s probe stats: %llu lookups, latency (cycles) p50 < %llu, "
+           "p90 < %llu, p99 < %llu, chain %.2lf, in flight %.2lf",
+           name, s->lookups, 2ULL << p50, 2ULL << p90, 2ULL << p99,
+           ps_mean(s->chain, PS_CHAIN_BINS),
+           ps_mean(s->inflight, PS_INFLIGHT_BINS));
+    if (ps_total(s->lanes, PS_LANE_BINS))
+      printf(", lanes %.2lf of %d", ps_mean(s->lanes, PS_LANE_BINS),
+             PS_LANE_BINS - 1);
+    printf("\n");
+    printf("  cycles:");
+    for (int i = 0; i < PS_NUM_STAGES; i++) {
+      if (s->stage_visits[i] == 0) continue;
+      printf(" %s %.1lf%% (%.1lf per visit)", stages[i],
+             cycles ? 100.0 * s->stage_cycles[i] / cycles : 0,
+             (double)s->stage_cycles[i] / s->stage_visits[i]);
+    }
+    printf("\n");
+    ps_print_hist("latency (cycles)", s->latency, PS_LATENCY_BINS, 1, 1);
+    ps_print_hist("chain length (buckets)", s->chain, PS_CHAIN_BINS, 0, 1);
+    ps_print_hist("active lanes per bucket visit", s->lanes, PS_LANE_BINS, 0,
+                  0);
+    ps_print_hist("lookups in flight", s->inflight, PS_INFLIGHT_BINS, 0, 1);
+
+    results_counter(name, "lookups", s->lookups);
+    results_counter(name, "latency_p50_cycles", 2ULL << p50);
+    results_counter(name, "latency_p90_cycles", 2ULL << p90);
+    results_counter(name, "latency_p99_cycles", 2ULL << p99);
+    results_counter(name, "chain_mean", ps_mean(s->chain, PS_CHAIN_BINS));
+    if (ps_total(s->lanes, PS_LANE_BINS))
+      results_counter(name, "lanes_mean", ps_mean(s->lanes, PS_LANE_BINS));
+    results_counter(name, "inflight_mean",
+                    ps_mean(s->inflight, PS_INFLIGHT_BINS));
+    for (int i = 0; i < PS_NUM_STAGES; i++) {
+      char key[32];
+      if (s->stage_visits[i] == 0) continue;
+      snprintf(key, sizeof(key), "%s_cycles", stages[i]);
+      results_counter(name, key, s->stage_cycles[i]);
+    }
+  }
+  pthread_mutex_unlock(&ps_lock);
+}
+
+#endif /* PROBE_STATS */
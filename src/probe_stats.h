@@ -0,0 +1,174 @@
+/**
+ * @file    probe_stats.h
+ *
+ * @brief  Per-lookup instrumentation of the interleaved probe kernels.
+ *
+ * With --enable-probestats (-DPROBE_STATS) the GP, AMAC and SIMD kernels
+ * read the time stamp counter with rdtscp at every state transition and
+ * record
+ *  - the latency of every lookup, from hashing the key to leaving the chain,
+ *  - the number of buckets visited per lookup (chain length),
+ *  - the active lanes of every SIMD bucket visit (lane utilization),
+ *  - the number of lookups in flight at every state visit and
+ *  - the cycles spent in the issue, bucket visit and compaction stages.
+ * The counters are thread-local and merged per kernel at its end. Without
+ * PROBE_STATS all PS_* macros are empty and the state structs carry no extra
+ * fields, the kernels are exactly the uninstrumented ones.
+ */
+#ifndef PROBE_STATS_H
+#define PROBE_STATS_H
+
+/** stages of the kernels the cycles are attributed to */
+#define PS_STAGE_ISSUE 0   /* hash the key and prefetch the bucket */
+#define PS_STAGE_VISIT 1   /* compare with a bucket and follow the chain */
+#define PS_STAGE_COMPACT 2 /* refill lanes, SIMD kernels with compaction */
+#define PS_NUM_STAGES 3
+
+#define PS_LATENCY_BINS 40 /* log2 of cycles */
+#define PS_CHAIN_BINS 16   /* last bin: longer chains */
+#define PS_LANE_BINS 9     /* 0..VECTOR_SCALE active lanes */
+#define PS_INFLIGHT_BINS 256
+
+#ifdef PROBE_STATS
+#include <stdint.h>     /* uint64_t */
+#include <x86intrin.h>  /* __rdtscp */
+#include <immintrin.h>  /* __m512i */
+
+typedef struct probe_stats_t probe_stats_t;
+
+struct probe_stats_t {
+  uint64_t lookups;
+  uint64_t latency[PS_LATENCY_BINS];
+  uint64_t chain[PS_CHAIN_BINS];
+  uint64_t lanes[PS_LANE_BINS];
+  uint64_t inflight[PS_INFLIGHT_BINS];
+  uint64_t stage_cycles[PS_NUM_STAGES];
+  uint64_t stage_visits[PS_NUM_STAGES];
+};
+
+/** counters of the kernel running on this thread */
+extern __thread probe_stats_t probe_stats_tls;
+
+/** adds the thread-local counters to those of kernel and clears them */
+void probe_stats_merge(const char *kernel);
+
+static inline uint64_t ps_tick() {
+  unsigned int aux;
+  return __rdtscp(&aux);
+}
+
+static inline void ps_lookup_done(uint64_t cycles, uint64_t chain) {
+  int bin = cycles ? 63 - __builtin_clzll(cycles) : 0;
+  probe_stats_tls.lookups++;
+  probe_stats_tls.latency[bin < PS_LATENCY_BINS ? bin : PS_LATENCY_BINS - 1]++;
+  probe_stats_tls.chain[chain < PS_CHAIN_BINS ? chain : PS_CHAIN_BINS - 1]++;
+}
+
+/** records the lanes in done, their issue ticks and chain lengths */
+static inline void ps_lanes_done(uint64_t now, __m512i start, __m512i chain,
+                                 __mmask8 done) {
+  __attribute__((aligned(64))) uint64_t s[8], c[8];
+  _mm512_store_epi64(s, start);
+  _mm512_store_epi64(c, chain);
+  for (; done; done &= done - 1) {
+    int i = __builtin_ctz(done);
+    ps_lookup_done(now - s[i], c[i]);
+  }
+}
+
+/* declares the locals of the instrumentation, at the top of a kernel */
+#define PS_BEGIN()                           \
+  uint64_t ps_now = ps_tick(), ps_prev = ps_now; \
+  int ps_stage = PS_STAGE_ISSUE;             \
+  int64_t ps_inflight = 0;                   \
+  __mmask8 ps_active = 0
+
+/* the kernel enters stage S, the time since the last one is charged to it */
+#define PS_STAGE(S)                                          \
+  do {                                                       \
+    ps_now = ps_tick();                                      \
+    probe_stats_tls.stage_cycles[ps_stage] += ps_now - ps_prev; \
+    probe_stats_tls.stage_visits[ps_stage]++;                \
+    ps_prev = ps_now;                                        \
+    ps_stage = (S);                                          \
+  } while (0)
+
+/* N lookups were issued (positive) or finished (negative) */
+#define PS_INFLIGHT(N) (ps_inflight += (N))
+
+/* samples the number of lookups in flight */
+#define PS_SAMPLE_INFLIGHT()                                         \
+  probe_stats_tls.inflight[ps_inflight < PS_INFLIGHT_BINS           \
+                               ? ps_inflight                        \
+                               : PS_INFLIGHT_BINS - 1]++
+
+/* scalar state: lookup issued now, one more bucket, lookup finished */
+#define PS_ISSUE(ST) ((ST).ps_start = ps_now, (ST).ps_chain = 0)
+#define PS_VISIT(ST) ((ST).ps_chain++)
+#define PS_DONE(ST) ps_lookup_done(ps_now - (ST).ps_start, (ST).ps_chain)
+
+/* SIMD state: lanes M issued now, one more bucket for the active lanes */
+#define PS_SIMD_ISSUE(ST, M)                                         \
+  ((ST).ps_start = _mm512_mask_mov_epi64((ST).ps_start, (M),        \
+                                         _mm512_set1_epi64(ps_now)), \
+   (ST).ps_chain = _mm512_maskz_mov_epi64(_mm512_knot(M), (ST).ps_chain))
+#define PS_SIMD_VISIT(ST)                                             \
+  ((ST).ps_chain = _mm512_mask_add_epi64((ST).ps_chain, (ST).m_have_tuple, \
+                                         (ST).ps_chain,                 \
+                                         _mm512_set1_epi64(1)),         \
+   ps_active = (ST).m_have_tuple,                                       \
+   probe_stats_tls.lanes[_mm_popcnt_u32(ps_active)]++)
+/* the lanes active at PS_SIMD_VISIT that left their chain since */
+#define PS_SIMD_DONE(ST)                                                   \
+  do {                                                                     \
+    __mmask8 ps_done = ps_active & ~(ST).m_have_tuple;                     \
+    ps_lanes_done(ps_now, (ST).ps_start, (ST).ps_chain, ps_done);          \
+    PS_INFLIGHT(-(int64_t)_mm_popcnt_u32(ps_done));                        \
+  } while (0)
+
+/* moves the instrumentation lanes along with the compacted key lanes */
+#define PS_SIMD_COMPRESS(DST, M, SRC)                                 \
+  ((DST).ps_start = _mm512_maskz_compress_epi64((M), (SRC).ps_start), \
+   (DST).ps_chain = _mm512_maskz_compress_epi64((M), (SRC).ps_chain))
+#define PS_SIMD_EXPAND(DST, BASE, M, SRC)                                \
+  ((DST).ps_start =                                                      \
+       _mm512_mask_expand_epi64((BASE).ps_start, (M), (SRC).ps_start),   \
+   (DST).ps_chain =                                                      \
+       _mm512_mask_expand_epi64((BASE).ps_chain, (M), (SRC).ps_chain))
+#define PS_SIMD_MOV(DST, M, SRC)                                          \
+  ((DST).ps_start = _mm512_mask_mov_epi64((DST).ps_start, (M), (SRC).ps_start), \
+   (DST).ps_chain = _mm512_mask_mov_epi64((DST).ps_chain, (M), (SRC).ps_chain))
+
+/* charges the last stage and merges the counters as those of KERNEL */
+#define PS_END(KERNEL)                 \
+  do {                                 \
+    PS_STAGE(PS_STAGE_ISSUE);          \
+    probe_stats_merge(KERNEL);         \
+  } while (0)
+
+/**
+ * Prints the histograms of all instrumented kernels and adds their
+ * summaries to the results (see results.h).
+ */
+void probe_stats_print();
+
+#else /* !PROBE_STATS */
+
+#define PS_BEGIN()
+#define PS_STAGE(S)
+#define PS_INFLIGHT(N)
+#define PS_SAMPLE_INFLIGHT()
+#define PS_ISSUE(ST)
+#define PS_VISIT(ST)
+#define PS_DONE(ST)
+#define PS_SIMD_ISSUE(ST, M)
+#define PS_SIMD_VISIT(ST)
+#define PS_SIMD_DONE(ST)
+#define PS_SIMD_COMPRESS(DST, M, SRC)
+#define PS_SIMD_EXPAND(DST, BASE, M, SRC)
+#define PS_SIMD_MOV(DST, M, SRC)
+#define PS_END(KERNEL)
+
+#endif /* PROBE_STATS */
+
+#endif /* PROBE_STATS_H */
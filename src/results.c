@@ -0,0 +1,461 @@
+/**
+ * @file    results.c
+ *
+ * @brief  Collection and JSON/CSV output of the benchmark results.
+ */
+#include <math.h>    /* sqrt */
+#include <pthread.h> /* pthread_mutex_t */
+#include <stdio.h>   /* FILE, fprintf */
+#include <stdlib.h>  /* realloc, qsort */
+#include <string.h>  /* strcmp, strncpy */
+
+#include "results.h"
+
+#define RESULTS_NAME_LEN 64
+
+typedef struct result_record_t result_record_t;
+typedef struct result_param_t result_param_t;
+typedef struct result_stats_t result_stats_t;
+
+struct result_record_t {
+  char phase[RESULTS_NAME_LEN];
+  char kernel[RESULTS_NAME_LEN];
+  int point; /* sweep point, -1 outside of a sweep */
+  int tid;
+  double usecs;
+  uint64_t cycles;
+  uint64_t ntuples;
+  int64_t nresults;
+};
+
+/**
+ * configuration parameter (kind 's', 'i', 'd'), counter (kind 'c') or
+ * parameter of a sweep point (kind 'p' with an int, 'q' with a double)
+ */
+struct result_param_t {
+  char key[RESULTS_NAME_LEN];
+  int point;
+  char phase[RESULTS_NAME_LEN];
+  char kind;
+  char str[256];
+  int64_t i;
+  double d;
+};
+
+struct result_stats_t {
+  double min;
+  double median;
+  double stddev;
+};
+
+static pthread_mutex_t results_lock = PTHREAD_MUTEX_INITIALIZER;
+static result_record_t *records;
+static int num_records, cap_records;
+static result_param_t *params;
+static int num_params, cap_params;
+static int cur_point = -1, num_points;
+
+static void copy_name(char *dst, const char *src) {
+  strncpy(dst, src, RESULTS_NAME_LEN - 1);
+  dst[RESULTS_NAME_LEN - 1] = 0;
+}
+
+void results_add(const char *phase, const char *kernel, int tid, double usecs,
+                 uint64_t cycles, uint64_t ntuples, int64_t nresults) {
+  pthread_mutex_lock(&results_lock);
+  if (num_records == cap_records) {
+    cap_records = cap_records ? 2 * cap_records : 256;
+    records = (result_record_t *)realloc(records,
+                                         cap_records * sizeof(result_record_t));
+    if (!records) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  result_record_t *r = &records[num_records++];
+  copy_name(r->phase, phase);
+  copy_name(r->kernel, kernel);
+  r->point = cur_point;
+  r->tid = tid;
+  r->usecs = usecs;
+  r->cycles = cycles;
+  r->ntuples = ntuples;
+  r->nresults = nresults;
+  pthread_mutex_unlock(&results_lock);
+}
+
+static double elapsed_usecs(const result_timer_t *t) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - t->start.tv_sec) * 1000000.0 + now.tv_usec -
+         t->start.tv_usec;
+}
+
+void results_thread(const char *phase, const char *kernel, int tid,
+                    const result_timer_t *t, uint64_t ntuples,
+                    int64_t nresults) {
+  results_add(phase, kernel, tid, elapsed_usecs(t), curtick() - t->tick,
+              ntuples, nresults);
+}
+
+void results_total(const char *phase, const char *kernel,
+                   const result_timer_t *t, int64_t nresults) {
+  results_add(phase, kernel, RESULTS_ALL_THREADS, elapsed_usecs(t),
+              curtick() - t->tick, 0, nresults);
+}
+
+static result_param_t *new_param(const char *phase, const char *key,
+                                 char kind) {
+  if (num_params == cap_params) {
+    cap_params = cap_params ? 2 * cap_params : 64;
+    params =
+        (result_param_t *)realloc(params, cap_params * sizeof(result_param_t));
+    if (!params) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  result_param_t *p = &params[num_params++];
+  copy_name(p->phase, phase);
+  copy_name(p->key, key);
+  p->kind = kind;
+  p->point = cur_point;
+  return p;
+}
+
+void results_config_str(const char *key, const char *value) {
+  result_param_t *p = new_param("", key, 's');
+  strncpy(p->str, value ? value : "", sizeof(p->str) - 1);
+  p->str[sizeof(p->str) - 1] = 0;
+}
+
+void results_config_int(const char *key, int64_t value) {
+  new_param("", key, 'i')->i = value;
+}
+
+void results_config_double(const char *key, double value) {
+  new_param("", key, 'd')->d = value;
+}
+
+void results_point_begin() {
+  pthread_mutex_lock(&results_lock);
+  cur_point = num_points++;
+  pthread_mutex_unlock(&results_lock);
+}
+
+void results_point_int(const char *key, int64_t value) {
+  new_param("", key, 'p')->i = value;
+}
+
+void results_point_double(const char *key, double value) {
+  new_param("", key, 'q')->d = value;
+}
+
+void results_counter(const char *phase, const char *event, double value) {
+  new_param(phase, event, 'c')->d = value;
+}
+
+void results_clear() {
+  pthread_mutex_lock(&results_lock);
+  num_records = 0;
+  num_params = 0;
+  num_points = 0;
+  cur_point = -1;
+  pthread_mutex_unlock(&results_lock);
+}
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : (x > y);
+}
+
+static result_stats_t stats(const double *v, int n) {
+  result_stats_t s = {0.0, 0.0, 0.0};
+  double sorted[n > 0 ? n : 1], mean = 0.0;
+  int i;
+
+  if (n == 0) return s;
+  memcpy(sorted, v, n * sizeof(double));
+  qsort(sorted, n, sizeof(double), cmp_double);
+  s.min = sorted[0];
+  s.median =
+      (n & 1) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+  for (i = 0; i < n; i++) mean += v[i];
+  mean /= n;
+  for (i = 0; i < n; i++) s.stddev += (v[i] - mean) * (v[i] - mean);
+  s.stddev = sqrt(s.stddev / n);
+  return s;
+}
+
+static int same_kernel(const result_record_t *a, const result_record_t *b) {
+  return a->point == b->point && strcmp(a->phase, b->phase) == 0 &&
+         strcmp(a->kernel, b->kernel) == 0;
+}
+
+/** Summary of all runs of one kernel of a phase */
+typedef struct kernel_summary_t {
+  int repeats;
+  double ms[256];
+  double cycles[256];
+  double tps[256]; /* tuples per second of every repeat */
+  result_stats_t ms_stats, cycles_stats, tps_stats;
+  int64_t nresults;
+  int max_tid;
+} kernel_summary_t;
+
+/**
+ * Summarizes the kernel of records[first]. The n-th record of a thread and
+ * the n-th record of all threads belong to the n-th repeat.
+ */
+static void summarize(int first, kernel_summary_t *s) {
+  uint64_t tuples[256];
+  int per_tid_runs[1024];
+  int i, n = 0;
+
+  memset(tuples, 0, sizeof(tuples));
+  memset(per_tid_runs, 0, sizeof(per_tid_runs));
+  s->max_tid = -1;
+  s->nresults = 0;
+  /* the records of a sweep point are contiguous */
+  for (i = first; i < num_records && records[i].point == records[first].point;
+       i++) {
+    result_record_t *r = &records[i];
+    if (!same_kernel(r, &records[first])) continue;
+    if (r->tid == RESULTS_ALL_THREADS) {
+      if (n < 256) {
+        s->ms[n] = r->usecs / 1000.0;
+        s->cycles[n] = (double)r->cycles;
+        tuples[n] += r->ntuples;
+        n++;
+      }
+      s->nresults = r->nresults;
+    } else if (r->tid < 1024) {
+      int rep = per_tid_runs[r->tid]++;
+      if (rep < 256) tuples[rep] += r->ntuples;
+      if (r->tid > s->max_tid) s->max_tid = r->tid;
+    }
+  }
+  s->repeats = n;
+  for (i = 0; i < n; i++) {
+    s->tps[i] = s->ms[i] > 0 ? tuples[i] / (s->ms[i] / 1000.0) : 0.0;
+  }
+  s->ms_stats = stats(s->ms, n);
+  s->cycles_stats = stats(s->cycles, n);
+  s->tps_stats = stats(s->tps, n);
+}
+
+/** Whether records[i] is the first record of its kernel */
+static int first_of_kernel(int i) {
+  int j;
+  for (j = i - 1; j >= 0 && records[j].point == records[i].point; j--)
+    if (same_kernel(&records[j], &records[i])) return 0;
+  return 1;
+}
+
+static void json_string(FILE *out, const char *s) {
+  fputc('"', out);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') fputc('\\', out);
+    fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+static void json_number(FILE *out, double v) {
+  if (isnan(v) || isinf(v))
+    fprintf(out, "null");
+  else
+    fprintf(out, "%.6lf", v);
+}
+
+static void json_stats(FILE *out, const char *name, result_stats_t s,
+                       const double *v, int n) {
+  int i;
+  fprintf(out, "\"%s\": {\"min\": ", name);
+  json_number(out, s.min);
+  fprintf(out, ", \"median\": ");
+  json_number(out, s.median);
+  fprintf(out, ", \"stddev\": ");
+  json_number(out, s.stddev);
+  fprintf(out, ", \"values\": [");
+  for (i = 0; i < n; i++) {
+    if (i) fprintf(out, ", ");
+    json_number(out, v[i]);
+  }
+  fprintf(out, "]}");
+}
+
+static void json_threads(FILE *out, int first, int max_tid) {
+  int tid, i, n;
+
+  fprintf(out, "\"threads\": [");
+  for (tid = 0; tid <= max_tid; tid++) {
+    fprintf(out, "%s\n        {\"tid\": %d, \"runs\": [", tid ? "," : "", tid);
+    n = 0;
+    for (i = first; i < num_records; i++) {
+      result_record_t *r = &records[i];
+      if (r->tid != tid || !same_kernel(r, &records[first])) continue;
+      fprintf(out, "%s{\"time_ms\": ", n++ ? ", " : "");
+      json_number(out, r->usecs < 0 ? NAN : r->usecs / 1000.0);
+      fprintf(out, ", \"cycles\": %llu, \"tuples\": %llu, \"results\": %lld}",
+              (unsigned long long)r->cycles, (unsigned long long)r->ntuples,
+              (long long)r->nresults);
+    }
+    fprintf(out, "]}");
+  }
+  fprintf(out, "]");
+}
+
+static void json_point(FILE *out, int point) {
+  int i, n = 0;
+  fprintf(out, "\"point\": {");
+  for (i = 0; i < num_params; i++) {
+    result_param_t *p = &params[i];
+    if ((p->kind != 'p' && p->kind != 'q') || p->point != point) continue;
+    fprintf(out, "%s", n++ ? ", " : "");
+    json_string(out, p->key);
+    if (p->kind == 'p')
+      fprintf(out, ": %lld", (long long)p->i);
+    else {
+      fprintf(out, ": ");
+      json_number(out, p->d);
+    }
+  }
+  fprintf(out, "}");
+}
+
+static void write_json(FILE *out) {
+  kernel_summary_t *s = (kernel_summary_t *)malloc(sizeof(kernel_summary_t));
+  int i, j, n;
+
+  fprintf(out, "{\n  \"config\": {");
+  for (i = 0, n = 0; i < num_params; i++) {
+    result_param_t *p = &params[i];
+    if (p->kind != 's' && p->kind != 'i' && p->kind != 'd') continue;
+    fprintf(out, "%s\n    ", n++ ? "," : "");
+    json_string(out, p->key);
+    fprintf(out, ": ");
+    if (p->kind == 's')
+      json_string(out, p->str);
+    else if (p->kind == 'i')
+      fprintf(out, "%lld", (long long)p->i);
+    else
+      json_number(out, p->d);
+  }
+  fprintf(out, "\n  },\n  \"phases\": [");
+
+  for (i = 0, n = 0; i < num_records; i++) {
+    if (!first_of_kernel(i)) continue;
+    summarize(i, s);
+    fprintf(out, "%s\n    {", n++ ? "," : "");
+    if (records[i].point >= 0) {
+      json_point(out, records[i].point);
+      fprintf(out, ",\n      ");
+    }
+    fprintf(out, "\"phase\": ");
+    json_string(out, records[i].phase);
+    fprintf(out, ", \"kernel\": ");
+    json_string(out, records[i].kernel);
+    fprintf(out, ", \"repeats\": %d, \"results\": %lld,\n      ", s->repeats,
+            (long long)s->nresults);
+    json_stats(out, "time_ms", s->ms_stats, s->ms, s->repeats);
+    fprintf(out, ",\n      ");
+    json_stats(out, "cycles", s->cycles_stats, s->cycles, s->repeats);
+    fprintf(out, ",\n      ");
+    json_stats(out, "tuples_per_sec", s->tps_stats, s->tps, s->repeats);
+    fprintf(out, ",\n      ");
+    json_threads(out, i, s->max_tid);
+    fprintf(out, "}");
+  }
+  fprintf(out, "\n  ],\n  \"counters\": {");
+
+  for (i = 0, n = 0; i < num_params; i++) {
+    result_param_t *p = &params[i];
+    int m = 0;
+    if (p->kind != 'c') continue;
+    for (j = 0; j < i; j++)
+      if (params[j].kind == 'c' && strcmp(params[j].phase, p->phase) == 0)
+        break;
+    if (j < i) continue; /* phase already written */
+    fprintf(out, "%s\n    ", n++ ? "," : "");
+    json_string(out, p->phase);
+    fprintf(out, ": {");
+    for (j = i; j < num_params; j++) {
+      if (params[j].kind != 'c' || strcmp(params[j].phase, p->phase)) continue;
+      fprintf(out, "%s", m++ ? ", " : "");
+      json_string(out, params[j].key);
+      fprintf(out, ": ");
+      json_number(out, params[j].d);
+    }
+    fprintf(out, "}");
+  }
+  fprintf(out, "\n  }\n}\n");
+  free(s);
+}
+
+/** One row per kernel, prefixed by the configuration */
+static void write_csv(FILE *out) {
+  kernel_summary_t *s = (kernel_summary_t *)malloc(sizeof(kernel_summary_t));
+  int i, j;
+
+  for (j = 0; j < num_params; j++) {
+    result_param_t *p = &params[j];
+    if (p->kind == 's' || p->kind == 'i' || p->kind == 'd')
+      fprintf(out, "%s,", p->key);
+  }
+  /* the parameters of all sweep points are those of the first one */
+  for (j = 0; j < num_params; j++) {
+    result_param_t *p = &params[j];
+    if ((p->kind == 'p' || p->kind == 'q') && p->point == 0)
+      fprintf(out, "%s,", p->key);
+  }
+  fprintf(out,
+          "phase,kernel,repeats,results,time_ms_min,time_ms_median,"
+          "time_ms_stddev,cycles_min,cycles_median,cycles_stddev,"
+          "tuples_per_sec_median\n");
+
+  for (i = 0; i < num_records; i++) {
+    if (!first_of_kernel(i)) continue;
+    summarize(i, s);
+    for (j = 0; j < num_params; j++) {
+      result_param_t *p = &params[j];
+      if (p->kind == 's')
+        fprintf(out, "%s,", p->str);
+      else if (p->kind == 'i')
+        fprintf(out, "%lld,", (long long)p->i);
+      else if (p->kind == 'd')
+        fprintf(out, "%lf,", p->d);
+    }
+    for (j = 0; j < num_params; j++) {
+      result_param_t *p = &params[j];
+      if (p->point != records[i].point || records[i].point < 0) continue;
+      if (p->kind == 'p')
+        fprintf(out, "%lld,", (long long)p->i);
+      else if (p->kind == 'q')
+        fprintf(out, "%lf,", p->d);
+    }
+    fprintf(out, "%s,%s,%d,%lld,%lf,%lf,%lf,%.0lf,%.0lf,%.0lf,%.0lf\n",
+            records[i].phase, records[i].kernel, s->repeats,
+            (long long)s->nresults, s->ms_stats.min, s->ms_stats.median,
+            s->ms_stats.stddev, s->cycles_stats.min, s->cycles_stats.median,
+            s->cycles_stats.stddev, s->tps_stats.median);
+  }
+  free(s);
+}
+
+void results_write(const char *filename) {
+  size_t len = strlen(filename);
+  FILE *out = fopen(filename, "w");
+
+  if (out == NULL) {
+    perror("Could not open the results file");
+    return;
+  }
+  pthread_mutex_lock(&results_lock);
+  if (len > 4 && strcmp(filename + len - 4, ".csv") == 0)
+    write_csv(out);
+  else
+    write_json(out);
+  pthread_mutex_unlock(&results_lock);
+  fclose(out);
+}
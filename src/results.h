@@ -0,0 +1,91 @@
+/**
+ * @file    results.h
+ *
+ * @brief  Machine-readable benchmark results.
+ *
+ * The join threads record the time, cycles, processed tuples and result
+ * count of every kernel run, per thread and for all threads together. main()
+ * adds the configuration and the performance counters and writes everything
+ * as JSON, or as CSV with one summary row per kernel, at the end of the run.
+ * Repeated runs of a kernel (REPEAT_PROBE) are summarized by min, median and
+ * standard deviation.
+ */
+#ifndef RESULTS_H
+#define RESULTS_H
+#include <stdint.h>   /* uint64_t */
+#include <sys/time.h> /* gettimeofday */
+#include "rdtsc.h"    /* curtick */
+
+/** @defgroup Results Benchmark result output
+ * @{
+ */
+
+/** Records of all threads together use this as thread id */
+#define RESULTS_ALL_THREADS -1
+
+typedef struct result_timer_t result_timer_t;
+
+/** Start of a measured interval */
+struct result_timer_t {
+  struct timeval start;
+  uint64_t tick;
+};
+
+static inline void results_start(result_timer_t *t) {
+  gettimeofday(&t->start, NULL);
+  t->tick = curtick();
+}
+
+/**
+ * Records one run of a kernel. Thread-safe.
+ *
+ * @param phase build, partition, probe, ...
+ * @param kernel name of the kernel or algorithm
+ * @param tid thread id or RESULTS_ALL_THREADS
+ * @param usecs wall time, negative if unknown
+ * @param cycles elapsed cycles
+ * @param ntuples number of input tuples processed
+ * @param nresults number of results produced
+ */
+void results_add(const char *phase, const char *kernel, int tid, double usecs,
+                 uint64_t cycles, uint64_t ntuples, int64_t nresults);
+
+/** Records the run of a thread, from t until now */
+void results_thread(const char *phase, const char *kernel, int tid,
+                    const result_timer_t *t, uint64_t ntuples,
+                    int64_t nresults);
+
+/** Records the run of all threads, from t until now */
+void results_total(const char *phase, const char *kernel,
+                   const result_timer_t *t, int64_t nresults);
+
+/** Adds a configuration parameter to the output */
+void results_config_str(const char *key, const char *value);
+void results_config_int(const char *key, int64_t value);
+void results_config_double(const char *key, double value);
+
+/**
+ * Starts a new point of a parameter sweep. The records that follow belong
+ * to it and are summarized separately from those of other points.
+ */
+void results_point_begin();
+
+/** Adds a parameter of the current sweep point */
+void results_point_int(const char *key, int64_t value);
+void results_point_double(const char *key, double value);
+
+/** Adds the value of a performance counter in a phase to the output */
+void results_counter(const char *phase, const char *event, double value);
+
+/**
+ * Writes all records to filename, as CSV if the name ends in ".csv" and as
+ * JSON otherwise.
+ */
+void results_write(const char *filename);
+
+/** Drops all records, the configuration and the counters */
+void results_clear();
+
+/** @} */
+
+#endif /* RESULTS_H */
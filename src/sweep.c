@@ -0,0 +1,509 @@
+/**
+ * @file    sweep.c
+ *
+ * @brief  Parameter sweep over the NPO probe kernels, see sweep.h.
+ */
+#include "no_partitioning_join.h" /* hashtable_t, probe kernels */
+#include "sweep.h"
+#include <ctype.h> /* isspace */
+
+#define SWEEP_MAX_VALUES 64
+#define SWEEP_NAME_LEN 32
+
+/* which group size of the kernel is swept */
+#define SWEEP_GROUP_NONE 0
+#define SWEEP_GROUP_SCALAR 1
+#define SWEEP_GROUP_SIMD 2
+
+typedef struct sweep_kernel_t sweep_kernel_t;
+typedef struct sweep_value_t sweep_value_t;
+typedef struct sweep_config_t sweep_config_t;
+typedef struct sweep_arg_t sweep_arg_t;
+
+struct sweep_kernel_t {
+  const char *name;
+  int64_t (*probe)(hashtable_t *, relation_t *, void *);
+  int group;
+  int slots; /* probes the multi-slot hashtable of bucket_size > 1 */
+};
+
+/** all kernels that can be swept */
+static const sweep_kernel_t sweep_kernels[] = {
+    {"RAW", probe_hashtable, SWEEP_GROUP_NONE, 0},
+    {"GP", probe_gp, SWEEP_GROUP_SCALAR, 0},
+    {"AMAC", probe_AMAC, SWEEP_GROUP_SCALAR, 0},
+    {"SIMD", probe_simd, SWEEP_GROUP_NONE, 0},
+    {"SIMD_GP", probe_simd_gp, SWEEP_GROUP_SIMD, 0},
+    {"SIMD_AMAC", probe_simd_amac, SWEEP_GROUP_SIMD, 0},
+    {"SIMD_AMAC_RAW", probe_simd_amac_raw, SWEEP_GROUP_SIMD, 0},
+    {"SIMD_AMAC_COMPACT2", probe_simd_amac_compact2, SWEEP_GROUP_SIMD, 0},
+    {"SMV", smv_probe, SWEEP_GROUP_SIMD, 0},
+    {"SLOTS", probe_slots, SWEEP_GROUP_NONE, 1},
+    {"SLOTS_AMAC", probe_slots_amac, SWEEP_GROUP_SCALAR, 1},
+#ifdef KEY_8B /* like the other SIMD kernels */
+    {"SLOTS_SIMD_AMAC", probe_simd_amac_slots, SWEEP_GROUP_SIMD, 1},
+#endif
+    {0, 0, 0, 0}};
+
+/** a JSON number, string or list of them */
+struct sweep_value_t {
+  int n;
+  double num[SWEEP_MAX_VALUES];
+  char str[SWEEP_MAX_VALUES][SWEEP_NAME_LEN];
+};
+
+struct sweep_config_t {
+  uint64_t r_size;
+  uint64_t s_size;
+  uint32_t r_seed;
+  uint32_t s_seed;
+  sweep_value_t r_skew;
+  sweep_value_t s_skew;
+  sweep_value_t threads;
+  sweep_value_t scalar_state_size;
+  sweep_value_t simd_state_size;
+  int nkernels;
+  const sweep_kernel_t *kernels[SWEEP_MAX_VALUES];
+  int warmup;
+  int repeat;
+  char output[256];
+};
+
+struct sweep_arg_t {
+  int32_t tid;
+  int32_t nthreads;
+  hashtable_t *ht;
+  relation_t relR; /* the part of R built by the thread */
+  relation_t relS; /* the part of S probed by the thread */
+  double r_skew;
+  double s_skew;
+  const sweep_config_t *cfg;
+  pthread_barrier_t *barrier;
+  int64_t num_results;
+};
+
+static volatile char sweep_lock;
+static volatile uint64_t sweep_total;
+
+/* ------------------------- config file parsing ------------------------- */
+
+static void sweep_error(const char *config, const char *msg, const char *at) {
+  printf("[ERROR] Sweep config `%s': %s", config, msg);
+  if (at != NULL) printf(" at `%.20s'", at);
+  printf("\n");
+  exit(EXIT_FAILURE);
+}
+
+static const char *skip_ws(const char *p) {
+  while (isspace((unsigned char)*p)) p++;
+  return p;
+}
+
+static const char *parse_string(const char *config, const char *p,
+                                char *out) {
+  int len = 0;
+  if (*p != '"') sweep_error(config, "expected a string", p);
+  for (p++; *p && *p != '"'; p++) {
+    if (len < SWEEP_NAME_LEN - 1) out[len++] = *p;
+  }
+  if (*p != '"') sweep_error(config, "unterminated string", NULL);
+  out[len] = '\0';
+  return p + 1;
+}
+
+/** parses a number or a string into value slot v->n */
+static const char *parse_scalar(const char *config, const char *p,
+                                sweep_value_t *v) {
+  if (v->n == SWEEP_MAX_VALUES) sweep_error(config, "too many values", p);
+  if (*p == '"') {
+    p = parse_string(config, p, v->str[v->n]);
+    v->num[v->n] = 0;
+  } else {
+    char *end;
+    v->num[v->n] = strtod(p, &end);
+    if (end == p) sweep_error(config, "expected a number or string", p);
+    v->str[v->n][0] = '\0';
+    p = end;
+  }
+  v->n++;
+  return p;
+}
+
+static const char *parse_value(const char *config, const char *p,
+                               sweep_value_t *v) {
+  v->n = 0;
+  if (*p != '[') return parse_scalar(config, p, v);
+  p = skip_ws(p + 1);
+  while (*p != ']') {
+    p = skip_ws(parse_scalar(config, p, v));
+    if (*p == ',') {
+      p = skip_ws(p + 1);
+    } else if (*p != ']') {
+      sweep_error(config, "expected `,' or `]'", p);
+    }
+  }
+  return p + 1;
+}
+
+static void check_positive(const char *config, const char *key,
+                           const sweep_value_t *v) {
+  for (int i = 0; i < v->n; i++) {
+    if (v->num[i] < 1) {
+      printf("[ERROR] Sweep config `%s': %s must be positive\n", config, key);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static void parse_config(const char *config, sweep_config_t *cfg) {
+  FILE *fp = fopen(config, "r");
+  char key[SWEEP_NAME_LEN], *text;
+  const char *p;
+  long size;
+  sweep_value_t v;
+
+  if (fp == NULL) {
+    perror("Could not open the sweep config");
+    exit(EXIT_FAILURE);
+  }
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  text = (char *)malloc(size + 1);
+  if (fread(text, 1, size, fp) != (size_t)size) {
+    perror("Could not read the sweep config");
+    exit(EXIT_FAILURE);
+  }
+  text[size] = '\0';
+  fclose(fp);
+
+  /* defaults, the same as those of the command line */
+  memset(cfg, 0, sizeof(sweep_config_t));
+  cfg->r_size = 128000000;
+  cfg->s_size = 128000000;
+  cfg->r_seed = 12345;
+  cfg->s_seed = 54321;
+  cfg->r_skew.n = cfg->s_skew.n = 1;
+  cfg->threads.n = 1;
+  cfg->threads.num[0] = 2;
+  cfg->scalar_state_size.n = 1;
+  cfg->scalar_state_size.num[0] = SCALAR_STATE_SIZE;
+  cfg->simd_state_size.n = 1;
+  cfg->simd_state_size.num[0] = SIMD_STATE_SIZE;
+  cfg->warmup = 1;
+  cfg->repeat = REPEAT_PROBE;
+
+  p = skip_ws(text);
+  if (*p != '{') sweep_error(config, "expected `{'", p);
+  p = skip_ws(p + 1);
+  while (*p != '}') {
+    p = skip_ws(parse_string(config, p, key));
+    if (*p != ':') sweep_error(config, "expected `:'", p);
+    p = skip_ws(parse_value(config, skip_ws(p + 1), &v));
+    if (v.n == 0) sweep_error(config, "empty list", p);
+
+    if (strcmp(key, "r_size") == 0) {
+      cfg->r_size = v.num[0];
+    } else if (strcmp(key, "s_size") == 0) {
+      cfg->s_size = v.num[0];
+    } else if (strcmp(key, "r_seed") == 0) {
+      cfg->r_seed = v.num[0];
+    } else if (strcmp(key, "s_seed") == 0) {
+      cfg->s_seed = v.num[0];
+    } else if (strcmp(key, "r_skew") == 0) {
+      cfg->r_skew = v;
+    } else if (strcmp(key, "s_skew") == 0) {
+      cfg->s_skew = v;
+    } else if (strcmp(key, "threads") == 0) {
+      cfg->threads = v;
+    } else if (strcmp(key, "scalar_state_size") == 0) {
+      cfg->scalar_state_size = v;
+    } else if (strcmp(key, "simd_state_size") == 0) {
+      cfg->simd_state_size = v;
+    } else if (strcmp(key, "warmup") == 0) {
+      cfg->warmup = v.num[0];
+    } else if (strcmp(key, "repeat") == 0) {
+      cfg->repeat = v.num[0];
+    } else if (strcmp(key, "output") == 0) {
+      strncpy(cfg->output, v.str[0], sizeof(cfg->output) - 1);
+    } else if (strcmp(key, "kernels") == 0) {
+      for (int i = 0; i < v.n; i++) {
+        int k = 0;
+        while (sweep_kernels[k].name &&
+               strcmp(sweep_kernels[k].name, v.str[i]) != 0)
+          k++;
+        if (sweep_kernels[k].name == NULL) {
+          printf("[ERROR] Sweep kernel `%s' does not exist! Kernels:", v.str[i]);
+          for (k = 0; sweep_kernels[k].name; k++)
+            printf(" %s", sweep_kernels[k].name);
+          printf("\n");
+          exit(EXIT_FAILURE);
+        }
+        if (sweep_kernels[k].slots != (bucket_size > 1)) {
+          printf("[ERROR] Sweep kernel `%s' does not probe buckets of %d "
+                 "tuples (--bucket-size)\n",
+                 v.str[i], bucket_size);
+          exit(EXIT_FAILURE);
+        }
+        cfg->kernels[cfg->nkernels++] = &sweep_kernels[k];
+      }
+    } else {
+      printf("[ERROR] Sweep config `%s': unknown key `%s'\n", config, key);
+      exit(EXIT_FAILURE);
+    }
+
+    if (*p == ',') {
+      p = skip_ws(p + 1);
+    } else if (*p != '}') {
+      sweep_error(config, "expected `,' or `}'", p);
+    }
+  }
+  free(text);
+
+  if (cfg->nkernels == 0) {
+    /* all of them that probe the buckets of bucket_size tuples */
+    for (int k = 0; sweep_kernels[k].name; k++)
+      if (sweep_kernels[k].slots == (bucket_size > 1))
+        cfg->kernels[cfg->nkernels++] = &sweep_kernels[k];
+  }
+  check_positive(config, "threads", &cfg->threads);
+  check_positive(config, "scalar_state_size", &cfg->scalar_state_size);
+  check_positive(config, "simd_state_size", &cfg->simd_state_size);
+  if (cfg->repeat < 1) cfg->repeat = 1;
+}
+
+/* ------------------------------ the sweep ------------------------------ */
+
+/** starts a new results point, called by thread 0 between two barriers */
+static void sweep_point(const sweep_arg_t *arg, int group_size) {
+  results_point_begin();
+  results_point_int("threads", arg->nthreads);
+  results_point_double("r_skew", arg->r_skew);
+  results_point_double("s_skew", arg->s_skew);
+  results_point_int("group_size", group_size);
+}
+
+/** runs the warmup and the recorded probes of one point */
+static void sweep_probe(sweep_arg_t *arg, const sweep_kernel_t *kernel,
+                        int group_size) {
+  const sweep_config_t *cfg = arg->cfg;
+  struct timeval t1, t2;
+  result_timer_t rt;
+  char name[SWEEP_NAME_LEN * 2];
+  int rv, deltaT;
+
+  if (arg->tid == 0) {
+    sweep_point(arg, group_size);
+    if (kernel->group == SWEEP_GROUP_SCALAR) scalar_state_size = group_size;
+    if (kernel->group == SWEEP_GROUP_SIMD) simd_state_size = group_size;
+  }
+  if (kernel->group == SWEEP_GROUP_NONE)
+    snprintf(name, sizeof(name), "%s", kernel->name);
+  else
+    snprintf(name, sizeof(name), "%s(%d)", kernel->name, group_size);
+
+  chainedtuplebuffer_t *chainedbuf = chainedtuplebuffer_init();
+  for (int rp = -cfg->warmup; rp < cfg->repeat; ++rp) {
+    BARRIER_ARRIVE(arg->barrier, rv);
+    gettimeofday(&t1, NULL);
+    results_start(&rt);
+    arg->num_results = kernel->probe(arg->ht, &arg->relS, chainedbuf);
+    if (rp >= 0) {
+      results_thread("probe", kernel->name, arg->tid, &rt,
+                     arg->relS.num_tuples, arg->num_results);
+    }
+    lock(&sweep_lock);
+#if DIVIDE
+    sweep_total += arg->num_results;
+#else
+    sweep_total = arg->num_results;
+#endif
+    unlock(&sweep_lock);
+    BARRIER_ARRIVE(arg->barrier, rv);
+    if (arg->tid == 0) {
+      if (rp >= 0) {
+        results_total("probe", kernel->name, &rt, sweep_total);
+        gettimeofday(&t2, NULL);
+        deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
+        printf("total result num = %lld\t", sweep_total);
+        printf("---- %s probe costs time (ms) = %lf\n", name,
+               deltaT * 1.0 / 1000);
+      }
+      sweep_total = 0;
+    }
+  }
+  chainedtuplebuffer_free(chainedbuf);
+}
+
+void *sweep_thread(void *param) {
+  sweep_arg_t *arg = (sweep_arg_t *)param;
+  const sweep_config_t *cfg = arg->cfg;
+  bucket_buffer_t *overflowbuf;
+  result_timer_t rt;
+  int rv;
+
+  init_bucket_buffer(&overflowbuf);
+  if (arg->tid == 0) sweep_point(arg, 0);
+  BARRIER_ARRIVE(arg->barrier, rv);
+  results_start(&rt);
+  if (arg->ht->bucket_size > 1) {
+    build_hashtable_slots_mt(arg->ht, &arg->relR, &overflowbuf);
+  } else {
+    build_hashtable_mt(arg->ht, &arg->relR, &overflowbuf);
+  }
+  results_thread("build", "build", arg->tid, &rt, arg->relR.num_tuples, 0);
+  BARRIER_ARRIVE(arg->barrier, rv);
+  if (arg->tid == 0) results_total("build", "build", &rt, 0);
+
+  for (int k = 0; k < cfg->nkernels; k++) {
+    const sweep_kernel_t *kernel = cfg->kernels[k];
+    const sweep_value_t *sizes = NULL;
+    if (kernel->group == SWEEP_GROUP_SCALAR) sizes = &cfg->scalar_state_size;
+    if (kernel->group == SWEEP_GROUP_SIMD) sizes = &cfg->simd_state_size;
+    if (sizes == NULL) {
+      sweep_probe(arg, kernel, 0);
+      continue;
+    }
+    for (int g = 0; g < sizes->n; g++) {
+      sweep_probe(arg, kernel, (int)sizes->num[g]);
+    }
+  }
+  free_bucket_buffer(overflowbuf);
+  return 0;
+}
+
+/** builds the hashtable from relR and probes every kernel with relS */
+static void sweep_join(const sweep_config_t *cfg, relation_t *relR,
+                       relation_t *relS, double r_skew, double s_skew,
+                       int nthr) {
+  hashtable_t *ht;
+  int64_t numR = relR->num_tuples, numRthr = numR / nthr;
+  sweep_arg_t args[nthr];
+  pthread_t tid[nthr];
+  pthread_attr_t attr;
+  pthread_barrier_t barrier;
+  cpu_set_t set;
+  int i, rv;
+
+  printf("[INFO ] Sweep: threads = %d, r_skew = %.2lf, s_skew = %.2lf\n", nthr,
+         r_skew, s_skew);
+  /* sized like the hashtable of NPO */
+  allocate_hashtable_slots(&ht, hashtable_num_buckets(relR, bucket_size),
+                           bucket_size);
+  rv = pthread_barrier_init(&barrier, NULL, nthr);
+  if (rv != 0) {
+    printf("Couldn't create the barrier\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_attr_init(&attr);
+  for (i = 0; i < nthr; i++) {
+#if AFFINITY
+    CPU_ZERO(&set);
+    CPU_SET(get_cpu_id(i), &set);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+#endif
+    args[i].tid = i;
+    args[i].nthreads = nthr;
+    args[i].ht = ht;
+    args[i].r_skew = r_skew;
+    args[i].s_skew = s_skew;
+    args[i].cfg = cfg;
+    args[i].barrier = &barrier;
+    args[i].relR.num_tuples = (i == nthr - 1) ? numR - numRthr * i : numRthr;
+    args[i].relR.tuples = relR->tuples + numRthr * i;
+#if DIVIDE
+    int64_t numS = relS->num_tuples, numSthr = numS / nthr;
+    args[i].relS.num_tuples = (i == nthr - 1) ? numS - numSthr * i : numSthr;
+    args[i].relS.tuples = relS->tuples + numSthr * i;
+#else
+    args[i].relS = *relS;
+#endif
+    rv = pthread_create(&tid[i], &attr, sweep_thread, (void *)&args[i]);
+    if (rv) {
+      printf("ERROR; return code from pthread_create() is %d\n", rv);
+      exit(-1);
+    }
+  }
+  for (i = 0; i < nthr; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  pthread_barrier_destroy(&barrier);
+  destroy_hashtable(ht);
+}
+
+static void sweep_relation(relation_t *rel, uint64_t ntuples, uint64_t maxid,
+                           uint32_t seed, double skew, const char *name) {
+  fprintf(stdout,
+          "[INFO ] Creating relation %s with size = %.3lf MiB, #tuples = %llu, "
+          "skew = %.2lf : ",
+          name, (double)sizeof(tuple_t) * ntuples / 1024.0 / 1024.0, ntuples,
+          skew);
+  fflush(stdout);
+  seed_generator(seed);
+  if (skew > 0) {
+    parallel_create_relation_zipf(rel, ntuples, nthreads, maxid, skew);
+  } else {
+    parallel_create_relation(rel, ntuples, nthreads, maxid);
+  }
+  printf("OK \n");
+}
+
+void sweep_run(const char *config, const char *results) {
+  sweep_config_t *cfg = (sweep_config_t *)malloc(sizeof(sweep_config_t));
+  int ri, si, ti;
+
+  parse_config(config, cfg);
+  if (results == NULL) results = cfg->output[0] ? cfg->output : "sweep.json";
+
+  /* the generator threads, also used to numa-localize the relations */
+  nthreads = 1;
+  for (ti = 0; ti < cfg->threads.n; ti++) {
+    if (cfg->threads.num[ti] > nthreads) nthreads = cfg->threads.num[ti];
+  }
+
+  /* every relation is generated once for the whole sweep */
+  relation_t relR[cfg->r_skew.n], relS[cfg->s_skew.n];
+  for (ri = 0; ri < cfg->r_skew.n; ri++) {
+    sweep_relation(&relR[ri], cfg->r_size, cfg->r_size, cfg->r_seed,
+                   cfg->r_skew.num[ri], "R");
+  }
+  for (si = 0; si < cfg->s_skew.n; si++) {
+    sweep_relation(&relS[si], cfg->s_size, cfg->r_size, cfg->s_seed,
+                   cfg->s_skew.num[si], "S");
+  }
+
+  for (ri = 0; ri < cfg->r_skew.n; ri++) {
+    for (si = 0; si < cfg->s_skew.n; si++) {
+      for (ti = 0; ti < cfg->threads.n; ti++) {
+        sweep_join(cfg, &relR[ri], &relS[si], cfg->r_skew.num[ri],
+                   cfg->s_skew.num[si], (int)cfg->threads.num[ti]);
+      }
+    }
+  }
+
+  /* the group sizes of later, non-sweep kernels are the defaults again */
+  scalar_state_size = SCALAR_STATE_SIZE;
+  simd_state_size = SIMD_STATE_SIZE;
+
+#ifdef PROBE_STATS
+  probe_stats_print();
+#endif
+  results_config_str("algo", "SWEEP");
+  results_config_str("sweep", config);
+  results_config_int("r_size", cfg->r_size);
+  results_config_int("s_size", cfg->s_size);
+  results_config_int("r_seed", cfg->r_seed);
+  results_config_int("s_seed", cfg->s_seed);
+  results_config_int("warmup", cfg->warmup);
+  results_config_int("repeat", cfg->repeat);
+  results_config_int("bucket_size", bucket_size);
+  results_config_int("tuple_size", sizeof(tuple_t));
+  results_config_int("divide", DIVIDE);
+  results_config_int("pdis", PDIS);
+  results_write(results);
+  printf("[INFO ] Results written to %s\n", results);
+
+  for (ri = 0; ri < cfg->r_skew.n; ri++) delete_relation(&relR[ri]);
+  for (si = 0; si < cfg->s_skew.n; si++) delete_relation(&relS[si]);
+  free(cfg);
+}
@@ -0,0 +1,43 @@
+/**
+ * @file    sweep.h
+ *
+ * @brief  Parameter sweep over the NPO probe kernels without recompiling.
+ *
+ * A sweep is described by a small JSON file, e.g.
+ * @verbatim
+   {
+     "r_size": 16777216, "s_size": 268435456,
+     "r_seed": 12345, "s_seed": 54321,
+     "r_skew": [0.0], "s_skew": [0.0, 0.5, 1.0],
+     "threads": [1, 2, 4, 8],
+     "kernels": ["RAW", "GP", "AMAC", "SIMD", "SIMD_GP", "SIMD_AMAC", "SMV"],
+     "scalar_state_size": [10, 20, 30],
+     "simd_state_size": [3, 5, 8],
+     "warmup": 1, "repeat": 5,
+     "output": "sweep.json"
+   }
+   @endverbatim
+ * Every relation is generated once and reused by all points of the grid. For
+ * each combination of skews and thread count the hashtable is built and all
+ * kernels are probed, GP and AMAC with every scalar_state_size and the
+ * SIMD_GP, SIMD_AMAC, SIMD_AMAC_RAW, SIMD_AMAC_COMPACT2 and SMV kernels with
+ * every simd_state_size. The hashtable is sized and laid out as for NPO, so
+ * with --bucket-size above 1 the kernels are SLOTS, SLOTS_AMAC (every
+ * scalar_state_size) and SLOTS_SIMD_AMAC (every simd_state_size) instead.
+ * A single number is accepted in place of a list. Each point runs `warmup`
+ * unrecorded and `repeat` recorded probes, the records go to one results file
+ * (see results.h).
+ */
+#ifndef SWEEP_H
+#define SWEEP_H
+
+/**
+ * Runs the sweep described by the file config and writes the results.
+ *
+ * @param config the JSON sweep description
+ * @param results results file, if NULL the `output` of the config is used and
+ *                "sweep.json" if that is missing as well
+ */
+void sweep_run(const char *config, const char *results);
+
+#endif /* SWEEP_H */
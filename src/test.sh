@@ -123,8 +123,8 @@ function file_loop() {
 		        output_file=${dir_name}/${app}_pdis_${pdis}_simdstatesize_${simdstatesize}_scalarstatesize_${scalarstatesize}.txt
 		        echo $output_file
 		        #############修改prefetch.h文件##############
-		        sed -i "/#define\ SIMDStateSize/c\#define\ SIMDStateSize\ ${simdstatesize}" prefetch.h
-		        sed -i "/#define\ ScalarStateSize/c\#define\ ScalarStateSize\ ${scalarstatesize}" prefetch.h
+		        sed -i "/#define\ SIMD_STATE_SIZE/c\#define\ SIMD_STATE_SIZE\ ${simdstatesize}" prefetch.h
+		        sed -i "/#define\ SCALAR_STATE_SIZE/c\#define\ SCALAR_STATE_SIZE\ ${scalarstatesize}" prefetch.h
 			echo "pdis_${pdis}_simdstatesize_${simdstatesize}_scalarstatesize_${scalarstatesize}" >> chg_prefetch_h.log
 		        cat prefetch.h >> chg_prefetch_h.log
 		        cd ..
@@ -160,6 +160,24 @@ function expr_group_size() {
 	file_loop
 	python test_results_merge.py $dir_name merged_results.csv
 }
+## group sizes, threads and skew in one run, without recompiling prefetch.h
+function expr_sweep() {
+	reset_default_param
+	dir_name="results_sweep"_$(date +%F-%T)
+	mkdir $dir_name
+	cat > ${dir_name}/sweep.json << EOF
+{
+  "r_size": 1048576, "s_size": 52428800,
+  "r_skew": [0, 0.5, 1], "s_skew": [0, 0.5, 1],
+  "threads": [1, 2, 4, 8, 16],
+  "kernels": ["RAW", "GP", "AMAC", "SIMD", "SIMD_GP", "SIMD_AMAC", "SIMD_AMAC_RAW", "SMV"],
+  "scalar_state_size": [1, 4, 7, 10, 13, 16, 19, 22],
+  "simd_state_size": [1, 2, 3, 4, 5, 6, 7, 8, 9, 10],
+  "warmup": 1, "repeat": ${repeat}
+}
+EOF
+	numactl ${numa_config} ./mchashjoins --sweep=${dir_name}/sweep.json --results=${dir_name}/sweep.csv
+}
 function expr_pdis() {
 	reset_default_param
 	# set parameters for this experiemnt 
@@ -427,6 +445,7 @@ sed -i "1s/.*/$core_set/" cpu-mapping.txt
 
 echo "input expr name : 
 GROUP: group size
+SWEEP: group size x threads x skew in one run
 DIS: prefetch distance
 SCALE: scalability
 SKEW: data skew
@@ -456,6 +475,8 @@ if [[ ${expr_name} == 'DIS' ]]; then
 	expr_pdis
 elif [[ ${expr_name} == 'GROUP' ]]; then	
 	expr_group_size
+elif [[ ${expr_name} == 'SWEEP' ]]; then
+	expr_sweep
 elif [[ ${expr_name} == 'GEN' ]]; then	
 	gen_data
 elif [[ ${expr_name} == 'DATA' ]]; then	
@@ -139,6 +139,7 @@ void *bts_thread(void *param) {
   total_num = 0;
   tree_arg_t *args = (tree_arg_t *)param;
   struct timeval t1, t2;
+  result_timer_t rt;
   int deltaT = 0;
 
 #ifdef PERF_COUNTERS
@@ -162,8 +163,12 @@ void *bts_thread(void *param) {
 #endif
   if (args->tid == 0) {
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     /* insert tuples from the assigned part of relR to the ht */
     build_tree_st(args->tree, &args->relR);
+    /* single-threaded build, thread 0 accounts for all threads */
+    results_thread("build", "build tree", 0, &rt, args->relR.num_tuples, 0);
+    results_total("build", "build tree", &rt, 0);
 
     /* wait at a barrier until each thread completes build phase */
     gettimeofday(&t2, NULL);
@@ -177,6 +182,7 @@ void *bts_thread(void *param) {
 #ifdef PERF_COUNTERS
   if (args->tid == 0) {
     PCM_stop();
+    PCM_accumulatePhase(PCM_PHASE_BUILD);
     PCM_log("========== Build phase profiling results ==========\n");
     PCM_printResults();
     PCM_start();
@@ -238,7 +244,10 @@ void *bts_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results = bts_smv(args->tree, &args->relS, chainedbuf_compact1);
+    results_thread("probe", "SMV bts", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
 #if DIVIDE
     total_num += args->num_results;
@@ -249,6 +258,7 @@ void *bts_thread(void *param) {
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "SMV bts", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("------ SMV bts costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -334,8 +344,11 @@ void *bts_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results =
         search_tree_AMAC(args->tree, &args->relS, chainedbuf_amac);
+    results_thread("probe", "AMAC tree", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
 #if DIVIDE
     total_num += args->num_results;
@@ -346,6 +359,7 @@ void *bts_thread(void *param) {
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "AMAC tree", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("--------AMAC tree costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -401,8 +415,11 @@ void *bts_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results =
         bts_simd_amac(args->tree, &args->relS, chainedbuf_simd_amac);
+    results_thread("probe", "SIMD AMAC bts", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
 #if DIVIDE
     total_num += args->num_results;
@@ -413,6 +430,7 @@ void *bts_thread(void *param) {
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "SIMD AMAC bts", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("---SIMD AMAC bts costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -434,8 +452,11 @@ void *bts_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results =
         bts_simd_amac_raw(args->tree, &args->relS, chainedbuf_simd_amac_raw);
+    results_thread("probe", "SIMD AMAC RAW", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
 #if DIVIDE
     total_num += args->num_results;
@@ -446,6 +467,7 @@ void *bts_thread(void *param) {
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "SIMD AMAC RAW", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("---  SIMD AMAC RAW costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -465,7 +487,10 @@ void *bts_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results = bts_simd(args->tree, &args->relS, chainedbuf_simd);
+    results_thread("probe", "SIMD bts", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
 #if DIVIDE
     total_num += args->num_results;
@@ -476,6 +501,7 @@ void *bts_thread(void *param) {
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "SIMD bts", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("--------SIMD bts costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -497,7 +523,10 @@ void *bts_thread(void *param) {
   for (int rp = 0; rp < REPEAT_PROBE; ++rp) {
     BARRIER_ARRIVE(args->barrier, rv);
     gettimeofday(&t1, NULL);
+    results_start(&rt);
     args->num_results = search_tree_raw(args->tree, &args->relS, chainedbuf);
+    results_thread("probe", "RAW bts", args->tid, &rt,
+                   args->relS.num_tuples, args->num_results);
     lock(&g_lock);
 #if DIVIDE
     total_num += args->num_results;
@@ -508,6 +537,7 @@ void *bts_thread(void *param) {
     BARRIER_ARRIVE(args->barrier, rv);
     if (args->tid == 0) {
       printf("total result num = %lld\t", total_num);
+      results_total("probe", "RAW bts", &rt, total_num);
       gettimeofday(&t2, NULL);
       deltaT = (t2.tv_sec - t1.tv_sec) * 1000000 + t2.tv_usec - t1.tv_usec;
       printf("-------- RAW bts costs time (ms) = %lf\n", deltaT * 1.0 / 1000);
@@ -538,6 +568,7 @@ void *bts_thread(void *param) {
 #ifdef PERF_COUNTERS
   if (args->tid == 0) {
     PCM_stop();
+    PCM_accumulatePhase(PCM_PHASE_PROBE);
     PCM_log("========== Probe phase profiling results ==========\n");
     PCM_printResults();
     PCM_log("===================================================\n");
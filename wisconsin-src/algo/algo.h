@@ -25,6 +25,9 @@
 #include "../lock.h"
 #include "../Barrier.h"
 #include "../partitioner.h"
+#include "../exceptions.h"
+#include "../atomics.h"
+#include "../sink.h"
 #include "hashtable.h"
 
 /* 1 is inner! */
@@ -114,14 +117,83 @@ class HashBase : public BaseAlgo {
 		virtual void build(SplitResult t, int threadid) = 0;
 		virtual PageCursor* probe(SplitResult t, int threadid) = 0;
 	protected:
+		/** Probe loops, chosen with prefetch = "no", "gp" or "amac". */
+		enum ProbeMode {
+			PM_NORMAL,	/**< one probe tuple at a time */
+			PM_GP,		/**< group prefetching */
+			PM_AMAC		/**< asynchronous memory access chaining */
+		};
+
+		/** Upper bound of groupsize, the in-flight lookups of PM_GP, PM_AMAC. */
+		static const int MAXGROUP = 64;
+
+		/**
+		 * Probes all tuples of page \a b2 with the loop of \a probemode.
+		 * \a Owner supplies the bucket of a probe key through
+		 * probeBucket(key2) and compares and outputs a pair of tuples through
+		 * joinTuple(tup1, key2, tup2, tmp, ret, threadid), where \a key2 is
+		 * the key of probe tuple \a tup2. Keys are read from the key
+		 * minipage of PAX pages, so that only the probe tuples that match
+		 * are touched. The variants differ only in the order of memory
+		 * accesses, not in their output.
+		 */
+		template <typename Owner>
+		void probePage(Owner* o, Page* b2, char* tmp, WriteTable* ret, int threadid);
+
+		/**
+		 * Returns the key minipage of \a b if it holds the keys at offset
+		 * \a keyoff of its tuples, else NULL.
+		 */
+		static inline const long long* keysOf(Page* b, unsigned int keyoff) {
+			return (b->hasKeys() && b->getKeyOffset() == keyoff) 
+				? b->getKeys() : NULL;
+		}
+
+		/**
+		 * Returns the bucket of \a key. Calls ModuloHashFunction::hash()
+		 * directly if that is the hash function, saving the virtual call.
+		 */
+		inline unsigned int bucketOf(long long key) {
+			return _modhash ? _modhash->ModuloHashFunction::hash(key)
+				: _hashfn->hash(key);
+		}
+
 		HashFunction* _hashfn;
+		ModuloHashFunction* _modhash;	/**< _hashfn if exactly modulo, else NULL */
 		HashTable hashtable;
 		int nthreads;
 		int outputsize;
-#ifdef OUTPUT_AGGREGATE
-		int* aggregator;
-		static const int AGGLEN=512;
-#endif
+		ProbeMode probemode;
+		int groupsize;
+		unsigned int keyoff1, keyoff2;	/**< offsets of the join keys */
+		ResultSink* sink;	/**< receives the matches, see SinkFactory */
+
+	private:
+		/** A probe tuple in flight in \ref probePageGP or \ref probePageAMAC. */
+		struct ProbeState {
+			char* tup2;
+			const char* key2;		/**< key of tup2 */
+			unsigned int offset;	/**< bucket of tup2 */
+			void* chunk;			/**< chunk to scan next, NULL at the end */
+			int stage;				/**< of PM_AMAC */
+		};
+
+		/**
+		 * Group prefetching: hashes \a groupsize probe tuples and
+		 * prefetches their buckets, then their first chunks, then visits all
+		 * of them chunk by chunk, prefetching the next chunk of every chain
+		 * before the group moves on.
+		 */
+		template <typename Owner>
+		void probePageGP(Owner* o, Page* b2, char* tmp, WriteTable* ret, int threadid);
+
+		/**
+		 * AMAC: \a groupsize probe tuples advance independently through the
+		 * stages bucket, chunk and scan, each stage prefetching what the next
+		 * one reads. A finished lookup takes the next probe tuple at once.
+		 */
+		template <typename Owner>
+		void probePageAMAC(Owner* o, Page* b2, char* tmp, WriteTable* ret, int threadid);
 };
 
 class StoreCopy : public HashBase {
@@ -148,6 +220,17 @@ class StoreCopy : public HashBase {
 
 		template <bool atomic>
 		WriteTable* realprobeCursor(PageCursor* t, int threadid, WriteTable* ret = NULL);
+
+		friend class HashBase;
+
+		/** Returns the bucket of probe key \a key2, for \ref probePage. */
+		inline unsigned int probeBucket(const char* key2);
+
+		/**
+		 * Appends \a tup1 joined with \a tup2 to \a ret, assembled in \a tmp,
+		 * if \a key2, the key of \a tup2, matches the key of \a tup1.
+		 */
+		inline void joinTuple(char* tup1, const char* key2, char* tup2, char* tmp, WriteTable* ret, int threadid);
 };
 
 class StorePointer : public HashBase {
@@ -174,8 +257,130 @@ class StorePointer : public HashBase {
 
 		template <bool atomic>
 		WriteTable* realprobeCursor(PageCursor* t, int threadid, WriteTable* ret = NULL);
+
+		friend class HashBase;
+
+		/** Returns the bucket of probe key \a key2, for \ref probePage. */
+		inline unsigned int probeBucket(const char* key2);
+
+		/**
+		 * Appends \a tup1 joined with \a tup2 to \a ret, assembled in \a tmp,
+		 * if \a key2, the key of \a tup2, matches the key of \a tup1.
+		 */
+		inline void joinTuple(char* tup1, const char* key2, char* tup2, char* tmp, WriteTable* ret, int threadid);
+};
+
+/**
+ * A range of \a len bytes copied from offset \a src of a tuple to offset
+ * \a dst of another.
+ */
+struct CopyRun {
+	unsigned int src, dst, len;
 };
 
+/**
+ * Appends to \a runs the copies of columns \a cols of schema \a s to
+ * consecutive positions starting at \a dst. Columns that follow each other
+ * in \a s become one run.
+ * @return Offset after the last copied column.
+ */
+unsigned int addCopyRuns(vector<CopyRun>& runs, Schema* s, 
+		const vector<unsigned int>& cols, unsigned int dst);
+
+/**
+ * StoreCopy for schemas without CHAR columns whose join keys are both of
+ * type \a KeyT (int or long long). The key is read at a fixed offset and the
+ * columns are copied as precomputed runs of bytes, instead of a call to
+ * Schema::asLong(), calcOffset() and writeData() per column and tuple.
+ * \a PayloadSize is the size of the only run of each side if known at
+ * compile time, as for (long, long) and (int, int) schemas that select the
+ * payload, and 0 otherwise. Chosen by JoinerFactory from the schemas.
+ */
+template <typename KeyT, unsigned int PayloadSize>
+class StoreCopySpec : public StoreCopy {
+	public:
+		StoreCopySpec(const libconfig::Setting& cfg) 
+			: StoreCopy(cfg), pruns(NULL), npruns(0) {}
+		virtual ~StoreCopySpec() {}
+
+		virtual void init(
+			Schema* schema1, vector<unsigned int> select1, unsigned int jattr1,
+			Schema* schema2, vector<unsigned int> select2, unsigned int jattr2);
+
+	protected:
+		void buildCursor(PageCursor* t, int threadid, bool atomic);
+
+		WriteTable* probeCursor(PageCursor* t, int threadid, bool atomic, WriteTable* ret = NULL);
+
+	private:
+		template <bool atomic>
+		void realbuildCursor(PageCursor* t, int threadid);
+
+		template <bool atomic>
+		WriteTable* realprobeCursor(PageCursor* t, int threadid, WriteTable* ret = NULL);
+
+		friend class HashBase;
+
+		/** Returns the bucket of probe key \a key2, for \ref probePage. */
+		inline unsigned int probeBucket(const char* key2);
+
+		/**
+		 * Appends \a tup1 joined with \a tup2 to \a ret, assembled in \a tmp,
+		 * if \a key2, the key of \a tup2, matches the key of \a tup1.
+		 */
+		inline void joinTuple(char* tup1, const char* key2, char* tup2, char* tmp, WriteTable* ret, int threadid);
+
+		vector<CopyRun> buildruns;		/**< build tuple to hash table */
+		vector<CopyRun> proberuns;		/**< probe tuple to output */
+		const CopyRun* pruns;			/**< proberuns, for joinTuple */
+		unsigned int npruns;
+};
+
+/**
+ * StorePointer counterpart of StoreCopySpec: the hash table holds the key and
+ * a pointer, the columns of both sides are copied to the output as runs.
+ */
+template <typename KeyT, unsigned int PayloadSize>
+class StorePointerSpec : public StorePointer {
+	public:
+		StorePointerSpec(const libconfig::Setting& cfg) 
+			: StorePointer(cfg), bruns(NULL), nbruns(0), pruns(NULL), npruns(0) {}
+		virtual ~StorePointerSpec() {}
+
+		virtual void init(
+			Schema* schema1, vector<unsigned int> select1, unsigned int jattr1,
+			Schema* schema2, vector<unsigned int> select2, unsigned int jattr2);
+
+	protected:
+		void buildCursor(PageCursor* t, int threadid, bool atomic);
+
+		WriteTable* probeCursor(PageCursor* t, int threadid, bool atomic, WriteTable* ret = NULL);
+
+	private:
+		template <bool atomic>
+		void realbuildCursor(PageCursor* t, int threadid);
+
+		template <bool atomic>
+		WriteTable* realprobeCursor(PageCursor* t, int threadid, WriteTable* ret = NULL);
+
+		friend class HashBase;
+
+		/** Returns the bucket of probe key \a key2, for \ref probePage. */
+		inline unsigned int probeBucket(const char* key2);
+
+		/**
+		 * Appends \a tup1 joined with \a tup2 to \a ret, assembled in \a tmp,
+		 * if \a key2, the key of \a tup2, matches the key of \a tup1.
+		 */
+		inline void joinTuple(char* tup1, const char* key2, char* tup2, char* tmp, WriteTable* ret, int threadid);
+
+		vector<CopyRun> buildruns;		/**< build tuple to output */
+		vector<CopyRun> proberuns;		/**< probe tuple to output */
+		const CopyRun* bruns;			/**< buildruns, for joinTuple */
+		unsigned int nbruns;
+		const CopyRun* pruns;			/**< proberuns, for joinTuple */
+		unsigned int npruns;
+};
 
 template <typename Super>
 class BuildIsPart : public Super {
@@ -210,18 +415,79 @@ class ProbeIsNotPart : public Super {
 		virtual PageCursor* probe(SplitResult t, int threadid);
 };
 
+/** Reads the pages in [\a begin, \a end) of an array. Not thread-safe. */
+class PageRangeCursor : public PageCursor {
+	public:
+		PageRangeCursor(Schema* s, Page** begin, Page** end)
+			: sch(s), cur(begin), end(end)
+		{ }
+
+		virtual Page* atomicReadNext()
+		{
+			return (cur != end) ? *cur++ : NULL;
+		}
+
+		virtual Schema* schema() { return sch; }
+
+		virtual vector<PageCursor*> split(int nthreads)
+		{
+			throw NotYetImplemented();
+		}
+
+	private:
+		Schema* sch;
+		Page** cur;
+		Page** end;
+};
+
 /** 
  * Work-stealing prober. 
- * Works only with non-partitioned build, otherwise will lose data. 
+ * Every thread collects the pages of its own partitions in a queue, and
+ * probes them a batch of "stealbatch" pages at a time. A thread that runs
+ * out of pages steals batches from the queues of randomly picked victims,
+ * until all queues are empty. Batches are claimed with a single CAS on the
+ * queue head, by the owner and the thieves alike.
  */
 template <typename Super>
 class ProbeSteal : public Super {
 	public:
-		ProbeSteal(const libconfig::Setting& cfg) : Super(cfg) {}
+		ProbeSteal(const libconfig::Setting& cfg);
 		virtual ~ProbeSteal() {}
+		virtual void build(SplitResult t, int threadid);
 		virtual PageCursor* probe(SplitResult t, int threadid);
+
+	private:
+		/** 
+		 * Pages of the partitions of one thread. Padded to a cache line so
+		 * that claims on different queues do not contend.
+		 */
+		struct PageQueue {
+			Page** volatile next;	/**< next unclaimed page, NULL until published */
+			Page** volatile end;	/**< end of the pages */
+			Schema* schema;			/**< schema of the pages */
+			char pad[64 - 3*sizeof(void*)];
+		};
+
+		/**
+		 * Claims up to \a batchsize pages of queue \a q, returns false if
+		 * it is empty or has not been published yet.
+		 */
+		bool claim(PageQueue& q, Page**& begin, Page**& end);
+
+		unsigned int batchsize;
+		vector<PageQueue> queues;
+		vector< vector<Page*> > pages;	/**< storage of the queues */
 };
 
+/**
+ * Radix-partitions the whole build input into one flat buffer, partition i
+ * being the tuples of hash bucket i, and probes it with the probe input
+ * copied to another flat buffer. Build tuples are kept as they are, so any
+ * join attribute and projection can be used; the output is assembled from
+ * both inputs like StorePointer does. As it partitions the inputs itself,
+ * the partitioners of the configuration and partitionbuild/partitionprobe
+ * must be "no".
+ */
 class FlatMemoryJoiner : public HashBase {
 	public:
 		FlatMemoryJoiner(const libconfig::Config& cfg);
@@ -237,13 +503,29 @@ class FlatMemoryJoiner : public HashBase {
 		void custominit(Table* tbuild, Table* tprobe);
 
 	protected:
+		/**
+		 * Probes the probe tuples [\a start, \a start + \a items), reading
+		 * the keys of build and probe tuples with \a key1 and \a key2.
+		 */
+		template <typename Key1, typename Key2>
+		void probeRange(const Key1& key1, const Key2& key2, 
+				unsigned int start, unsigned int items, int threadid);
+
+		/** Assembles the output tuple of \a tup1 and \a tup2 in \a tmp. */
+		inline void assemble(char* tmp, const char* tup1, const char* tup2);
+
 		RadixPartitioner partitioner;
 		Page* probetable;
 		vector<unsigned int>* phistogram;
 		unsigned long totaltuples;
 		vector<WriteTable*> result;
+		unsigned int keysize1, keysize2;	/**< bytes of the join keys */
+		bool copyruns;				/**< no CHAR columns, output is copied as runs */
+		vector<CopyRun> buildruns;	/**< build tuple to output */
+		vector<CopyRun> proberuns;	/**< probe tuple to output */
 };
 
+#include "storage.inl"
 #include "build.inl"
 #include "probe.inl"
 
@@ -16,11 +16,13 @@
 */
 
 #include "algo.h"
+#include <cstring>
 
 FlatMemoryJoiner::FlatMemoryJoiner (const libconfig::Config& cfg) 
 	: HashBase(cfg.getRoot()), 
 		partitioner(cfg, cfg.getRoot()["hash"], cfg.getRoot()["hash"]), 
-		probetable(NULL), totaltuples(0), phistogram(NULL)
+		probetable(NULL), totaltuples(0), phistogram(NULL),
+		keysize1(0), keysize2(0), copyruns(false)
 {
 }
 
@@ -37,7 +39,12 @@ void FlatMemoryJoiner::destroy()
 		//	(main.cpp will free output buffers)
 	}
 	result.clear();
-	HashBase::destroy();
+	buildruns.clear();
+	proberuns.clear();
+
+	// Cannot call HashBase::destroy(), s1 is the schema of the build input.
+	delete sbuild;
+	sink->destroy();
 }
 
 /** 
@@ -66,21 +73,51 @@ unsigned long countTuples(PageCursor* t) {
 
 void copyTuples(PageCursor* t, Page* p, Schema& s);
 
+/** Reads a key of type \a KeyT at a fixed offset of a tuple, widened. */
+template <typename KeyT>
+struct FixedKey {
+	FixedKey(unsigned int off) : off(off) { }
+	inline long long operator()(const char* tup) const {
+		return *reinterpret_cast<const KeyT*>(tup + off);
+	}
+	unsigned int off;
+};
+
+static bool isFixedWidth(Schema* s)
+{
+	for (unsigned int i=0; i<s->columns(); ++i)
+		if (s->getColumnType(i) == CT_CHAR)
+			return false;
+	return true;
+}
 
 void FlatMemoryJoiner::init(
 	Schema* schema1, vector<unsigned int> select1, unsigned int jattr1,
 	Schema* schema2, vector<unsigned int> select2, unsigned int jattr2)
 {
-	// This class only works under a special build format.
-	// Do simple sanity checks to enforce that.
-	assert(jattr1 == 0);
-	assert(schema1->columns() == select1.size() + 1);
-	for (int i=0; i<select1.size(); ++i) {
-		assert(select1[i] == i+1);
-	}
-
 	HashBase::init(schema1, select1, jattr1, schema2, select2, jattr2);
 
+	// The flat buffer holds build tuples as they are, override s1.
+	delete s1;
+	s1 = schema1;
+
+	// Keys are compared as numbers, so that int and long keys can be mixed.
+	// Other types only join with keys of the same type, compared bitwise.
+	ColumnType kt1 = schema1->getColumnType(jattr1);
+	ColumnType kt2 = schema2->getColumnType(jattr2);
+	if (kt1 == CT_CHAR || kt2 == CT_CHAR)
+		throw IllegalConversionException();
+	if (kt1 != kt2 && (kt1 == CT_DECIMAL || kt2 == CT_DECIMAL))
+		throw IllegalConversionException();
+	keysize1 = (kt1 == CT_INTEGER ? sizeof(int) : sizeof(long long));
+	keysize2 = (kt2 == CT_INTEGER ? sizeof(int) : sizeof(long long));
+
+	copyruns = isFixedWidth(schema1) && isFixedWidth(schema2);
+	if (copyruns) {
+		unsigned int dst = addCopyRuns(buildruns, schema1, sel1, 0);
+		addCopyRuns(proberuns, schema2, sel2, dst);
+	}
+
 	for (int i=0; i<nthreads; ++i) {
 		WriteTable* wt = new WriteTable();
 		wt->init(sout, outputsize);
@@ -103,75 +140,101 @@ void FlatMemoryJoiner::custominit(Table* tbuild, Table* tprobe)
 
 void FlatMemoryJoiner::build(SplitResult ignored, int threadid) 
 {
-	vector<unsigned int>& ret = partitioner.realsplit(threadid);
+	vector<unsigned int>& ret = partitioner.partition(threadid);
 	if (threadid == 0) {
 		phistogram = &ret;
 	}
 }
 
-PageCursor* FlatMemoryJoiner::probe(SplitResult ignored, int threadid) 
+inline void FlatMemoryJoiner::assemble(char* tmp, const char* tup1, const char* tup2)
 {
-	WriteTable& ret = *(result[threadid]);
-	const vector<unsigned int>& histogram = *phistogram;
-	Page& buildpage = *(partitioner.getOutputBuffer());
-	Page& probepage = *probetable;
-
-	unsigned int items = totaltuples / nthreads;
-	unsigned int start = items * threadid;
-	if (threadid == nthreads-1) {
-		// Compensate for last few tuples, 
-		// if \a items has been rounded down.
-		items = totaltuples - start;
+	if (copyruns) {
+		for (unsigned int j=0; j<buildruns.size(); ++j)
+			memcpy(tmp + buildruns[j].dst, tup1 + buildruns[j].src, buildruns[j].len);
+		for (unsigned int j=0; j<proberuns.size(); ++j)
+			memcpy(tmp + proberuns[j].dst, tup2 + proberuns[j].src, proberuns[j].len);
+		return;
 	}
 
-	void* tup1;	///< points to the tuple from build
-	void* tup2; ///< points to the tuple from probe
+	// copy each column to destination
+	for (unsigned int j=0; j<sel1.size(); ++j)
+		sout->writeData(tmp,		// dest
+				j,		// col in output
+				s1->calcOffset(const_cast<char*>(tup1), sel1[j]));	// src for this col
+	for (unsigned int j=0; j<sel2.size(); ++j)
+		sout->writeData(tmp,		// dest
+				sel1.size()+j,	// col in output
+				s2->calcOffset(const_cast<char*>(tup2), sel2[j]));	// src for this col
+}
+
+template <typename Key1, typename Key2>
+void FlatMemoryJoiner::probeRange(const Key1& key1, const Key2& key2, 
+		unsigned int start, unsigned int items, int threadid)
+{
+	WriteTable* ret = result[threadid];
+	const vector<unsigned int>& histogram = *phistogram;
+	const char* build = (const char*) partitioner.getOutputBuffer()->getTupleOffset(0);
+	const char* probe = (const char*) probetable->getTupleOffset(0);
+	const unsigned int tupsz1 = s1->getTupleSize();
+	const unsigned int tupsz2 = s2->getTupleSize();
+
+	const char* tup1;	///< points to the tuple from build
+	const char* tup2; ///< points to the tuple from probe
 	unsigned int bstart;	///< start of hash bucket (an offset) in build page
-	unsigned int bitems;	///< number of tuples in hash bucket
+	unsigned int bend;	///< end of hash bucket in build page
 	char tmp[sout->getTupleSize()];	///< output tuple construction space
 	unsigned int curbuc;	///< current hash bucket being examined
+	long long key;		///< key of the probe tuple
 	
 	for (unsigned int probetid = start; 
 			probetid < start + items; 
 			++probetid) {
 
-		tup2 = probepage.getTupleOffset(probetid);
-		curbuc = _hashfn->hash(s2->asLong(tup2, ja2));
+		tup2 = probe + (unsigned long) probetid * tupsz2;
+		key = key2(tup2);
+		curbuc = bucketOf(key);
 
 		bstart = (curbuc != 0 ? histogram[curbuc-1] : 0);
-		bitems = histogram[curbuc] - bstart;
+		bend = histogram[curbuc];
 		for (unsigned int buildtid = bstart; 
-				buildtid < bstart + bitems; 
+				buildtid < bend; 
 				++buildtid) {
-			tup1 = buildpage.getTupleOffset(buildtid);
+			tup1 = build + (unsigned long) buildtid * tupsz1;
 
-			if ( sbuild->asLong(tup1,ja1) != s2->asLong(tup2,ja2) )
+			if (key1(tup1) != key)
 				continue;
 
 			// Now, tup1 and tup2 match. Bring the bytes together.
-#if defined(OUTPUT_ASSEMBLE)
-			// copy payload of first tuple to destination
-			if (s1->getTupleSize()) 
-				s1->copyTuple(tmp, sbuild->calcOffset(tup1,1));
-
-			// copy each column to destination
-			for (unsigned int j=0; j<sel2.size(); ++j)
-				sout->writeData(tmp,		// dest
-						s1->columns()+j,	// col in output
-						s2->calcOffset(tup2, sel2[j]));	// src for this col
-#if defined(OUTPUT_WRITE_NORMAL)
-			ret.append(tmp);
-#elif defined(OUTPUT_WRITE_NT)
-			ret.nontemporalappend16(tmp);
-#endif
-#endif
-
-#if !defined(OUTPUT_AGGREGATE) && !defined(OUTPUT_ASSEMBLE)
-			__asm__ __volatile__ ("nop");
-#endif
+			if (sink->assembles())
+				assemble(tmp, tup1, tup2);
+			sink->append(tmp, key, ret, threadid);
 		}
 
 	}
+}
+
+PageCursor* FlatMemoryJoiner::probe(SplitResult ignored, int threadid) 
+{
+	unsigned int items = totaltuples / nthreads;
+	unsigned int start = items * threadid;
+	if (threadid == nthreads-1) {
+		// Compensate for last few tuples, 
+		// if \a items has been rounded down.
+		items = totaltuples - start;
+	}
+
+	if (keysize1 == sizeof(int) && keysize2 == sizeof(int))
+		probeRange(FixedKey<int>(keyoff1), 
+				FixedKey<int>(keyoff2), start, items, threadid);
+	else if (keysize1 == sizeof(int))
+		probeRange(FixedKey<int>(keyoff1), 
+				FixedKey<long long>(keyoff2), start, items, threadid);
+	else if (keysize2 == sizeof(int))
+		probeRange(FixedKey<long long>(keyoff1), 
+				FixedKey<int>(keyoff2), start, items, threadid);
+	else
+		probeRange(FixedKey<long long>(keyoff1), 
+				FixedKey<long long>(keyoff2), start, items, threadid);
 
 	return result[threadid];
 }
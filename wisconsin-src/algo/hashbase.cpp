@@ -15,34 +15,52 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <typeinfo>
 #include "algo.h"
+#include "../exceptions.h"
 
 HashBase::HashBase(const libconfig::Setting& cfg) : BaseAlgo(cfg) {
 	nthreads = cfg["threads"];
 	size = cfg["algorithm"]["buildpagesize"];
 	outputsize = cfg["bucksize"];
 	_hashfn = HashFactory::createHashFunction(cfg["hash"]);
-#ifdef OUTPUT_AGGREGATE
-	aggregator = new int[AGGLEN*nthreads];
-	for (int i=0; i<AGGLEN*nthreads; ++i) {
-		aggregator[i] = 0;
-	}
-#endif
+	// not for subclasses such as MagicHashFunction, they override hash()
+	_modhash = typeid(*_hashfn) == typeid(ModuloHashFunction) ?
+		static_cast<ModuloHashFunction*>(_hashfn) : NULL;
+
+	string prefetch = "no";
+	cfg["algorithm"].lookupValue("prefetch", prefetch);
+	if (prefetch == "no")
+		probemode = PM_NORMAL;
+	else if (prefetch == "gp")
+		probemode = PM_GP;
+	else if (prefetch == "amac")
+		probemode = PM_AMAC;
+	else
+		throw UnknownAlgorithmException();
+	groupsize = 16;
+	cfg["algorithm"].lookupValue("groupsize", groupsize);
+	if (groupsize < 1 || groupsize > MAXGROUP)
+		throw UnknownAlgorithmException();
+	sink = SinkFactory::createSink(cfg);
 }
 
 HashBase::~HashBase() {
 	delete _hashfn;
-#ifdef OUTPUT_AGGREGATE
-	delete[] aggregator;
-#endif
+	delete sink;
 }
 
 void HashBase::init(
 		Schema* schema1, vector<unsigned int> select1, unsigned int jattr1,
 		Schema* schema2, vector<unsigned int> select2, unsigned int jattr2) {
 	BaseAlgo::init(schema1, select1, jattr1, schema2, select2, jattr2);
+
+	keyoff1 = schema1->getOffset(ja1);
+	keyoff2 = schema2->getOffset(ja2);
+	sink->init(sout, nthreads);
 }
 
 void HashBase::destroy() {
+	sink->destroy();
 	BaseAlgo::destroy();
 }
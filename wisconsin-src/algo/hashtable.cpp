@@ -25,50 +25,72 @@ void * myalloc(int size){
   return mem;
 }
 
-void HashTable::init(unsigned int nbuckets, unsigned int bucksize, unsigned int tuplesize)
+void HashTable::init(unsigned int nbuckets, unsigned int bucksize, unsigned int tuplesize,
+		int nthreads)
 {
-  lock = new Lock[nbuckets];
-  bucket = (void**)new char[sizeof(void*) * nbuckets];
-	for (int i=0; i<nbuckets; ++i) {
-		// allocating space for data + free pointer + next pointer
-	  bucket[i] = new char[bucksize + 2*sizeof(void*)];//myalloc(bucksize + 2*sizeof(void*));//
-		void** free = (void**)(((char*)bucket[i]) + bucksize);
-		void** next = (void**)(((char*)bucket[i]) + bucksize + sizeof(void*));
-		*next = 0;
-		*free = bucket[i];
-	}
-
 	this->bucksize = bucksize;
 	this->tuplesize = tuplesize;
 	this->nbuckets = nbuckets;
+	this->nthreads = nthreads;
+
+	// data + free pointer + next pointer, rounded up to cache lines
+	chunksize = (bucksize + 2*sizeof(void*) + 63) & ~63;
+
+	cache = new ChunkCache[nthreads];
+	for (int i=0; i<nthreads; ++i) {
+		cache[i].next = 0;
+		cache[i].end = 0;
+		cache[i].spare = 0;
+	}
+
+	emptychunk = myalloc(chunksize);
+	slabs.push_back(emptychunk);
+	*(void**)(((char*)emptychunk) + bucksize) = emptychunk;
+	*(void**)(((char*)emptychunk) + bucksize + sizeof(void*)) = 0;
+
+	bucket = (void**)new char[sizeof(void*) * nbuckets];
+	for (int i=0; i<nbuckets; ++i) {
+		bucket[i] = emptychunk;
+	}
 }
 
 void HashTable::destroy()
 {
-	for (int i=0; i<nbuckets; ++i) {
-		void* tmp = bucket[i];
-		void* cur = *(void**)(((char*)bucket[i]) + bucksize + sizeof(void*));
-		while (cur) {
-			delete[] (char*)tmp;
-			tmp = cur;
-			cur = *(void**)(((char*)cur) + bucksize + sizeof(void*));
-		} 
-		delete[] (char*) tmp;
+	for (int i=0; i<slabs.size(); ++i) {
+		free(slabs[i]);
 	}
+	slabs.clear();
 
-	delete[] lock;
+	delete[] cache;
 	delete[] (char*) bucket;
 }
 
-void* HashTable::allocate(unsigned int offset)
+void HashTable::refill(ChunkCache& c)
+{
+	unsigned int nchunks = SLABSIZE / chunksize;
+	if (nchunks == 0)
+		nchunks = 1;
+
+	char* slab = (char*) myalloc(nchunks * chunksize);
+	slablock.lock();
+	slabs.push_back(slab);
+	slablock.unlock();
+
+	c.next = slab;
+	c.end = slab + nchunks * chunksize;
+}
+
+void* HashTable::allocate(unsigned int offset, int threadid)
 {
 #ifdef DEBUG
 	assert(0 <= offset && offset<nbuckets);
+	assert(0 <= threadid && threadid<nthreads);
 #endif
 	void* data = bucket[offset];
 	void** freeloc = (void**)((char*)data + bucksize);
 	void* ret;
-	if ((*freeloc) <= ((char*)data + bucksize - tuplesize)) {
+	if (data != emptychunk 
+			&& (*freeloc) <= ((char*)data + bucksize - tuplesize)) {
 		// Fast path: it fits!
 		//
 		ret = *freeloc;
@@ -76,15 +98,15 @@ void* HashTable::allocate(unsigned int offset)
 		return ret;
 	}
 
-	// Allocate new page and make bucket[offset] point to it.
+	// Take a new chunk and make bucket[offset] point to it.
 	//
 	//throw PageFullException(offset);
 	
-	ret = new char[bucksize + 2*sizeof(void*)];
+	ret = newChunk(threadid);
 	bucket[offset] = ret;
 
 	void** nextloc = (void**)(((char*)ret) + bucksize + sizeof(void*));
-	*nextloc = data;
+	*nextloc = (data == emptychunk) ? 0 : data;
 
 	freeloc = (void**)(((char*)ret) + bucksize);
 	*freeloc = ((char*)ret) + tuplesize;
@@ -98,6 +120,7 @@ HashTable::Iterator HashTable::createIterator()
 }
 
 HashTable::Iterator::Iterator(unsigned int bucksize, unsigned int tuplesize)
-	: bucksize(bucksize), tuplesize(tuplesize), cur(0), free(0), next(0)
+	: bucksize(bucksize), tuplesize(tuplesize), 
+	chunkend(bucksize - bucksize % tuplesize), cur(0), free(0), next(0)
 {
 }
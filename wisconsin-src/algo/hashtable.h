@@ -16,44 +16,97 @@
 */
 
 #include "../lock.h"
+#include "../atomics.h"
 
 #ifdef DEBUG
 #include <cassert>
 #endif
 
+#include <vector>
+
 class HashTable {
 	public:
-		void init(unsigned int nbuckets, unsigned int bucksize, unsigned int tuplesize);
+		/**
+		 * Creates \a nbuckets empty buckets of chunks with room for \a
+		 * bucksize bytes of tuples. No chunk is allocated yet, all buckets
+		 * point to a shared empty chunk until their first tuple. \a nthreads
+		 * threads, numbered from 0, may allocate concurrently.
+		 */
+		void init(unsigned int nbuckets, unsigned int bucksize, unsigned int tuplesize,
+				int nthreads = 1);
+
+		/** Frees all chunks at once. */
 		void destroy();
 
 		/**
 		 * Allocates a tuple at bucket at \a offset. Call is not atomic and
-		 * might result in a new memory allocation if page is full.
+		 * might result in a new chunk from the cache of thread \a threadid
+		 * if page is full.
 		 * @return Location that has \a tuplesize bytes for writing.
 		 */
-		void* allocate(unsigned int offset);
+		void* allocate(unsigned int offset, int threadid = 0);
 
 		/**
-		 * Allocates a tuple at bucket at \a offset atomically.
+		 * Allocates a tuple at bucket at \a offset atomically, without locks.
+		 * The tuple is reserved by a fetch-and-add on the free pointer of the
+		 * first chunk. If that runs past the end of the chunk, a new chunk
+		 * from the cache of \a threadid is installed with a compare-and-swap
+		 * on the bucket; a thread that loses the race keeps its chunk for
+		 * the next time and retries.
 		 * @return Location that has \a tuplesize bytes for writing.
 		 */
-		inline void* atomicAllocate(unsigned int offset)
+		inline void* atomicAllocate(unsigned int offset, int threadid = 0)
 		{
 #ifdef DEBUG
 			assert(0 <= offset && offset<nbuckets);
 #endif
-			void* ret;
-			lock[offset].lock();
-			ret = allocate(offset);
-			lock[offset].unlock();
-			return ret;
+			for (;;) {
+				void* data = *(void* volatile*)&bucket[offset];
+				if (data != emptychunk) {
+					char* ret = (char*) atomic_fetch_and_add(
+							(void**)((char*)data + bucksize), tuplesize);
+					if (ret <= ((char*)data + bucksize - tuplesize))
+						return ret;
+				}
+
+				char* chunk = (char*) newChunk(threadid);
+				*(void**)(chunk + bucksize) = chunk + tuplesize;
+				*(void**)(chunk + bucksize + sizeof(void*)) = 
+					(data == emptychunk) ? 0 : data;
+				if (atomic_compare_and_swap(&bucket[offset], data, chunk) == data)
+					return chunk;
+				cache[threadid].spare = chunk;
+			}
 		}
 
 		class Iterator {
 			friend class HashTable;
 			public:
-				Iterator() : bucksize(0), tuplesize(0), cur(0), next(0), free(0) { }
+				Iterator() : bucksize(0), tuplesize(0), chunkend(0), cur(0), next(0), free(0) { }
 				Iterator(unsigned int bucksize, unsigned int tuplesize);
+
+				/**
+				 * Returns the next tuple of the current chunk, or NULL at its
+				 * end. Does not follow the chain, see \ref nextchunk.
+				 */
+				inline void* readlocal()
+				{
+					void* ret = cur;
+					if (cur < free) {
+						cur = ((char*)cur) + tuplesize;
+						return ret;
+					}
+					return 0;
+				}
+
+				/**
+				 * Returns the chunk after the current one, NULL at the end
+				 * of the chain.
+				 */
+				inline void* nextchunk()
+				{
+					return next;
+				}
 				
 				inline void* readnext() 
 				{
@@ -66,7 +119,7 @@ class HashTable {
 					} else if (next != 0) {
 						ret = next;
 						cur = ((char*)next) + tuplesize;
-						free = *(void**)((char*)next + bucksize);
+						free = chunkfree(next);
 						next = *(void**)((char*)next + bucksize + sizeof(void*));
 						// Return null if last chunk exists but is empty.
 						// Caveat: will not work correctly if there are empty
@@ -78,11 +131,23 @@ class HashTable {
 				}
 
 			private:
+				/**
+				 * End of the tuples of \a chunk. The free pointer can lie
+				 * past the last tuple, see \ref atomicAllocate.
+				 */
+				inline void* chunkfree(void* chunk)
+				{
+					char* f = *(char**)((char*)chunk + bucksize);
+					char* end = (char*)chunk + chunkend;
+					return f < end ? f : end;
+				}
+
 				void* cur;
 				void* free;
 				void* next;
 				const unsigned int bucksize;
 				const unsigned int tuplesize;
+				const unsigned int chunkend;	/**< bytes of tuples in a full chunk */
 		};
 
 		Iterator createIterator();
@@ -91,10 +156,47 @@ class HashTable {
 		{
 			void* start = bucket[offset];
 			it.cur = start;
-			it.free = *(void**)((char*)start + bucksize);
+			it.free = it.chunkfree(start);
 			it.next = *(void**)((char*)start + bucksize + sizeof(void*));
 		}
 
+		/**
+		 * Returns the first chunk of the chain of bucket at \a offset.
+		 */
+		inline void* getChunk(unsigned int offset)
+		{
+			return bucket[offset];
+		}
+
+		/**
+		 * Places \a it at the start of \a chunk, as returned by \ref
+		 * getChunk or Iterator::nextchunk.
+		 */
+		inline void placeChunk(Iterator& it, void* chunk)
+		{
+			it.cur = chunk;
+			it.free = it.chunkfree(chunk);
+			it.next = *(void**)((char*)chunk + bucksize + sizeof(void*));
+		}
+
+		/**
+		 * Prefetches the pointer to the first chunk of bucket at \a offset.
+		 */
+		inline void prefetchBucket(unsigned int offset)
+		{
+			__builtin_prefetch(&bucket[offset]);
+		}
+
+		/**
+		 * Prefetches the first tuples of \a chunk and the free and next
+		 * pointers at its end.
+		 */
+		inline void prefetchChunk(void* chunk)
+		{
+			__builtin_prefetch(chunk);
+			__builtin_prefetch((char*)chunk + bucksize);
+		}
+
 		inline void prefetch(unsigned int offset)
 		{
 #ifdef __x86_64__
@@ -103,8 +205,49 @@ class HashTable {
 		}
 
 	private:
-		Lock* lock;
+		/**
+		 * Chunks of one thread, carved from its current slab. Padded to a
+		 * cache line so that threads do not share one.
+		 */
+		struct ChunkCache {
+			char* next;		/**< next unused chunk */
+			char* end;		/**< end of the slab */
+			void* spare;	/**< chunk of a lost race in atomicAllocate */
+			char pad[64 - 3*sizeof(char*)];
+		};
+
+		/** Bytes of the slabs the chunks are carved from. */
+		static const unsigned int SLABSIZE = 2*1024*1024;
+
+		/**
+		 * Returns an uninitialized chunk from the cache of \a threadid,
+		 * refilling it with a new slab if it is empty.
+		 */
+		inline void* newChunk(int threadid)
+		{
+			ChunkCache& c = cache[threadid];
+			if (c.spare) {
+				void* ret = c.spare;
+				c.spare = 0;
+				return ret;
+			}
+			if (c.next == c.end)
+				refill(c);
+			void* ret = c.next;
+			c.next += chunksize;
+			return ret;
+		}
+
+		void refill(ChunkCache& c);
+
 		void** bucket;
+		void* emptychunk;	/**< shared by all buckets without tuples */
+
+		ChunkCache* cache;	/**< one per thread */
+		std::vector<void*> slabs;
+		Lock slablock;		/**< protects \a slabs */
+		unsigned int chunksize;	/**< bucksize + free and next, cache aligned */
+		int nthreads;
 		
 		unsigned int tuplesize;
 		unsigned int bucksize; 
@@ -34,18 +34,125 @@ PageCursor* ProbeIsNotPart<Super>::probe(SplitResult tin, int threadid)
 	return Super::probeCursor(t, threadid, true);
 }
 
+template <typename Super>
+ProbeSteal<Super>::ProbeSteal(const libconfig::Setting& cfg)
+	: Super(cfg), batchsize(4)
+{
+	cfg["algorithm"].lookupValue("stealbatch", batchsize);
+	if (batchsize == 0)
+		batchsize = 1;
+
+	PageQueue empty;
+	empty.next = NULL;
+	empty.end = NULL;
+	empty.schema = NULL;
+	queues.resize(Super::nthreads, empty);
+	pages.resize(Super::nthreads);
+}
+
+/**
+ * Unpublishes the queue of \a threadid before building. There is a barrier
+ * between build and probe, so no thief sees the queue of an earlier probe.
+ */
+template <typename Super>
+void ProbeSteal<Super>::build(SplitResult tin, int threadid)
+{
+	queues[threadid].next = NULL;
+	queues[threadid].end = NULL;
+	Super::build(tin, threadid);
+}
+
+template <typename Super>
+bool ProbeSteal<Super>::claim(PageQueue& q, Page**& begin, Page**& end)
+{
+	Page** oldval = q.next;
+	Page** newval;
+
+	do
+	{
+		if (oldval == NULL || oldval == q.end)
+			return false;
+
+		newval = oldval + batchsize;
+		if (newval > q.end)
+			newval = q.end;
+		begin = oldval;
+		oldval = (Page**) atomic_compare_and_swap((void**) &q.next, begin, newval);
+
+	} while (oldval != begin);
+
+	end = newval;
+	return true;
+}
+
 template <typename Super>
 PageCursor* ProbeSteal<Super>::probe(SplitResult tin, int threadid)
 {
 	WriteTable* ret = NULL;
-	for (int i=threadid; i<tin->size(); i+=Super::nthreads) {
+	const int nthreads = Super::nthreads;
+	PageQueue& own = queues[threadid];
+	vector<Page*>& ownpages = pages[threadid];
+	Page** begin;
+	Page** end;
+
+	// 1. Collect the pages of our partitions and publish them. The CAS is a
+	// full barrier, thieves see the pages before they see the queue. The
+	// trailing NULL keeps the head of a published queue from being NULL.
+	//
+	ownpages.clear();
+	for (int i=threadid; i<tin->size(); i+=nthreads) {
 		PageCursor* t = (*tin)[i];
-		ret = Super::probeCursor(t, threadid, false, ret);
+		Page* b;
+		while (b = t->readNext())
+			ownpages.push_back(b);
+		own.schema = t->schema();
 	}
+	ownpages.push_back(NULL);
+	own.end = &ownpages[0] + ownpages.size() - 1;
+	atomic_compare_and_swap((void**) &own.next, NULL, &ownpages[0]);
 
-	for (int i=0; i<tin->size(); ++i) {
-		PageCursor* t = (*tin)[i];
-		ret = Super::probeCursor(t, threadid, true, ret);
+	// 2. Probe our own pages.
+	//
+	while (claim(own, begin, end)) {
+		PageRangeCursor cursor(own.schema, begin, end);
+		ret = Super::probeCursor(&cursor, threadid, false, ret);
+	}
+
+	// 3. Steal from random victims until a full round finds every queue 
+	// published and empty. Unpublished queues are still being filled.
+	//
+	unsigned int seed = (threadid + 1) * 2654435761u;
+	bool done = (nthreads == 1);
+	while (!done) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		int first = seed % nthreads;
+
+		done = true;
+		for (int i=0; i<nthreads; ++i) {
+			int victim = (first + i) % nthreads;
+			if (victim == threadid)
+				continue;
+			PageQueue& q = queues[victim];
+			if (q.next == NULL) {
+				done = false;
+				continue;
+			}
+			if (claim(q, begin, end)) {
+				PageRangeCursor cursor(q.schema, begin, end);
+				ret = Super::probeCursor(&cursor, threadid, false, ret);
+				done = false;
+				break;
+			}
+		}
+	}
+
+	// 4. A thread that had no pages and stole none still returns a table.
+	//
+	if (ret == NULL) {
+		PageRangeCursor cursor((*tin)[0]->schema(), own.end, own.end);
+		ret = Super::probeCursor(&cursor, threadid, false, ret);
 	}
 
 	return ret;
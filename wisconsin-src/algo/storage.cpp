@@ -22,13 +22,34 @@
 using namespace std;
 #endif
 
+unsigned int addCopyRuns(vector<CopyRun>& runs, Schema* s, 
+		const vector<unsigned int>& cols, unsigned int dst)
+{
+	for (unsigned int j=0; j<cols.size(); ++j) {
+		unsigned int src = s->getOffset(cols[j]);
+		unsigned int len = (cols[j]+1 < s->columns() ? 
+				s->getOffset(cols[j]+1) : s->getTupleSize()) - src;
+
+		// merge with the previous run if the column follows it
+		if (!runs.empty() && runs.back().src + runs.back().len == src
+				&& runs.back().dst + runs.back().len == dst) {
+			runs.back().len += len;
+		} else {
+			CopyRun r = { src, dst, len };
+			runs.push_back(r);
+		}
+		dst += len;
+	}
+	return dst;
+}
+
 void StoreCopy::init(
 		Schema* schema1, vector<unsigned int> select1, unsigned int jattr1,
 		Schema* schema2, vector<unsigned int> select2, unsigned int jattr2) {
 	HashBase::init(schema1, select1, jattr1, schema2, select2, jattr2);
 
 	// create hashtable with new build schema
-	hashtable.init(_hashfn->buckets(), size, sbuild->getTupleSize());
+	hashtable.init(_hashfn->buckets(), size, sbuild->getTupleSize(), nthreads);
 }
 
 void StoreCopy::destroy() 
@@ -55,21 +76,24 @@ void StoreCopy::realbuildCursor(PageCursor* t, int threadid)
 	Schema* s = t->schema();
 	unsigned int curbuc;
 	while(b = (atomic ? t->atomicReadNext() : t->readNext())) {
+		const long long* keys = keysOf(b, keyoff1);
 		i = 0;
-		while(tup = b->getTupleOffset(i++)) {
+		while(tup = b->getTupleOffset(i)) {
+			long long key = keys ? keys[i] : s->asLong(tup, ja1);
+			++i;
 			// find hash table to append
-			curbuc = _hashfn->hash(s->asLong(tup, ja1));
+			curbuc = _hashfn->hash(key);
 			void* target = atomic ? 
-				hashtable.atomicAllocate(curbuc) :
-				hashtable.allocate(curbuc);
+				hashtable.atomicAllocate(curbuc, threadid) :
+				hashtable.allocate(curbuc, threadid);
 
 #ifdef VERBOSE
 		cout << "Adding tuple with key " 
-			<< setfill('0') << setw(7) << s->asLong(tup, ja1)
+			<< setfill('0') << setw(7) << key
 			<< " to bucket " << setfill('0') << setw(4) << curbuc << endl;
 #endif
 
-			sbuild->writeData(target, 0, s->calcOffset(tup, ja1));
+			sbuild->writeData(target, 0, &key);
 			for (unsigned int j=0; j<sel1.size(); ++j)
 				sbuild->writeData(target,		// dest
 						j+1,	// col in output
@@ -79,6 +103,36 @@ void StoreCopy::realbuildCursor(PageCursor* t, int threadid)
 	}
 }
 
+inline unsigned int StoreCopy::probeBucket(const char* key2)
+{
+	long long key = *reinterpret_cast<const long long*>(key2);
+#ifdef VERBOSE
+	cout << "Joining tuple having key " << key << endl;
+#endif
+	return _hashfn->hash(key);
+}
+
+inline void StoreCopy::joinTuple(char* tup1, const char* key2, char* tup2, char* tmp, WriteTable* ret, int threadid)
+{
+	long long key = *reinterpret_cast<const long long*>(key2);
+	if (sbuild->asLong(tup1,0) != key) {
+		return;
+	}
+
+	if (sink->assembles()) {
+		// copy payload of first tuple to destination
+		if (s1->getTupleSize()) 
+			s1->copyTuple(tmp, sbuild->calcOffset(tup1,1));
+
+		// copy each column to destination
+		for (unsigned int j=0; j<sel2.size(); ++j)
+			sout->writeData(tmp,		// dest
+					s1->columns()+j,	// col in output
+					s2->calcOffset(tup2, sel2[j]));	// src for this col
+	}
+	sink->append(tmp, key, ret, threadid);
+}
+
 WriteTable* StoreCopy::probeCursor(PageCursor* t, int threadid, bool atomic, WriteTable* ret)
 {
 	if (atomic)
@@ -95,73 +149,13 @@ WriteTable* StoreCopy::realprobeCursor(PageCursor* t, int threadid, WriteTable*
 	}
 
 	char tmp[sout->getTupleSize()];
-	void* tup1;
-	void* tup2;
 	Page* b2;
-	unsigned int curbuc, i;
-
-	HashTable::Iterator it = hashtable.createIterator();
 
 	while (b2 = (atomic ? t->atomicReadNext() : t->readNext())) {
 #ifdef VERBOSE
 		cout << "Working on page " << b2 << endl;
 #endif
-		i = 0;
-		while (tup2 = b2->getTupleOffset(i++)) {
-#ifdef VERBOSE
-			cout << "Joining tuple " << b2 << ":" 
-				<< setfill('0') << setw(6) << i 
-				<< " having key " << s2->asLong(tup2, ja2) << endl;
-#endif
-			curbuc = _hashfn->hash(s2->asLong(tup2, ja2));
-#ifdef VERBOSE
-			cout << "\twith bucket " << setfill('0') << setw(6) << curbuc << endl;
-#endif
-			hashtable.placeIterator(it, curbuc);
-
-#ifdef PREFETCH
-#warning Only works for 16-byte tuples!
-			hashtable.prefetch(_hashfn->hash(
-						*(unsigned long long*)(((char*)tup2)+32)
-						));
-			hashtable.prefetch(_hashfn->hash(
-						*(unsigned long long*)(((char*)tup2)+64)
-						));
-#endif
-
-			while (tup1 = it.readnext()) {
-				if (sbuild->asLong(tup1,0) != s2->asLong(tup2,ja2) ) {
-					continue;
-				}
-
-#if defined(OUTPUT_ASSEMBLE)
-				// copy payload of first tuple to destination
-				if (s1->getTupleSize()) 
-					s1->copyTuple(tmp, sbuild->calcOffset(tup1,1));
-
-				// copy each column to destination
-				for (unsigned int j=0; j<sel2.size(); ++j)
-					sout->writeData(tmp,		// dest
-							s1->columns()+j,	// col in output
-							s2->calcOffset(tup2, sel2[j]));	// src for this col
-#if defined(OUTPUT_WRITE_NORMAL)
-				ret->append(tmp);
-#elif defined(OUTPUT_WRITE_NT)
-				ret->nontemporalappend16(tmp);
-#endif
-#endif
-
-#if defined(OUTPUT_AGGREGATE)
-				aggregator[ (threadid * AGGLEN) +
-					+ (sbuild->asLong(tup1,0) & (AGGLEN-1)) ]++;
-#endif
-
-#if !defined(OUTPUT_AGGREGATE) && !defined(OUTPUT_ASSEMBLE)
-				__asm__ __volatile__ ("nop");
-#endif
-
-			}
-		}
+		probePage(this, b2, tmp, ret, threadid);
 	}
 	return ret;
 }
@@ -184,7 +178,7 @@ void StorePointer::init(
 	sbuild->add(CT_POINTER);
 	
 	// create hashtable with new build schema
-	hashtable.init(_hashfn->buckets(), size, sbuild->getTupleSize());
+	hashtable.init(_hashfn->buckets(), size, sbuild->getTupleSize(), nthreads);
 }
 
 void StorePointer::buildCursor(PageCursor* t, int threadid, bool atomic)
@@ -204,27 +198,57 @@ void StorePointer::realbuildCursor(PageCursor* t, int threadid)
 	Schema* s = t->schema();
 	unsigned int curbuc;
 	while(b = (atomic ? t->atomicReadNext() : t->readNext())) {
+		const long long* keys = keysOf(b, keyoff1);
 		i = 0;
-		while(tup = b->getTupleOffset(i++)) {
+		while(tup = b->getTupleOffset(i)) {
+			long long key = keys ? keys[i] : s->asLong(tup, ja1);
+			++i;
 			// find hash table to append
-			curbuc = _hashfn->hash(s->asLong(tup, ja1));
+			curbuc = _hashfn->hash(key);
 			void* target = atomic ?
-				hashtable.atomicAllocate(curbuc) :
-				hashtable.allocate(curbuc);
+				hashtable.atomicAllocate(curbuc, threadid) :
+				hashtable.allocate(curbuc, threadid);
 
 #ifdef VERBOSE
 		cout << "Adding tuple with key " 
-			<< setfill('0') << setw(7) << s->asLong(tup, ja1)
+			<< setfill('0') << setw(7) << key
 			<< " to bucket " << setfill('0') << setw(4) << curbuc << endl;
 #endif
 
-			sbuild->writeData(target, 0, s->calcOffset(tup, ja1));
+			sbuild->writeData(target, 0, &key);
 			sbuild->writeData(target, 1, &tup);
 
 		}
 	}
 }
 
+inline unsigned int StorePointer::probeBucket(const char* key2)
+{
+	return _hashfn->hash(*reinterpret_cast<const long long*>(key2));
+}
+
+inline void StorePointer::joinTuple(char* tup1, const char* key2, char* tup2, char* tmp, WriteTable* ret, int threadid)
+{
+	long long key = *reinterpret_cast<const long long*>(key2);
+	if (sbuild->asLong(tup1,0) != key) {
+		return;
+	}
+
+	if (sink->assembles()) {
+		void* realtup1 = sbuild->asPointer(tup1, 1);
+		// copy each column to destination
+		for (unsigned int j=0; j<sel1.size(); ++j)
+			sout->writeData(tmp,		// dest
+					j,		// col in output
+					s1->calcOffset(realtup1, sel1[j]));	// src for this col
+		for (unsigned int j=0; j<sel2.size(); ++j)
+			sout->writeData(tmp,		// dest
+					sel1.size()+j,	// col in output
+					s2->calcOffset(tup2, sel2[j]));	// src for this col
+	}
+	sink->append(tmp, key, ret, threadid);
+}
+
 WriteTable* StorePointer::probeCursor(PageCursor* t, int threadid, bool atomic, WriteTable* ret)
 {
 	if (atomic)
@@ -241,63 +265,10 @@ WriteTable* StorePointer::realprobeCursor(PageCursor* t, int threadid, WriteTabl
 	}
 
 	char tmp[sout->getTupleSize()];
-	void* tup1;
-	void* tup2;
 	Page* b2;
-	unsigned int curbuc, i;
-
-	HashTable::Iterator it = hashtable.createIterator();
 
 	while (b2 = (atomic ? t->atomicReadNext() : t->readNext())) {
-		i = 0;
-		while (tup2 = b2->getTupleOffset(i++)) {
-			curbuc = _hashfn->hash(s2->asLong(tup2, ja2));
-			hashtable.placeIterator(it, curbuc);
-
-#ifdef PREFETCH
-#warning Only works for 16-byte tuples!
-			hashtable.prefetch(_hashfn->hash(
-						*(unsigned long long*)(((char*)tup2)+32)
-						));
-			hashtable.prefetch(_hashfn->hash(
-						*(unsigned long long*)(((char*)tup2)+64)
-						));
-#endif
-
-			while (tup1 = it.readnext()) {
-				if (sbuild->asLong(tup1,0) != s2->asLong(tup2,ja2) ) {
-					continue;
-				}
-
-#if defined(OUTPUT_ASSEMBLE)
-				void* realtup1 = sbuild->asPointer(tup1, 1);
-				// copy each column to destination
-				for (unsigned int j=0; j<sel1.size(); ++j)
-					sout->writeData(tmp,		// dest
-							j,		// col in output
-							s1->calcOffset(realtup1, sel1[j]));	// src for this col
-				for (unsigned int j=0; j<sel2.size(); ++j)
-					sout->writeData(tmp,		// dest
-							sel1.size()+j,	// col in output
-							s2->calcOffset(tup2, sel2[j]));	// src for this col
-#if defined(OUTPUT_WRITE_NORMAL)
-				ret->append(tmp);
-#elif defined(OUTPUT_WRITE_NT)
-				ret->nontemporalappend16(tmp);
-#endif
-#endif
-
-#if defined(OUTPUT_AGGREGATE)
-				aggregator[ (threadid * AGGLEN) +
-					+ (sbuild->asLong(tup1,0) & (AGGLEN-1)) ]++;
-#endif
-
-#if !defined(OUTPUT_AGGREGATE) && !defined(OUTPUT_ASSEMBLE)
-				__asm__ __volatile__ ("nop");
-#endif
-
-			}
-		}
+		probePage(this, b2, tmp, ret, threadid);
 	}
 	return ret;
 }
@@ -309,6 +280,7 @@ void StorePointer::destroy() {
 	// XXX memory leak: can't delete, pointed to by output tables
 	// delete sout;
 	delete sbuild;
+	sink->destroy();
 
 	hashtable.destroy();
 }
@@ -0,0 +1,381 @@
+/*
+    Copyright 2011, Spyros Blanas.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+
+/**
+ * Performs the copies \a runs from tuple \a src to tuple \a dst. If \a Len is
+ * not 0 there is exactly one run of \a Len bytes, copied without a loop.
+ */
+template <unsigned int Len>
+inline void copyRuns(char* dst, const char* src, const CopyRun* runs, 
+		unsigned int nruns)
+{
+	if (Len) {
+		memcpy(dst + runs[0].dst, src + runs[0].src, Len);
+		return;
+	}
+	for (unsigned int j=0; j<nruns; ++j)
+		memcpy(dst + runs[j].dst, src + runs[j].src, runs[j].len);
+}
+
+template <typename Owner>
+void HashBase::probePage(Owner* o, Page* b2, char* tmp, WriteTable* ret, int threadid)
+{
+	if (probemode == PM_GP) {
+		probePageGP(o, b2, tmp, ret, threadid);
+		return;
+	}
+	if (probemode == PM_AMAC) {
+		probePageAMAC(o, b2, tmp, ret, threadid);
+		return;
+	}
+
+	char* tup1;
+	char* tup2;
+	const char* key2;
+	const long long* keys = keysOf(b2, keyoff2);
+	unsigned int i = 0;
+	HashTable::Iterator it = hashtable.createIterator();
+
+	while (tup2 = reinterpret_cast<char*>(b2->getTupleOffset(i))) {
+		key2 = keys ? reinterpret_cast<const char*>(keys + i) : tup2 + keyoff2;
+		++i;
+		hashtable.placeIterator(it, o->probeBucket(key2));
+		while (tup1 = reinterpret_cast<char*>(it.readnext()))
+			o->joinTuple(tup1, key2, tup2, tmp, ret, threadid);
+	}
+}
+
+template <typename Owner>
+void HashBase::probePageGP(Owner* o, Page* b2, char* tmp, WriteTable* ret, int threadid)
+{
+	ProbeState state[MAXGROUP];
+	char* tup1;
+	char* tup2;
+	const long long* keys = keysOf(b2, keyoff2);
+	unsigned int i = 0;
+	int k, n, done;
+	HashTable::Iterator it = hashtable.createIterator();
+
+	do {
+		// hash a group of probe tuples, prefetch their buckets
+		for (n=0; n<groupsize && 
+				(tup2 = reinterpret_cast<char*>(b2->getTupleOffset(i))); ++n, ++i) {
+			state[n].tup2 = tup2;
+			state[n].key2 = keys ? 
+				reinterpret_cast<const char*>(keys + i) : tup2 + keyoff2;
+			state[n].offset = o->probeBucket(state[n].key2);
+			hashtable.prefetchBucket(state[n].offset);
+		}
+
+		// prefetch the first chunks of the chains
+		for (k=0; k<n; ++k) {
+			state[k].chunk = hashtable.getChunk(state[k].offset);
+			hashtable.prefetchChunk(state[k].chunk);
+		}
+
+		// scan one chunk of every chain per round, prefetching the next
+		done = 0;
+		while (done < n) {
+			for (k=0; k<n; ++k) {
+				if (!state[k].chunk)
+					continue;
+				hashtable.placeChunk(it, state[k].chunk);
+				while (tup1 = reinterpret_cast<char*>(it.readlocal()))
+					o->joinTuple(tup1, state[k].key2, state[k].tup2, tmp, ret, 
+							threadid);
+				state[k].chunk = it.nextchunk();
+				if (state[k].chunk)
+					hashtable.prefetchChunk(state[k].chunk);
+				else
+					++done;
+			}
+		}
+	} while (n == groupsize);
+}
+
+template <typename Owner>
+void HashBase::probePageAMAC(Owner* o, Page* b2, char* tmp, WriteTable* ret, int threadid)
+{
+	enum { S_ISSUE, S_BUCKET, S_CHUNK, S_DONE };
+
+	ProbeState state[MAXGROUP];
+	char* tup1;
+	const long long* keys = keysOf(b2, keyoff2);
+	unsigned int i = 0;
+	int k, done = 0;
+	HashTable::Iterator it = hashtable.createIterator();
+
+	for (k=0; k<groupsize; ++k)
+		state[k].stage = S_ISSUE;
+
+	k = 0;
+	while (done < groupsize) {
+		ProbeState& st = state[k];
+		switch (st.stage) {
+			case S_ISSUE:
+				st.tup2 = reinterpret_cast<char*>(b2->getTupleOffset(i));
+				if (!st.tup2) {
+					st.stage = S_DONE;
+					++done;
+					break;
+				}
+				st.key2 = keys ? 
+					reinterpret_cast<const char*>(keys + i) : st.tup2 + keyoff2;
+				++i;
+				st.offset = o->probeBucket(st.key2);
+				hashtable.prefetchBucket(st.offset);
+				st.stage = S_BUCKET;
+				break;
+			case S_BUCKET:
+				st.chunk = hashtable.getChunk(st.offset);
+				hashtable.prefetchChunk(st.chunk);
+				st.stage = S_CHUNK;
+				break;
+			case S_CHUNK:
+				hashtable.placeChunk(it, st.chunk);
+				while (tup1 = reinterpret_cast<char*>(it.readlocal()))
+					o->joinTuple(tup1, st.key2, st.tup2, tmp, ret, threadid);
+				st.chunk = it.nextchunk();
+				if (st.chunk) {
+					hashtable.prefetchChunk(st.chunk);
+					break;
+				}
+				// chain done, this slot takes the next probe tuple at once
+				st.stage = S_ISSUE;
+				continue;
+			default:
+				break;
+		}
+		k = (k+1 == groupsize) ? 0 : k+1;
+	}
+}
+
+template <typename KeyT, unsigned int PayloadSize>
+void StoreCopySpec<KeyT, PayloadSize>::init(
+		Schema* schema1, vector<unsigned int> select1, unsigned int jattr1,
+		Schema* schema2, vector<unsigned int> select2, unsigned int jattr2) {
+	StoreCopy::init(schema1, select1, jattr1, schema2, select2, jattr2);
+
+	// hash table tuples are {key, s1}, output tuples are {s1, selected s2}
+	buildruns.clear();
+	proberuns.clear();
+	unsigned int end = addCopyRuns(buildruns, schema1, sel1, sizeof(KeyT));
+	addCopyRuns(proberuns, s2, sel2, s1->getTupleSize());
+
+	assert(sizeof(KeyT) == sbuild->getTupleSize() - s1->getTupleSize());
+	assert(end == sbuild->getTupleSize());
+	assert(PayloadSize == 0 || (buildruns.size() == 1 && proberuns.size() == 1
+				&& buildruns[0].len == PayloadSize 
+				&& proberuns[0].len == PayloadSize));
+
+	pruns = proberuns.empty() ? NULL : &proberuns[0];
+	npruns = proberuns.size();
+}
+
+template <typename KeyT, unsigned int PayloadSize>
+void StoreCopySpec<KeyT, PayloadSize>::buildCursor(PageCursor* t, int threadid, bool atomic)
+{
+	if (atomic)
+		realbuildCursor<true>(t, threadid);
+	else
+		realbuildCursor<false>(t, threadid);
+}
+
+template <typename KeyT, unsigned int PayloadSize>
+template <bool atomic>
+void StoreCopySpec<KeyT, PayloadSize>::realbuildCursor(PageCursor* t, int threadid)
+{
+	int i = 0;
+	char* tup;
+	Page* b;
+	const CopyRun* runs = buildruns.empty() ? NULL : &buildruns[0];
+	const unsigned int nruns = buildruns.size();
+	while(b = (atomic ? t->atomicReadNext() : t->readNext())) {
+		const long long* keys = keysOf(b, keyoff1);
+		i = 0;
+		while(tup = reinterpret_cast<char*>(b->getTupleOffset(i))) {
+			KeyT key = keys ? static_cast<KeyT>(keys[i]) 
+				: *reinterpret_cast<KeyT*>(tup + keyoff1);
+			++i;
+			unsigned int curbuc = bucketOf(key);
+			char* target = reinterpret_cast<char*>(atomic ? 
+				hashtable.atomicAllocate(curbuc, threadid) :
+				hashtable.allocate(curbuc, threadid));
+
+			*reinterpret_cast<KeyT*>(target) = key;
+			copyRuns<PayloadSize>(target, tup, runs, nruns);
+		}
+	}
+}
+
+template <typename KeyT, unsigned int PayloadSize>
+inline unsigned int StoreCopySpec<KeyT, PayloadSize>::probeBucket(const char* key2)
+{
+	return bucketOf(*reinterpret_cast<const KeyT*>(key2));
+}
+
+template <typename KeyT, unsigned int PayloadSize>
+inline void StoreCopySpec<KeyT, PayloadSize>::joinTuple(char* tup1, const char* key2, char* tup2, char* tmp, WriteTable* ret, int threadid)
+{
+	KeyT key = *reinterpret_cast<const KeyT*>(key2);
+	if (*reinterpret_cast<KeyT*>(tup1) != key) {
+		return;
+	}
+
+	if (sink->assembles()) {
+		// payload of first tuple, then the columns of the second
+		memcpy(tmp, tup1 + sizeof(KeyT), PayloadSize ? PayloadSize : s1->getTupleSize());
+		copyRuns<PayloadSize>(tmp, tup2, pruns, npruns);
+	}
+	sink->append(tmp, key, ret, threadid);
+}
+
+template <typename KeyT, unsigned int PayloadSize>
+WriteTable* StoreCopySpec<KeyT, PayloadSize>::probeCursor(PageCursor* t, int threadid, bool atomic, WriteTable* ret)
+{
+	if (atomic)
+		return realprobeCursor<true>(t, threadid, ret);
+	return realprobeCursor<false>(t, threadid, ret);
+}
+
+template <typename KeyT, unsigned int PayloadSize>
+template <bool atomic>
+WriteTable* StoreCopySpec<KeyT, PayloadSize>::realprobeCursor(PageCursor* t, int threadid, WriteTable* ret)
+{
+	if (ret == NULL) {
+		ret = new WriteTable();
+		ret->init(sout, outputsize);
+	}
+
+	char tmp[sout->getTupleSize()];
+	Page* b2;
+
+	while (b2 = (atomic ? t->atomicReadNext() : t->readNext())) {
+		probePage(this, b2, tmp, ret, threadid);
+	}
+	return ret;
+}
+
+
+
+
+template <typename KeyT, unsigned int PayloadSize>
+void StorePointerSpec<KeyT, PayloadSize>::init(
+		Schema* schema1, vector<unsigned int> select1, unsigned int jattr1,
+		Schema* schema2, vector<unsigned int> select2, unsigned int jattr2) {
+	StorePointer::init(schema1, select1, jattr1, schema2, select2, jattr2);
+
+	// hash table tuples are {key, pointer}, output tuples are {s1, s2}
+	buildruns.clear();
+	proberuns.clear();
+	unsigned int end = addCopyRuns(buildruns, s1, sel1, 0);
+	addCopyRuns(proberuns, s2, sel2, end);
+
+	assert(sizeof(KeyT) == sbuild->getOffset(1));
+	assert(PayloadSize == 0 || (buildruns.size() == 1 && proberuns.size() == 1
+				&& buildruns[0].len == PayloadSize 
+				&& proberuns[0].len == PayloadSize));
+
+	bruns = buildruns.empty() ? NULL : &buildruns[0];
+	nbruns = buildruns.size();
+	pruns = proberuns.empty() ? NULL : &proberuns[0];
+	npruns = proberuns.size();
+}
+
+template <typename KeyT, unsigned int PayloadSize>
+void StorePointerSpec<KeyT, PayloadSize>::buildCursor(PageCursor* t, int threadid, bool atomic)
+{
+	if (atomic)
+		realbuildCursor<true>(t, threadid);
+	else
+		realbuildCursor<false>(t, threadid);
+}
+
+template <typename KeyT, unsigned int PayloadSize>
+template <bool atomic>
+void StorePointerSpec<KeyT, PayloadSize>::realbuildCursor(PageCursor* t, int threadid)
+{
+	int i = 0;
+	char* tup;
+	Page* b;
+	while(b = (atomic ? t->atomicReadNext() : t->readNext())) {
+		const long long* keys = keysOf(b, keyoff1);
+		i = 0;
+		while(tup = reinterpret_cast<char*>(b->getTupleOffset(i))) {
+			KeyT key = keys ? static_cast<KeyT>(keys[i]) 
+				: *reinterpret_cast<KeyT*>(tup + keyoff1);
+			++i;
+			unsigned int curbuc = bucketOf(key);
+			char* target = reinterpret_cast<char*>(atomic ?
+				hashtable.atomicAllocate(curbuc, threadid) :
+				hashtable.allocate(curbuc, threadid));
+
+			*reinterpret_cast<KeyT*>(target) = key;
+			*reinterpret_cast<char**>(target + sizeof(KeyT)) = tup;
+		}
+	}
+}
+
+template <typename KeyT, unsigned int PayloadSize>
+inline unsigned int StorePointerSpec<KeyT, PayloadSize>::probeBucket(const char* key2)
+{
+	return bucketOf(*reinterpret_cast<const KeyT*>(key2));
+}
+
+template <typename KeyT, unsigned int PayloadSize>
+inline void StorePointerSpec<KeyT, PayloadSize>::joinTuple(char* tup1, const char* key2, char* tup2, char* tmp, WriteTable* ret, int threadid)
+{
+	KeyT key = *reinterpret_cast<const KeyT*>(key2);
+	if (*reinterpret_cast<KeyT*>(tup1) != key) {
+		return;
+	}
+
+	if (sink->assembles()) {
+		char* realtup1 = *reinterpret_cast<char**>(tup1 + sizeof(KeyT));
+		copyRuns<PayloadSize>(tmp, realtup1, bruns, nbruns);
+		copyRuns<PayloadSize>(tmp, tup2, pruns, npruns);
+	}
+	sink->append(tmp, key, ret, threadid);
+}
+
+template <typename KeyT, unsigned int PayloadSize>
+WriteTable* StorePointerSpec<KeyT, PayloadSize>::probeCursor(PageCursor* t, int threadid, bool atomic, WriteTable* ret)
+{
+	if (atomic)
+		return realprobeCursor<true>(t, threadid, ret);
+	return realprobeCursor<false>(t, threadid, ret);
+}
+
+template <typename KeyT, unsigned int PayloadSize>
+template <bool atomic>
+WriteTable* StorePointerSpec<KeyT, PayloadSize>::realprobeCursor(PageCursor* t, int threadid, WriteTable* ret)
+{
+	if (ret == NULL) {
+		ret = new WriteTable();
+		ret->init(sout, outputsize);
+	}
+
+	char tmp[sout->getTupleSize()];
+	Page* b2;
+
+	while (b2 = (atomic ? t->atomicReadNext() : t->readNext())) {
+		probePage(this, b2, tmp, ret, threadid);
+	}
+	return ret;
+}
@@ -60,4 +60,40 @@ inline void* atomic_compare_and_swap(void** ptr, void* oldval, void* newval)
 	return newval;
 }
 
+/**
+ * Atomic fetch-and-add: Advances the pointer \a *ptr by \a inc bytes.
+ * @return the contents of *ptr before the operation.
+ */
+inline void* atomic_fetch_and_add(void** ptr, unsigned long inc)
+{
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8) || defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_4)
+	return (void*) __sync_fetch_and_add((char**) ptr, inc);
+#elif defined(__x86_64__)
+	__asm__ __volatile__ ( \
+			"lock xaddq %0, %1   \n\t" \
+:           "+r" (inc), "+m" (*ptr)     /* output */ \
+:                                       /* input */ \
+:           "memory"    /* clobber */ \
+	);
+	return (void*) inc;
+#else
+	void* oldval;
+	void* newval = *ptr;
+	do {
+		oldval = newval;
+		newval = atomic_compare_and_swap(ptr, oldval, (char*)oldval + inc);
+	} while (newval != oldval);
+	return oldval;
+#endif
+}
+
+/**
+ * Atomic fetch-and-add on a counter: Adds \a inc to \a *ptr.
+ * @return the contents of *ptr before the operation.
+ */
+inline unsigned long atomic_fetch_and_add(unsigned long* ptr, unsigned long inc)
+{
+	return (unsigned long) atomic_fetch_and_add((void**) ptr, inc);
+}
+
 #endif
@@ -15,6 +15,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cstring>
 #include "atomics.h"
 
 inline bool Buffer::isValidAddress(void* loc, unsigned int len) 
@@ -82,3 +83,23 @@ inline bool TupleBuffer::isValidTupleAddress(void* loc)
 {
 	return Buffer::isValidAddress(loc, tuplesize);
 }
+
+inline void TupleBuffer::storeKey(const void* tup)
+{
+	if (!keys)
+		return;
+
+	unsigned long pos = (reinterpret_cast<const char*>(tup) 
+			- reinterpret_cast<char*>(data)) / tuplesize;
+	const char* src = reinterpret_cast<const char*>(tup) + keyoffset;
+
+	// The whole key if the tuple has 8 bytes from its offset, else the rest
+	// of the tuple and zeroes.
+	if (keyoffset + sizeof(long long) <= tuplesize) {
+		keys[pos] = *reinterpret_cast<const long long*>(src);
+	} else {
+		long long key = 0;
+		memcpy(&key, src, tuplesize - keyoffset);
+		keys[pos] = key;
+	}
+}
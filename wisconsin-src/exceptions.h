@@ -36,10 +36,16 @@ class PageFullException {
 
 class LoadBZ2Exception { };
 
+class LoadGzipException { };
+
+class LoadZstdException { };
+
 class AffinitizationException { };
 
 class FileNotFoundException { };
 
+class WriteFileException { };
+
 class ComparisonException { };
 
 class NotYetImplemented { };
@@ -64,6 +64,17 @@ HashFunction* HashFactory::createHashFunction(const libconfig::Setting& node)
 		unsigned int skipbits = 0;
 		node.lookupValue("skipbits", skipbits);
 		hashfn = new ModuloHashFunction(min, max, k, skipbits);
+	} else if (hashfnname == "mult" || hashfnname == "crc32c" 
+			|| hashfnname == "murmur") {
+		// modulo over the multiply-shift, CRC32C or murmur hash of the key
+		unsigned int skipbits = 0;
+		node.lookupValue("skipbits", skipbits);
+		int mix = HASH_FN_MULT;
+		if (hashfnname == "crc32c")
+			mix = HASH_FN_CRC32C;
+		else if (hashfnname == "murmur")
+			mix = HASH_FN_MURMUR;
+		hashfn = new ModuloHashFunction(min, max, k, skipbits, mix);
 	} else if (hashfnname == "magic") {
 		hashfn = new MagicHashFunction(min, max, k);
 	} else {
@@ -83,13 +94,13 @@ vector<HashFunction*> ModuloHashFunction::generate(unsigned int passes)
 	for (int i=0; i<passes-1; ++i) {
 		ret.push_back(new ModuloHashFunction(_min, _max, 
 					(1 << bitsperpass), 
-					_skipbits + totalbitsset - ((i+1)*bitsperpass)));
+					_skipbits + totalbitsset - ((i+1)*bitsperpass), _mix));
 	}
 
 	bitsperpass = totalbitsset - ((passes-1) * bitsperpass);
 	ret.push_back(new ModuloHashFunction(_min, _max, 
 				(1 << bitsperpass), 
-				_skipbits));
+				_skipbits, _mix));
 
 #ifdef DEBUG
 	unsigned int kfinal = dynamic_cast<ModuloHashFunction*>(ret[0])->_k;
@@ -21,6 +21,8 @@
 #include <vector>
 #include <libconfig.h++>
 
+#include "hash_functions.h"	// hash_key, HASH_FN_*
+
 using std::vector;
 
 class HashFunction {
@@ -67,28 +69,42 @@ class ModuloHashFunction : public HashFunction {
 	public:
 		/**
 		 * Skipbits parameter defines number of least-significant bits which
-		 * will be discarded before computing the hash.
+		 * will be discarded before computing the hash. Parameter \a mix
+		 * is one of HASH_FN_* of hash_functions.h and scrambles the value
+		 * before the bits are taken, HASH_FN_MODULO keeps it as it is.
 		 */
-		ModuloHashFunction(int min, int max, unsigned int k, unsigned int skipbits)
+		ModuloHashFunction(int min, int max, unsigned int k, unsigned int skipbits,
+				int mix = HASH_FN_MODULO)
 			: HashFunction(min, max, k) { 
 			_skipbits = skipbits;
+			_mix = mix;
 			_k = ((1 << _k) - 1) << _skipbits;	// _k is used as the modulo mask
 		}
 
-		/** Return h(x) = x mod k. */
+		/** Return h(x) = mix(x) mod k. */
 		inline unsigned int hash(long long value) {
-			return ((value-_min) & _k) >> _skipbits;
+			return (hash_key(value-_min, _mix) & _k) >> _skipbits;
 		}
 
 		inline unsigned int buckets() {
 			return (_k >> _skipbits) + 1;
 		}
 
+#ifdef __AVX512F__
+		/** Return h(x) of the 8 keys in \a values, lane i is hash(values[i]). */
+		inline __m512i hash(__m512i values) {
+			__m512i v = _mm512_sub_epi64(values, _mm512_set1_epi64(_min));
+			v = _mm512_and_epi64(hash_key_simd(v, _mix), _mm512_set1_epi64(_k));
+			return _mm512_srli_epi64(v, _skipbits);
+		}
+#endif
+
 		/** Generate set of hash functions to be used for multiple passes. */
 		vector<HashFunction*> generate(unsigned int passes);
 
 	private:
 		unsigned int _skipbits;
+		int _mix;	/**< HASH_FN_* applied before taking the bits */
 };
 
 class MagicHashFunction : public ModuloHashFunction {
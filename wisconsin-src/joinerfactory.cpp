@@ -20,6 +20,99 @@
 
 using namespace std;
 
+/**
+ * Wraps \a Store in the build and probe loops chosen in the algorithm
+ * section. Work stealing is only considered if \a allowsteal is set.
+ */
+template <typename Store>
+static BaseAlgo* createWrapped(const libconfig::Setting& cfg, bool allowsteal)
+{
+	string partitionbuild = cfg["algorithm"]["partitionbuild"];
+	string partitionprobe = cfg["algorithm"]["partitionprobe"];
+	string steal = "no";
+	cfg["algorithm"].lookupValue("steal", steal);
+
+	if (allowsteal && steal == "yes") {
+		if (partitionbuild == "yes")
+			return new ProbeSteal < BuildIsPart < Store > > (cfg);
+		return new ProbeSteal < BuildIsNotPart < Store > > (cfg);
+	}
+	if (partitionbuild == "yes") {
+		if (partitionprobe == "yes") {
+			return new ProbeIsPart< BuildIsPart< Store > > (cfg);
+		} else {
+			return new ProbeIsNotPart< BuildIsPart< Store > > (cfg);
+		}
+	} else {
+		if (partitionprobe == "yes") {
+			return new ProbeIsPart< BuildIsNotPart< Store > > (cfg);
+		} else {
+			return new ProbeIsNotPart< BuildIsNotPart< Store > > (cfg);
+		}
+	}
+}
+
+/** True if no column of \a s is of variable length. */
+static bool isFixedWidth(Schema& s)
+{
+	for (unsigned int i=0; i<s.columns(); ++i)
+		if (s.getColumnType(i) == CT_CHAR)
+			return false;
+	return true;
+}
+
+/**
+ * True if \a s is a (key, payload) schema with both columns of the same type,
+ * joining on column \a jattr and selecting only the other column.
+ */
+static bool isKeyPayload(Schema& s, unsigned int jattr, 
+		const libconfig::Setting& select)
+{
+	if (s.columns() != 2 || select.getLength() != 1)
+		return false;
+	unsigned int payload = 1 - jattr;
+	unsigned int sel = select[0];
+	return s.getColumnType(payload) == s.getColumnType(jattr) 
+		&& sel - 1 == payload;
+}
+
+/**
+ * Creates the joiner with the kernels of \a Spec specialized for the build
+ * and probe schemas of the configuration, or with the generic \a Generic if
+ * they have CHAR columns or join keys of different types. Can be turned off
+ * with specialize = "no" in the algorithm section.
+ */
+template <template <typename, unsigned int> class Spec, typename Generic>
+static BaseAlgo* createStore(const libconfig::Setting& cfg, bool allowsteal)
+{
+	Schema s1 = Schema::create(cfg["build"]["schema"]);
+	Schema s2 = Schema::create(cfg["probe"]["schema"]);
+	unsigned int ja1 = cfg["build"]["jattr"];
+	unsigned int ja2 = cfg["probe"]["jattr"];
+	ja1--;
+	ja2--;
+	string specialize = "yes";
+	cfg["algorithm"].lookupValue("specialize", specialize);
+
+	ColumnType kt = s1.getColumnType(ja1);
+	if (specialize != "yes" || kt != s2.getColumnType(ja2) 
+			|| (kt != CT_LONG && kt != CT_INTEGER)
+			|| !isFixedWidth(s1) || !isFixedWidth(s2)) {
+		return createWrapped< Generic >(cfg, allowsteal);
+	}
+
+	bool pair = isKeyPayload(s1, ja1, cfg["build"]["select"]) 
+		&& isKeyPayload(s2, ja2, cfg["probe"]["select"]);
+	if (kt == CT_LONG) {
+		if (pair)
+			return createWrapped< Spec<long long, sizeof(long long)> >(cfg, allowsteal);
+		return createWrapped< Spec<long long, 0> >(cfg, allowsteal);
+	}
+	if (pair)
+		return createWrapped< Spec<int, sizeof(int)> >(cfg, allowsteal);
+	return createWrapped< Spec<int, 0> >(cfg, allowsteal);
+}
+
 BaseAlgo* JoinerFactory::createJoiner(const libconfig::Config& root) {
 	BaseAlgo* joiner;
 
@@ -27,46 +120,23 @@ BaseAlgo* JoinerFactory::createJoiner(const libconfig::Config& root) {
 	string flatmem = "no";
 	cfg["algorithm"].lookupValue("flatmem", flatmem);
 	string copydata = cfg["algorithm"]["copydata"];
-	string partitionbuild = cfg["algorithm"]["partitionbuild"];
-	string partitionprobe = cfg["algorithm"]["partitionprobe"];
-	string steal = "no";
-	cfg["algorithm"].lookupValue("steal", steal);
 
 	if (flatmem == "yes") {
+		// partitions the inputs itself, from the unpartitioned tables
+		string partbuild = cfg["partitioner"]["build"]["algorithm"];
+		string partprobe = cfg["partitioner"]["probe"]["algorithm"];
+		string partitionbuild = "no";
+		string partitionprobe = "no";
+		cfg["algorithm"].lookupValue("partitionbuild", partitionbuild);
+		cfg["algorithm"].lookupValue("partitionprobe", partitionprobe);
+		if (partbuild != "no" || partprobe != "no"
+				|| partitionbuild != "no" || partitionprobe != "no")
+			throw UnknownAlgorithmException();
 		joiner = new FlatMemoryJoiner(root);
 	} else if (copydata == "yes") { 
-		if (steal == "yes") {
-			assert(partitionbuild == "no");
-			assert(partitionprobe == "yes");
-			joiner = new ProbeSteal < BuildIsNotPart < StoreCopy > > (cfg);
-		}
-		else if (partitionbuild == "yes") {
-			if (partitionprobe == "yes") {
-				joiner = new ProbeIsPart< BuildIsPart< StoreCopy > > (cfg);
-			} else {
-				joiner = new ProbeIsNotPart< BuildIsPart< StoreCopy > > (cfg);
-			}
-		} else {
-			if (partitionprobe == "yes") {
-				joiner = new ProbeIsPart< BuildIsNotPart< StoreCopy > > (cfg);
-			} else {
-				joiner = new ProbeIsNotPart< BuildIsNotPart< StoreCopy > > (cfg);
-			}
-		}
+		joiner = createStore< StoreCopySpec, StoreCopy >(cfg, true);
 	} else {
-		if (partitionbuild == "yes") {
-			if (partitionprobe == "yes") {
-				joiner = new ProbeIsPart< BuildIsPart< StorePointer > > (cfg);
-			} else {
-				joiner = new ProbeIsNotPart< BuildIsPart< StorePointer > > (cfg);
-			}
-		} else {
-			if (partitionprobe == "yes") {
-				joiner = new ProbeIsPart< BuildIsNotPart< StorePointer > > (cfg);
-			} else {
-				joiner = new ProbeIsNotPart< BuildIsNotPart< StorePointer > > (cfg);
-			}
-		}
+		joiner = createStore< StorePointerSpec, StorePointer >(cfg, false);
 	}
 	//} else {
 	//	throw UnknownAlgorithmException();
@@ -15,157 +15,623 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <fstream>
-using std::ifstream;
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "bzlib.h"
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "loader.h"
 #include "parser.h"
+#include "exceptions.h"
 
 Loader::Loader(const char separator)
-	: sep(separator) 
+	: sep(separator), outputs(0), fd(-1), filesize(0), filedata(0)
 {
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&cond, NULL);
+}
+
+Loader::~Loader()
+{
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+struct LoaderArg {
+	Loader* loader;
+	int threadid;
+};
+
+static void* loadworker(void* arg)
+{
+	LoaderArg* a = reinterpret_cast<LoaderArg*>(arg);
+	a->loader->work(a->threadid);
+	return NULL;
 }
 
 /**
- * Loads \a filename, parses it and outputs it at the WriteTable \a output.
- * Automatically checks if input is a BZ2 file and uncompresses on the fly,
- * using libbz2.
+ * Loads \a filename, parses it and appends every line as a tuple to one of
+ * the WriteTables in \a outputs. The format is told by the first bytes of
+ * the file. Lines without fields are skipped.
+ *
+ * Threads pick work in this order: a block of decompressed text from the
+ * queue, a chunk of an uncompressed file, a range of a compressed file. A
+ * thread decompressing a range queues its blocks for the others, or parses
+ * them itself if the queue is full. Parts of lines that span two ranges
+ * are put together and parsed once all threads are done.
  */
-void Loader::load(const string& filename, WriteTable& output)
+void Loader::load(const string& filename, vector<WriteTable*>& outputs)
 {
-	const char* parseresult[MAX_COL];
-	int parseresultcount;
+	this->outputs = &outputs;
+	const int nthreads = outputs.size();
+
+	fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw FileNotFoundException();
+	struct stat st;
+	fstat(fd, &st);
+	filesize = st.st_size;
+
+	format = detectFormat();
+#ifndef USE_ZLIB
+	if (format == FMT_GZIP) {
+		close(fd);
+		throw NotYetImplemented();
+	}
+#endif
+#ifndef USE_ZSTD
+	if (format == FMT_ZSTD) {
+		close(fd);
+		throw NotYetImplemented();
+	}
+#endif
+	nextchunk = 0;
+	totalchunks = 0;
+	nextrange = 0;
+	producers = 0;
+	maxqueue = 2 * nthreads;
+	failed = false;
+	ranges.clear();
+
+	if (format == FMT_TEXT) {
+		totalchunks = (filesize + CHUNKSIZE - 1) / CHUNKSIZE;
+	} else {
+		filedata = reinterpret_cast<const char*>(
+				mmap(NULL, filesize, PROT_READ, MAP_PRIVATE, fd, 0));
+		if (filedata == MAP_FAILED)
+			throw FileNotFoundException();
+		splitRanges();
+	}
 
-	Parser parser(sep);
+	pthread_t* threads = new pthread_t[nthreads];
+	LoaderArg* args = new LoaderArg[nthreads];
+	for (int i=0; i<nthreads; ++i) {
+		args[i].loader = this;
+		args[i].threadid = i;
+	}
+	for (int i=1; i<nthreads; ++i)
+		pthread_create(&threads[i], NULL, loadworker, &args[i]);
+	work(0);
+	for (int i=1; i<nthreads; ++i)
+		pthread_join(threads[i], NULL);
+	delete[] threads;
+	delete[] args;
+
+	// Put together the lines that span ranges, in the order of the file.
+	//
+	if (!ranges.empty() && !failed) {
+		string line = ranges[0].tail;
+		for (unsigned int i=1; i<ranges.size(); ++i) {
+			line += ranges[i].head;
+			if (ranges[i].headdone) {
+				parseBlock(&line[0], line.size(), 0);
+				line = ranges[i].tail;
+			}
+		}
+		parseBlock(&line[0], line.size(), 0);
+	}
 
-	if (!isBz2(filename))
-	{
-		char linebuf[MAX_LINE];
-		ifstream f(filename.c_str(), ifstream::in);
+	if (filedata)
+		munmap(const_cast<char*>(filedata), filesize);
+	filedata = 0;
+	close(fd);
+	fd = -1;
 
-		if (!f)
-			throw FileNotFoundException();
+	if (failed) {
+		switch (format) {
+			case FMT_BZ2:
+				throw LoadBZ2Exception();
+			case FMT_GZIP:
+				throw LoadGzipException();
+			case FMT_ZSTD:
+				throw LoadZstdException();
+			default:
+				throw FileNotFoundException();
+		}
+	}
+}
 
-		f.getline(linebuf, MAX_LINE);
-		while(f) {
-			parseresultcount = parser.parseLine(linebuf, parseresult);
-			output.append(parseresult, parseresultcount);
-			f.getline(linebuf, MAX_LINE);
+void Loader::work(int threadid)
+{
+	pthread_mutex_lock(&mutex);
+	while (true) {
+		if (!queue.empty()) {
+			TextBlock b = queue.front();
+			queue.pop_front();
+			pthread_mutex_unlock(&mutex);
+			parseBlock(b.data, b.len, threadid);
+			delete[] b.mem;
+			pthread_mutex_lock(&mutex);
+		} else if (nextchunk < totalchunks) {
+			unsigned long chunk = nextchunk++;
+			pthread_mutex_unlock(&mutex);
+			loadChunk(chunk, threadid);
+			pthread_mutex_lock(&mutex);
+		} else if (nextrange < ranges.size()) {
+			Range& r = ranges[nextrange++];
+			++producers;
+			pthread_mutex_unlock(&mutex);
+			decompress(r, threadid);
+			pthread_mutex_lock(&mutex);
+			--producers;
+			pthread_cond_broadcast(&cond);
+		} else if (producers == 0) {
+			break;
+		} else {
+			pthread_cond_wait(&cond, &mutex);
 		}
-		f.close();
-	} 
-	else 
-	{
-		FILE*   f;
-		BZFILE* b;
-		int     bzerror;
-		int     nBuf;
-		int     nWritten;
-
-		int 	unused = 0;
-
-		char* 	decbuf;
-		const int decbufsize = 1024*1024;
-		decbuf = new char[decbufsize];
-
-		f = fopen (filename.c_str(), "rb");
-		if (!f) {
-			throw LoadBZ2Exception();
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Parses the lines of \a data, the last of which may lack its newline. 
+ * \a data is overwritten.
+ */
+void Loader::parseBlock(char* data, unsigned long len, int threadid)
+{
+	const char* parseresult[MAX_COL];
+	int parseresultcount;
+	Parser parser(sep);
+	WriteTable* output = (*outputs)[threadid];
+	char* end = data + len;
+
+	while (data < end) {
+		char* nl = reinterpret_cast<char*>(memchr(data, '\n', end - data));
+		if (nl == NULL) {
+			// Last line without newline; parseLine() needs a \0.
+			string last(data, end - data);
+			parseresultcount = parser.parseLine(&last[0], parseresult);
+			if (parseresultcount > 0)
+				output->append(parseresult, parseresultcount);
+			break;
+		}
+		*nl = 0;
+		parseresultcount = parser.parseLine(data, parseresult);
+		if (parseresultcount > 0)
+			output->append(parseresult, parseresultcount);
+		data = nl + 1;
+	}
+}
+
+/**
+ * Parses the lines that start in bytes [chunk * CHUNKSIZE, 
+ * (chunk+1) * CHUNKSIZE) of an uncompressed file. The byte before the chunk
+ * tells if a line starts at its first byte; the line that crosses its end 
+ * is read to its newline.
+ */
+void Loader::loadChunk(unsigned long chunk, int threadid)
+{
+	unsigned long begin = chunk * CHUNKSIZE;
+	unsigned long end = std::min(begin + CHUNKSIZE, filesize);
+	unsigned long from = (begin == 0) ? 0 : begin - 1;
+	unsigned long capacity = end - from + 64*1024;
+	unsigned long len = 0;
+	char* buf = new char[capacity + 1];
+
+	// Read the chunk, then more until a newline at or after its last byte.
+	//
+	unsigned long last = end - from - 1;
+	while (true) {
+		unsigned long want = std::min(capacity, filesize - from) - len;
+		ssize_t got = pread(fd, buf + len, want, from + len);
+		if (got < 0) {
+			delete[] buf;
+			fail();
+			return;
 		}
-		b = BZ2_bzReadOpen (&bzerror, f, 0, 0, NULL, 0);
-		if (bzerror != BZ_OK) {
-			BZ2_bzReadClose (&bzerror, b);
-			throw LoadBZ2Exception();
+		len += got;
+		if (from + len == filesize || (len > last
+				&& memchr(buf + last, '\n', len - last) != NULL))
+			break;
+		if (len == capacity) {
+			char* tmp = new char[2 * capacity + 1];
+			memcpy(tmp, buf, len);
+			delete[] buf;
+			buf = tmp;
+			capacity *= 2;
 		}
+	}
 
-		bzerror = BZ_OK;
+	char* start = buf;
+	if (begin != 0) {
+		// Skip the end of the line that started in the previous chunk.
+		char* nl = reinterpret_cast<char*>(memchr(buf, '\n', last + 1));
+		if (nl == NULL) {
+			delete[] buf;
+			return;
+		}
+		start = nl + 1;
+	}
 
-		while (bzerror == BZ_OK) {
-			nBuf = BZ2_bzRead ( &bzerror, b, decbuf+unused, decbufsize-unused);
+	// Parse up to the newline ending the last line of the chunk.
+	char* stop = reinterpret_cast<char*>(memchr(buf + last, '\n', len - last));
+	stop = (stop == NULL) ? buf + len : stop + 1;
+	if (start < stop)
+		parseBlock(start, stop - start, threadid);
 
-			// Check for error during decompression.
-			//
-			if (bzerror != BZ_OK && bzerror != BZ_STREAM_END) {
-				BZ2_bzReadClose ( &bzerror, b );
-				throw LoadBZ2Exception();
-			}
+	delete[] buf;
+}
 
-			// No error; parse decompressed buffer.
-			//
-			char* p = decbuf;
-			char* usablep = decbuf;
-			assert(nBuf + unused <= decbufsize);
-			while (p < decbuf + nBuf + unused) {
-				p = readFullLine(usablep, decbuf, nBuf + unused);
-
-				// Check if buffer didn't have a full line. If yes, break.
-				//
-				if (usablep == p) {
-					break;
-				}
-
-				// We have a full line at usablep. Parse it.
-				//
-				parseresultcount = parser.parseLine(usablep, parseresult);
-				output.append(parseresult, parseresultcount);
-
-				usablep = p;
-			}
+/**
+ * Queues \a b for any thread to parse. If the queue is full, parses it
+ * right away, which keeps decompression from running too far ahead.
+ */
+void Loader::emitBlock(TextBlock& b, int threadid)
+{
+	pthread_mutex_lock(&mutex);
+	if (queue.size() < maxqueue) {
+		queue.push_back(b);
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+	pthread_mutex_unlock(&mutex);
 
-			// Copy leftovers to start of buffer and call bzRead so
-			// that it writes output immediately after existing data. 
-			unused = decbuf + nBuf + unused - p;
-			assert(unused < p - decbuf);  // no overlapped memcpy
-			memcpy(decbuf, p, unused);
-		}
+	parseBlock(b.data, b.len, threadid);
+	delete[] b.mem;
+}
 
-		assert (bzerror == BZ_STREAM_END);
-		BZ2_bzReadClose ( &bzerror, b );
+/**
+ * Hands over the whole lines in the \a used bytes of \a buf and moves the
+ * last partial line to the start of a \a buf. If \a done, the range has
+ * ended and the partial line is stored as its tail. The text up to the first
+ * newline of a range other than the first is stored as its head.
+ */
+void Loader::emitText(Range& r, char*& buf, unsigned long& used, 
+		unsigned long& capacity, bool done, int threadid)
+{
+	char* start = buf;
+	char* end = buf + used;
+
+	if (!r.headdone) {
+		char* nl = reinterpret_cast<char*>(memchr(start, '\n', end - start));
+		if (nl == NULL) {
+			r.head.append(start, end - start);
+			used = 0;
+			return;
+		}
+		r.head.append(start, nl - start);
+		r.headdone = true;
+		start = nl + 1;
+	}
 
-		delete[] decbuf;
+	char* nl = reinterpret_cast<char*>(memrchr(start, '\n', end - start));
+	char* rest = (nl == NULL) ? start : nl + 1;
+	unsigned long restlen = end - rest;
+
+	if (nl != NULL) {
+		// Hand over the buffer itself, the partial line goes to a new one.
+		TextBlock b;
+		b.mem = buf;
+		b.data = start;
+		b.len = rest - start;
+		buf = new char[capacity];
+		memcpy(buf, rest, restlen);
+		emitBlock(b, threadid);
+	} else if (start != buf) {
+		memmove(buf, start, restlen);
+	}
+	used = restlen;
+
+	if (done) {
+		r.tail.assign(buf, used);
+		used = 0;
+	} else if (used == capacity) {
+		// A line longer than the buffer, make room for more.
+		char* tmp = new char[2 * capacity];
+		memcpy(tmp, buf, used);
+		delete[] buf;
+		buf = tmp;
+		capacity *= 2;
 	}
 }
 
-/** 
- * Reads one full line from buffer. 
- *
- * If buffer has at least one line, returns the start of the next line and 
- * \a cur points to a null-terminated string.
- *
- * Otherwise, returns \a cur.
+Loader::Format Loader::detectFormat()
+{
+	unsigned char magic[4] = {0, 0, 0, 0};
+	if (pread(fd, magic, 4, 0) < 0)
+		throw FileNotFoundException();
+
+	if (magic[0] == 'B' && magic[1] == 'Z' && magic[2] == 'h')
+		return FMT_BZ2;
+	if (magic[0] == 0x1f && magic[1] == 0x8b)
+		return FMT_GZIP;
+	if (magic[0] == 0x28 && magic[1] == 0xb5 
+			&& magic[2] == 0x2f && magic[3] == 0xfd)
+		return FMT_ZSTD;
+	return FMT_TEXT;
+}
+
+/**
+ * Cuts a compressed file into ranges for the threads to decompress. Files
+ * written by pbzip2, or concatenated from chunks compressed separately,
+ * consist of many bzip2 streams or zstd frames, each of which decompresses
+ * on its own; lbzip2 and zstd -T write a single stream or frame. Neighbouring streams are grouped so that there
+ * are about four ranges per thread. Gzip members cannot be told apart
+ * without inflating, so a gzip file is one range.
  */
-char* Loader::readFullLine(char* cur, const char* bufstart, const int buflen)
+void Loader::splitRanges()
 {
-	char* oldcur = cur;
+	vector<unsigned long> starts;
+	starts.push_back(0);
+
+	if (format == FMT_BZ2) {
+		// A stream starts with "BZh", the block size and the magic of its
+		// first block, 0x314159265359.
+		static const char blockmagic[] = "\x31\x41\x59\x26\x53\x59";
+		unsigned long pos = 4;
+		while (pos + 6 <= filesize) {
+			const char* p = reinterpret_cast<const char*>(
+					memmem(filedata + pos, filesize - pos, blockmagic, 6));
+			if (p == NULL)
+				break;
+			pos = p - filedata;
+			if (pos >= 4 + 4 && memcmp(p - 4, "BZh", 3) == 0 
+					&& p[-1] >= '1' && p[-1] <= '9')
+				starts.push_back(pos - 4);
+			pos += 6;
+		}
+	}
+#ifdef USE_ZSTD
+	if (format == FMT_ZSTD) {
+		unsigned long pos = 0;
+		while (pos < filesize) {
+			size_t len = ZSTD_findFrameCompressedSize(filedata + pos, 
+					filesize - pos);
+			if (ZSTD_isError(len))
+				break;	// reported when decompressing
+			pos += len;
+			if (pos < filesize)
+				starts.push_back(pos);
+		}
+	}
+#endif
+
+	const unsigned long target = 
+		filesize / (4 * outputs->size()) + 1;
+	for (unsigned int i=0; i<starts.size(); ) {
+		Range r;
+		r.begin = starts[i];
+		r.headdone = ranges.empty();
+		do {
+			++i;
+		} while (i < starts.size() && starts[i] - r.begin < target);
+		r.end = (i < starts.size()) ? starts[i] : filesize;
+		ranges.push_back(r);
+	}
+}
 
-	while(cur >= bufstart && cur < (bufstart + buflen))
-	{
-		if ((*cur) == '\n')
-		{
-			*cur = 0;
-			return ++cur;
+void Loader::decompress(Range& r, int threadid)
+{
+	switch (format) {
+		case FMT_BZ2:
+			decompressBz2(r, threadid);
+			break;
+		case FMT_GZIP:
+			decompressGzip(r, threadid);
+			break;
+		case FMT_ZSTD:
+			decompressZstd(r, threadid);
+			break;
+		default:
+			fail();
+	}
+}
+
+void Loader::decompressBz2(Range& r, int threadid)
+{
+	unsigned long capacity = BLOCKSIZE;
+	unsigned long used = 0;
+	char* buf = new char[capacity];
+
+	// avail_in is an unsigned int, feed larger ranges in pieces.
+	const unsigned long maxin = 1ul << 30;
+	unsigned long pos = r.begin;
+
+	bz_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) {
+		delete[] buf;
+		fail();
+		return;
+	}
+
+	bool ok = true;
+	while (true) {
+		if (strm.avail_in == 0 && pos < r.end) {
+			strm.next_in = const_cast<char*>(filedata + pos);
+			strm.avail_in = std::min(r.end - pos, maxin);
+			pos += strm.avail_in;
 		}
 
-		cur++;
+		strm.next_out = buf + used;
+		strm.avail_out = capacity - used;
+		int ret = BZ2_bzDecompress(&strm);
+		used = capacity - strm.avail_out;
+
+		if (ret == BZ_STREAM_END) {
+			if (strm.avail_in == 0 && pos == r.end)
+				break;
+
+			// Another stream follows, start over.
+			char* next_in = strm.next_in;
+			unsigned int avail_in = strm.avail_in;
+			BZ2_bzDecompressEnd(&strm);
+			memset(&strm, 0, sizeof(strm));
+			if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) {
+				ok = false;
+				break;
+			}
+			strm.next_in = next_in;
+			strm.avail_in = avail_in;
+		} else if (ret != BZ_OK 
+				|| (strm.avail_in == 0 && pos == r.end && strm.avail_out != 0)) {
+			// Error, or input ran out in the middle of a stream.
+			ok = false;
+			break;
+		}
+
+		if (used == capacity)
+			emitText(r, buf, used, capacity, false, threadid);
 	}
+	BZ2_bzDecompressEnd(&strm);
 
-	return oldcur;
+	if (ok)
+		emitText(r, buf, used, capacity, true, threadid);
+	else
+		fail();
+	delete[] buf;
 }
 
+#ifdef USE_ZLIB
 /**
- * Returns true if input file is BZ2-compressed. 
- * Check is done by looking at the three first bytes of the file: if "BZh",
- * then it is assumed to be a valid file to be parsed by libbz2.
+ * Inflates \a r, a gzip file of one or more members. The deflate stream
+ * cannot be split, so this is serial; parsing still runs in parallel.
  */
-bool Loader::isBz2(const string& filename)
+void Loader::decompressGzip(Range& r, int threadid)
+{
+	unsigned long capacity = BLOCKSIZE;
+	unsigned long used = 0;
+	char* buf = new char[capacity];
+
+	const unsigned long maxin = 1ul << 30;
+	unsigned long pos = r.begin;
+
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	// Window of 32K, gzip header.
+	if (inflateInit2(&strm, 15 + 16) != Z_OK) {
+		delete[] buf;
+		fail();
+		return;
+	}
+
+	bool ok = true;
+	while (true) {
+		if (strm.avail_in == 0 && pos < r.end) {
+			strm.next_in = reinterpret_cast<Bytef*>(
+					const_cast<char*>(filedata + pos));
+			strm.avail_in = std::min(r.end - pos, maxin);
+			pos += strm.avail_in;
+		}
+
+		strm.next_out = reinterpret_cast<Bytef*>(buf + used);
+		strm.avail_out = capacity - used;
+		int ret = inflate(&strm, Z_NO_FLUSH);
+		used = capacity - strm.avail_out;
+
+		if (ret == Z_STREAM_END) {
+			if (strm.avail_in == 0 && pos == r.end)
+				break;
+			// Another member follows.
+			inflateReset(&strm);
+		} else if ((ret != Z_OK && ret != Z_BUF_ERROR)
+				|| (strm.avail_in == 0 && pos == r.end && strm.avail_out != 0)) {
+			ok = false;
+			break;
+		}
+
+		if (used == capacity)
+			emitText(r, buf, used, capacity, false, threadid);
+	}
+	inflateEnd(&strm);
+
+	if (ok)
+		emitText(r, buf, used, capacity, true, threadid);
+	else
+		fail();
+	delete[] buf;
+}
+#else
+void Loader::decompressGzip(Range& r, int threadid)
+{
+	fail();
+}
+#endif
+
+#ifdef USE_ZSTD
+void Loader::decompressZstd(Range& r, int threadid)
 {
-	char header[4];
+	unsigned long capacity = BLOCKSIZE;
+	unsigned long used = 0;
+	char* buf = new char[capacity];
+
+	ZSTD_DStream* strm = ZSTD_createDStream();
+	ZSTD_inBuffer in = { filedata + r.begin, r.end - r.begin, 0 };
+	size_t ret = 0;
+	bool ok = true;
+
+	while (true) {
+		ZSTD_outBuffer out = { buf + used, capacity - used, 0 };
+		ret = ZSTD_decompressStream(strm, &out, &in);
+		if (ZSTD_isError(ret)) {
+			ok = false;
+			break;
+		}
+		used += out.pos;
 
-	ifstream f(filename.c_str(), ifstream::in);
-	f.get(header, 4);
-	f.close();
+		// All input is in and what is decompressed has been flushed.
+		if (in.pos == in.size && out.pos < out.size)
+			break;
 
-	return string(header) == "BZh";
+		if (used == capacity)
+			emitText(r, buf, used, capacity, false, threadid);
+	}
+	ZSTD_freeDStream(strm);
+
+	// Input ran out in the middle of a frame.
+	if (ret != 0)
+		ok = false;
+
+	if (ok)
+		emitText(r, buf, used, capacity, true, threadid);
+	else
+		fail();
+	delete[] buf;
+}
+#else
+void Loader::decompressZstd(Range& r, int threadid)
+{
+	fail();
+}
+#endif
+
+/**
+ * Records that loading has failed, load() throws after all threads are done.
+ */
+void Loader::fail()
+{
+	pthread_mutex_lock(&mutex);
+	failed = true;
+	pthread_mutex_unlock(&mutex);
 }
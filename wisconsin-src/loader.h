@@ -19,30 +19,101 @@
 #define __LOADER__
 
 #include <string>
+#include <vector>
+#include <deque>
 using std::string;
+using std::vector;
+using std::deque;
 
+#include <pthread.h>
 #include "table.h"
 
+/**
+ * Loads text files, compressed with bzip2, gzip or zstd or not compressed at
+ * all, with one thread per output table. Uncompressed files are parsed in
+ * chunks of CHUNKSIZE bytes. Compressed files are cut into ranges that can
+ * be decompressed independently (bzip2 streams, zstd frames); each range
+ * is decompressed by one thread into blocks of whole lines, which are parsed
+ * by whichever thread is free. See loader.cpp.
+ */
 class Loader {
 	public:
 		Loader(const char separator);
+		~Loader();
 
-		void load(const string& filename, WriteTable& output);
+		/**
+		 * Loads \a filename, thread i appending to \a outputs[i]. The calling
+		 * thread is thread 0.
+		 */
+		void load(const string& filename, vector<WriteTable*>& outputs);
+
+		/** Thread body of load(), not to be called directly. */
+		void work(int threadid);
 
 	private:
-		bool isBz2(const string& filename);
+		enum Format { FMT_TEXT, FMT_BZ2, FMT_GZIP, FMT_ZSTD };
+
+		/** Decompressed lines, \a data is within \a mem. */
+		struct TextBlock {
+			char* mem;
+			char* data;
+			unsigned long len;
+		};
+
+		/** 
+		 * Compressed bytes [\a begin, \a end) that decompress on their own,
+		 * and their partial lines at either end. 
+		 */
+		struct Range {
+			unsigned long begin;
+			unsigned long end;
+			string head;	///< text before the first newline, unless range 0
+			string tail;	///< text after the last newline
+			bool headdone;	///< a newline has been seen
+		};
 
-		char* readFullLine(char* cur, const char* bufstart, const int buflen);
+		Format detectFormat();
+		void splitRanges();
+
+		void loadChunk(unsigned long chunk, int threadid);
+		void decompress(Range& r, int threadid);
+		void decompressBz2(Range& r, int threadid);
+		void decompressGzip(Range& r, int threadid);
+		void decompressZstd(Range& r, int threadid);
+		void emitText(Range& r, char*& buf, unsigned long& used, 
+				unsigned long& capacity, bool done, int threadid);
+		void emitBlock(TextBlock& b, int threadid);
+		void parseBlock(char* data, unsigned long len, int threadid);
+		void fail();
 
 		/** Column separating character. */
 		const char sep;
 
-		/** Maximum characters in line. */
-		static const unsigned int MAX_LINE = 1024;
+		/** Uncompressed files are parsed in chunks of this many bytes. */
+		static const unsigned long CHUNKSIZE = 8*1024*1024;
+
+		/** Decompressed text is handed over in blocks of this many bytes. */
+		static const unsigned long BLOCKSIZE = 4*1024*1024;
 
 		/** Maximum columns in line. */
 		static const unsigned int MAX_COL = 64;
 
+		vector<WriteTable*>* outputs;
+		Format format;
+		int fd;
+		unsigned long filesize;
+		const char* filedata;	///< compressed files are mapped here
+
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;	///< signals new blocks and finished ranges
+		unsigned long nextchunk;
+		unsigned long totalchunks;
+		unsigned int nextrange;
+		vector<Range> ranges;
+		int producers;			///< threads decompressing a range
+		deque<TextBlock> queue;
+		unsigned int maxqueue;
+		bool failed;
 };
 
 #endif
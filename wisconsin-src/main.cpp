@@ -75,6 +75,20 @@ vector<unsigned int> createIntVector(const Setting& line) {
 	return ret;
 }
 
+/**
+ * Returns \a jattr if the table of \a node has "layout: pax", that is, keeps
+ * its join keys in a key minipage of every page, or -1 for rows only.
+ */
+int paxKeyColumn(const Setting& node, int jattr) {
+	string layout = "row";
+	node.lookupValue("layout", layout);
+	if (layout == "pax")
+		return jattr;
+	if (layout != "row")
+		throw IllegalSchemaDeclarationException();
+	return -1;
+}
+
 inline void initchkpt(void) {
 	startTimer(&timer);
 	startTimer(&timer2);	
@@ -208,21 +222,21 @@ int main(int argc, char** argv) {
 		bucksize = cfg.lookup("bucksize");
 
 		sin = Schema::create(cfg.lookup("build.schema"));
+		joinattr1 = cfg.lookup("build.jattr");
+		joinattr1--;
 		WriteTable wr1;
-		wr1.init(&sin, bucksize);
+		wr1.init(&sin, bucksize, paxKeyColumn(cfg.lookup("build"), joinattr1));
 		tin = &wr1;
 		infilename = (const char*) cfg.lookup("build.file");
-		joinattr1 = cfg.lookup("build.jattr");
-		joinattr1--;
 		select1 = createIntVector(cfg.lookup("build.select"));
 
 		sout = Schema::create(cfg.lookup("probe.schema"));
+		joinattr2 = cfg.lookup("probe.jattr");
+		joinattr2--;
 		WriteTable wr2;
-		wr2.init(&sout, bucksize);
+		wr2.init(&sout, bucksize, paxKeyColumn(cfg.lookup("probe"), joinattr2));
 		tout = &wr2;
 		outfilename = (const char*) cfg.lookup("probe.file");
-		joinattr2 = cfg.lookup("probe.jattr");
-		joinattr2--;
 		select2 = createIntVector(cfg.lookup("probe.select"));
 
 		outputfile = (const char*) cfg.lookup("output");
@@ -273,7 +287,7 @@ int main(int argc, char** argv) {
             //the old method: loads from file.
             // load files in memory
             cout << "Loading data in memory... " << flush;
-            wr1.load(datapath+infilename, "|");
+            wr1.load(datapath+infilename, "|", nothreads);
         }
 		cout << "ok" << endl;
         
@@ -289,7 +303,7 @@ int main(int argc, char** argv) {
             //the old method: loads from file.
             // load files in memory
             cout << "Loading data in memory... " << flush;
-            wr2.load(datapath+outfilename, "|");
+            wr2.load(datapath+outfilename, "|", nothreads);
         }
         cout << "ok" << endl;
 
@@ -325,33 +339,37 @@ int main(int argc, char** argv) {
 		delete barrier;
 		delete[] threadpool;
 
+		cout << "ok" << endl;
+
+		// the result sink reports here
 		joiner->destroy();
 		delete joiner;
 
-		cout << "ok" << endl;
-
 		/* joinresult of type vector<PageCursor*> has the generated output */
-		// output for validation
+		// output for validation, unless the sink has written it already
 #ifdef DEBUG
-		cout << "Outputting code for validation... " << flush;
-		ofstream foutput((datapath+outputfile).c_str());
-		for (vector<PageCursor*>::iterator i1=joinresult.begin(); 
-				i1!=joinresult.end(); ++i1) {
-			Page* b;
-			if (!*i1)
-				continue;
-			void* tuple;
-			while (b = (*i1)->readNext()) {
-				int i = 0;
-				while(tuple = b->getTupleOffset(i++)) {
-					foutput << (*i1)->schema()->prettyprint(tuple, '|') << '\n';
+		string sinkname = "table";
+		cfg.getRoot()["algorithm"].lookupValue("sink", sinkname);
+		if (sinkname != "file") {
+			cout << "Outputting code for validation... " << flush;
+			ofstream foutput((datapath+outputfile).c_str());
+			for (vector<PageCursor*>::iterator i1=joinresult.begin(); 
+					i1!=joinresult.end(); ++i1) {
+				Page* b;
+				if (!*i1)
+					continue;
+				void* tuple;
+				while (b = (*i1)->readNext()) {
+					int i = 0;
+					while(tuple = b->getTupleOffset(i++)) {
+						foutput << (*i1)->schema()->prettyprint(tuple, '|') << '\n';
+					}
 				}
 			}
+			foutput << flush;
+			foutput.close();
+			cout << "ok" << endl;
 		}
-		foutput << flush;
-		foutput.close();
-		cout << "ok" << endl;
-		
 #endif
 
 		// be nice, free some mem
@@ -361,6 +379,8 @@ int main(int argc, char** argv) {
 		partitioner2->destroy();
 		for (vector<PageCursor*>::iterator i1=joinresult.begin(); 
 				i1!=joinresult.end(); ++i1) {
+			if (!*i1)
+				continue;
 			(*i1)->close();
 			delete *i1;
 		}
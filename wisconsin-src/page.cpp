@@ -54,15 +54,35 @@ Buffer::~Buffer()
 }
 
 TupleBuffer::TupleBuffer(unsigned long size, unsigned int tuplesize)
-	: Buffer(size), tuplesize(tuplesize)
+	: Buffer(size), tuplesize(tuplesize), keys(0), keyoffset(0)
 { 
 	// Sanity check: Fail if page doesn't fit even a single tuple.
 	//
 	dbgassert(size >= tuplesize);
 }
 
+/** Start of the key minipage in a PAX block, a cache line after the tuples. */
+static inline unsigned long keyMinipageOffset(unsigned long size)
+{
+	return (size + 63) & ~63UL;
+}
+
+TupleBuffer::TupleBuffer(unsigned long size, unsigned int tuplesize, 
+		unsigned int keyoffset)
+	: Buffer(keyMinipageOffset(size) + (size/tuplesize) * sizeof(long long)),
+	tuplesize(tuplesize), keyoffset(keyoffset)
+{ 
+	dbgassert(size >= tuplesize);
+	dbgassert(keyoffset < tuplesize);
+
+	// Tuples may only use the first size bytes.
+	keys = reinterpret_cast<long long*>(
+			reinterpret_cast<char*>(data) + keyMinipageOffset(size));
+	maxsize = size;
+}
+
 TupleBuffer::TupleBuffer(void* data, unsigned int size, void* free, unsigned int tuplesize)
-	: Buffer(data, size, free), tuplesize(tuplesize)
+	: Buffer(data, size, free), tuplesize(tuplesize), keys(0), keyoffset(0)
 { 
 	// Sanity check: Fail if page doesn't fit even a single tuple.
 	//
@@ -128,6 +128,19 @@ class TupleBuffer : public Buffer
 		 * \param tuplesize Size of tuples in bytes.
 		 */
 		TupleBuffer(unsigned long size, unsigned int tuplesize);
+
+		/**
+		 * Creates a PAX buffer: \a size bytes of tuples as above, followed
+		 * in the same block by a key minipage that holds the join key of
+		 * every tuple contiguously. The key of a tuple is the 8 bytes at
+		 * \a keyoffset, read as Schema::asLong() does, and is stored there
+		 * by storeKey().
+		 * \param size Bytes for tuples, the key minipage comes on top.
+		 * \param tuplesize Size of tuples in bytes.
+		 * \param keyoffset Offset of the join key in a tuple.
+		 */
+		TupleBuffer(unsigned long size, unsigned int tuplesize, 
+				unsigned int keyoffset);
 		~TupleBuffer() { }
 
 		/**
@@ -170,6 +183,29 @@ class TupleBuffer : public Buffer
 		 */
 		inline void* atomicAllocateTuple();
 
+		/**
+		 * Returns true if this is a PAX buffer with a key minipage.
+		 */
+		inline bool hasKeys() { return keys != 0; }
+
+		/**
+		 * Returns the key minipage, where the key of the \a pos -th tuple
+		 * is at position \a pos, or NULL if this buffer has none.
+		 */
+		inline const long long* getKeys() { return keys; }
+
+		/**
+		 * Returns the offset in a tuple of the keys in the key minipage.
+		 */
+		inline unsigned int getKeyOffset() { return keyoffset; }
+
+		/**
+		 * Copies the key of tuple \a tup, which has been allocated from this
+		 * buffer and written, to the key minipage. Does nothing if there is
+		 * no key minipage.
+		 */
+		inline void storeKey(const void* tup);
+
 		class Iterator {
 			friend class TupleBuffer;
 
@@ -215,6 +251,9 @@ class TupleBuffer : public Buffer
 	protected:
 		unsigned int tuplesize;
 
+		/** Key minipage, NULL for a buffer of rows only. */
+		long long* keys;
+		unsigned int keyoffset;
 };
 
 
@@ -239,6 +278,13 @@ class LinkedTupleBuffer : public TupleBuffer {
 		LinkedTupleBuffer(unsigned int size, unsigned int tuplesize) 
 			: TupleBuffer(size, tuplesize), next(0) { }
 
+		/**
+		 * Creates a PAX bucket, see TupleBuffer.
+		 */
+		LinkedTupleBuffer(unsigned int size, unsigned int tuplesize, 
+				unsigned int keyoffset) 
+			: TupleBuffer(size, tuplesize, keyoffset), next(0) { }
+
 		/** 
 		 * Returns a pointer to next bucket.
 		 * @return Next bucket, or NULL if it doesn't exist.
@@ -283,11 +329,18 @@ class FakePage : public Page {
 			free = 0;	// NULL
 		}
 
-		void place(unsigned int size, unsigned int tuplesz, void* existingdata) 
+		/**
+		 * Places the page on \a existingdata, whose keys are at 
+		 * \a existingkeys if not NULL.
+		 */
+		void place(unsigned int size, unsigned int tuplesz, void* existingdata,
+				long long* existingkeys = 0, unsigned int keyoff = 0) 
 		{
 			maxsize = size;
 			tuplesize = tuplesz;
 			data = existingdata;
+			keys = existingkeys;
+			keyoffset = keyoff;
 			// invalidate free pointer, making page "full".
 			free = reinterpret_cast<char*>(data) + maxsize;
 		}
@@ -18,6 +18,47 @@
 #include "parser.h"
 using namespace std;
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+/**
+ * Same as the scalar version below, but finds separators and the final \0
+ * 16 bytes at a time. Loads are aligned, so they never cross into a page
+ * past the end of \a line, and the bytes before \a line are masked out.
+ */
+int Parser::parseLine(char* line, const char** result) {
+	const __m128i sep = _mm_set1_epi8(_sep);
+	const __m128i zero = _mm_setzero_si128();
+	char* s=line; /**< Points to beginning of token. */
+	char* blk = reinterpret_cast<char*>(
+			reinterpret_cast<unsigned long>(line) & ~15UL);
+	int ret = 0;
+
+	__m128i v = _mm_load_si128(reinterpret_cast<__m128i*>(blk));
+	unsigned int mask = _mm_movemask_epi8(
+			_mm_or_si128(_mm_cmpeq_epi8(v, sep), _mm_cmpeq_epi8(v, zero)));
+	mask &= ~0U << (line - blk);
+
+	while (true) {
+		while (mask) {
+			char* p = blk + __builtin_ctz(mask); /**< Points to end of token. */
+			mask &= mask - 1;
+			if (s!=p)	// eats null fields
+				result[ret++]=s;
+			if (*p == 0)	// end of string
+				return ret;
+			(*p)=0;
+			s=p+1;
+		}
+		blk += 16;
+		v = _mm_load_si128(reinterpret_cast<__m128i*>(blk));
+		mask = _mm_movemask_epi8(
+				_mm_or_si128(_mm_cmpeq_epi8(v, sep), _mm_cmpeq_epi8(v, zero)));
+	}
+}
+
+#else
+
 int Parser::parseLine(char* line, const char** result) {
 	char* s=line; /**< Points to beginning of token. */
 	char* p=line; /**< Points to end of token. */
@@ -37,3 +78,5 @@ int Parser::parseLine(char* line, const char** result) {
 	}
 	return ret;
 }
+
+#endif
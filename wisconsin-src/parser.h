@@ -31,7 +31,8 @@ class Parser {
 		/** 
 		 * Returns the offsets of all data contained in this \a line in 
 		 * variable \a result. Will read until it encounters a \0 in \a line,
-		 * leaving code vulnerable to overflow attacks.
+		 * leaving code vulnerable to overflow attacks. With SSE2 it may also
+		 * read past the \0, up to the next 16-byte boundary.
 		 * @return The number of valid entries in \a result.
 		 */
 		int parseLine(char* line, const char** result);
@@ -18,6 +18,13 @@
 #include "partitioner.h"
 #include "table.h"
 
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifdef DEBUG
 #include <cassert>
 #include <iostream>
@@ -30,6 +37,15 @@ using std::endl;
 
 //#define DEBUGALLOC
 
+/** Tuples whose hashes RadixPartitioner computes at once. */
+#define HASHBLOCK 256
+/** Bytes of a software write-combining (SWWC) buffer, one cache line. */
+#define SWWC_SIZE 64
+/** Largest fanout whose SWWC buffers still fit in a 1MB L2. */
+#define SWWC_MAXFANOUT 16384
+/** Second-level TLB entries, unless "tlbentries" is given. */
+#define DEFAULT_TLB_ENTRIES 1536
+
 #ifdef DEBUGALLOC
 #include <cstdio>
 #include <cstdlib>
@@ -273,81 +289,307 @@ RadixPartitioner::RadixPartitioner(const libconfig::Config& cfg,
 		const libconfig::Setting& hashnode)
 	: Partitioner(cfg, node, hashnode), maxkey(0)
 {
-	string hashfnname = hashnode["fn"];
-	if (hashfnname != "modulo")
+	// The passes take consecutive bits of the hash, see generate(). This
+	// holds for "modulo" and for the mixing functions built on it.
+	if (dynamic_cast<ModuloHashFunction*>(hashfn) == NULL)
 		throw NotYetImplemented();
-	totalpasses = static_cast<short>(static_cast<int>(node["passes"]));
+
+	// Zero or missing passes are chosen in init(), once tuple size is known.
+	int passes = 0;
+	node.lookupValue("passes", passes);
+	totalpasses = static_cast<short>(passes);
+
+	tlbentries = DEFAULT_TLB_ENTRIES;
+	node.lookupValue("tlbentries", tlbentries);
+
+	string swwc = "yes";
+	node.lookupValue("swwc", swwc);
+	useswwc = (swwc == "yes");
+	// "pax" keeps the keys of the partitioned tuples in a key minipage too.
+	string layout = "row";
+	node.lookupValue("layout", layout);
+	if (layout != "row" && layout != "pax")
+		throw UnknownPartitionerException();
+	pax = (layout == "pax");
+}
+
+/** 
+ * Tuples per SWWC buffer, the largest power of two whose tuples fit in a
+ * cache line. Zero if not even two tuples fit, which makes buffering
+ * pointless.
+ */
+unsigned int swwctuples(const unsigned int tuplesize)
+{
+	unsigned int ret = 1;
+	while (ret * 2 * tuplesize <= SWWC_SIZE)
+		ret *= 2;
+	return (ret < 2 ? 0 : ret);
+}
+
+/**
+ * Number of passes for the radix bits of the hash function. A pass writes
+ * to as many output pages as it has partitions, so without SWWC its fanout
+ * is bounded by the TLB entries. With SWWC a TLB miss is paid once per
+ * flushed buffer instead of once per tuple, and the bound is the TLB entries
+ * times the tuples per buffer, as long as the buffers fit in L2.
+ */
+unsigned short RadixPartitioner::choosepasses()
+{
+	unsigned int totalbits = 0;
+	while ((1u << totalbits) < hashfn->buckets())
+		++totalbits;
+
+	unsigned int maxfanout = tlbentries;
+	unsigned int pertuple = swwctuples(schema.getTupleSize());
+	if (useswwc && pertuple != 0)
+		maxfanout = min(tlbentries * pertuple, (unsigned int) SWWC_MAXFANOUT);
+
+	unsigned int bitsperpass = 1;
+	while ((2u << bitsperpass) <= maxfanout)
+		++bitsperpass;
+
+	// Every pass needs at least one bit, see ModuloHashFunction::generate().
+	unsigned int passes = (totalbits + bitsperpass - 1) / bitsperpass;
+	return max(1u, min(passes, totalbits));
+}
+
+/**
+ * Hashes the keys of \a items consecutive tuples starting at \a src into
+ * \a out. Keys are read as Schema::asLong() does, at byte \a keyoff of each
+ * tuple. With AVX-512 eight keys are gathered and hashed at once.
+ */
+inline void hashblock(ModuloHashFunction* hashfunc, const char* src, 
+		const unsigned int tuplesize, const unsigned int keyoff, 
+		const unsigned int items, unsigned int* out)
+{
+	unsigned int i = 0;
+	src += keyoff;
+
+#ifdef __AVX512F__
+	const long long ts = tuplesize;
+	const __m512i stride = _mm512_set_epi64(7*ts, 6*ts, 5*ts, 4*ts, 
+			3*ts, 2*ts, ts, 0);
+	for (; i+8 <= items; i+=8) {
+		__m512i keys = _mm512_i64gather_epi64(stride, 
+				src + (unsigned long) i * tuplesize, 1);
+		_mm256_storeu_si256((__m256i*) (out + i), 
+				_mm512_cvtepi64_epi32(hashfunc->hash(keys)));
+	}
+#endif
+
+	for (; i<items; ++i) {
+		long long key = *(long long*) (src + (unsigned long) i * tuplesize);
+		out[i] = hashfunc->ModuloHashFunction::hash(key);
+	}
+}
+
+/**
+ * Hashes \a items keys of a key minipage, as hashblock() does for tuples.
+ * The keys are consecutive, so they are loaded rather than gathered.
+ */
+inline void hashkeys(ModuloHashFunction* hashfunc, const long long* keys, 
+		const unsigned int items, unsigned int* out)
+{
+	unsigned int i = 0;
+#ifdef __AVX512F__
+	for (; i+8 <= items; i+=8) {
+		__m512i k = _mm512_loadu_si512(keys + i);
+		_mm256_storeu_si256((__m256i*) (out + i), 
+				_mm512_cvtepi64_epi32(hashfunc->hash(k)));
+	}
+#endif
+	for (; i<items; ++i)
+		out[i] = hashfunc->ModuloHashFunction::hash(keys[i]);
+}
+
+template <unsigned int TupleSize>
+inline void copytuple(char* dst, const char* src, const unsigned int tuplesize)
+{
+	memcpy(dst, src, TupleSize ? TupleSize : tuplesize);
+}
+
+/**
+ * Writes a full SWWC buffer of \a size bytes to \a dst with non-temporal
+ * stores, so that the output does not evict the buffers from the cache.
+ * \a src is cache-line aligned. Without SSE2 this is a plain memcpy.
+ */
+inline void streamline(char* dst, const char* src, const unsigned int size)
+{
+	unsigned int i = 0;
+
+#ifdef __AVX512F__
+	if (size == SWWC_SIZE && (((unsigned long) dst) & (SWWC_SIZE-1)) == 0) {
+		_mm512_stream_si512((__m512i*) dst, _mm512_load_si512(src));
+		return;
+	}
+#endif
+#ifdef __SSE2__
+	if ((((unsigned long) dst) & 15) == 0) {
+		for (; i+16 <= size; i+=16)
+			_mm_stream_si128((__m128i*) (dst + i), 
+					_mm_load_si128((const __m128i*) (src + i)));
+	}
+#ifdef __x86_64__
+	else {
+		for (; i+8 <= size; i+=8)
+			_mm_stream_si64((long long*) (dst + i), 
+					*(const long long*) (src + i));
+	}
+#endif
+#endif
+	memcpy(dst + i, src + i, size - i);
 }
 
 /**
  * Do radix partitioning.
  * Prerequisites: 
- * 	- Schema must have been initialized.
- * 	- Class variable attribute must point to the partition attribute.
  * 	- \a dest can hold as many tuples as \a source can.
  *
- * @param source Page to read from.
- * @param offset First tuple to partition. Different per thread.
+ * Tuples are hashed HASHBLOCK at a time. If \a swwc is not NULL, they are
+ * gathered in a cache-line buffer per partition and written out with
+ * non-temporal stores when the buffer fills up. Buffers are lined up with
+ * the cache lines of \a dest when \a tuplesize allows it, the first and
+ * last line of a partition are partial and are written with regular stores.
+ *
+ * If \a srckeys is not NULL, the keys are read from there instead of the
+ * tuples and are written to \a destkeys, at the index of their tuple.
+ *
+ * @param source First tuple to read from.
  * @param items Number of tuples to partition.
- * @param dest Page to write to. (All tuples have been pre-allocated.)
  * @param hashfunc Pointer to hash function.
+ * @param keyoff Offset of the partition attribute in a tuple.
+ * @param dest Start of output. (All tuples have been pre-allocated.)
  * @param globalhist Global histogram.
  * @param iteroffset Offset if hashing to bucket 0, which can't be deduced from
  * the histogram.
- * @param localhist Local, thread-specific histogram.
+ * @param localhist Local, thread-specific histogram. Overwritten with the 
+ * next output slot of each partition.
+ * @param fanout Number of partitions.
+ * @param swwc Thread-specific SWWC buffers, SWWC_SIZE bytes per partition.
+ * @param first Thread-specific scratch space, \a fanout entries.
+ * @param srckeys Keys of the tuples at \a source, or NULL.
+ * @param destkeys Key minipage of \a dest, used if \a srckeys is not NULL.
  */
-void radixpartition(Page* source, const int offset, const int items, 
-		HashFunction* hashfunc, Schema& schema, const int attribute,
-		Page* dest,
+template <unsigned int TupleSize>
+void radixpartition(const char* source, const unsigned int items, 
+		ModuloHashFunction* hashfunc, 
+		const unsigned int tuplesize, const unsigned int keyoff,
+		char* dest,
 		const unsigned int* globalhist, const unsigned int iteroffset,
-		vector<unsigned int>& localhist)
-{
-	void* srctup;
-	unsigned int h;
-	unsigned int globaloff;
-	unsigned int localoff;
-	void* dsttup;
-
-	for (int i=0; i<items; ++i) {
-		srctup = source->getTupleOffset(offset + i);
-		h = hashfunc->hash(schema.asLong(srctup, attribute));
-		globaloff = (h != 0 ? globalhist[h-1] : iteroffset);
-		localoff = localhist[h];
-		++localhist[h];
-
-		dsttup = dest->getTupleOffset(globaloff + localoff);
-#if VERBOSE2
-		printf("Copy from %p h[0x%08x]=%d to %p\n", 
-				srctup, 
-				schema.asLong(srctup, attribute), 
-				h, 
-				dsttup);
-#endif
-#ifdef DEBUG
-		assert(dsttup);
-#endif
-		schema.copyTuple(dsttup, srctup);
+		unsigned int* localhist, const unsigned int fanout,
+		char* swwc, unsigned int* first,
+		const long long* srckeys, long long* destkeys)
+{
+	const unsigned int ts = TupleSize ? TupleSize : tuplesize;
+	unsigned int* next = localhist;
+	unsigned int h[HASHBLOCK];
+
+	for (unsigned int p=0; p<fanout; ++p)
+		next[p] += (p != 0 ? globalhist[p-1] : iteroffset);
+
+	if (swwc == NULL) {
+		for (unsigned int i=0; i<items; i+=HASHBLOCK) {
+			unsigned int n = min(items - i, (unsigned int) HASHBLOCK);
+			const char* src = source + (unsigned long) i * ts;
+			if (srckeys)
+				hashkeys(hashfunc, srckeys + i, n, h);
+			else
+				hashblock(hashfunc, src, ts, keyoff, n, h);
+			for (unsigned int j=0; j<n; ++j, src+=ts) {
+				const unsigned int idx = next[h[j]]++;
+				copytuple<TupleSize>(dest + (unsigned long) idx * ts, src, ts);
+				if (srckeys)
+					destkeys[idx] = srckeys[i+j];
+			}
+		}
+		return;
+	}
+
+	// Slot j of a buffer holds the tuples whose output index is j modulo
+	// pertuple, after shifting by skew to line them up with cache lines.
+	const unsigned int pertuple = swwctuples(ts);
+	const unsigned int mask = pertuple - 1;
+	const unsigned int misalign = ((unsigned long) dest) & (SWWC_SIZE-1);
+	const unsigned int skew = 
+		((ts & (ts-1)) == 0 && misalign % ts == 0) ? misalign / ts : 0;
+
+	for (unsigned int p=0; p<fanout; ++p)
+		first[p] = next[p];
+
+	for (unsigned int i=0; i<items; i+=HASHBLOCK) {
+		unsigned int n = min(items - i, (unsigned int) HASHBLOCK);
+		const char* src = source + (unsigned long) i * ts;
+		if (srckeys)
+			hashkeys(hashfunc, srckeys + i, n, h);
+		else
+			hashblock(hashfunc, src, ts, keyoff, n, h);
+		for (unsigned int j=0; j<n; ++j, src+=ts) {
+			const unsigned int p = h[j];
+			const unsigned int idx = next[p]++;
+			const unsigned int slot = (idx + skew) & mask;
+			char* buf = swwc + p * SWWC_SIZE;
+			copytuple<TupleSize>(buf + slot * ts, src, ts);
+			if (srckeys)
+				destkeys[idx] = srckeys[i+j];
+
+			if (slot != mask)
+				continue;
+
+			// Buffer is full, write it out.
+			const unsigned int lo = idx - mask;
+			if (idx >= first[p] + mask) {
+				streamline(dest + (unsigned long) lo * ts, buf, pertuple * ts);
+			} else {
+				unsigned int skip = first[p] - lo;
+				memcpy(dest + (unsigned long) first[p] * ts, buf + skip * ts,
+						(pertuple - skip) * ts);
+			}
+		}
+	}
+
+	// Write out what is left in the buffers.
+	for (unsigned int p=0; p<fanout; ++p) {
+		unsigned int left = min((next[p] + skew) & mask, next[p] - first[p]);
+		if (left == 0)
+			continue;
+		unsigned int lo = next[p] - left;
+		memcpy(dest + (unsigned long) lo * ts, 
+				swwc + p * SWWC_SIZE + ((lo + skew) & mask) * ts,
+				left * ts);
 	}
+
+#ifdef __SSE2__
+	// Order the non-temporal stores before the barrier that publishes them.
+	_mm_sfence();
+#endif
 }
 
 /** 
- * Fills in \a histogram. 
+ * Fills in \a histogram. Reads only \a keys, the keys of the tuples at
+ * \a source, if not NULL.
  */
-void createhistogram(Page* source, const int offset, const int items, 
-		HashFunction* hashfunc, Schema& schema, const int attribute,
-		unsigned int* histogram)
+void createhistogram(const char* source, const unsigned int items, 
+		ModuloHashFunction* hashfunc, 
+		const unsigned int tuplesize, const unsigned int keyoff,
+		unsigned int* histogram, const long long* keys)
 {
-	void* srctup;
-
-	for (int i=0; i<items; ++i) {
-		srctup = source->getTupleOffset(offset + i);
-		unsigned int h = hashfunc->hash(schema.asLong(srctup, attribute));
-		++histogram[h];
+	unsigned int h[HASHBLOCK];
+
+	for (unsigned int i=0; i<items; i+=HASHBLOCK) {
+		unsigned int n = min(items - i, (unsigned int) HASHBLOCK);
+		if (keys)
+			hashkeys(hashfunc, keys + i, n, h);
+		else
+			hashblock(hashfunc, source + (unsigned long) i * tuplesize, 
+					tuplesize, keyoff, n, h);
+		for (unsigned int j=0; j<n; ++j)
+			++histogram[h[j]];
 	}
 }
 
 /** 
- * Place \a output cursor i at location[i].
+ * Place \a output cursor i at location[i]. The cursors share the key
+ * minipage of \a page, if it has one.
  * @param threadid Unique threadid in 0, 1, ..., \a nthreads - 1.
  * @param nthreads Number of threads.
  */
@@ -355,6 +597,9 @@ void placecursors(const int threadid, const int nthreads,
 		const unsigned int tuplesize,
 		const vector<unsigned int>& location, Page* page, SplitResult results)
 {
+	long long* keys = const_cast<long long*>(page->getKeys());
+	const unsigned int keyoff = page->getKeyOffset();
+
 	unsigned int pagesize;
 	void* data;
 
@@ -383,7 +628,7 @@ void placecursors(const int threadid, const int nthreads,
 #else
 		p = (FakeTable*)((*results)[0]);
 #endif
-		p->place(pagesize, tuplesize, data);
+		p->place(pagesize, tuplesize, data, keys, keyoff);
 		++start;
 		--items;
 	}
@@ -398,7 +643,8 @@ void placecursors(const int threadid, const int nthreads,
 #else
 		p = (FakeTable*)((*results)[i]);
 #endif
-		p->place(pagesize, tuplesize, data);
+		p->place(pagesize, tuplesize, data, 
+				keys ? keys + location[i-1] : NULL, keyoff);
 	}
 }
 
@@ -449,11 +695,14 @@ vector<unsigned int>& RadixPartitioner::realsplit(int threadid)
 	
 	unsigned int histsize; 
 	unsigned int accum = 1;
+	const unsigned int tupsz = schema.getTupleSize();
+	const unsigned int keyoff = schema.getOffset(attribute);
 
 	// Loop as many times as specified.
 	for (int pass=0; pass<totalpasses; ++pass) {
 
 		histsize = vec_hf[pass]->buckets();
+		ModuloHashFunction* hf = static_cast<ModuloHashFunction*>(vec_hf[pass]);
 
 		for (int iter=0; iter < accum; ++iter) {
 			unsigned int tuplesinblock;
@@ -480,7 +729,7 @@ vector<unsigned int>& RadixPartitioner::realsplit(int threadid)
 			start += iteroffset;
 
 #ifdef DEBUG
-			assert(oldbuf->getTupleOffset(start+items-1) != NULL);
+			assert(items == 0 || oldbuf->getTupleOffset(start+items-1) != NULL);
 			if ( (threadid == nthreads-1) && (iter == accum-1) )
 				// If last thread and last iteration, make sure we read 
 				// the very last tuple in the page.
@@ -493,17 +742,21 @@ vector<unsigned int>& RadixPartitioner::realsplit(int threadid)
 #endif
 
 			unsigned int* globalhist = &offsets[pass][iter * histsize];
+			const char* source = 
+				(const char*) oldbuf->getTupleOffset(0) + (unsigned long) start * tupsz;
+			const long long* srckeys = 
+				oldbuf->hasKeys() ? oldbuf->getKeys() + start : NULL;
 
 			// 1. Scan once; create per-thread histograms.
 			//
 			if (threadid == nthreads-1) {
-				createhistogram(oldbuf, start, items, 
-						vec_hf[pass], schema, attribute, 
-						globalhist);
+				createhistogram(source, items, 
+						hf, tupsz, keyoff, 
+						globalhist, srckeys);
 			} else {
-				createhistogram(oldbuf, start, items, 
-						vec_hf[pass], schema, attribute, 
-						&histograms[threadid+1][0]);
+				createhistogram(source, items, 
+						hf, tupsz, keyoff, 
+						&histograms[threadid+1][0], srckeys);
 			}
 			barrier->Arrive();
 
@@ -528,10 +781,33 @@ vector<unsigned int>& RadixPartitioner::realsplit(int threadid)
 			// 3. Call radixpartition (scans twice) to partition.
 			// If last pass, place cursors on output.
 			//
-			radixpartition(oldbuf, start, items, 
-					vec_hf[pass], schema, attribute, 
-					newbuf,
-					globalhist, iteroffset, histograms[threadid]);
+			char* dest = (char*) newbuf->getTupleOffset(0);
+			unsigned int* localhist = &histograms[threadid][0];
+			char* swwc = swwcbuf.empty() ? NULL : swwcbuf[threadid];
+			unsigned int* first = swwcbuf.empty() ? NULL : &swwcfirst[threadid][0];
+			long long* destkeys = const_cast<long long*>(newbuf->getKeys());
+			switch (tupsz) {
+				case 8:
+					radixpartition<8>(source, items, hf, tupsz, keyoff, dest, 
+							globalhist, iteroffset, localhist, histsize, swwc, first,
+							srckeys, destkeys);
+					break;
+				case 16:
+					radixpartition<16>(source, items, hf, tupsz, keyoff, dest, 
+							globalhist, iteroffset, localhist, histsize, swwc, first,
+							srckeys, destkeys);
+					break;
+				case 32:
+					radixpartition<32>(source, items, hf, tupsz, keyoff, dest, 
+							globalhist, iteroffset, localhist, histsize, swwc, first,
+							srckeys, destkeys);
+					break;
+				default:
+					radixpartition<0>(source, items, hf, tupsz, keyoff, dest, 
+							globalhist, iteroffset, localhist, histsize, swwc, first,
+							srckeys, destkeys);
+					break;
+			}
 
 			// 4. Reset histograms.
 			//
@@ -574,6 +850,23 @@ vector<unsigned int>& RadixPartitioner::realsplit(int threadid)
 
 unsigned int pageCopy(void* dest, const Buffer* page);
 
+/**
+ * Fills the key minipage of \a p for the \a count tuples at \a dest, the
+ * \a base -th tuple of \a p on, copied from \a page. Copies the key
+ * minipage of \a page if it has the same keys, else reads the tuples.
+ */
+void copyKeys(Page* p, const unsigned int base, char* dest, Page* page, 
+		const unsigned int count, const unsigned int tuplesize)
+{
+	if (page->hasKeys() && page->getKeyOffset() == p->getKeyOffset()) {
+		memcpy(const_cast<long long*>(p->getKeys()) + base, page->getKeys(),
+				count * sizeof(long long));
+		return;
+	}
+	for (unsigned int i=0; i<count; ++i)
+		p->storeKey(dest + (unsigned long) i * tuplesize);
+}
+
 /** 
  * Copies tuples from \a t to \a p in parallel. Does not reset \a t.
  */
@@ -592,18 +885,26 @@ void parallelCopyTuples(
 	unsigned int base = destoffset[threadid];
 
 	while (page = inputs[threadid]->readNext()) {
-		void* dest = p->getTupleOffset(base);
-		base += (pageCopy(dest, page) / s.getTupleSize());
+		char* dest = reinterpret_cast<char*>(p->getTupleOffset(base));
+		unsigned int count = pageCopy(dest, page) / s.getTupleSize();
+		if (p->hasKeys())
+			copyKeys(p, base, dest, page, count, s.getTupleSize());
+		base += count;
 	}
 }
 
-SplitResult RadixPartitioner::split(int threadid) 
+vector<unsigned int>& RadixPartitioner::partition(int threadid) 
 {
 	parallelCopyTuples(threadid, nthreads, 
 			partitionedinput, destoffsets, oldbuf, schema);
 	barrier->Arrive();
 
-	vector<unsigned int>& splitresult = realsplit(threadid);
+	return realsplit(threadid);
+}
+
+SplitResult RadixPartitioner::split(int threadid) 
+{
+	vector<unsigned int>& splitresult = partition(threadid);
 
 	// construct return objects from oldbuf
 	placecursors(threadid, nthreads, schema.getTupleSize(), 
@@ -682,8 +983,14 @@ void RadixPartitioner::init(PageCursor* t)
 
 	unsigned int tupsz = schema.getTupleSize();
 	unsigned long long ulltotaltuples = totaltuples; 
-	oldbuf = new Page(ulltotaltuples*tupsz, tupsz);
-	newbuf = new Page(ulltotaltuples*tupsz, tupsz);
+	if (pax) {
+		unsigned int keyoff = schema.getOffset(attribute);
+		oldbuf = new Page(ulltotaltuples*tupsz, tupsz, keyoff);
+		newbuf = new Page(ulltotaltuples*tupsz, tupsz, keyoff);
+	} else {
+		oldbuf = new Page(ulltotaltuples*tupsz, tupsz);
+		newbuf = new Page(ulltotaltuples*tupsz, tupsz);
+	}
 
 	// Scan twice, copy data. 
 	copyTuples(t, newbuf, schema);
@@ -695,6 +1002,14 @@ void RadixPartitioner::init(PageCursor* t)
 			ulltotaltuples * schema.getTupleSize());
 	
 	// Prepare temporary objects for split().
+	if (totalpasses == 0)
+		totalpasses = choosepasses();
+#ifdef DEBUG
+#ifdef VERBOSE
+	cout << "Radix partitioning in " << totalpasses << " passes" << endl;
+#endif
+#endif
+
 	unsigned int maxhashkey = 0; //<<< max hash key in all iterations
 	vec_hf = dynamic_cast<ModuloHashFunction*>(hashfn)->generate(totalpasses);
 	for (int pass=0; pass<totalpasses; ++pass) {
@@ -721,6 +1036,18 @@ void RadixPartitioner::init(PageCursor* t)
 		histograms.push_back(vector<unsigned int>(maxhashkey, 0));
 	}
 
+	// SWWC buffers are cache-line aligned, for the non-temporal stores.
+	//
+	if (useswwc && swwctuples(tupsz) != 0) {
+		for (int trd=0; trd<nthreads; ++trd) {
+			void* buf = 0;
+			if (posix_memalign(&buf, SWWC_SIZE, maxhashkey * SWWC_SIZE) != 0)
+				throw std::bad_alloc();
+			swwcbuf.push_back(reinterpret_cast<char*>(buf));
+			swwcfirst.push_back(vector<unsigned int>(maxhashkey, 0));
+		}
+	}
+
 	// Global histograms. The thread with threadid==0 is responsible for
 	// computing and resetting them.
 	//
@@ -749,6 +1076,10 @@ void RadixPartitioner::destroy()
 	vec_hf.clear();
 	histograms.clear();
 	offsets.clear();
+	for (int i=0; i<swwcbuf.size(); ++i)
+		std::free(swwcbuf[i]);
+	swwcbuf.clear();
+	swwcfirst.clear();
 
 	delete oldbuf;
 	delete newbuf;
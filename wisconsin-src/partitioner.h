@@ -87,16 +87,26 @@ class RadixPartitioner : public Partitioner {
 		virtual SplitResult split(int threadid);
 		virtual void destroy();
 
+		/**
+		 * Copies the input to the output buffer with all threads, each
+		 * from its own part of it, and radix-partitions it there.
+		 * @return End offsets of the partitions in getOutputBuffer().
+		 */
+		vector<unsigned int>& partition(int threadid);
 		vector<unsigned int>& realsplit(int threadid);
 		inline Page* getOutputBuffer() { return oldbuf; }
 
 	private:
 		unsigned long countTuples(PageCursor* t);
+		unsigned short choosepasses();
 
 		// temporary objects here
 		vector<HashFunction*> vec_hf;
 		unsigned long long maxkey;
 		unsigned short totalpasses;
+		unsigned int tlbentries;	///< bounds the fanout of a pass
+		bool useswwc;				///< partition through SWWC buffers
+		bool pax;					///< output has a key minipage
 		unsigned long totaltuples;
 		Page* oldbuf;
 		Page* newbuf;
@@ -106,6 +116,14 @@ class RadixPartitioner : public Partitioner {
 
 		vector<PageCursor*> partitionedinput;
 		vector<unsigned int> destoffsets;
+
+		/** 
+		 * Per-thread software write-combining buffers, a cache line per
+		 * partition, and the first output slot of each partition. Empty if
+		 * SWWC is off or tuples are too wide for it.
+		 */
+		vector<char*> swwcbuf;
+		vector< vector<unsigned int> > swwcfirst;
 };
 
 #endif
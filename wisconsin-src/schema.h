@@ -79,6 +79,13 @@ class Schema {
 		 */
 		unsigned int getTupleSize();
 
+		/**
+		 * Get the offset of column \a pos from the start of the tuple.
+		 * @param pos Position in schema.
+		 * @return Offset in bytes.
+		 */
+		unsigned int getOffset(unsigned int pos);
+
 		/**
 		 * Return a string representation of the data in column \a pos.
 		 * @param data Tuple to work on.
@@ -201,6 +208,13 @@ inline unsigned int Schema::getTupleSize() {
 	return totalsize;
 }
 
+inline unsigned int Schema::getOffset(unsigned int pos) {
+#ifdef DEBUG2
+	assert(pos<columns());
+#endif
+	return voffset[pos];
+}
+
 
 inline void Schema::writeData(void* dest, unsigned int pos, const void* const data) {
 #ifdef DEBUG2
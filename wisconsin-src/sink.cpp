@@ -0,0 +1,334 @@
+/*
+    Copyright 2011, Spyros Blanas.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+using namespace std;
+
+#include "sink.h"
+#include "atomics.h"
+#include "exceptions.h"
+
+void CountSink::init(Schema* s, int nthreads)
+{
+	Counter zero;
+	zero.n = 0;
+	counts.assign(nthreads, zero);
+}
+
+void CountSink::destroy()
+{
+	unsigned long long total = 0;
+	for (unsigned int i=0; i<counts.size(); ++i)
+		total += counts[i].n;
+	cout << "RESULT TUPLES: " << total << endl;
+	counts.clear();
+}
+
+void AggregateSink::init(Schema* s, int nthreads)
+{
+	states.assign(nthreads, (void*) NULL);
+}
+
+void AggregateSink::destroy()
+{
+	states.clear();
+}
+
+void HistogramSink::init(Schema* s, int nthreads)
+{
+	AggregateSink::init(s, nthreads);
+	this->nthreads = nthreads;
+	histograms.assign(AGGLEN*nthreads, 0);
+	for (int i=0; i<nthreads; ++i)
+		setState(i, &histograms[AGGLEN*i]);
+}
+
+void HistogramSink::destroy()
+{
+	unsigned long long total = 0;
+	for (unsigned int i=0; i<histograms.size(); ++i)
+		total += histograms[i];
+	cout << "RESULT TUPLES: " << total << endl;
+	histograms.clear();
+	AggregateSink::destroy();
+}
+
+void TableSink::init(Schema* s, int nthreads)
+{
+	// nontemporalappend16() stores exactly two words
+	if (s->getTupleSize() != 16)
+		nontemporal = false;
+}
+
+FileSink::FileSink(const string& filename)
+	: ResultSink(true, false), filename(filename), tuplesize(0),
+	chunksize(0), fd(-1), map(NULL), mapsize(0), filled(0)
+{
+	pthread_rwlock_init(&maplock, NULL);
+}
+
+FileSink::~FileSink()
+{
+	pthread_rwlock_destroy(&maplock);
+}
+
+void FileSink::init(Schema* s, int nthreads)
+{
+	tuplesize = s->getTupleSize();
+	chunksize = max(1ul, CHUNKSIZE / tuplesize) * tuplesize;
+
+	fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		throw WriteFileException();
+	mapsize = 64*1024*1024;
+	if (ftruncate(fd, mapsize) != 0)
+		throw WriteFileException();
+	void* m = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (m == MAP_FAILED)
+		throw WriteFileException();
+	map = reinterpret_cast<char*>(m);
+	filled = 0;
+
+	buffers.resize(nthreads);
+	for (int i=0; i<nthreads; ++i) {
+		buffers[i].data = new char[chunksize];
+		buffers[i].used = 0;
+	}
+}
+
+void FileSink::append(const char* tup, long long key,
+		WriteTable* ret, int threadid)
+{
+	Buffer& b = buffers[threadid];
+	memcpy(b.data + b.used, tup, tuplesize);
+	b.used += tuplesize;
+	if (b.used == chunksize) {
+		write(b.data, b.used);
+		b.used = 0;
+	}
+}
+
+void FileSink::write(const char* data, unsigned long len)
+{
+	unsigned long off = atomic_fetch_and_add(&filled, len);
+
+	pthread_rwlock_rdlock(&maplock);
+	while (off + len > mapsize) {
+		pthread_rwlock_unlock(&maplock);
+		grow(off + len);
+		pthread_rwlock_rdlock(&maplock);
+	}
+	memcpy(map + off, data, len);
+	pthread_rwlock_unlock(&maplock);
+}
+
+void FileSink::grow(unsigned long size)
+{
+	pthread_rwlock_wrlock(&maplock);
+	if (size > mapsize) {
+		unsigned long newsize = mapsize;
+		while (newsize < size)
+			newsize *= 2;
+		if (ftruncate(fd, newsize) != 0) {
+			pthread_rwlock_unlock(&maplock);
+			throw WriteFileException();
+		}
+		void* m = mremap(map, mapsize, newsize, MREMAP_MAYMOVE);
+		if (m == MAP_FAILED) {
+			pthread_rwlock_unlock(&maplock);
+			throw WriteFileException();
+		}
+		map = reinterpret_cast<char*>(m);
+		mapsize = newsize;
+	}
+	pthread_rwlock_unlock(&maplock);
+}
+
+void FileSink::destroy()
+{
+	if (fd < 0)
+		return;
+
+	for (unsigned int i=0; i<buffers.size(); ++i) {
+		write(buffers[i].data, buffers[i].used);
+		delete[] buffers[i].data;
+	}
+	buffers.clear();
+
+	munmap(map, mapsize);
+	map = NULL;
+	int err = ftruncate(fd, filled);
+	close(fd);
+	fd = -1;
+	if (err != 0)
+		throw WriteFileException();
+	cout << "RESULT TUPLES: " << filled / tuplesize << endl;
+}
+
+void* runconsumer(void* sink)
+{
+	reinterpret_cast<QueueSink*>(sink)->work();
+	return 0;
+}
+
+QueueSink::QueueSink(unsigned int capacity)
+	: ResultSink(true, false), capacity(2*BATCH), tuplesize(0),
+	started(false), done(false), consumed(0), checksum(0)
+{
+	while (this->capacity < capacity)
+		this->capacity *= 2;
+}
+
+QueueSink::~QueueSink()
+{
+	for (unsigned int i=0; i<queues.size(); ++i)
+		delete[] queues[i].slots;
+}
+
+void QueueSink::init(Schema* s, int nthreads)
+{
+	tuplesize = s->getTupleSize();
+
+	Queue empty;
+	memset(&empty, 0, sizeof(Queue));
+	queues.assign(nthreads, empty);
+	for (int i=0; i<nthreads; ++i)
+		queues[i].slots = new char[capacity * tuplesize];
+
+	done = false;
+	if (pthread_create(&consumer, NULL, runconsumer, this) != 0)
+		throw std::bad_alloc();
+	started = true;
+}
+
+void QueueSink::append(const char* tup, long long key,
+		WriteTable* ret, int threadid)
+{
+	Queue& q = queues[threadid];
+
+	// wait for the consumer if the queue is full
+	while (q.next - q.headseen == capacity) {
+		q.headseen = q.head;
+		if (q.next - q.headseen == capacity)
+			sched_yield();
+	}
+
+	memcpy(q.slots + (q.next & (capacity-1)) * tuplesize, tup, tuplesize);
+	++q.next;
+
+	if ((q.next & (BATCH-1)) == 0) {
+		__sync_synchronize();	// tuples before the index that publishes them
+		q.tail = q.next;
+	}
+}
+
+bool QueueSink::drain(Queue& q)
+{
+	unsigned long head = q.head;
+	unsigned long tail = q.tail;
+	if (head == tail)
+		return false;
+	__sync_synchronize();	// index before the tuples it publishes
+
+	for (; head != tail; ++head)
+		consume(q.slots + (head & (capacity-1)) * tuplesize);
+
+	__sync_synchronize();	// done with the slots before freeing them
+	q.head = head;
+	return true;
+}
+
+void QueueSink::work()
+{
+	while (true) {
+		bool finished = done;
+		__sync_synchronize();
+
+		bool busy = false;
+		for (unsigned int i=0; i<queues.size(); ++i)
+			busy |= drain(queues[i]);
+
+		if (!busy) {
+			if (finished)
+				return;
+			sched_yield();
+		}
+	}
+}
+
+void QueueSink::consume(const char* tup)
+{
+	// FNV-1a
+	unsigned long long h = 14695981039346656037ull;
+	for (unsigned int i=0; i<tuplesize; ++i) {
+		h ^= (unsigned char) tup[i];
+		h *= 1099511628211ull;
+	}
+	checksum += h;
+	++consumed;
+}
+
+void QueueSink::destroy()
+{
+	if (!started)
+		return;
+
+	// The probe threads have exited, publish what they left unpublished.
+	for (unsigned int i=0; i<queues.size(); ++i) {
+		__sync_synchronize();
+		queues[i].tail = queues[i].next;
+	}
+	__sync_synchronize();
+	done = true;
+	pthread_join(consumer, NULL);
+	started = false;
+
+	cout << "RESULT TUPLES: " << consumed << endl;
+	cout << "RESULT CHECKSUM: " << hex << checksum << dec << endl;
+}
+
+ResultSink* SinkFactory::createSink(const libconfig::Setting& root)
+{
+	string sink = "table";
+	root["algorithm"].lookupValue("sink", sink);
+
+	if (sink == "table")
+		return new TableSink(false);
+	if (sink == "table-nt")
+		return new TableSink(true);
+	if (sink == "count")
+		return new CountSink();
+	if (sink == "aggregate")
+		return new HistogramSink();
+	if (sink == "file") {
+		string path = root["path"];
+		string output = root["output"];
+		return new FileSink(path + output);
+	}
+	if (sink == "queue") {
+		unsigned int queuesize = 4096;
+		root["algorithm"].lookupValue("queuesize", queuesize);
+		return new QueueSink(queuesize);
+	}
+	throw UnknownAlgorithmException();
+}
@@ -0,0 +1,273 @@
+/*
+    Copyright 2011, Spyros Blanas.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MYSINK__
+#define __MYSINK__
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <libconfig.h++>
+using std::string;
+using std::vector;
+
+#include "table.h"
+
+/**
+ * Receives the matches of a join. Every probe thread calls append() for each
+ * pair of matching tuples, with the output tuple assembled only if the sink
+ * assembles(). Chosen at runtime with the `sink' setting of the algorithm
+ * section, see SinkFactory.
+ */
+class ResultSink {
+	public:
+		ResultSink(bool assemble, bool table)
+			: assemble(assemble), table(table) { }
+		virtual ~ResultSink() { }
+
+		/**
+		 * Called by a single thread before the join. \a s is the schema of
+		 * the output tuples, \a nthreads the number of probe threads.
+		 */
+		virtual void init(Schema* s, int nthreads) = 0;
+
+		/**
+		 * Consumes a match of thread \a threadid on key \a key. \a tup is the
+		 * output tuple if assembles(), else undefined. \a ret is the table
+		 * the probe of the thread returns.
+		 */
+		virtual void append(const char* tup, long long key,
+				WriteTable* ret, int threadid) = 0;
+
+		/**
+		 * Called by a single thread after all threads have probed. Writes out
+		 * what is left and reports the result.
+		 */
+		virtual void destroy() = 0;
+
+		/** True if append() reads the output tuple. */
+		inline bool assembles() { return assemble; }
+
+		/** True if the output goes to the tables returned by the probe. */
+		inline bool writesTable() { return table; }
+
+	protected:
+		bool assemble;
+		bool table;
+};
+
+/** Counts the matches. */
+class CountSink : public ResultSink {
+	public:
+		CountSink() : ResultSink(false, false) { }
+		virtual void init(Schema* s, int nthreads);
+		virtual void append(const char* tup, long long key,
+				WriteTable* ret, int threadid) {
+			++counts[threadid].n;
+		}
+		virtual void destroy();
+
+	private:
+		/** A counter per thread, a cache line each. */
+		struct Counter {
+			unsigned long long n;
+			char pad[64 - sizeof(unsigned long long)];
+		};
+		vector<Counter> counts;
+};
+
+/**
+ * Hands every match to a callback, which aggregates it in the state of
+ * the thread.
+ */
+class AggregateSink : public ResultSink {
+	public:
+		/**
+		 * Adds the match of \a key to \a state. \a tup is the output tuple if
+		 * the sink assembles, else undefined.
+		 */
+		typedef void (*Callback)(void* state, long long key, const char* tup);
+
+		AggregateSink(Callback fn, bool assemble)
+			: ResultSink(assemble, false), fn(fn) { }
+		virtual void init(Schema* s, int nthreads);
+		virtual void append(const char* tup, long long key,
+				WriteTable* ret, int threadid) {
+			fn(states[threadid], key, tup);
+		}
+		virtual void destroy();
+
+		/** Sets the state that thread \a threadid aggregates into. */
+		void setState(int threadid, void* state) { states[threadid] = state; }
+
+	private:
+		Callback fn;
+		vector<void*> states;
+};
+
+/**
+ * The aggregate sink of the configuration: counts the matches of every key
+ * modulo AGGLEN, a histogram per thread.
+ */
+class HistogramSink : public AggregateSink {
+	public:
+		HistogramSink() : AggregateSink(&HistogramSink::add, false) { }
+		virtual void init(Schema* s, int nthreads);
+		virtual void destroy();
+
+		static const int AGGLEN=512;
+
+	private:
+		static void add(void* state, long long key, const char* tup) {
+			++reinterpret_cast<unsigned long long*>(state)[key & (AGGLEN-1)];
+		}
+
+		vector<unsigned long long> histograms;
+		int nthreads;
+};
+
+/**
+ * Appends the output tuples to the table of the probe thread, with
+ * non-temporal stores if \a nontemporal and the tuples are 16 bytes.
+ */
+class TableSink : public ResultSink {
+	public:
+		TableSink(bool nontemporal)
+			: ResultSink(true, true), nontemporal(nontemporal) { }
+		virtual void init(Schema* s, int nthreads);
+		virtual void append(const char* tup, long long key,
+				WriteTable* ret, int threadid) {
+			if (nontemporal)
+				ret->nontemporalappend16(tup);
+			else
+				ret->append(tup);
+		}
+		virtual void destroy() { }
+
+	private:
+		bool nontemporal;
+};
+
+/**
+ * Writes the output tuples to a memory-mapped file, as they are laid out in
+ * memory. Threads gather tuples in a buffer of their own and claim the next
+ * part of the file when it is full, so that the file has no holes. The
+ * mapping grows by doubling.
+ */
+class FileSink : public ResultSink {
+	public:
+		FileSink(const string& filename);
+		virtual ~FileSink();
+		virtual void init(Schema* s, int nthreads);
+		virtual void append(const char* tup, long long key,
+				WriteTable* ret, int threadid);
+		virtual void destroy();
+
+	private:
+		/** Copies \a len bytes to the next free part of the file. */
+		void write(const char* data, unsigned long len);
+		void grow(unsigned long size);
+
+		/** Threads write to the file in pieces of this many bytes at most. */
+		static const unsigned long CHUNKSIZE = 64*1024;
+
+		struct Buffer {
+			char* data;
+			unsigned long used;
+			char pad[64 - sizeof(char*) - sizeof(unsigned long)];
+		};
+
+		string filename;
+		unsigned int tuplesize;
+		unsigned long chunksize;	///< CHUNKSIZE rounded down to tuples
+		vector<Buffer> buffers;
+		int fd;
+		char* map;
+		unsigned long mapsize;
+		unsigned long filled;		///< bytes claimed, bumped atomically
+		pthread_rwlock_t maplock;	///< held exclusively to grow the map
+};
+
+/**
+ * Streams the output tuples to a consumer thread, through a bounded
+ * single-producer single-consumer queue per probe thread. Producers wait
+ * while their queue is full.
+ */
+class QueueSink : public ResultSink {
+	public:
+		QueueSink(unsigned int capacity);
+		virtual ~QueueSink();
+		virtual void init(Schema* s, int nthreads);
+		virtual void append(const char* tup, long long key,
+				WriteTable* ret, int threadid);
+		virtual void destroy();
+
+		/** Thread body of the consumer, not to be called directly. */
+		void work();
+
+	protected:
+		/**
+		 * Processes \a tup in the consumer thread. Counts the tuples and
+		 * adds up a hash of each, which does not depend on their order.
+		 */
+		virtual void consume(const char* tup);
+
+	private:
+		/** Tuples are published to the consumer in batches of this many. */
+		static const unsigned long BATCH = 64;
+
+		/**
+		 * A ring of capacity tuples. \a tail is written by the producer
+		 * only, \a head by the consumer only, each on a cache line of
+		 * its own with the copy of the other index its owner saw last.
+		 */
+		struct Queue {
+			char* slots;
+			char pad0[64 - sizeof(char*)];
+			volatile unsigned long tail;	///< published by producer
+			unsigned long next;		///< producer: next slot to write
+			unsigned long headseen;	///< producer: last head read
+			char pad1[64 - 3*sizeof(unsigned long)];
+			volatile unsigned long head;	///< published by consumer
+			char pad2[64 - sizeof(unsigned long)];
+		};
+
+		/** Pops what is in queue \a q, returns false if it was empty. */
+		bool drain(Queue& q);
+
+		unsigned long capacity;		///< power of two, at least 2 BATCH
+		unsigned int tuplesize;
+		vector<Queue> queues;
+		pthread_t consumer;
+		bool started;
+		volatile bool done;			///< all producers have finished
+		unsigned long long consumed;
+		unsigned long long checksum;
+};
+
+class SinkFactory {
+	public:
+		/**
+		 * Creates the sink named by `sink' in the algorithm section of
+		 * \a root: "table" (default), "table-nt", "count", "aggregate",
+		 * "file" (writes to `output' in `path') or "queue" (of `queuesize'
+		 * tuples per thread).
+		 */
+		static ResultSink* createSink(const libconfig::Setting& root);
+};
+
+#endif
@@ -49,7 +49,7 @@ void WriteTable::append(const char** data, unsigned int count) {
 	unsigned int s = _schema->getTupleSize();
 	if (!last->canStore(s)) {
 		// create a new bucket
-		LinkedTupleBuffer* tmp = new LinkedTupleBuffer(size, s);
+		LinkedTupleBuffer* tmp = createBucket();
 		// link it as the next bucket of last
 		last->setNext(tmp);
 		// make last point to the new bucket
@@ -60,13 +60,14 @@ void WriteTable::append(const char** data, unsigned int count) {
 	dbg2assert(target!=NULL);
 	dbg2assert(count==_schema->columns());
 	_schema->parseTuple(target, data);
+	last->storeKey(target);
 }
 
 void WriteTable::append(const vector<string>& input) {
 	unsigned int s = _schema->getTupleSize();
 	if (!last->canStore(s)) {
 		// create a new bucket
-		LinkedTupleBuffer* tmp = new LinkedTupleBuffer(size, s);
+		LinkedTupleBuffer* tmp = createBucket();
 		// link it as the next bucket of last
 		last->setNext(tmp);
 		// make last point to the new bucket
@@ -76,6 +77,7 @@ void WriteTable::append(const vector<string>& input) {
 	void* target = last->allocateTuple();
 	dbg2assert(target!=NULL);
 	_schema->parseTuple(target, input);
+	last->storeKey(target);
 }
 
 void WriteTable::append(const void* const src) {
@@ -83,7 +85,7 @@ void WriteTable::append(const void* const src) {
 
 	if (!last->canStore(s)) {
 		// create a new bucket
-		LinkedTupleBuffer* tmp = new LinkedTupleBuffer(size, s);
+		LinkedTupleBuffer* tmp = createBucket();
 		// link it as the next bucket of last
 		last->setNext(tmp);
 		// make last point to the new bucket
@@ -93,6 +95,7 @@ void WriteTable::append(const void* const src) {
 	void* target = last->allocateTuple();
 	dbg2assert(target!=NULL);
 	_schema->copyTuple(target, src);
+	last->storeKey(target);
 }
 
 void WriteTable::nontemporalappend16(const void* const src) {
@@ -101,7 +104,7 @@ void WriteTable::nontemporalappend16(const void* const src) {
 
 	if (!last->canStore(s)) {
 		// create a new bucket
-		LinkedTupleBuffer* tmp = new LinkedTupleBuffer(size, s);
+		LinkedTupleBuffer* tmp = createBucket();
 		// link it as the next bucket of last
 		last->setNext(tmp);
 		// make last point to the new bucket
@@ -121,6 +124,7 @@ void WriteTable::nontemporalappend16(const void* const src) {
 #warning MOVNTI not known for this architecture
 	_schema->copyTuple(target, src);
 #endif
+	last->storeKey(target);
 }
 
 void WriteTable::concatenate(const WriteTable& table)
@@ -136,31 +140,47 @@ void WriteTable::concatenate(const WriteTable& table)
 }
 
 void WriteTable::init(Schema* s, unsigned int size)
+{
+	init(s, size, -1);
+}
+
+void WriteTable::init(Schema* s, unsigned int size, int keyattr)
 {
 	Table::init(s, size);
 
 	this->size=size;
-	data = new LinkedTupleBuffer(size, s->getTupleSize());
+	this->keyattr = keyattr;
+	data = createBucket();
 	last = data;
 	cur = data;
 }
 
+LinkedTupleBuffer* WriteTable::createBucket()
+{
+	unsigned int s = _schema->getTupleSize();
+	if (keyattr >= 0)
+		return new LinkedTupleBuffer(size, s, _schema->getOffset(keyattr));
+	return new LinkedTupleBuffer(size, s);
+}
+
 void AtomicWriteTable::append(const void* const src) {
 	unsigned int s = _schema->getTupleSize();
 	lock.lock();
 	if (!last->canStore(s)) {
 		// create a new bucket
-		LinkedTupleBuffer* tmp = new LinkedTupleBuffer(size, s);
+		LinkedTupleBuffer* tmp = createBucket();
 		// link it as the next bucket of last
 		last->setNext(tmp);
 		// make last point to the new bucket
 		last = tmp;
 	}
 
-	void* target = last->allocateTuple();
+	LinkedTupleBuffer* page = last;
+	void* target = page->allocateTuple();
 	lock.unlock();
 	dbg2assert(target!=NULL);
 	_schema->copyTuple(target, src);
+	page->storeKey(target);
 }
 
 void AtomicWriteTable::append(const vector<string>& input) {
@@ -168,17 +188,19 @@ void AtomicWriteTable::append(const vector<string>& input) {
 	lock.lock();
 	if (!last->canStore(s)) {
 		// create a new bucket
-		LinkedTupleBuffer* tmp = new LinkedTupleBuffer(size, s);
+		LinkedTupleBuffer* tmp = createBucket();
 		// link it as the next bucket of last
 		last->setNext(tmp);
 		// make last point to the new bucket
 		last = tmp;
 	}
 
-	void* target = last->allocateTuple();
+	LinkedTupleBuffer* page = last;
+	void* target = page->allocateTuple();
 	lock.unlock();
 	dbg2assert(target!=NULL);
 	_schema->parseTuple(target, input);
+	page->storeKey(target);
 }
 
 /**
@@ -195,11 +217,33 @@ LinkedTupleBuffer* findChainEnd(LinkedTupleBuffer* head)
 	return prev;
 }
 
+/**
+ * Each of the \a nthreads loading threads appends to a table of its own,
+ * which are concatenated to this one at the end. The order of the tuples is
+ * not the order of the file.
+ */
 Table::LoadErrorT WriteTable::load(const string& filepattern, 
-		const string& separators)
+		const string& separators, int nthreads)
 {
+	vector<WriteTable*> parts;
+	parts.push_back(this);
+	for (int i=1; i<nthreads; ++i) {
+		WriteTable* wt = new WriteTable();
+		wt->init(_schema, size, keyattr);
+		parts.push_back(wt);
+	}
+
 	Loader loader(separators[0]);
-	loader.load(filepattern, *this);
+	loader.load(filepattern, parts);
+
+	for (int i=1; i<nthreads; ++i) {
+		// Skip tables that got no tuples, not to leave empty pages behind.
+		if (parts[i]->data->getUsedSpace() != 0)
+			concatenate(*parts[i]);
+		else
+			delete parts[i]->data;
+		delete parts[i];
+	}
 	return LOAD_OK;
 }
 
@@ -242,7 +286,7 @@ vector<PageCursor*> Table::split(int nthreads)
 
 	for (int i=0; i<nthreads; ++i) {
 		Table* pt = new WriteTable();
-		pt->init(_schema, 0);
+		pt->init(_schema, _schema->getTupleSize());
 		ret.push_back(pt);
 	}
 
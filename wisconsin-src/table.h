@@ -80,7 +80,7 @@ class Table : public TupleBufferCursor {
 		};
 
 		virtual LoadErrorT load(const string& filepattern, 
-				const string& separators) = 0;
+				const string& separators, int nthreads = 1) = 0;
 
 		/**
 		 * Initializes a new table.
@@ -165,17 +165,26 @@ class Table : public TupleBufferCursor {
 
 class WriteTable : public Table {
 	public:
-		WriteTable() : last(NULL), size(0) { }
+		WriteTable() : last(NULL), size(0), keyattr(-1) { }
 		virtual ~WriteTable() { }
 
 		virtual void whatever()  { }
 		void init(Schema* s, unsigned int size);
 
+		/**
+		 * Initializes a table of PAX pages, which keep the join key column
+		 * \a keyattr of their tuples in a key minipage, see TupleBuffer.
+		 * If \a keyattr is negative, pages hold rows only.
+		 */
+		void init(Schema* s, unsigned int size, int keyattr);
+
 		/**
 		 * Loads a single text file, where each line is a tuple and each field
-		 * is separated by any character in the \a separators string.
+		 * is separated by the first character in the \a separators string.
+		 * The file is loaded by \a nthreads threads, see Loader.
 		 */
-		LoadErrorT load(const string& filepattern, const string& separators);
+		LoadErrorT load(const string& filepattern, const string& separators,
+				int nthreads = 1);
 
     /**
      * Generates tuples on-the-fly in memory.
@@ -199,8 +208,12 @@ class WriteTable : public Table {
 		void concatenate(const WriteTable& table);
 
 	protected:
+		/** Returns a new empty page, a PAX one if \a keyattr >= 0. */
+		LinkedTupleBuffer* createBucket();
+
 		LinkedTupleBuffer* last;
 		unsigned int size;
+		int keyattr;	///< column of the key minipage, -1 if none
 };
 
 class AtomicWriteTable : public WriteTable {
@@ -219,9 +232,10 @@ class FakeTable : public PageCursor {
 			: sch(s), firsttime(false) 
 		{ }
 
-		void place(unsigned int pagesz, unsigned int tuplesz, void* data) 
+		void place(unsigned int pagesz, unsigned int tuplesz, void* data,
+				long long* keys = 0, unsigned int keyoffset = 0) 
 		{
-			fakepage.place(pagesz, tuplesz, data);
+			fakepage.place(pagesz, tuplesz, data, keys, keyoffset);
 			firsttime = true;
 		}
 